@@ -64,14 +64,17 @@ class Dictionary(object):
     def _reset(self):
         self._lib.ArtmDisposeDictionary(self._master.master_id, self._name)
 
-    def load(self, dictionary_path):
+    def load(self, dictionary_path, cooc_file_path=None):
         """
         :Description: loads the BigARTM dictionary of the collection into the lib
 
         :param str dictionary_path: full filename of the dictionary
+        :param str cooc_file_path: full path to the binary file with cooc info\
+                                   (written by collection parser with binary_cooc_files=True)
         """
         self._reset()
-        self._master.import_dictionary(filename=dictionary_path, dictionary_name=self._name)
+        self._master.import_dictionary(filename=dictionary_path, dictionary_name=self._name,
+                                       cooc_file_path=cooc_file_path)
 
     def save(self, dictionary_path):
         """
@@ -179,7 +182,8 @@ class Dictionary(object):
         :param str cooc_file_path: full path to the file with cooc info. Cooc info is a file with three\
                                    columns, first two a the zero-based indices of tokens in vocab file,\
                                    and third one is a value of their co-occurrence in collection (or another)\
-                                   pairwise statistic.
+                                   pairwise statistic. Binary cooc files, written by collection parser\
+                                   with binary_cooc_files=True, are also accepted and memory-mapped.
         :param str vocab_file_path: full path to the file with vocabulary.\
                       If given, the dictionary token will have the same order, as in\
                       this file, otherwise the order will be random.\
@@ -314,12 +314,15 @@ class MasterComponent(object):
         self._config = master_config
         self._lib.ArtmReconfigureTopicName(self.master_id, master_config)
 
-    def import_dictionary(self, filename, dictionary_name):
+    def import_dictionary(self, filename, dictionary_name, cooc_file_path=None):
         """
         :param str filename: full name of dictionary file
         :param str dictionary_name: name of imported dictionary
+        :param str cooc_file_path: full name of binary file with co-occurrences to attach to the dictionary
         """
         args = messages.ImportDictionaryArgs(dictionary_name=dictionary_name, file_name=filename)
+        if cooc_file_path is not None:
+            args.cooc_file_path = cooc_file_path
         self._lib.ArtmImportDictionary(self.master_id, args)
 
     def export_dictionary(self, filename, dictionary_name):
@@ -760,10 +763,12 @@ class MasterComponent(object):
 
         return theta_matrix_info
 
-    def get_theta_matrix(self, topic_names=None):
+    def get_theta_matrix(self, topic_names=None, item_offset=None, item_limit=None):
         """
         :param topic_names: list of topics to retrieve (None means all topics)
         :type topic_names: list of str or None
+        :param int item_offset: number of cached items to skip (None means 0)
+        :param int item_limit: max number of items to retrieve (None means all remaining items)
         :return: numpy.ndarray with Theta data (i.e., p(t|d) values)
         """
         args = messages.GetThetaMatrixArgs()
@@ -772,12 +777,22 @@ class MasterComponent(object):
             for topic_name in topic_names:
                 args.topic_name.append(topic_name)
 
-        theta_matrix_info = self._lib.ArtmRequestThetaMatrixExternal(self.master_id, args)
+        if item_offset is not None:
+            args.item_offset = item_offset
+
+        if item_limit is not None:
+            args.item_limit = item_limit
 
-        num_rows = len(theta_matrix_info.item_id)
-        num_cols = theta_matrix_info.num_topics
+        # The first call only reports the size of the matrix (without decoding theta cache),
+        # the second one copies values directly into numpy array and returns item ids, titles and topic names
+        empty_buffer = numpy.zeros(shape=(0, ), dtype=numpy.float32)
+        theta_matrix_size = self._lib.ArtmCopyThetaMatrix(self.master_id, args, empty_buffer)
+        num_cols = theta_matrix_size.num_topics
+        num_rows = theta_matrix_size.num_values // num_cols if num_cols > 0 else 0
         numpy_ndarray = numpy.zeros(shape=(num_rows, num_cols), dtype=numpy.float32)
-        self._lib.ArtmCopyRequestedObject(numpy_ndarray)
+        theta_matrix_info = self._lib.ArtmCopyThetaMatrix(self.master_id, args, numpy_ndarray)
+        if len(theta_matrix_info.item_id) != num_rows or theta_matrix_info.num_topics != num_cols:
+            raise RuntimeError('Theta cache has changed while theta matrix was copied')
 
         return theta_matrix_info, numpy_ndarray
 
@@ -45,6 +45,7 @@ PerplexityScoreConfig_Type_UnigramCollectionModel = 1
 CollectionParserConfig_CollectionFormat_BagOfWordsUci = 0
 CollectionParserConfig_CollectionFormat_MatrixMarket = 1
 CollectionParserConfig_CollectionFormat_VowpalWabbit = 2
+CollectionParserConfig_CollectionFormat_Batches = 3
 CollectionParserConfig_BatchNameType_Guid = 0
 CollectionParserConfig_BatchNameType_Code = 1
 MatrixLayout_Dense = 0
@@ -149,6 +149,11 @@ ARTM_API = [
         [('master_id', int), ('args', messages.GetThetaMatrixArgs)],
         request=messages.ThetaMatrix,
     ),
+    CallSpec(
+        'ArtmCopyThetaMatrix',
+        [('master_id', int), ('args', messages.GetThetaMatrixArgs), ('theta', numpy.ndarray)],
+        request=messages.ThetaMatrix,
+    ),
     CallSpec(
         'ArtmRequestTopicModel',
         [('master_id', int), ('args', messages.GetTopicModelArgs)],
@@ -627,6 +627,21 @@ int64_t ArtmRequestThetaMatrixExternal(int master_id, int64_t length, const char
                               ::artm::ThetaMatrix>(master_id, length, args);
 }
 
+int64_t ArtmCopyThetaMatrix(int master_id, int64_t length, const char* get_theta_args,
+                            int64_t theta_length, char* theta_address) {
+  try {
+    artm::GetThetaMatrixArgs args;
+    ::artm::ThetaMatrix result;
+    ParseFromArray(get_theta_args, length, &args);
+    ::artm::core::FixAndValidateMessage(&args, /* throw_error =*/ true);
+    master_component(master_id)->CopyThetaMatrix(args, theta_length, reinterpret_cast<float*>(theta_address),
+                                                 &result);
+    // The result has no item_weights (values are in the buffer), so it is not validated
+    SerializeToString(result, last_message());
+    return static_cast<int64_t>(last_message()->size());
+  } CATCH_EXCEPTIONS;
+}
+
 int64_t ArtmRequestTopicModel(int master_id, int64_t length, const char* args) {
   return ArtmRequest< ::artm::GetTopicModelArgs,
                       ::artm::TopicModel>(master_id, length, args);
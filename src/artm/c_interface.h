@@ -69,6 +69,8 @@ extern "C" {
 
   DLL_PUBLIC int64_t ArtmRequestThetaMatrix(int master_id, int64_t length, const char* get_theta_args);
   DLL_PUBLIC int64_t ArtmRequestThetaMatrixExternal(int master_id, int64_t length, const char* get_theta_args);
+  DLL_PUBLIC int64_t ArtmCopyThetaMatrix(int master_id, int64_t length, const char* get_theta_args,
+                                         int64_t theta_length, char* theta_address);
   DLL_PUBLIC int64_t ArtmRequestTopicModel(int master_id, int64_t length, const char* get_model_args);
   DLL_PUBLIC int64_t ArtmRequestTopicModelExternal(int master_id, int64_t length, const char* get_model_args);
 
@@ -2,6 +2,15 @@
 
 #include "artm/core/cache_manager.h"
 
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <future>  // NOLINT
+#include <limits>
+#include <thread>  // NOLINT
+#include <unordered_map>
+
 #include "boost/filesystem.hpp"
 #include "boost/lexical_cast.hpp"
 #include "boost/uuid/uuid_io.hpp"
@@ -17,31 +26,418 @@ namespace fs = boost::filesystem;
 namespace artm {
 namespace core {
 
-ThetaCacheEntry::ThetaCacheEntry()
-    : theta_matrix_(std::make_shared<ThetaMatrix>())
-    , filename_() { }
+const int64_t kMaxThetaCacheSegmentSize = 256 * 1024 * 1024;
+const size_t kMaxThetaCacheWriterQueueSize = 64;
+
+const int kThetaRecordVersion = 1;
+const int kThetaRecordFp16Flag = 1;
+const int kThetaRecordWideIndicesFlag = 2;
+
+template<typename T>
+static void AppendRaw(const T& value, std::string* buffer) {
+  buffer->append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template<typename T>
+static T ReadRaw(const std::string& buffer, size_t* pos) {
+  if (*pos + sizeof(T) > buffer.size()) {
+    BOOST_THROW_EXCEPTION(CorruptedMessageException("Theta cache record is truncated"));
+  }
+  T value;
+  memcpy(&value, buffer.data() + *pos, sizeof(T));
+  *pos += sizeof(T);
+  return value;
+}
+
+static void AppendString(const std::string& value, std::string* buffer) {
+  AppendRaw<uint32_t>(static_cast<uint32_t>(value.size()), buffer);
+  buffer->append(value);
+}
+
+static std::string ReadString(const std::string& buffer, size_t* pos) {
+  const uint32_t size = ReadRaw<uint32_t>(buffer, pos);
+  if (*pos + size > buffer.size()) {
+    BOOST_THROW_EXCEPTION(CorruptedMessageException("Theta cache record is truncated"));
+  }
+  std::string retval(buffer.data() + *pos, size);
+  *pos += size;
+  return retval;
+}
+
+// Record layout (all numbers are in native byte order):
+//   int32 version, int32 flags, int32 num_topics, int32 num_items,
+//   num_topics x string topic_name,
+//   num_items x int64 row offset (relative to the first row),
+//   num_items x row, where row is
+//     int32 item_id, string item_title, int32 nnz,
+//     nnz x topic_index (uint16, or int32 with kThetaRecordWideIndicesFlag),
+//     nnz x value (float, or fp16 with kThetaRecordFp16Flag).
+// Strings are stored as uint32 length followed by the characters.
+static void EncodeThetaRecord(const ThetaMatrix& theta, bool use_fp16, std::string* record) {
+  const int num_topics = theta.topic_name_size();
+  const int num_items = theta.item_id_size();
+  const bool sparse_cache = theta.topic_indices_size() > 0;
+  const bool has_title = theta.item_title_size() == num_items;
+  const bool wide_indices = num_topics > std::numeric_limits<uint16_t>::max();
+
+  int flags = 0;
+  if (use_fp16) {
+    flags |= kThetaRecordFp16Flag;
+  }
+  if (wide_indices) {
+    flags |= kThetaRecordWideIndicesFlag;
+  }
+
+  AppendRaw<int32_t>(kThetaRecordVersion, record);
+  AppendRaw<int32_t>(flags, record);
+  AppendRaw<int32_t>(num_topics, record);
+  AppendRaw<int32_t>(num_items, record);
+  for (const auto& topic_name : theta.topic_name()) {
+    AppendString(topic_name, record);
+  }
+
+  std::string rows;
+  std::vector<int64_t> row_offsets;
+  row_offsets.reserve(num_items);
+  std::vector<int> topic_indices;
+  std::vector<float> values;
+  for (int item_index = 0; item_index < num_items; ++item_index) {
+    row_offsets.push_back(static_cast<int64_t>(rows.size()));
+    AppendRaw<int32_t>(theta.item_id(item_index), &rows);
+    AppendString(has_title ? theta.item_title(item_index) : std::string(), &rows);
+
+    topic_indices.clear();
+    values.clear();
+    const FloatArray& item_weights = theta.item_weights(item_index);
+    for (int index = 0; index < item_weights.value_size(); ++index) {
+      const float value = item_weights.value(index);
+      if (value == 0.0f) {
+        continue;
+      }
+      topic_indices.push_back(sparse_cache ? theta.topic_indices(item_index).value(index) : index);
+      values.push_back(value);
+    }
+
+    AppendRaw<int32_t>(static_cast<int32_t>(values.size()), &rows);
+    for (int topic_index : topic_indices) {
+      if (wide_indices) {
+        AppendRaw<int32_t>(topic_index, &rows);
+      } else {
+        AppendRaw<uint16_t>(static_cast<uint16_t>(topic_index), &rows);
+      }
+    }
+    for (float value : values) {
+      if (use_fp16) {
+        AppendRaw<uint16_t>(Helpers::FloatToHalf(value), &rows);
+      } else {
+        AppendRaw<float>(value, &rows);
+      }
+    }
+  }
+
+  for (int64_t row_offset : row_offsets) {
+    AppendRaw<int64_t>(row_offset, record);
+  }
+  record->append(rows);
+}
+
+// Decodes items in range [item_begin, item_end) from the record into a sparse theta matrix
+// (item_weights hold non-zero values, topic_indices hold their topics).
+// Rows outside of the range are not touched, thanks to the table of row offsets.
+static void DecodeThetaRecord(const std::string& record, int item_begin, int item_end, ThetaMatrix* theta) {
+  size_t pos = 0;
+  const int version = ReadRaw<int32_t>(record, &pos);
+  if (version != kThetaRecordVersion) {
+    BOOST_THROW_EXCEPTION(CorruptedMessageException("Unsupported version of theta cache record"));
+  }
+
+  const int flags = ReadRaw<int32_t>(record, &pos);
+  const bool use_fp16 = (flags & kThetaRecordFp16Flag) != 0;
+  const bool wide_indices = (flags & kThetaRecordWideIndicesFlag) != 0;
+  const int num_topics = ReadRaw<int32_t>(record, &pos);
+  const int num_items = ReadRaw<int32_t>(record, &pos);
+  if (item_begin < 0 || item_end > num_items || item_begin > item_end) {
+    BOOST_THROW_EXCEPTION(ArgumentOutOfRangeException("item_begin", item_begin));
+  }
+
+  for (int topic_index = 0; topic_index < num_topics; ++topic_index) {
+    theta->add_topic_name(ReadString(record, &pos));
+  }
+
+  const size_t row_offsets_pos = pos;
+  const size_t rows_pos = row_offsets_pos + sizeof(int64_t) * num_items;
+  for (int item_index = item_begin; item_index < item_end; ++item_index) {
+    size_t offset_pos = row_offsets_pos + sizeof(int64_t) * item_index;
+    pos = rows_pos + static_cast<size_t>(ReadRaw<int64_t>(record, &offset_pos));
+
+    theta->add_item_id(ReadRaw<int32_t>(record, &pos));
+    theta->add_item_title(ReadString(record, &pos));
+    const int nnz = ReadRaw<int32_t>(record, &pos);
+
+    auto item_values = theta->add_item_weights()->mutable_value();
+    auto item_topics = theta->add_topic_indices()->mutable_value();
+    item_values->Reserve(nnz);
+    item_topics->Reserve(nnz);
+    size_t values_pos = pos + nnz * (wide_indices ? sizeof(int32_t) : sizeof(uint16_t));
+    for (int index = 0; index < nnz; ++index) {
+      const int topic_index = wide_indices ? ReadRaw<int32_t>(record, &pos) : ReadRaw<uint16_t>(record, &pos);
+      const float value = use_fp16 ? Helpers::HalfToFloat(ReadRaw<uint16_t>(record, &values_pos))
+                                   : ReadRaw<float>(record, &values_pos);
+      if (topic_index < 0 || topic_index >= num_topics) {
+        BOOST_THROW_EXCEPTION(CorruptedMessageException("Theta cache record has invalid topic index"));
+      }
+      item_values->AddAlreadyReserved(value);
+      item_topics->AddAlreadyReserved(topic_index);
+    }
+  }
+}
+
+static void SliceThetaMatrix(const ThetaMatrix& theta, int item_begin, int item_end, ThetaMatrix* slice) {
+  slice->mutable_topic_name()->CopyFrom(theta.topic_name());
+  const bool has_title = theta.item_title_size() == theta.item_id_size();
+  const bool sparse_cache = theta.topic_indices_size() > 0;
+  for (int item_index = item_begin; item_index < item_end; ++item_index) {
+    slice->add_item_id(theta.item_id(item_index));
+    if (has_title) {
+      slice->add_item_title(theta.item_title(item_index));
+    }
+    slice->add_item_weights()->CopyFrom(theta.item_weights(item_index));
+    if (sparse_cache) {
+      slice->add_topic_indices()->CopyFrom(theta.topic_indices(item_index));
+    }
+  }
+}
+
+ThetaCacheSegment::ThetaCacheSegment(const std::string& filename)
+    : filename_(filename)
+    , stream_(filename.c_str(), std::ofstream::binary | std::ofstream::trunc)
+    , size_(0) {
+  if (!stream_.is_open()) {
+    BOOST_THROW_EXCEPTION(DiskWriteException("Unable to create file " + filename));
+  }
+}
+
+ThetaCacheSegment::~ThetaCacheSegment() {
+  stream_.close();
+  try { fs::remove(fs::path(filename_)); }
+  catch (...) { }
+}
+
+int64_t ThetaCacheSegment::Append(const std::string& record) {
+  const int64_t offset = size_;
+  stream_.write(record.data(), record.size());
+  stream_.flush();
+  if (!stream_.good()) {
+    BOOST_THROW_EXCEPTION(DiskWriteException("Unable to write into file " + filename_));
+  }
+  size_ += record.size();
+  return offset;
+}
+
+void ThetaCacheSegment::Read(int64_t offset, int64_t length, std::string* record) const {
+  std::ifstream fin(filename_.c_str(), std::ifstream::binary);
+  if (!fin.is_open()) {
+    BOOST_THROW_EXCEPTION(DiskReadException("Unable to open file " + filename_));
+  }
+
+  record->resize(length);
+  fin.seekg(offset);
+  fin.read(&(*record)[0], length);
+  if (fin.gcount() != length) {
+    BOOST_THROW_EXCEPTION(DiskReadException("Unable to read from file " + filename_));
+  }
+}
+
+ThetaCacheEntry::ThetaCacheEntry(const ThetaMatrix& theta_matrix, bool use_fp16)
+    : lock_()
+    , theta_matrix_()
+    , record_()
+    , segment_()
+    , offset_(0)
+    , length_(0)
+    , item_size_(theta_matrix.item_id_size())
+    , topic_size_(theta_matrix.topic_name_size()) {
+  if (use_fp16) {
+    auto record = std::make_shared<std::string>();
+    EncodeThetaRecord(theta_matrix, use_fp16, record.get());
+    record_ = record;
+  } else {
+    theta_matrix_ = std::make_shared<ThetaMatrix>(theta_matrix);
+  }
+}
+
+ThetaCacheEntry::~ThetaCacheEntry() { }
 
-ThetaCacheEntry::~ThetaCacheEntry() {
-  if (!filename_.empty()) {
-    try { fs::remove(fs::path(filename_)); }
-    catch (...) { }
+int64_t ThetaCacheEntry::byte_size() const {
+  boost::lock_guard<boost::mutex> guard(lock_);
+  if (theta_matrix_ != nullptr) {
+    return theta_matrix_->ByteSize();
   }
+  return (record_ != nullptr) ? static_cast<int64_t>(record_->size()) : length_;
+}
+
+std::shared_ptr<ThetaMatrix> ThetaCacheEntry::theta_matrix() const {
+  return theta_matrix(0, item_size_);
+}
+
+std::shared_ptr<ThetaMatrix> ThetaCacheEntry::theta_matrix(int item_begin, int item_end) const {
+  std::shared_ptr<ThetaMatrix> theta_matrix;
+  std::shared_ptr<const std::string> record;
+  std::shared_ptr<ThetaCacheSegment> segment;
+  int64_t offset, length;
+  {
+    boost::lock_guard<boost::mutex> guard(lock_);
+    theta_matrix = theta_matrix_;
+    record = record_;
+    segment = segment_;
+    offset = offset_;
+    length = length_;
+  }
+
+  auto retval = std::make_shared<ThetaMatrix>();
+  if (theta_matrix != nullptr) {
+    if (item_begin == 0 && item_end == item_size_) {
+      return theta_matrix;
+    }
+    SliceThetaMatrix(*theta_matrix, item_begin, item_end, retval.get());
+    return retval;
+  }
+
+  if (record == nullptr) {
+    auto disk_record = std::make_shared<std::string>();
+    segment->Read(offset, length, disk_record.get());
+    record = disk_record;
+  }
+
+  DecodeThetaRecord(*record, item_begin, item_end, retval.get());
+  return retval;
+}
+
+void ThetaCacheEntry::Spill(const std::shared_ptr<ThetaCacheSegment>& segment, bool use_fp16) {
+  std::shared_ptr<ThetaMatrix> theta_matrix;
+  std::shared_ptr<const std::string> record;
+  {
+    boost::lock_guard<boost::mutex> guard(lock_);
+    theta_matrix = theta_matrix_;
+    record = record_;
+  }
+
+  if (theta_matrix == nullptr && record == nullptr) {
+    return;  // already spilled
+  }
+
+  if (record == nullptr) {
+    auto new_record = std::make_shared<std::string>();
+    EncodeThetaRecord(*theta_matrix, use_fp16, new_record.get());
+    record = new_record;
+  }
+
+  const int64_t offset = segment->Append(*record);
+
+  boost::lock_guard<boost::mutex> guard(lock_);
+  segment_ = segment;
+  offset_ = offset;
+  length_ = static_cast<int64_t>(record->size());
+  theta_matrix_.reset();
+  record_.reset();
 }
 
 CacheManager::CacheManager(const std::string& disk_path, Instance* instance)
     : lock_()
     , disk_path_(disk_path)
     , instance_(instance)
-    , cache_() {
+    , cache_()
+    , writer_lock_()
+    , writer_condition_()
+    , writer_queue_()
+    , segment_()
+    , is_stopping_(false)
+    , writer_thread_() {
   Clear();
+  if (!disk_path_.empty()) {
+    StartWriter();
+  }
 }
 
 CacheManager::~CacheManager() {
+  StopWriter();
   cache_.clear();
 }
 
+void CacheManager::StartWriter() {
+  if (writer_thread_.joinable()) {
+    return;
+  }
+
+  is_stopping_ = false;
+  boost::thread t(&CacheManager::WriterThreadFunction, this);
+  writer_thread_.swap(t);
+}
+
+void CacheManager::StopWriter() {
+  {
+    boost::lock_guard<boost::mutex> guard(writer_lock_);
+    is_stopping_ = true;
+  }
+  writer_condition_.notify_all();
+  if (writer_thread_.joinable()) {
+    writer_thread_.join();
+  }
+}
+
+void CacheManager::WriterThreadFunction() {
+  Helpers::SetThreadName(-1, "CacheManager writer");
+  while (true) {
+    std::shared_ptr<ThetaCacheEntry> entry;
+    std::shared_ptr<ThetaCacheSegment> segment;
+    {
+      boost::unique_lock<boost::mutex> lock(writer_lock_);
+      while (!is_stopping_ && writer_queue_.empty()) {
+        writer_condition_.wait(lock);
+      }
+
+      if (is_stopping_) {
+        return;
+      }
+
+      entry = writer_queue_.front();
+      writer_queue_.pop_front();
+      writer_condition_.notify_all();
+
+      if (segment_ == nullptr || segment_->size() >= kMaxThetaCacheSegmentSize) {
+        boost::uuids::uuid uuid = boost::uuids::random_generator()();
+        fs::path file(boost::lexical_cast<std::string>(uuid) + ".cache");
+        try {
+          segment_ = std::make_shared<ThetaCacheSegment>((fs::path(disk_path_) / file).string());
+        } catch (...) {
+          LOG(ERROR) << "Unable to create cache segment in " << disk_path_;
+          segment_.reset();
+          continue;  // the entry remains in memory
+        }
+      }
+
+      segment = segment_;
+    }
+
+    std::shared_ptr<MasterModelConfig> config = (instance_ != nullptr) ? instance_->config() : nullptr;
+    const bool use_fp16 = (config != nullptr) && config->disk_cache_fp16();
+    try {
+      entry->Spill(segment, use_fp16);
+    } catch (...) {
+      LOG(ERROR) << "Unable to save cache entry to " << segment->filename();
+    }
+  }
+}
+
 void CacheManager::Clear() {
   cache_.clear();
+  {
+    boost::lock_guard<boost::mutex> guard(writer_lock_);
+    writer_queue_.clear();
+    segment_.reset();
+  }
+  writer_condition_.notify_all();
+
   std::string ptd_name = (instance_ != nullptr) ? instance_->config()->ptd_name() : std::string();
   if (!ptd_name.empty()) {
     std::shared_ptr<PhiMatrix> ptd(
@@ -59,24 +455,20 @@ void CacheManager::RequestMasterComponentInfo(MasterComponentInfo* master_info)
 
     MasterComponentInfo::CacheEntryInfo* info = master_info->add_cache_entry();
     info->set_key(boost::lexical_cast<std::string>(key));
-    info->set_byte_size(entry->theta_matrix()->ByteSize());
+    info->set_byte_size(entry->byte_size());
   }
 }
 
-// ToDo(sashafrey): this method has grown too big and complicated.
-// It needs to be refactored.
-static bool PopulateThetaMatrixFromCacheEntry(const ThetaMatrix& cache,
-                                              const GetThetaMatrixArgs& get_theta_args,
-                                              ::artm::ThetaMatrix* theta_matrix) {
+// Returns indices of topics (within cache_topic_name) requested via GetThetaMatrixArgs.topic_name
+// (or all topics when GetThetaMatrixArgs.topic_name is empty).
+static std::vector<int> ResolveTopicsToUse(
+    const ::google::protobuf::RepeatedPtrField< ::std::string>& cache_topic_name,
+    const GetThetaMatrixArgs& get_theta_args) {
   auto& args_topic_name = get_theta_args.topic_name();
-  const bool has_sparse_format = get_theta_args.matrix_layout() == MatrixLayout_Sparse;
-  const bool sparse_cache = cache.topic_indices_size() > 0;
-  bool use_all_topics = false;
-
   std::vector<int> topics_to_use;
   if (args_topic_name.size() != 0) {
     for (int i = 0; i < args_topic_name.size(); ++i) {
-      int topic_index = repeated_field_index_of(cache.topic_name(), args_topic_name.Get(i));
+      int topic_index = repeated_field_index_of(cache_topic_name, args_topic_name.Get(i));
       if (topic_index == -1) {
         std::stringstream ss;
         ss << "GetThetaMatrixArgs.topic_name[" << i << "] == " << args_topic_name.Get(i)
@@ -84,15 +476,81 @@ static bool PopulateThetaMatrixFromCacheEntry(const ThetaMatrix& cache,
         BOOST_THROW_EXCEPTION(artm::core::InvalidOperation(ss.str()));
       }
 
-      assert(topic_index >= 0 && topic_index < cache.topic_name_size());
+      assert(topic_index >= 0 && topic_index < cache_topic_name.size());
       topics_to_use.push_back(topic_index);
     }
   } else {  // use all topics
-    assert(cache.topic_name_size() > 0);
-    for (int i = 0; i < cache.topic_name_size(); ++i) {
+    assert(cache_topic_name.size() > 0);
+    for (int i = 0; i < cache_topic_name.size(); ++i) {
       topics_to_use.push_back(i);
     }
-    use_all_topics = true;
+  }
+
+  return topics_to_use;
+}
+
+struct ThetaCachePageEntry {
+  std::string key;
+  std::shared_ptr<ThetaCacheEntry> entry;
+  int item_begin;
+  int item_end;
+};
+
+// Lists cache entries (and ranges of their items) that fall into the page
+// requested via GetThetaMatrixArgs.item_offset and GetThetaMatrixArgs.item_limit.
+// Entries are not loaded from disk, because the number of items is known for each entry.
+static std::vector<ThetaCachePageEntry> ListThetaCachePage(
+    const ThreadSafeCollectionHolder<std::string, ThetaCacheEntry>& cache,
+    const GetThetaMatrixArgs& get_theta_args) {
+  int items_to_skip = std::max(0, get_theta_args.item_offset());
+  int items_to_take = (get_theta_args.item_limit() < 0) ? std::numeric_limits<int>::max()
+                                                        : get_theta_args.item_limit();
+
+  std::vector<ThetaCachePageEntry> page;
+  for (const auto &key : cache.keys()) {
+    if (items_to_take <= 0) {
+      break;
+    }
+
+    std::shared_ptr<ThetaCacheEntry> entry = cache.get(key);
+    if (entry == nullptr) {
+      continue;
+    }
+
+    const int item_size = entry->item_size();
+    if (items_to_skip >= item_size) {
+      items_to_skip -= item_size;
+      continue;
+    }
+
+    ThetaCachePageEntry page_entry;
+    page_entry.key = key;
+    page_entry.entry = entry;
+    page_entry.item_begin = items_to_skip;
+    page_entry.item_end = items_to_skip + std::min(item_size - items_to_skip, items_to_take);
+    items_to_skip = 0;
+    items_to_take -= (page_entry.item_end - page_entry.item_begin);
+    page.push_back(page_entry);
+  }
+
+  return page;
+}
+
+// ToDo(sashafrey): this method has grown too big and complicated.
+// It needs to be refactored.
+static bool PopulateThetaMatrixFromCacheEntry(const ThetaMatrix& cache,
+                                              const GetThetaMatrixArgs& get_theta_args,
+                                              ::artm::ThetaMatrix* theta_matrix) {
+  const bool has_sparse_format = get_theta_args.matrix_layout() == MatrixLayout_Sparse;
+  const bool sparse_cache = cache.topic_indices_size() > 0;
+
+  std::vector<int> topics_to_use = ResolveTopicsToUse(cache.topic_name(), get_theta_args);
+
+  // Position of each cached topic in the resulting message (-1 for topics that were not requested).
+  // This allows to handle sparse cache entries with a single pass over their non-zero values.
+  std::vector<int> topic_position(cache.topic_name_size(), -1);
+  for (unsigned index = 0; index < topics_to_use.size(); ++index) {
+    topic_position[topics_to_use[index]] = index;
   }
 
   // Populate num_topics and topic_name fields in the resulting message
@@ -133,9 +591,13 @@ static bool PopulateThetaMatrixFromCacheEntry(const ThetaMatrix& cache,
     if (!has_sparse_format) {
       if (sparse_cache) {
         // dense output -- sparse cache
-        for (unsigned index = 0; index < topics_to_use.size(); ++index) {
-          int topic_index = repeated_field_index_of(cache.topic_indices(item_index).value(), topics_to_use[index]);
-          theta_vec->add_value(topic_index != -1 ? item_theta.value(topic_index) : 0.0f);
+        const artm::IntArray& item_topics = cache.topic_indices(item_index);
+        theta_vec->mutable_value()->Resize(topics_to_use.size(), 0.0f);
+        for (int index = 0; index < item_topics.value_size(); ++index) {
+          int position = topic_position[item_topics.value(index)];
+          if (position != -1) {
+            theta_vec->set_value(position, item_theta.value(index));
+          }
         }
       } else {
         // dense output -- dense cache
@@ -147,19 +609,16 @@ static bool PopulateThetaMatrixFromCacheEntry(const ThetaMatrix& cache,
       ::artm::IntArray* sparse_topic_indices = theta_matrix->add_topic_indices();
       if (sparse_cache) {
         // sparse output -- sparse cache
-        for (int index = 0; index < cache.topic_indices(item_index).value_size(); ++index) {
-          int topic_index = cache.topic_indices(item_index).value(index);
-          if (use_all_topics) {
-            theta_vec->add_value(item_theta.value(index));
-            sparse_topic_indices->add_value(topic_index);
-          } else {
-            for (unsigned i = 0; i < topics_to_use.size(); ++i) {
-              if (topics_to_use[i] == topic_index) {
-                theta_vec->add_value(item_theta.value(index));
-                sparse_topic_indices->add_value(topic_index);
-                break;
-              }
-            }
+        // Same as for dense cache: topic_indices are positions in the resulting topic_name,
+        // and values below GetThetaMatrixArgs.eps are dropped. (Before cache entries became sparse
+        // by default, topic_indices of this case referred to all topics and were not filtered by eps.)
+        const artm::IntArray& item_topics = cache.topic_indices(item_index);
+        for (int index = 0; index < item_topics.value_size(); ++index) {
+          int position = topic_position[item_topics.value(index)];
+          float value = item_theta.value(index);
+          if (position != -1 && value >= get_theta_args.eps()) {
+            theta_vec->add_value(value);
+            sparse_topic_indices->add_value(position);
           }
         }
       } else {
@@ -181,6 +640,11 @@ static bool PopulateThetaMatrixFromCacheEntry(const ThetaMatrix& cache,
 
 void CacheManager::RequestThetaMatrix(const GetThetaMatrixArgs& get_theta_args,
                                       ::artm::ThetaMatrix* theta_matrix) const {
+  // Paging: skip first item_offset items, then take up to item_limit items (or all remaining items).
+  int items_to_skip = std::max(0, get_theta_args.item_offset());
+  int items_to_take = (get_theta_args.item_limit() < 0) ? std::numeric_limits<int>::max()
+                                                        : get_theta_args.item_limit();
+
   std::string ptd_name = (instance_ != nullptr) ? instance_->config()->ptd_name() : std::string();
   if (!ptd_name.empty()) {
     boost::lock_guard<boost::mutex> guard(lock_);
@@ -188,9 +652,11 @@ void CacheManager::RequestThetaMatrix(const GetThetaMatrixArgs& get_theta_args,
     ThetaMatrix cached_theta;
     cached_theta.mutable_topic_name()->CopyFrom(phi_matrix->topic_name());
     std::vector<float> values; values.resize(phi_matrix->topic_size());
-    for (int token_id = 0; token_id < phi_matrix->token_size(); token_id++) {
+    const int token_end = static_cast<int>(std::min<int64_t>(phi_matrix->token_size(),
+                                                             static_cast<int64_t>(items_to_skip) + items_to_take));
+    for (int token_id = items_to_skip; token_id < token_end; token_id++) {
       Token token = phi_matrix->token(token_id);
-      cached_theta.add_item_title(token.keyword);
+      cached_theta.add_item_title(token.keyword());
       cached_theta.add_item_id(-1);  // not available
       ::artm::FloatArray* item_weights = cached_theta.add_item_weights();
       phi_matrix->get(token_id, &values);
@@ -203,65 +669,279 @@ void CacheManager::RequestThetaMatrix(const GetThetaMatrixArgs& get_theta_args,
     return;
   }
 
-  auto keys = cache_.keys();
-  for (const auto &key : keys) {
-    std::shared_ptr<ThetaMatrix> cached_theta = FindCacheEntry(key);
+  for (const auto& page_entry : ListThetaCachePage(cache_, get_theta_args)) {
+    std::shared_ptr<ThetaMatrix> cached_theta;
+    try {
+      cached_theta = page_entry.entry->theta_matrix(page_entry.item_begin, page_entry.item_end);
+    } catch (...) {
+      LOG(ERROR) << "Unable to reload cache for " << page_entry.key;
+    }
+
     if (cached_theta != nullptr) {
       PopulateThetaMatrixFromCacheEntry(*cached_theta, get_theta_args, theta_matrix);
     }
   }
 }
 
-std::shared_ptr<ThetaMatrix> CacheManager::FindCacheEntry(const Batch& batch) const {
+// Writes rows of the cached theta matrix into dense row-major buffer (one row per item),
+// and the ids and titles of the items into item_id and item_title. Returns false if the entry has no titles.
+static bool CopyThetaRows(const ThetaMatrix& cache, const GetThetaMatrixArgs& get_theta_args,
+                          int num_columns, float* theta, int* item_id, std::string* item_title) {
+  const std::vector<int> topics_to_use = ResolveTopicsToUse(cache.topic_name(), get_theta_args);
+  if (static_cast<int>(topics_to_use.size()) != num_columns) {
+    BOOST_THROW_EXCEPTION(InvalidOperation("Theta cache entries have different number of topics"));
+  }
+
+  std::vector<int> topic_position(cache.topic_name_size(), -1);
+  for (unsigned index = 0; index < topics_to_use.size(); ++index) {
+    topic_position[topics_to_use[index]] = index;
+  }
+
+  const bool sparse_cache = cache.topic_indices_size() > 0;
+  const bool has_title = (cache.item_title_size() == cache.item_id_size());
+  for (int item_index = 0; item_index < cache.item_id_size(); ++item_index) {
+    float* row = theta + static_cast<int64_t>(item_index) * num_columns;
+    const FloatArray& item_theta = cache.item_weights(item_index);
+    item_id[item_index] = cache.item_id(item_index);
+    if (has_title) {
+      item_title[item_index] = cache.item_title(item_index);
+    }
+
+    if (sparse_cache) {
+      const IntArray& item_topics = cache.topic_indices(item_index);
+      std::fill(row, row + num_columns, 0.0f);
+      for (int index = 0; index < item_topics.value_size(); ++index) {
+        int position = topic_position[item_topics.value(index)];
+        if (position != -1) {
+          row[position] = item_theta.value(index);
+        }
+      }
+    } else {
+      for (int column = 0; column < num_columns; ++column) {
+        row[column] = item_theta.value(topics_to_use[column]);
+      }
+    }
+  }
+
+  return has_title;
+}
+
+void CacheManager::CopyThetaMatrix(const GetThetaMatrixArgs& get_theta_args,
+                                   int64_t theta_size, float* theta,
+                                   ::artm::ThetaMatrix* theta_info) const {
+  if (get_theta_args.matrix_layout() != MatrixLayout_Dense) {
+    BOOST_THROW_EXCEPTION(InvalidOperation("CopyThetaMatrix supports only MatrixLayout_Dense"));
+  }
+
+  std::string ptd_name = (instance_ != nullptr) ? instance_->config()->ptd_name() : std::string();
+  if (!ptd_name.empty()) {
+    // ptd matrix is not split into entries, so it is copied via a regular ThetaMatrix message
+    ::artm::ThetaMatrix theta_matrix;
+    RequestThetaMatrix(get_theta_args, &theta_matrix);
+    const int num_columns = theta_matrix.num_topics();
+    const int64_t num_rows = theta_matrix.item_id_size();
+    theta_info->set_num_topics(num_columns);
+    theta_info->set_num_values(num_rows * num_columns);
+    if (theta == nullptr) {
+      return;
+    }
+
+    if (num_rows * num_columns > theta_size) {
+      BOOST_THROW_EXCEPTION(InvalidOperation("Buffer is too small to copy theta matrix"));
+    }
+
+    for (int64_t item_index = 0; item_index < num_rows; ++item_index) {
+      const FloatArray& item_weights = theta_matrix.item_weights(item_index);
+      std::copy(item_weights.value().begin(), item_weights.value().end(), theta + item_index * num_columns);
+    }
+
+    theta_matrix.clear_item_weights();
+    theta_info->Swap(&theta_matrix);
+    return;
+  }
+
+  const std::vector<ThetaCachePageEntry> page = ListThetaCachePage(cache_, get_theta_args);
+  if (page.empty()) {
+    return;
+  }
+
+  // Each entry is written into its own range of rows, so entries can be processed in parallel.
+  std::vector<int64_t> first_row;
+  int64_t num_rows = 0;
+  for (const auto& page_entry : page) {
+    first_row.push_back(num_rows);
+    num_rows += page_entry.item_end - page_entry.item_begin;
+  }
+
+  // The size of the matrix is known without decoding the entries
+  const int num_columns = (get_theta_args.topic_name_size() > 0) ? get_theta_args.topic_name_size()
+                                                                 : page.front().entry->topic_size();
+  theta_info->set_num_topics(num_columns);
+  theta_info->set_num_values(num_rows * num_columns);
+  if (theta == nullptr) {
+    return;
+  }
+
+  if (num_rows * num_columns > theta_size) {
+    std::stringstream ss;
+    ss << "Buffer is too small to copy theta matrix of " << num_rows << " items and " << num_columns << " topics";
+    BOOST_THROW_EXCEPTION(InvalidOperation(ss.str()));
+  }
+
+  std::vector<int> item_id(num_rows);
+  std::vector<std::string> item_title(num_rows);
+  std::vector<char> has_title(page.size(), 0);
+  ::google::protobuf::RepeatedPtrField< ::std::string> topic_name;
+
+  std::atomic<int> next_entry(0);
+  auto func = [&page, &first_row, &next_entry, &get_theta_args, &item_id, &item_title, &has_title, &topic_name,
+               num_columns, theta]() {
+    for (int index = next_entry++; index < static_cast<int>(page.size()); index = next_entry++) {
+      const ThetaCachePageEntry& page_entry = page[index];
+      std::shared_ptr<ThetaMatrix> cached_theta =
+        page_entry.entry->theta_matrix(page_entry.item_begin, page_entry.item_end);
+      has_title[index] = CopyThetaRows(*cached_theta, get_theta_args, num_columns,
+                                       theta + first_row[index] * num_columns,
+                                       &item_id[first_row[index]], &item_title[first_row[index]]);
+      if (index == 0) {
+        for (int topic_index : ResolveTopicsToUse(cached_theta->topic_name(), get_theta_args)) {
+          topic_name.Add()->assign(cached_theta->topic_name(topic_index));
+        }
+      }
+    }
+  };
+
+  int num_threads = std::thread::hardware_concurrency();
+  num_threads = std::max(1, std::min(num_threads, static_cast<int>(page.size())));
+
+  // Exceptions from workers are re-thrown on this thread.
+  std::vector<std::shared_future<void>> tasks;
+  for (int i = 0; i < num_threads; i++) {
+    tasks.push_back(std::move(std::async(std::launch::async, func)));
+  }
+  for (int i = 0; i < num_threads; i++) {
+    tasks[i].get();
+  }
+
+  // Ids, titles and topic names come from the same decoded entries as the values
+  theta_info->mutable_topic_name()->Swap(&topic_name);
+  theta_info->mutable_item_id()->Reserve(num_rows);
+  for (int id : item_id) {
+    theta_info->add_item_id(id);
+  }
+
+  if (std::all_of(has_title.begin(), has_title.end(), [](char value) { return value != 0; })) {
+    theta_info->mutable_item_title()->Reserve(num_rows);
+    for (auto& title : item_title) {
+      theta_info->add_item_title()->swap(title);
+    }
+  }
+}
+
+void CacheManager::InitializeThetaFromCache(const Batch& batch,
+                                            ::artm::utility::LocalThetaMatrix<float>* theta,
+                                            std::vector<bool>* is_cached) const {
+  const int topic_size = theta->num_topics();
+  is_cached->assign(batch.item_size(), false);
+
   std::string ptd_name = (instance_ != nullptr) ? instance_->config()->ptd_name() : std::string();
   if (!ptd_name.empty()) {
     boost::lock_guard<boost::mutex> guard(lock_);
     std::shared_ptr<const ::artm::core::PhiMatrix> phi_matrix = instance_->GetPhiMatrixSafe(ptd_name);
-    auto cached_theta = std::make_shared<ThetaMatrix>();
-    cached_theta->mutable_topic_name()->CopyFrom(phi_matrix->topic_name());
-    std::vector<float> values; values.resize(phi_matrix->topic_size());
-    for (int item_id = 0; item_id < batch.item_size(); item_id++) {
-      Token token(DocumentsClass, batch.item(item_id).title());
+    if (phi_matrix->topic_size() != topic_size) {
+      return;
+    }
 
-      if (token.keyword.empty()) {
+    std::vector<float> values; values.resize(topic_size);
+    for (int item_index = 0; item_index < batch.item_size(); item_index++) {
+      if (batch.item(item_index).title().empty()) {
         continue;
       }
 
+      const Token token = Token::Find(DocumentsClass, batch.item(item_index).title());
       int token_index = phi_matrix->token_index(token);
       if (token_index < 0) {
         continue;
       }
 
-      cached_theta->add_item_title(batch.item(item_id).title());
-      cached_theta->add_item_id(batch.item(item_id).id());
-      ::artm::FloatArray* item_weights = cached_theta->add_item_weights();
       phi_matrix->get(token_index, &values);
-      for (int topic_index = 0; topic_index < phi_matrix->topic_size(); topic_index++) {
-        item_weights->add_value(values[topic_index]);
+      for (int topic_index = 0; topic_index < topic_size; topic_index++) {
+        (*theta)(topic_index, item_index) = values[topic_index];
       }
+      (*is_cached)[item_index] = true;
     }
 
-    return cached_theta;
+    return;
+  }
+
+  std::shared_ptr<ThetaMatrix> cache = FindCacheEntry(batch.id());
+  if (cache == nullptr || cache->item_title_size() != cache->item_id_size()) {
+    return;
+  }
+
+  const bool sparse_cache = cache->topic_indices_size() > 0;
+  if (sparse_cache && cache->topic_name_size() != topic_size) {
+    return;
   }
 
-  return FindCacheEntry(batch.id());
+  // Cache entry is normally produced from the very same batch, so items are expected at the same positions.
+  // Title-to-row index is only built when this assumption does not hold.
+  std::unordered_map<std::string, int> title_to_row;
+  for (int item_index = 0; item_index < batch.item_size(); ++item_index) {
+    const std::string& title = batch.item(item_index).title();
+    int row = -1;
+    if (item_index < cache->item_title_size() && cache->item_title(item_index) == title) {
+      row = item_index;
+    } else {
+      if (title_to_row.empty()) {
+        title_to_row.reserve(cache->item_title_size());
+        for (int i = 0; i < cache->item_title_size(); ++i) {
+          title_to_row.emplace(cache->item_title(i), i);  // keeps the first occurrence of each title
+        }
+      }
+
+      auto iter = title_to_row.find(title);
+      if (iter != title_to_row.end()) {
+        row = iter->second;
+      }
+    }
+
+    if (row == -1) {
+      continue;
+    }
+
+    const FloatArray& old_thetas = cache->item_weights(row);
+    if (sparse_cache) {
+      const IntArray& old_topics = cache->topic_indices(row);
+      for (int topic_index = 0; topic_index < topic_size; ++topic_index) {
+        (*theta)(topic_index, item_index) = 0.0f;
+      }
+      for (int index = 0; index < old_topics.value_size(); ++index) {
+        (*theta)(old_topics.value(index), item_index) = old_thetas.value(index);
+      }
+    } else {
+      if (old_thetas.value_size() != topic_size) {
+        continue;
+      }
+
+      for (int topic_index = 0; topic_index < topic_size; ++topic_index) {
+        (*theta)(topic_index, item_index) = old_thetas.value(topic_index);
+      }
+    }
+    (*is_cached)[item_index] = true;
+  }
 }
 
 std::shared_ptr<ThetaMatrix> CacheManager::FindCacheEntry(const std::string& batch_id) const {
-  std::shared_ptr<ThetaCacheEntry> retval = cache_.get(batch_id);
-  if (retval == nullptr) {
+  std::shared_ptr<ThetaCacheEntry> entry = cache_.get(batch_id);
+  if (entry == nullptr) {
     return nullptr;
   }
-  if (retval->filename().empty()) {
-    return retval->theta_matrix();
-  }
 
   try {
-    std::shared_ptr<ThetaMatrix> copy(std::make_shared<ThetaMatrix>());
-    Helpers::LoadMessage(retval->filename(), copy.get());
-    return copy;
+    return entry->theta_matrix();
   } catch (...) {
-    LOG(ERROR) << "Unable to reload cache for " << retval->filename();
+    LOG(ERROR) << "Unable to reload cache for " << batch_id;
   }
 
   return nullptr;
@@ -279,6 +959,17 @@ void CacheManager::UpdateCacheEntry(const std::string& batch_id, const ThetaMatr
       if (token_id < 0) {
         token_id = mutable_phi_matrix->AddToken(token);
       }
+      if (theta_matrix.topic_indices_size() > 0) {
+        const IntArray& topic_indices = theta_matrix.topic_indices(i);
+        for (int topic_index = 0; topic_index < theta_matrix.topic_name_size(); topic_index++) {
+          mutable_phi_matrix->set(token_id, topic_index, 0.0f);
+        }
+        for (int index = 0; index < topic_indices.value_size(); ++index) {
+          mutable_phi_matrix->set(token_id, topic_indices.value(index), theta_matrix.item_weights(i).value(index));
+        }
+        continue;
+      }
+
       for (int topic_index = 0; topic_index < theta_matrix.topic_name_size(); topic_index++) {
         mutable_phi_matrix->set(token_id, topic_index, theta_matrix.item_weights(i).value(topic_index));
       }
@@ -286,23 +977,21 @@ void CacheManager::UpdateCacheEntry(const std::string& batch_id, const ThetaMatr
     return;
   }
 
-  std::shared_ptr<ThetaCacheEntry> new_entry(std::make_shared<ThetaCacheEntry>());
-  if (disk_path_.empty()) {
-    new_entry->theta_matrix()->CopyFrom(theta_matrix);
-  } else {
-    boost::uuids::uuid uuid = boost::uuids::random_generator()();
-    fs::path file(boost::lexical_cast<std::string>(uuid) + ".cache");
-    try {
-      Helpers::SaveMessage(file.string(), disk_path_, theta_matrix);
-      new_entry->mutable_filename()->assign((fs::path(disk_path_) / file).string());
-    } catch (...) {
-      LOG(ERROR) << "Unable to save cache entry to " << disk_path_;
-      cache_.set(batch_id, nullptr);
-      return;
+  std::shared_ptr<MasterModelConfig> config = (instance_ != nullptr) ? instance_->config() : nullptr;
+  const bool use_fp16 = (config != nullptr) && config->disk_cache_fp16();
+  auto new_entry = std::make_shared<ThetaCacheEntry>(theta_matrix, use_fp16);
+  cache_.set(batch_id, new_entry);
+
+  if (!disk_path_.empty()) {
+    // The entry is served from memory until the background writer spills it to disk.
+    // Block the caller when the writer falls behind, so that memory usage stays bounded.
+    boost::unique_lock<boost::mutex> lock(writer_lock_);
+    while (!is_stopping_ && writer_queue_.size() >= kMaxThetaCacheWriterQueueSize) {
+      writer_condition_.wait(lock);
     }
+    writer_queue_.push_back(new_entry);
+    writer_condition_.notify_all();
   }
-
-  cache_.set(batch_id, new_entry);
 }
 
 void CacheManager::CopyFrom(const CacheManager& cache_manager) {
@@ -311,6 +1000,10 @@ void CacheManager::CopyFrom(const CacheManager& cache_manager) {
   for (const auto& key : keys) {
     cache_.set(key, cache_manager.cache_.get(key));
   }
+
+  if (!disk_path_.empty()) {
+    StartWriter();
+  }
 }
 
 }  // namespace core
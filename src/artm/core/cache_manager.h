@@ -3,34 +3,84 @@
 #pragma once
 
 #include <algorithm>
+#include <deque>
+#include <fstream>  // NOLINT
 #include <string>
 #include <utility>
 #include <vector>
 
+#include "boost/thread.hpp"
+#include "boost/thread/condition_variable.hpp"
 #include "boost/thread/locks.hpp"
 #include "boost/thread/mutex.hpp"
 #include "boost/utility.hpp"
 
 #include "artm/core/common.h"
 #include "artm/core/thread_safe_holder.h"
+#include "artm/utility/blas.h"
 
 namespace artm {
 namespace core {
 
 class Instance;
 
+// ThetaCacheSegment is an append-only file on disk that holds serialized theta cache entries.
+// Each entry is stored as a single record (see EncodeThetaRecord in cache_manager.cc):
+// a header with topic names, a table of row offsets (an index from item to its position within the record),
+// and sparse rows of (topic_index, value) pairs, where values are either float or fp16.
+// Only one thread (the background writer of CacheManager) appends to the segment,
+// while many threads may read already written records. The file is removed once the segment is destroyed.
+class ThetaCacheSegment : boost::noncopyable {
+ public:
+  explicit ThetaCacheSegment(const std::string& filename);
+  ~ThetaCacheSegment();
+
+  // Appends record to the end of segment and returns its offset.
+  int64_t Append(const std::string& record);
+  void Read(int64_t offset, int64_t length, std::string* record) const;
+
+  int64_t size() const { return size_; }
+  const std::string& filename() const { return filename_; }
+
+ private:
+  std::string filename_;
+  std::ofstream stream_;
+  int64_t size_;
+};
+
+// ThetaCacheEntry holds theta matrix of a single batch.
+// The entry is created in memory, either as ThetaMatrix message, or (with MasterModelConfig.disk_cache_fp16,
+// which applies to in-memory entries despite its name) as a compact record in the same format as used by
+// ThetaCacheSegment.
+// If CacheManager has a disk_path the entry is later spilled into a ThetaCacheSegment by the background writer,
+// and its in-memory copy is released.
 class ThetaCacheEntry : boost::noncopyable {
  public:
-  ThetaCacheEntry();
+  ThetaCacheEntry(const ThetaMatrix& theta_matrix, bool use_fp16);
   ~ThetaCacheEntry();
 
-  std::shared_ptr<ThetaMatrix> theta_matrix() { return theta_matrix_; }
-  const std::string& filename() const { return filename_; }
-  std::string* mutable_filename() { return &filename_; }
+  int item_size() const { return item_size_; }
+  int topic_size() const { return topic_size_; }
+  int64_t byte_size() const;
+
+  // Returns theta matrix for items in range [item_begin, item_end) of this entry.
+  // The in-memory matrix is returned without copying when the whole range is requested.
+  // Matrices decoded from compact records have sparse layout (see ThetaMatrix.topic_indices).
+  std::shared_ptr<ThetaMatrix> theta_matrix() const;
+  std::shared_ptr<ThetaMatrix> theta_matrix(int item_begin, int item_end) const;
+
+  // Writes the entry into the segment and releases the in-memory copy.
+  void Spill(const std::shared_ptr<ThetaCacheSegment>& segment, bool use_fp16);
 
  private:
+  mutable boost::mutex lock_;
   std::shared_ptr<ThetaMatrix> theta_matrix_;
-  std::string filename_;
+  std::shared_ptr<const std::string> record_;
+  std::shared_ptr<ThetaCacheSegment> segment_;
+  int64_t offset_;
+  int64_t length_;
+  int item_size_;
+  int topic_size_;
 };
 
 // CacheManager class is responsible for caching ThetaMatrix in between calls to different APIs.
@@ -39,6 +89,8 @@ class ThetaCacheEntry : boost::noncopyable {
 // Later user may retrieve the data from CacheManager via calls to ArtmRequestThetaMatrix.
 // The cache is organized as a set of entries, each entry associated with a single batch.
 // The key in the cache corresponds to 'batch.id' field.
+// Retrieval can be paged via GetThetaMatrixArgs.item_offset and GetThetaMatrixArgs.item_limit;
+// entries outside of the requested page are not loaded from disk.
 //
 // CacheManager can also store the cache as a PhiMatrix.
 // Note that this mode might be slower due to lock/guards that prevent several threads
@@ -48,7 +100,8 @@ class ThetaCacheEntry : boost::noncopyable {
 // These are the three "modus operandi" options for CacheManager:
 // - disk_path is empty, instance is nullptr --- caching happens in CacheManager::cache_
 // - disk_path is not empty, instance is nullptr --- caching happens in CacheManager::cache_,
-//   but the actual entries are stored on disk
+//   but the actual entries are asynchronously written by a background thread into segment files in disk_path.
+//   Segments are rotated once they exceed kMaxThetaCacheSegmentSize, and removed when no entry refers to them.
 // - instance is not nullptr and ptd_name is not empty --- chaching happens in PhiMatrix named as ptd_name.
 //   (in this case disk_path is ignored).
 class CacheManager : boost::noncopyable {
@@ -60,7 +113,21 @@ class CacheManager : boost::noncopyable {
   void Clear();
   void RequestThetaMatrix(const GetThetaMatrixArgs& get_theta_args,
                           ::artm::ThetaMatrix* theta_matrix) const;
-  std::shared_ptr<ThetaMatrix> FindCacheEntry(const Batch& batch) const;
+
+  // Copies theta matrix (MatrixLayout_Dense only) into caller-provided row-major buffer of theta_size values
+  // (item_size x topic_size), and fills theta_info with item ids, titles and topic names of the copied rows
+  // (item_weights are not set). Each cache entry is decoded once, entries are copied in parallel,
+  // each into its own range of rows. theta_info->num_values() is the number of values in the matrix;
+  // when theta is nullptr only num_topics and num_values are set, and no entry is decoded.
+  void CopyThetaMatrix(const GetThetaMatrixArgs& get_theta_args, int64_t theta_size, float* theta,
+                       ::artm::ThetaMatrix* theta_info) const;
+
+  // Copies cached theta values of batch items into the columns of theta matrix (used for reuse_theta).
+  // Sets (*is_cached)[item_index] to true for each item found in the cache; other columns are left intact.
+  // Items are matched by title; with ptd_name the values are read directly from the ptd matrix.
+  void InitializeThetaFromCache(const Batch& batch,
+                                ::artm::utility::LocalThetaMatrix<float>* theta,
+                                std::vector<bool>* is_cached) const;
   void UpdateCacheEntry(const std::string& batch_id, const ThetaMatrix& theta_matrix) const;
   void CopyFrom(const CacheManager& cache_manager);
 
@@ -70,7 +137,18 @@ class CacheManager : boost::noncopyable {
   Instance* instance_;
   mutable ThreadSafeCollectionHolder<std::string, ThetaCacheEntry> cache_;
 
+  // Background writer, active only when disk_path_ is not empty.
+  mutable boost::mutex writer_lock_;
+  mutable boost::condition_variable writer_condition_;
+  mutable std::deque<std::shared_ptr<ThetaCacheEntry>> writer_queue_;
+  std::shared_ptr<ThetaCacheSegment> segment_;
+  bool is_stopping_;
+  boost::thread writer_thread_;
+
   std::shared_ptr<ThetaMatrix> FindCacheEntry(const std::string& batch_id) const;
+  void StartWriter();
+  void StopWriter();
+  void WriterThreadFunction();
 };
 
 }  // namespace core
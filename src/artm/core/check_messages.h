@@ -253,13 +253,26 @@ inline std::string DescribeErrors(const ::artm::FitOfflineMasterModelArgs& messa
        << "FitOfflineMasterModelArgs.batch_filename must be specified; ";
   }
 
+  if (message.has_collection_parser_config() && (message.has_batch_folder() || message.batch_filename_size() != 0)) {
+    ss << "FitOfflineMasterModelArgs.collection_parser_config can not be used together with "
+       << "FitOfflineMasterModelArgs.batch_folder or FitOfflineMasterModelArgs.batch_filename; ";
+  }
+
   return ss.str();
 }
 
 inline std::string DescribeErrors(const ::artm::FitOnlineMasterModelArgs& message) {
   std::stringstream ss;
 
-  if (message.batch_filename_size() == 0) {
+  // With collection_parser_config batches are parsed while the model is trained,
+  // so their number is not known in advance (see OnlineBatchesIterator).
+  const bool streaming = message.has_collection_parser_config();
+  if (streaming && message.batch_filename_size() != 0) {
+    ss << "FitOnlineMasterModelArgs.collection_parser_config can not be used together with "
+       << "FitOnlineMasterModelArgs.batch_filename; ";
+  }
+
+  if (!streaming && message.batch_filename_size() == 0) {
     ss << "Fields FitOnlineMasterModelArgs.batch_filename must not be empty; ";
   }
 
@@ -285,7 +298,7 @@ inline std::string DescribeErrors(const ::artm::FitOnlineMasterModelArgs& messag
          << ", expected value must be greater than zero; ";
       break;
     }
-    if (value > message.batch_filename_size()) {
+    if (!streaming && value > message.batch_filename_size()) {
       ss << "FitOnlineMasterModelArgs.update_after[" << i << "] == " << value
          << ", expected value must not exceed FitOnlineMasterModelArgs.batch_filename_size(); ";
       break;
@@ -295,7 +308,7 @@ inline std::string DescribeErrors(const ::artm::FitOnlineMasterModelArgs& messag
          << "is less than previous value; expect strictly increasing sequence; ";
       break;
     }
-    if ((i + 1) == message.update_after_size()) {
+    if (!streaming && (i + 1) == message.update_after_size()) {
       if (message.update_after(i) != message.batch_filename_size()) {
         ss << "Last element in FitOnlineMasterModelArgs.update_after is " << message.update_after(i) << ", "
            << "expected value is FitOnlineMasterModelArgs.batch_filename_size(), which was "
@@ -355,6 +368,16 @@ inline std::string DescribeErrors(const ::artm::FilterDictionaryArgs& message) {
   return ss.str();
 }
 
+inline std::string DescribeErrors(const ::artm::ExportDictionaryArgs& message) {
+  std::stringstream ss;
+
+  if (message.format_version() != 0 && message.format_version() != 1) {
+    ss << "ExportDictionaryArgs.format_version == " << message.format_version() << ", expected 0 or 1; ";
+  }
+
+  return ss.str();
+}
+
 inline std::string DescribeErrors(const ::artm::GatherDictionaryArgs& message) {
   std::stringstream ss;
 
@@ -366,6 +389,10 @@ inline std::string DescribeErrors(const ::artm::GatherDictionaryArgs& message) {
     ss << "GatherDictionaryArgs has neither batch_path nor data_path set; ";
   }
 
+  if (message.max_tokens_in_memory() < 0) {
+    ss << "GatherDictionaryArgs.max_tokens_in_memory must not be negative; ";
+  }
+
   return ss.str();
 }
 
@@ -506,7 +533,6 @@ inline std::string DescribeErrors(const ::artm::GetThetaMatrixArgs& message) { r
 inline std::string DescribeErrors(const ::artm::RegularizeModelArgs& message) { return std::string(); }
 inline std::string DescribeErrors(const ::artm::NormalizeModelArgs& message) { return std::string(); }
 inline std::string DescribeErrors(const ::artm::RegularizerConfig& message) { return std::string(); }
-inline std::string DescribeErrors(const ::artm::ExportDictionaryArgs& message) { return std::string(); }
 inline std::string DescribeErrors(const ::artm::ScoreData& message) { return std::string(); }
 inline std::string DescribeErrors(const ::artm::MasterComponentInfo& message) { return std::string(); }
 inline std::string DescribeErrors(const ::artm::GetDictionaryArgs& message) { return std::string(); }
@@ -923,6 +949,12 @@ inline std::string DescribeMessage(const ::artm::GatherDictionaryArgs& message)
     ss << ", vocab_file_path=" << message.vocab_file_path();
   }
   ss << ", symmetric_cooc_values=" << message.symmetric_cooc_values();
+  if (message.has_num_threads()) {
+    ss << ", num_threads=" << message.num_threads();
+  }
+  if (message.max_tokens_in_memory() > 0) {
+    ss << ", max_tokens_in_memory=" << message.max_tokens_in_memory();
+  }
 
   return ss.str();
 }
@@ -1005,6 +1037,10 @@ inline std::string DescribeMessage(const ::artm::MasterModelConfig& message) {
   ss << ", cache_theta=" << (message.cache_theta() ? "yes" : "no");
   ss << ", opt_for_avx=" << (message.opt_for_avx() ? "yes" : "no");
   ss << ", disk_cache_path=" << message.disk_cache_path();
+  ss << ", disk_cache_fp16=" << (message.disk_cache_fp16() ? "yes" : "no");
+  if (message.has_cache_theta_eps()) {
+    ss << ", cache_theta_eps=" << message.cache_theta_eps();
+  }
   for (int i = 0; i < message.transaction_typename_size(); ++i) {
     ss << ", transaction_type=(" << message.transaction_typename(i)
       << ":" << message.transaction_weight(i) << ")";
@@ -2,10 +2,15 @@
 
 #include "artm/core/collection_parser.h"
 
+#include <stdlib.h>
+#include <string.h>
+
 #include <algorithm>
 #include <atomic>
+#include <functional>
 #include <iostream>  // NOLINT
 #include <future>  // NOLINT
+#include <limits>
 #include <map>
 #include <memory>
 #include <sstream>
@@ -19,6 +24,7 @@
 #include "boost/algorithm/string/predicate.hpp"
 #include "boost/lexical_cast.hpp"
 #include "boost/uuid/uuid_io.hpp"
+#include "boost/utility/string_ref.hpp"
 #include "boost/uuid/uuid_generators.hpp"
 
 #include "glog/logging.h"
@@ -26,11 +32,13 @@
 #include "artm/utility/ifstream_or_cin.h"
 #include "artm/utility/progress_printer.h"
 
+#include "artm/core/call_on_destruction.h"
 #include "artm/core/cooccurrence_collector.h"
 #include "artm/core/common.h"
 #include "artm/core/exceptions.h"
 #include "artm/core/helpers.h"
 #include "artm/core/protobuf_helpers.h"
+#include "artm/core/string_interner.h"
 #include "artm/core/transaction_type.h"
 
 using ::artm::utility::ifstream_or_cin;
@@ -94,7 +102,272 @@ static bool useClassId(const std::vector<ClassId>& class_ids, const CollectionPa
   return true;
 }
 
-CollectionParser::CollectionParser(const ::artm::CollectionParserConfig& config) : config_(config) { }
+// Runs func(0), ..., func(num_threads - 1) on separate threads.
+// Exceptions thrown by func are re-thrown on the calling thread.
+// http://stackoverflow.com/questions/14222899/exception-propagation-and-stdfuture
+static void RunInParallel(int num_threads, std::function<void(int)> func) {  // NOLINT
+  std::vector<std::shared_future<void>> tasks;
+  for (int i = 0; i < num_threads; i++) {
+    tasks.push_back(std::move(std::async(std::launch::async, func, i)));
+  }
+  for (int i = 0; i < num_threads; i++) {
+    tasks[i].get();
+  }
+}
+
+// Every thread keeps pairs of tokens in its own buffer, the memory budget is shared between them
+static int64_t GetMaxNumOfPairsPerThread(const CollectionParserConfig& config, int num_threads) {
+  return static_cast<int64_t>(config.cooc_memory_budget_mb()) * 1024 * 1024 /
+         sizeof(CooccurrenceStatisticsHolder::PairOfTokens) / std::max(1, num_threads);
+}
+
+static int GetNumThreads(const CollectionParserConfig& config) {
+  if (config.has_num_threads() && config.num_threads() >= 0) {
+    return config.num_threads();
+  }
+
+  int num_threads = std::thread::hardware_concurrency();
+  if (num_threads == 0) {
+    num_threads = 1;
+    LOG(INFO) << "CollectionParserConfig.num_threads is set to 1 (default)";
+  } else {
+    LOG(INFO) << "CollectionParserConfig.num_threads is automatically set to " << num_threads;
+  }
+
+  return num_threads;
+}
+
+// Cuts [begin, end) into num_ranges ranges, each (except the last one) ending right after a newline.
+// Returns num_ranges + 1 offsets.
+static std::vector<size_t> SplitOnNewlines(const char* data, size_t begin, size_t end, int num_ranges) {
+  std::vector<size_t> range_begin;
+  for (int i = 0; i < num_ranges; ++i) {
+    size_t offset = begin + ((end - begin) / num_ranges) * i;
+    if (i > 0) {
+      const char* newline = static_cast<const char*>(memchr(data + offset, '\n', end - offset));
+      offset = (newline == nullptr) ? end : static_cast<size_t>(newline - data) + 1;
+      offset = std::max(offset, range_begin.back());
+    }
+    range_begin.push_back(offset);
+  }
+  range_begin.push_back(end);
+  return range_begin;
+}
+
+// Returns the end of the line starting at ptr (either a newline, or the end of the range).
+static inline const char* FindLineEnd(const char* ptr, const char* end) {
+  const char* newline = static_cast<const char*>(memchr(ptr, '\n', end - ptr));
+  return (newline == nullptr) ? end : newline;
+}
+
+// Returns the beginning of the next line, given the end of the current line.
+static inline const char* NextLine(const char* line_end, const char* end) {
+  return (line_end < end) ? line_end + 1 : end;
+}
+
+enum UciLineStatus {
+  UciLineEmpty,
+  UciLineOk,
+  UciLineMalformed,
+};
+
+static inline bool IsUciSpace(char c) {
+  return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline const char* SkipUciSpaces(const char* ptr, const char* end) {
+  while (ptr < end && IsUciSpace(*ptr)) {
+    ++ptr;
+  }
+  return ptr;
+}
+
+static bool ParseUciInt(const char** ptr, const char* end, int* value) {
+  const char* p = *ptr;
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = (*p == '-');
+    ++p;
+  }
+
+  if (p == end || *p < '0' || *p > '9') {
+    return false;
+  }
+
+  int64_t result = 0;
+  for (; p < end && *p >= '0' && *p <= '9'; ++p) {
+    result = result * 10 + (*p - '0');
+    if (result > std::numeric_limits<int>::max()) {
+      return false;
+    }
+  }
+
+  *value = static_cast<int>(negative ? -result : result);
+  *ptr = p;
+  return true;
+}
+
+static bool ParseUciFloat(const char** ptr, const char* end, float* value) {
+  const char* p = *ptr;
+  const char* field_end = p;
+  while (field_end < end && !IsUciSpace(*field_end)) {
+    ++field_end;
+  }
+
+  // Integer values (the common case for n_wd) are converted directly; the conversion is correctly rounded,
+  // so it produces the same value as strtof. Other values are passed to strtof.
+  int64_t result = 0;
+  const char* digit = p;
+  while (digit < field_end && *digit >= '0' && *digit <= '9' && (digit - p) < 18) {
+    result = result * 10 + (*digit - '0');
+    ++digit;
+  }
+
+  if (digit == field_end && digit != p) {
+    *value = static_cast<float>(result);
+  } else {
+    char buffer[64];
+    if (field_end == p || (field_end - p) >= static_cast<int64_t>(sizeof(buffer))) {
+      return false;
+    }
+
+    memcpy(buffer, p, field_end - p);
+    buffer[field_end - p] = '\0';
+    char* parsed_end = nullptr;
+    *value = strtof(buffer, &parsed_end);
+    if (parsed_end != buffer + (field_end - p)) {
+      return false;
+    }
+  }
+
+  *ptr = field_end;
+  return true;
+}
+
+// Parses a line of UCI docword file: "item_id token_id n_wd", separated by spaces or tabs.
+static UciLineStatus ParseUciLine(const char* begin, const char* end,
+                                  int* item_id, int* token_id, float* token_weight) {
+  const char* ptr = SkipUciSpaces(begin, end);
+  if (ptr == end) {
+    return UciLineEmpty;
+  }
+
+  if (!ParseUciInt(&ptr, end, item_id) || ptr == end || !IsUciSpace(*ptr)) {
+    return UciLineMalformed;
+  }
+
+  ptr = SkipUciSpaces(ptr, end);
+  if (!ParseUciInt(&ptr, end, token_id) || ptr == end || !IsUciSpace(*ptr)) {
+    return UciLineMalformed;
+  }
+
+  ptr = SkipUciSpaces(ptr, end);
+  if (!ParseUciFloat(&ptr, end, token_weight)) {
+    return UciLineMalformed;
+  }
+
+  return (SkipUciSpaces(ptr, end) == end) ? UciLineOk : UciLineMalformed;
+}
+
+// UciBatchCollector forms a batch from triples of UCI docword file.
+// A new item starts each time item_id differs from the item_id of the previous triple.
+class CollectionParser::UciBatchCollector {
+ public:
+  UciBatchCollector(const CollectionParserConfig& config, const TokenMap& token_map, TokenMap* token_statistics)
+      : config_(config), token_map_(token_map), token_statistics_(token_statistics), item_(nullptr),
+        prev_item_id_(-1), total_token_weight_(0), total_items_count_(0), total_triples_count_(0) {
+    batch_.set_id(boost::lexical_cast<std::string>(boost::uuids::random_generator()()));
+  }
+
+  // Returns true if the triple would start an extra item in a batch that already has num_items_per_batch items.
+  bool IsFull(int item_id) const {
+    return batch_.item_size() >= config_.num_items_per_batch() && item_id != prev_item_id_;
+  }
+
+  // Records a triple with non-zero weight and known token_id.
+  void Record(int item_id, int token_id, float token_weight) {
+    if (item_ == nullptr || item_id != prev_item_id_) {
+      prev_item_id_ = item_id;
+      if (item_ != nullptr) {
+        item_->add_transaction_start_index(item_->transaction_start_index_size());
+      }
+
+      item_ = batch_.add_item();
+      item_->set_id(item_id);
+      total_items_count_++;
+    }
+
+    // Skip token when it is not among modalities that user has requested to parse
+    const CollectionParserTokenInfo& token_info = token_map_.find(token_id)->second;
+    if (!useClassId(token_info.class_id, config_)) {
+      return;
+    }
+
+    auto iter = batch_dictionary_.find(token_id);
+    if (iter == batch_dictionary_.end()) {
+      iter = batch_dictionary_.insert(std::make_pair(token_id, static_cast<int>(batch_dictionary_.size()))).first;
+      batch_.add_token(token_info.keyword);
+      batch_.add_class_id(token_info.class_id);
+    }
+
+    item_->add_token_id(iter->second);
+    item_->add_transaction_start_index(item_->transaction_start_index_size());
+    item_->add_transaction_typename_id(0);
+    item_->add_token_weight(token_weight);
+
+    // Increment statistics
+    total_token_weight_ += token_weight;
+    total_triples_count_++;
+    CollectionParserTokenInfo& token_statistics = (*token_statistics_)[token_id];
+    token_statistics.items_count++;
+    token_statistics.token_weight += token_weight;
+  }
+
+  Batch FinishBatch() {
+    if (item_ != nullptr) {
+      item_->add_transaction_start_index(item_->transaction_start_index_size());
+    }
+
+    batch_.add_transaction_typename(DefaultTransactionTypeName);
+    Batch batch;
+    batch.Swap(&batch_);
+    return batch;
+  }
+
+  const Batch& batch() const { return batch_; }
+  float total_token_weight() const { return total_token_weight_; }
+  int64_t total_items_count() const { return total_items_count_; }
+  int64_t total_triples_count() const { return total_triples_count_; }
+
+ private:
+  const CollectionParserConfig& config_;
+  const TokenMap& token_map_;
+  TokenMap* token_statistics_;
+  std::unordered_map<int, int> batch_dictionary_;
+  Batch batch_;
+  Item* item_;
+  int prev_item_id_;
+  float total_token_weight_;
+  int64_t total_items_count_;
+  int64_t total_triples_count_;
+};
+
+CollectionParser::CollectionParser(const ::artm::CollectionParserConfig& config)
+    : config_(config), batch_sink_() { }
+
+CollectionParser::CollectionParser(const ::artm::CollectionParserConfig& config, BatchSink batch_sink)
+    : config_(config), batch_sink_(batch_sink) { }
+
+void CollectionParser::StoreBatch(Batch* batch, const std::string& batch_name, BatchManifest* manifest) {
+  if (batch_sink_ == nullptr) {
+    ::artm::core::Helpers::SaveBatch(*batch, config_.target_folder(), batch_name, manifest->add_entry());
+    return;
+  }
+
+  auto batch_ptr = std::make_shared<Batch>();
+  batch_ptr->Swap(batch);
+  batch_sink_(batch_ptr);
+}
 
 CollectionParserInfo CollectionParser::ParseDocwordBagOfWordsUci(TokenMap* token_map) {
   BatchNameGenerator batch_name_generator(kBatchNameLength,
@@ -106,9 +379,11 @@ CollectionParserInfo CollectionParser::ParseDocwordBagOfWordsUci(TokenMap* token
   // Skip all lines starting with "%" and parse N, W, NNZ from the first line after that.
   auto pos = docword.tellg();
   std::string str;
+  int line_no = 0;
   while (true) {
     pos = docword.tellg();
     std::getline(docword, str);
+    ++line_no;
     if (!boost::starts_with(str.c_str(), "%")) {
       // FIXME (JeanPaulShapo) there can be failures when reading from standard input
       // there's no guarantee that seekg successfully move stream pointer, especially with std::cin
@@ -148,54 +423,34 @@ CollectionParserInfo CollectionParser::ParseDocwordBagOfWordsUci(TokenMap* token
     }
   }
 
-  std::unordered_map<int, int> batch_dictionary;
-  std::unordered_set<ClassId> batch_class_ids;
-  ::artm::Batch batch;
-  ::artm::Item* item = nullptr;
-  int prev_item_id = -1;
-
-  float total_token_weight = 0;
-  int64_t total_items_count = 0;
-  int64_t token_weight_zero = 0;
-  int64_t total_triples_count = 0;
-  int64_t num_batches = 0;
-
-  int item_id, token_id;
-  float token_weight;
-  int line_no = 1;
   std::getline(docword, str);  // skip end of previous line
 
-  while (!docword.eof()) {
-    std::getline(docword, str);
-    boost::algorithm::trim(str);
-    ++line_no;
-    progress.Set(docword.tellg());
-    if (str.empty()) {
-      continue;
+  // Parses a line into a triple; returns false for empty lines and triples with zero weight.
+  // Throws an exception if the line is malformed or token_id is unknown.
+  const CollectionParserConfig& config = config_;
+  auto parse_line = [&config, token_map](const char* begin, const char* end, int64_t line_no,
+                                         int* item_id, int* token_id, float* token_weight) {
+    UciLineStatus status = ParseUciLine(begin, end, item_id, token_id, token_weight);
+    if (status == UciLineEmpty) {
+      return false;
     }
 
-    std::vector<std::string> strs;
-    boost::split(strs, str, boost::is_any_of("\t "));
-    if (strs.size() != 3) {
+    if (status == UciLineMalformed) {
       std::stringstream ss;
-      ss << "Error at line" << line_no << " or " << line_no + 2 << ", file " << config_.docword_file_path()
+      ss << "Error at line " << line_no << ", file " << config.docword_file_path()
          << ". Expected format: item_id token_id n_wd";
       BOOST_THROW_EXCEPTION(InvalidOperation(ss.str()));
     }
 
-    item_id = std::stoi(strs[0]);
-    token_id = std::stoi(strs[1]);
-    token_weight = std::stof(strs[2]);
-
-    if (config_.use_unity_based_indices()) {
-      token_id--;  // convert 1-based to zero-based index
+    if (config.use_unity_based_indices()) {
+      (*token_id)--;  // convert 1-based to zero-based index
     }
 
-    if (token_map->find(token_id) == token_map->end())  {
+    if (token_map->find(*token_id) == token_map->end())  {
       std::stringstream ss;
-      ss << "Failed to parse line '" << item_id << " " << (token_id + 1) << " " << token_weight << "' in "
-         << config_.docword_file_path();
-      if (token_id == -1 && config_.use_unity_based_indices()) {
+      ss << "Failed to parse line '" << *item_id << " " << (*token_id + 1) << " " << *token_weight << "' in "
+         << config.docword_file_path();
+      if (*token_id == -1 && config.use_unity_based_indices()) {
         ss << ". wordID column appears to be zero-based in the docword file being parsed. "
            << "UCI format defines wordID column to be unity-based. "
            << "Please, set CollectionParserConfig.use_unity_based_indices=false "
@@ -204,76 +459,239 @@ CollectionParserInfo CollectionParser::ParseDocwordBagOfWordsUci(TokenMap* token
         ss << ". Token_id value is outside of the expected range.";
       }
 
-      BOOST_THROW_EXCEPTION(ArgumentOutOfRangeException("wordID", token_id, ss.str()));
+      BOOST_THROW_EXCEPTION(ArgumentOutOfRangeException("wordID", *token_id, ss.str()));
     }
 
-    if (isZero(token_weight)) {
-      token_weight_zero++;
-      continue;
-    }
+    return !isZero(*token_weight);
+  };
 
-    if (item_id != prev_item_id) {
-      prev_item_id = item_id;
+  // Token weights are summed per batch and then over batches, so the total may differ in the last digits
+  // from the sum over all triples in the order of the docword file
+  float total_token_weight = 0;
+  int64_t total_items_count = 0;
+  int64_t token_weight_zero = 0;
+  int64_t total_triples_count = 0;
+  int64_t num_batches = 0;
+  BatchManifest manifest;
+
+  const char* docword_data = stream_or_cin.data();
+  if (docword_data == nullptr) {  // Sequential parsing of std::cin
+    TokenMap token_statistics;
+    std::shared_ptr<UciBatchCollector> batch_collector;
+    auto save_batch = [&]() {  // NOLINT
+      Batch batch = batch_collector->FinishBatch();
+      StoreBatch(&batch, batch_name_generator.next_name(batch), &manifest);
+      num_batches++;
+      total_items_count += batch_collector->total_items_count();
+      total_triples_count += batch_collector->total_triples_count();
+      total_token_weight += batch_collector->total_token_weight();
+      VLOG(1) << total_items_count << " documents parsed.";
+      batch_collector.reset();
+    };
+
+    while (!docword.eof()) {
+      std::getline(docword, str);
+      ++line_no;
+      progress.Set(docword.tellg());
+
+      int item_id, token_id;
+      float token_weight = 1.0f;
+      if (!parse_line(str.c_str(), str.c_str() + str.size(), line_no, &item_id, &token_id, &token_weight)) {
+        token_weight_zero += isZero(token_weight) ? 1 : 0;
+        continue;
+      }
 
-      if (item != nullptr) {
-        item->add_transaction_start_index(item->transaction_start_index_size());
+      if (batch_collector != nullptr && batch_collector->IsFull(item_id)) {
+        save_batch();
       }
 
-      if (batch.item_size() >= config_.num_items_per_batch()) {
-        batch.set_id(boost::lexical_cast<std::string>(boost::uuids::random_generator()()));
-        batch.add_transaction_typename(DefaultTransactionTypeName);
-        ::artm::core::Helpers::SaveBatch(batch, config_.target_folder(), batch_name_generator.next_name(batch));
-        num_batches++;
-        batch.Clear();
-        batch_dictionary.clear();
-        batch_class_ids.clear();
+      if (batch_collector == nullptr) {
+        batch_collector = std::make_shared<UciBatchCollector>(config_, *token_map, &token_statistics);
       }
 
-      item = batch.add_item();
-      item->set_id(item_id);
+      batch_collector->Record(item_id, token_id, token_weight);
+    }
 
-      // Increment statistics
-      total_items_count++;
-      LOG_IF(INFO, total_items_count % 100000 == 0) << total_items_count << " documents parsed.";
+    if (batch_collector != nullptr) {
+      save_batch();
     }
 
-    // Skip token when it is not among modalities that user has requested to parse
-    if (!useClassId((*token_map)[token_id].class_id, config_)) {
-      continue;
+    for (const auto& statistics : token_statistics) {
+      CollectionParserTokenInfo& token_info = (*token_map)[statistics.first];
+      token_info.items_count += statistics.second.items_count;
+      token_info.token_weight += statistics.second.token_weight;
     }
+  } else {
+    // Docword file is memory-mapped and split into portions of num_items_per_batch items
+    // (phases 1 and 2 below), which are then parsed in parallel.
+    const size_t size = stream_or_cin.size();
+    const std::streamoff body_offset = docword.tellg();
+    const size_t body_begin = (body_offset < 0) ? size : std::min(static_cast<size_t>(body_offset), size);
+    line_no = static_cast<int>(std::count(docword_data, docword_data + body_begin, '\n'));
+
+    const int num_threads = std::max(1, GetNumThreads(config_));
+    const int64_t num_items_per_batch = config_.num_items_per_batch();
+
+    // Phase 1: validate all lines, count lines and triples with zero weight, and record the offsets of lines
+    // that may start new items within each range. Whether the first of them starts a new item depends on
+    // the last item_id of the previous range. Malformed lines are reported once line numbers are known.
+    struct ItemStart {
+      size_t offset;
+      int64_t line_index;  // within the range
+    };
+
+    struct RangeInfo {
+      RangeInfo() : num_lines(0), num_zero(0), error_offset(-1), first_item_id(0), last_item_id(0),
+                    first_line_no(0) { }
+      int64_t num_lines;
+      int64_t num_zero;
+      int64_t error_offset;  // offset of the first line that can't be parsed, or -1
+      std::vector<ItemStart> item_starts;
+      int first_item_id;
+      int last_item_id;
+      int64_t first_line_no;
+    };
+
+    std::vector<size_t> range_begin = SplitOnNewlines(docword_data, body_begin, size, num_threads);
+    std::vector<RangeInfo> ranges(num_threads);
+    RunInParallel(num_threads, [&range_begin, &ranges, &config, token_map, docword_data](int range) {
+      RangeInfo& info = ranges[range];
+      const char* end = docword_data + range_begin[range + 1];
+      for (const char* ptr = docword_data + range_begin[range]; ptr < end; ++info.num_lines) {
+        const char* line_end = FindLineEnd(ptr, end);
+        int item_id, token_id;
+        float token_weight;
+        const UciLineStatus status = ParseUciLine(ptr, line_end, &item_id, &token_id, &token_weight);
+        if (status == UciLineOk && config.use_unity_based_indices()) {
+          token_id--;
+        }
 
-    auto iter = batch_dictionary.find(token_id);
-    if (iter == batch_dictionary.end()) {
-      batch_dictionary.insert(std::make_pair(token_id, static_cast<int>(batch_dictionary.size())));
-      batch.add_token((*token_map)[token_id].keyword);
+        if (status == UciLineMalformed || (status == UciLineOk && token_map->find(token_id) == token_map->end())) {
+          info.error_offset = ptr - docword_data;
+          break;
+        }
 
-      const auto& class_id = (*token_map)[token_id].class_id;
-      batch.add_class_id(class_id);
-      batch_class_ids.emplace(class_id);
-      iter = batch_dictionary.find(token_id);
+        if (status == UciLineOk) {
+          if (isZero(token_weight)) {
+            info.num_zero++;
+          } else if (info.item_starts.empty() || item_id != info.last_item_id) {
+            if (info.item_starts.empty()) {
+              info.first_item_id = item_id;
+            }
+            info.item_starts.push_back({ static_cast<size_t>(ptr - docword_data), info.num_lines });
+            info.last_item_id = item_id;
+          }
+        }
+        ptr = NextLine(line_end, end);
+      }
+    });
+
+    int64_t num_lines = line_no + 1;
+    for (auto& info : ranges) {
+      info.first_line_no = num_lines;
+      num_lines += info.num_lines;
+      token_weight_zero += info.num_zero;
+      if (info.error_offset >= 0) {  // re-parse the line to throw the exception with its line number
+        const char* ptr = docword_data + info.error_offset;
+        int item_id, token_id;
+        float token_weight;
+        parse_line(ptr, FindLineEnd(ptr, docword_data + size), num_lines, &item_id, &token_id, &token_weight);
+      }
     }
 
-    item->add_token_id(iter->second);
-    item->add_transaction_start_index(item->transaction_start_index_size());
-    item->add_transaction_typename_id(0);
-    item->add_token_weight(token_weight);
+    // Phase 2: record where each portion of num_items_per_batch items starts, using the offsets from phase 1.
+    int64_t num_items = 0;
+    int prev_item_id = -1;
+    std::vector<size_t> batch_begin;
+    std::vector<int64_t> batch_first_line_no;
+    for (const auto& info : ranges) {
+      for (size_t i = 0; i < info.item_starts.size(); ++i) {
+        if (i == 0 && num_items > 0 && info.first_item_id == prev_item_id) {
+          continue;  // the item continues from the previous range
+        }
 
-    // Increment statistics
-    total_token_weight += token_weight;
-    total_triples_count++;
-    (*token_map)[token_id].items_count++;
-    (*token_map)[token_id].token_weight += token_weight;
-  }
+        if (num_items % num_items_per_batch == 0) {
+          batch_begin.push_back(info.item_starts[i].offset);
+          batch_first_line_no.push_back(info.first_line_no + info.item_starts[i].line_index);
+        }
+        num_items++;
+      }
+
+      if (!info.item_starts.empty()) {
+        prev_item_id = info.last_item_id;
+      }
+    }
+
+    const int64_t num_portions = static_cast<int64_t>(batch_begin.size());
+    batch_begin.push_back(size);
+    batch_first_line_no.push_back(num_lines);
+
+    // Phase 3: form batches and save them to disk.
+    std::mutex read_access;
+    std::mutex statistics_access;
+    int64_t next_batch = 0;
+    std::vector<float> batch_token_weight(num_portions, 0.0f);
+    RunInParallel(num_threads, [&](int thread_index) {  // NOLINT
+      TokenMap local_token_statistics;
+      BatchManifest local_manifest;
+      int64_t local_num_batches = 0;
+      int64_t local_items_count = 0;
+      int64_t local_triples_count = 0;
+      while (true) {
+        int64_t batch_index = 0;
+        std::shared_ptr<UciBatchCollector> batch_collector =
+          std::make_shared<UciBatchCollector>(config_, *token_map, &local_token_statistics);
+        std::string batch_name;
+        {  // Lock is held only to number the portion (batches are named in the order of the docword file)
+          std::lock_guard<std::mutex> guard(read_access);
+          batch_index = next_batch++;
+          if (batch_index >= num_portions) {
+            break;
+          }
+
+          progress.Set(batch_begin[batch_index + 1]);
+          batch_name = batch_name_generator.next_name(batch_collector->batch());
+        }
+
+        int64_t line_no = batch_first_line_no[batch_index];
+        const char* end = docword_data + batch_begin[batch_index + 1];
+        for (const char* ptr = docword_data + batch_begin[batch_index]; ptr < end; ++line_no) {
+          const char* line_end = FindLineEnd(ptr, end);
+          int item_id, token_id;
+          float token_weight;
+          if (parse_line(ptr, line_end, line_no, &item_id, &token_id, &token_weight)) {
+            batch_collector->Record(item_id, token_id, token_weight);
+          }
+          ptr = NextLine(line_end, end);
+        }
+
+        Batch batch = batch_collector->FinishBatch();
+        StoreBatch(&batch, batch_name, &local_manifest);
+        local_num_batches++;
+        local_items_count += batch_collector->total_items_count();
+        local_triples_count += batch_collector->total_triples_count();
+        batch_token_weight[batch_index] = batch_collector->total_token_weight();
+      }
 
-  if (batch.item_size() > 0) {
-    if (item != nullptr) {
-      item->add_transaction_start_index(item->transaction_start_index_size());
+      std::lock_guard<std::mutex> guard(statistics_access);
+      for (const auto& statistics : local_token_statistics) {
+        CollectionParserTokenInfo& token_info = (*token_map)[statistics.first];
+        token_info.items_count += statistics.second.items_count;
+        token_info.token_weight += statistics.second.token_weight;
+      }
+      manifest.MergeFrom(local_manifest);
+      num_batches += local_num_batches;
+      total_items_count += local_items_count;
+      total_triples_count += local_triples_count;
+    });
+
+    for (float value : batch_token_weight) {
+      total_token_weight += value;
     }
+  }
 
-    batch.set_id(boost::lexical_cast<std::string>(boost::uuids::random_generator()()));
-    batch.add_transaction_typename(DefaultTransactionTypeName);
-    ::artm::core::Helpers::SaveBatch(batch, config_.target_folder(), batch_name_generator.next_name(batch));
-    num_batches++;
+  if (manifest.entry_size() > 0) {
+    Helpers::UpdateBatchManifest(config_.target_folder(), manifest);
   }
 
   LOG_IF(WARNING, token_weight_zero > 0) << "Found " << token_weight_zero << " tokens with zero "
@@ -338,13 +756,13 @@ CollectionParser::TokenMap CollectionParser::ParseVocabBagOfWordsUci() {
 
     if (token_to_token_id.find(token) != token_to_token_id.end()) {
       std::stringstream ss;
-      ss << "Token (" << token.keyword << ", " << token.class_id << "' found twice, lines "
+      ss << "Token (" << token.keyword() << ", " << token.class_id() << "' found twice, lines "
          << (token_to_token_id.find(token)->second + 1)
          << " and " << (token_id + 1) << ", file " << config_.vocab_file_path();
       BOOST_THROW_EXCEPTION(InvalidOperation(ss.str()));
     }
 
-    token_info.insert(std::make_pair(token_id, CollectionParserTokenInfo(token.keyword, token.class_id)));
+    token_info.insert(std::make_pair(token_id, CollectionParserTokenInfo(token.keyword(), token.class_id())));
     token_to_token_id.insert(std::make_pair(token, token_id));
     token_id++;
   }
@@ -371,12 +789,16 @@ CollectionParser::TokenMap CollectionParser::ParseVocabMatrixMarket() {
   return token_info;  // empty if no input file had been provided
 }
 
+// BatchCollector forms a batch from tokens of VW docword file.
+// Keywords and class ids are given as ids from StringInterners shared by all parser threads,
+// so that strings are only copied when a token is added to the batch for the first time.
 class CollectionParser::BatchCollector {
  private:
+  const StringInterner& keywords_;
+  const StringInterner& class_ids_;
   Item *item_;
   Batch batch_;
-  std::unordered_map<Token, int, TokenHasher> local_map_;
-  std::unordered_map<Token, CollectionParserTokenInfo, TokenHasher> global_map_;
+  std::unordered_map<uint64_t, int> local_map_;  // (class_id, keyword) -> index of the token in batch_
   float total_token_weight_;
   int64_t total_items_count_;
   int64_t total_tokens_count_;
@@ -388,46 +810,46 @@ class CollectionParser::BatchCollector {
   }
 
  public:
-  BatchCollector() : item_(nullptr), total_token_weight_(0), total_items_count_(0), total_tokens_count_(0) {
+  BatchCollector(const StringInterner& keywords, const StringInterner& class_ids)
+      : keywords_(keywords), class_ids_(class_ids), item_(nullptr),
+        total_token_weight_(0), total_items_count_(0), total_tokens_count_(0) {
     batch_.set_id(boost::lexical_cast<std::string>(boost::uuids::random_generator()()));
   }
 
-  void RecordTransaction(const std::vector<ClassId>& class_ids, const std::vector<std::string>& tokens,
-      const std::vector<float>& token_weights, const TransactionTypeName& transaction_typename) {
+  static uint64_t TokenKey(int class_id, int keyword) {
+    return (static_cast<uint64_t>(static_cast<uint32_t>(class_id)) << 32) | static_cast<uint32_t>(keyword);
+  }
+
+  // Records tokens [begin, end) as one transaction.
+  // tt_id caches the index of transaction_typename in the batch; it should be set to -1 when the typename changes.
+  void RecordTransaction(const std::vector<int>& class_ids, const std::vector<int>& keywords,
+                         const std::vector<float>& token_weights, int begin, int end,
+                         const TransactionTypeName& transaction_typename, int* tt_id) {
     // prepare item for transaction insetion
     if (item_ == nullptr) {
       StartNewItem();
     }
 
-    auto id_iter = tt_name_to_id_.find(transaction_typename);
-    if (id_iter == tt_name_to_id_.end()) {
-      tt_name_to_id_.emplace(transaction_typename, tt_name_to_id_.size());
-
-      id_iter = tt_name_to_id_.find(transaction_typename);
+    if (*tt_id < 0) {
+      auto id_iter = tt_name_to_id_.find(transaction_typename);
+      if (id_iter == tt_name_to_id_.end()) {
+        id_iter = tt_name_to_id_.emplace(transaction_typename, tt_name_to_id_.size()).first;
+      }
+      *tt_id = id_iter->second;
     }
 
     item_->add_transaction_start_index(item_->token_id_size());
-    item_->add_transaction_typename_id(id_iter->second);
-
-    for (int i = 0; i < class_ids.size(); ++i) {
-      Token token(class_ids[i], tokens[i]);
+    item_->add_transaction_typename_id(*tt_id);
 
-      if (global_map_.find(token) == global_map_.end()) {
-        global_map_.insert(std::make_pair(token, CollectionParserTokenInfo(token.keyword, token.class_id)));
-      }
-      if (local_map_.find(token) == local_map_.end()) {
-        local_map_.insert(std::make_pair(token, batch_.token_size()));
-        batch_.add_token(token.keyword);
-        batch_.add_class_id(token.class_id);
+    for (int i = begin; i < end; ++i) {
+      auto local_iter = local_map_.emplace(TokenKey(class_ids[i], keywords[i]), batch_.token_size()).first;
+      if (local_iter->second == batch_.token_size()) {
+        batch_.add_token(keywords_.str(keywords[i]));
+        batch_.add_class_id(class_ids_.str(class_ids[i]));
       }
 
-      CollectionParserTokenInfo& token_info = global_map_[token];
-      int local_token_id = local_map_[token];
-
-      item_->add_token_id(local_token_id);
+      item_->add_token_id(local_iter->second);
       item_->add_token_weight(token_weights[i]);
-      token_info.items_count++;
-      token_info.token_weight += token_weights[i];
       total_token_weight_ += token_weights[i];
       total_tokens_count_ += 1;
     }
@@ -449,7 +871,8 @@ class CollectionParser::BatchCollector {
     item_ = nullptr;
   }
 
-  Batch FinishBatch(CollectionParserInfo* info) {
+  // Keys of all tokens of the batch (see TokenKey) are added to token_keys.
+  Batch FinishBatch(CollectionParserInfo* info, std::unordered_set<uint64_t>* token_keys) {
     info->set_num_items(info->num_items() + total_items_count_);
     info->set_num_tokens(info->num_tokens() + total_tokens_count_);
     info->set_total_token_weight(info->total_token_weight() + total_token_weight_);
@@ -464,6 +887,10 @@ class CollectionParser::BatchCollector {
       batch_.add_transaction_typename(v);
     }
 
+    for (const auto& token : local_map_) {
+      token_keys->insert(token.first);
+    }
+
     Batch batch;
     batch.Swap(&batch_);
     local_map_.clear();
@@ -479,6 +906,190 @@ std::string DropWeightSuffix(const std::string& token) {
   return token.substr(0, split_index);
 }
 
+// Splits a line of VW file on ' ', '\t' and '\r' without copying its content.
+// Same as boost::split(..., boost::is_any_of(" \t\r")), e.g. adjacent separators produce empty entries.
+static void SplitVowpalWabbitLine(boost::string_ref line, std::vector<boost::string_ref>* entries) {
+  entries->clear();
+  size_t begin = 0;
+  for (size_t i = 0; i < line.size(); ++i) {
+    const char c = line[i];
+    if (c == ' ' || c == '\t' || c == '\r') {
+      entries->push_back(line.substr(begin, i - begin));
+      begin = i + 1;
+    }
+  }
+  entries->push_back(line.substr(begin));
+}
+
+// useClassId() for interned class ids; the results are cached in use_class_id.
+static bool UseClassId(int class_id, const StringInterner& class_ids, const CollectionParserConfig& config,
+                       std::unordered_map<int, bool>* use_class_id) {
+  auto iter = use_class_id->find(class_id);
+  if (iter == use_class_id->end()) {
+    iter = use_class_id->emplace(class_id, useClassId(class_ids.str(class_id), config)).first;
+  }
+  return iter->second;
+}
+
+// Calls save_pair(second_token_id) for every token from vocab of the same modality as strs[elem_index]
+// that is in the window of cooc_window_width tokens to the right of it
+// If there are some words beginnig with '|' in the text the window is extended using not_a_word_counter
+template <typename SavePair>
+static void ForEachTokenInCoocWindow(const std::vector<boost::string_ref>& strs, unsigned elem_index,
+                                     const ClassId& first_token_class_id, unsigned cooc_window_width,
+                                     CooccurrenceCollector* cooc_collector, SavePair save_pair) {
+  ClassId second_token_class_id = first_token_class_id;
+  unsigned not_a_word_counter = 0;
+  // Loop through tokens in the window
+  for (unsigned neighbour_index = 1; neighbour_index <= cooc_window_width + not_a_word_counter &&
+                                     elem_index + neighbour_index < strs.size();
+                                     ++neighbour_index) {
+    if (strs[elem_index + neighbour_index].empty()) {
+      continue;
+    }
+    if (strs[elem_index + neighbour_index][0] == '|') {
+      second_token_class_id = strs[elem_index + neighbour_index].substr(1).to_string();
+      ++not_a_word_counter;
+      continue;
+    }
+    // Take into consideration only tokens from the same modality
+    if (second_token_class_id != first_token_class_id) {
+      continue;
+    }
+    const std::string neighbour = strs[elem_index + neighbour_index].to_string();
+    std::string second_token = DropWeightSuffix(neighbour);
+    int second_token_id = cooc_collector->FindTokenIdInVocab(second_token, second_token_class_id);
+    if (second_token_id == TOKEN_NOT_FOUND) {
+      continue;
+    }
+    save_pair(second_token_id);
+  }
+}
+
+// Adds pairs of tokens of one document to the count-min sketch of co-occurrences
+// Tokens are taken the same way as in ParseVowpalWabbit, but the line isn't validated here
+// (the following exact pass reports errors)
+static void AddDocumentToCoocSketch(boost::string_ref str, const CollectionParserConfig& config,
+                                    CooccurrenceCollector* cooc_collector, std::vector<boost::string_ref>* strs,
+                                    std::vector<uint64_t>* keys_of_pairs, CooccurrenceSketch* cooc_sketch) {
+  SplitVowpalWabbitLine(str, strs);
+  keys_of_pairs->clear();
+  ClassId class_id = DefaultClass;
+  bool use_current_class_id = useClassId(class_id, config);
+  for (unsigned elem_index = 1; elem_index < strs->size(); ++elem_index) {
+    const boost::string_ref elem = (*strs)[elem_index];
+    if (elem.size() == 0) {
+      continue;
+    }
+    if (elem[0] == '|') {  // modality is reset to default at the end of a transaction
+      class_id = (elem.size() > 1 && elem[1] != '|') ? elem.substr(1).to_string() : DefaultClass;
+      use_current_class_id = useClassId(class_id, config);
+      continue;
+    }
+    if (!use_current_class_id) {
+      continue;
+    }
+
+    const int first_token_id = cooc_collector->FindTokenIdInVocab(DropWeightSuffix(elem.to_string()), class_id);
+    if (first_token_id == TOKEN_NOT_FOUND) {
+      continue;
+    }
+    ForEachTokenInCoocWindow(*strs, elem_index, class_id, config.cooc_window_width(), cooc_collector,
+                             [keys_of_pairs, first_token_id](int second_token_id) {
+      keys_of_pairs->push_back(CooccurrenceSketch::MakeKey(first_token_id, second_token_id));
+    });
+  }
+  cooc_sketch->AddDocument(keys_of_pairs);
+}
+
+// Splits the content of a memory-mapped docword file into portions of num_items_per_batch lines each.
+// Returns byte offsets where each portion starts (the last element is the size of the content).
+// The content is cut into num_threads ranges aligned on newlines. Lines are counted in parallel
+// in each range; then, knowing the number of the first line in each range, the ranges are scanned again
+// to record offsets of lines that start new portions. Lines are numbered exactly as if the file was read sequentially.
+static std::vector<size_t> SplitIntoBatches(const char* data, size_t size, int64_t num_items_per_batch,
+                                            int num_threads) {
+  std::vector<size_t> range_begin = SplitOnNewlines(data, 0, size, num_threads);
+
+  // All ranges except the last one end with a newline; the last line of the file may have no newline.
+  std::vector<int64_t> range_lines(num_threads + 1, 0);
+  RunInParallel(num_threads, [&range_begin, &range_lines, data](int range) {
+    int64_t num_lines = 0;
+    const char* end = data + range_begin[range + 1];
+    for (const char* ptr = data + range_begin[range]; ptr < end; ++num_lines) {
+      ptr = NextLine(FindLineEnd(ptr, end), end);
+    }
+    range_lines[range + 1] = num_lines;
+  });
+
+  for (int i = 0; i < num_threads; ++i) {
+    range_lines[i + 1] += range_lines[i];  // now range_lines[i] is the number of the first line in range i
+  }
+
+  const int64_t num_lines = range_lines.back();
+  const int64_t num_batches = (num_lines + num_items_per_batch - 1) / num_items_per_batch;
+  std::vector<size_t> batch_begin(num_batches + 1, size);
+  RunInParallel(num_threads, [&range_begin, &range_lines, &batch_begin, data, num_items_per_batch](int range) {
+    int64_t line_no = range_lines[range];
+    const char* end = data + range_begin[range + 1];
+    for (const char* ptr = data + range_begin[range]; ptr < end; ++line_no) {
+      if (line_no % num_items_per_batch == 0) {
+        batch_begin[line_no / num_items_per_batch] = ptr - data;
+      }
+      ptr = NextLine(FindLineEnd(ptr, end), end);
+    }
+  });
+
+  return batch_begin;
+}
+
+// Approximate counting of co-occurrences is a two-pass procedure: firstly all the pairs of tokens are
+// counted in count-min sketch (this pass doesn't need any memory except the sketch), then during parsing
+// only pairs that may pass cooc_min_tf / cooc_min_df are stored and counted exactly.
+// Returns nullptr if the sketch can't drop any pair or the collection can't be read twice
+std::unique_ptr<CooccurrenceSketch> CollectionParser::GatherCoocSketch(const char* docword_data,
+                                                                       const std::vector<size_t>& batch_begin,
+                                                                       int num_threads,
+                                                                       CooccurrenceCollector* cooc_collector) {
+  // Thresholds are needed only for requested statistics, threshold 0 turns off counting
+  const bool need_tf = config_.gather_cooc_tf() || config_.has_ppmi_tf_file_path();
+  const bool need_df = config_.gather_cooc_df() || config_.has_ppmi_df_file_path();
+  const unsigned cooc_min_tf = need_tf ? std::max(1, config_.cooc_min_tf()) : 0;
+  const unsigned cooc_min_df = need_df ? std::max(1, config_.cooc_min_df()) : 0;
+  if (cooc_min_tf == 1 || cooc_min_df == 1) {
+    LOG(INFO) << "Co-occurrences are counted exactly, because all pairs of tokens pass cooc_min_tf / cooc_min_df";
+    return nullptr;
+  }
+  if (docword_data == nullptr) {
+    LOG(WARNING) << "Co-occurrences are counted exactly, because the collection can't be read twice";
+    return nullptr;
+  }
+
+  std::unique_ptr<CooccurrenceSketch> cooc_sketch(
+      new CooccurrenceSketch(config_.cooc_sketch_error(), cooc_min_tf, cooc_min_df));
+  LOG(INFO) << "Counting co-occurrences approximately, the size of count-min sketch is "
+            << cooc_sketch->SizeInBytes() << " bytes";
+
+  const int64_t num_batches = static_cast<int64_t>(batch_begin.size()) - 1;
+  const CollectionParserConfig& config = config_;
+  RunInParallel(num_threads, [&cooc_sketch, &batch_begin, &config, cooc_collector, docword_data, num_batches,
+                              num_threads](int thread_index) {
+    std::vector<boost::string_ref> strs;
+    std::vector<uint64_t> keys_of_pairs;
+    for (int64_t batch_index = thread_index; batch_index < num_batches; batch_index += num_threads) {
+      const char* ptr = docword_data + batch_begin[batch_index];
+      const char* end = docword_data + batch_begin[batch_index + 1];
+      while (ptr < end) {
+        const char* newline = static_cast<const char*>(memchr(ptr, '\n', end - ptr));
+        const boost::string_ref str(ptr, ((newline == nullptr) ? end : newline) - ptr);
+        AddDocumentToCoocSketch(str, config, cooc_collector, &strs, &keys_of_pairs, cooc_sketch.get());
+        ptr = (newline == nullptr) ? end : newline + 1;
+      }
+    }
+  });
+  return cooc_sketch;
+}
+
 // ToDo (MichaelSolotky): split this func into several
 CollectionParserInfo CollectionParser::ParseVowpalWabbit() {
   BatchNameGenerator batch_name_generator(kBatchNameLength,
@@ -491,12 +1102,24 @@ CollectionParserInfo CollectionParser::ParseVowpalWabbit() {
 
   std::mutex read_access;
   std::mutex cooc_config_access;
-  std::mutex token_map_access;
+  std::mutex parser_info_access;
   std::mutex token_statistics_access;
+  std::mutex manifest_access;
 
   int global_line_no = 0;
-
-  std::unordered_map<Token, bool, TokenHasher> token_map;
+  BatchManifest manifest;
+
+  // Regular files are memory-mapped and split into portions of num_items_per_batch lines upfront,
+  // so that workers parse their portions without a shared lock. std::cin is read line by line under read_access.
+  const char* docword_data = stream_or_cin.data();
+  std::vector<size_t> batch_begin;
+  int64_t next_batch = 0;
+
+  // Keywords and class ids are interned by all threads, so that tokens are handled as pairs of ints.
+  // token_keys holds all distinct (class_id, keyword) pairs of the collection (see BatchCollector::TokenKey).
+  StringInterner keywords;
+  StringInterner class_ids;
+  std::unordered_set<uint64_t> token_keys;
   CollectionParserInfo parser_info;
 
   ::artm::core::CooccurrenceCollector cooc_collector(collection_parser_config);
@@ -505,57 +1128,105 @@ CollectionParserInfo CollectionParser::ParseVowpalWabbit() {
   // gathering of co-occurrences on transaction data
 
   // The function defined below works as follows:
-  // 1. Acquire lock for reading from docword file
-  // 2. Read num_items_per_batch lines from docword file, and store them in a local buffer (vector<string>)
-  // 3. Release the lock
-  // 4. Parse strings, form a batch, and save it to the external storage
+  // 1. Take the next portion of num_items_per_batch lines from docword file
+  //    (either the next range of the memory-mapped file, or lines read from std::cin under read_access lock),
+  //    and keep references to them (the memory-mapped content is referenced directly)
+  // 2. Parse strings, form a batch, and save it to the external storage
   // During parsing it gathers co-occurrence counters for pairs of tokens (if the correspondent flag == true)
-  // Steps 1-4 are repeated in a while loop until there is no content left in docword file.
+  // Steps 1-2 are repeated in a while loop until there is no content left in docword file.
   // Multiple copies of the function can work in parallel.
+  const int num_threads = GetNumThreads(collection_parser_config);
+
+  // In approximate mode rare pairs of tokens are dropped before they are stored (see GatherCoocSketch)
+  std::unique_ptr<CooccurrenceSketch> cooc_sketch;
+
+  const int64_t max_num_of_pairs_per_thread = GetMaxNumOfPairsPerThread(collection_parser_config, num_threads);
+
   auto func = [&docword, &global_line_no, &progress, &batch_name_generator, &read_access,
-               &cooc_config_access, &token_map_access, &token_statistics_access, &parser_info,
-               &token_map, &total_num_of_pairs, &cooc_collector, &gather_transaction_cooc,
-               collection_parser_config]() {
+               &cooc_config_access, &parser_info_access, &token_statistics_access, &parser_info,
+               &keywords, &class_ids, &token_keys, &total_num_of_pairs, &cooc_collector, &gather_transaction_cooc,
+               &manifest_access, &manifest, &batch_begin, &next_batch, &cooc_sketch, docword_data,
+               collection_parser_config, max_num_of_pairs_per_thread, this]() {
     int64_t local_num_of_pairs = 0;  // statistics for future ppmi calculation
+    CollectionParserInfo local_parser_info;
+    std::unordered_set<uint64_t> local_token_keys;
+    BatchManifest local_manifest;
+
+    const int default_class_id = class_ids.Intern(DefaultClass);
+    std::unordered_map<int, bool> use_class_id;  // cache of useClassId() for interned class ids
+
+    // Buffers are reused across lines to avoid allocations
+    std::vector<boost::string_ref> strs;
+    std::vector<int> tokens;
+    std::vector<int> token_class_ids;
+    std::vector<float> weights;
+
+    // This container holds occurrences of pairs of tokens
+    // Every pair of valid tokens (e.g. both exist in vocab) is saved in this storage
+    // After walking through a batch of documents (or earlier, when the storage is full) all the statistics
+    // will be dumped to the external storage and the storage will be cleared (its memory is reused)
+    std::unique_ptr<CooccurrenceStatisticsHolder> cooc_stat_holder;
+    if (collection_parser_config.gather_cooc()) {
+      cooc_stat_holder.reset(new CooccurrenceStatisticsHolder(cooc_collector.VocabSize(),
+          collection_parser_config.store_symmetric_cooc_values(), max_num_of_pairs_per_thread, cooc_sketch.get()));
+    }
     while (true) {
       // The following variable remembers at which line the batch has started.
       // It helps to create informative error message (including line number)
       // if later the code discovers a problem when parsing the line.
       int first_line_no_for_batch = -1;
 
-      std::vector<std::string> all_strs_for_batch;
+      std::vector<std::string> lines_from_cin;
+      std::vector<boost::string_ref> all_strs_for_batch;
       std::string batch_name;
-      BatchCollector batch_collector;
+      BatchCollector batch_collector(keywords, class_ids);
+
+      if (docword_data != nullptr) {  // Take portion of documents from the memory-mapped file
+        int64_t batch_index = 0;
+        {  // Lock is held only to number the portion (batches are named in the order of the docword file)
+          std::lock_guard<std::mutex> guard(read_access);
+          batch_index = next_batch++;
+          if (batch_index >= static_cast<int64_t>(batch_begin.size()) - 1) {
+            break;
+          }
 
-      {  // Read portion of documents
+          progress.Set(batch_begin[batch_index + 1]);
+          batch_name = batch_name_generator.next_name(batch_collector.batch());
+        }
+
+        first_line_no_for_batch = static_cast<int>(batch_index * collection_parser_config.num_items_per_batch());
+        const char* ptr = docword_data + batch_begin[batch_index];
+        const char* end = docword_data + batch_begin[batch_index + 1];
+        while (ptr < end) {
+          const char* newline = static_cast<const char*>(memchr(ptr, '\n', end - ptr));
+          all_strs_for_batch.push_back(boost::string_ref(ptr, ((newline == nullptr) ? end : newline) - ptr));
+          ptr = (newline == nullptr) ? end : newline + 1;
+        }
+      } else {  // Read portion of documents from std::cin
         std::lock_guard<std::mutex> guard(read_access);
         first_line_no_for_batch = global_line_no;
         if (docword.eof()) {
           break;
         }
 
-        while ((int64_t) all_strs_for_batch.size() < collection_parser_config.num_items_per_batch()) {
+        while ((int64_t) lines_from_cin.size() < collection_parser_config.num_items_per_batch()) {
+          // The last line may have no trailing newline: getline() then reads it and sets eof, but doesn't fail
           std::string str;
-          std::getline(docword, str);
-          global_line_no++;
-          progress.Set(docword.tellg());
-          if (docword.eof()) {
+          if (!std::getline(docword, str)) {
             break;
           }
 
-          all_strs_for_batch.push_back(str);
+          global_line_no++;
+          lines_from_cin.push_back(std::move(str));
         }
 
+        all_strs_for_batch.assign(lines_from_cin.begin(), lines_from_cin.end());
+
         if (all_strs_for_batch.size() > 0) {
           batch_name = batch_name_generator.next_name(batch_collector.batch());
         }
       }
 
-      // This container holds tf and df of pairs of tokens
-      // Every pair of valid tokens (e.g. both exist in vocab) is saved in this storage
-      // After walking through a batch of documents all the statistics will be dumped to the external storage
-      // and then this storage will be destroyed
-      CooccurrenceStatisticsHolder cooc_stat_holder;
       // For every token from vocab keep the information about the last document this token occured in
 
       // ToDo (MichaelSolotky): consider the case if there is no vocab
@@ -563,11 +1234,10 @@ CollectionParserInfo CollectionParser::ParseVowpalWabbit() {
 
       // Loop through documents
       for (int str_index = 0; str_index < (int64_t) all_strs_for_batch.size(); ++str_index) {
-        std::string str = all_strs_for_batch[str_index];
+        const boost::string_ref str = all_strs_for_batch[str_index];
         const int line_no = first_line_no_for_batch + str_index;
 
-        std::vector<std::string> strs;
-        boost::split(strs, str, boost::is_any_of(" \t\r"));
+        SplitVowpalWabbitLine(str, &strs);
 
         if (strs.size() <= 1) {
           std::stringstream ss;
@@ -576,18 +1246,20 @@ CollectionParserInfo CollectionParser::ParseVowpalWabbit() {
           BOOST_THROW_EXCEPTION(InvalidOperation(ss.str()));
         }
 
-        std::string item_title = strs[0];
+        std::string item_title = strs[0].to_string();
 
         TransactionTypeName current_tt_name = DefaultTransactionTypeName;
-        ClassId current_class_id = DefaultClass;
+        int current_tt_id = -1;
+        int current_class_id = default_class_id;
+        bool use_current_class_id = UseClassId(default_class_id, class_ids, collection_parser_config, &use_class_id);
 
-        std::vector<std::string> tokens;
-        std::vector<ClassId> class_ids;
-        std::vector<float> weights;
+        tokens.clear();
+        token_class_ids.clear();
+        weights.clear();
 
         // Loop through tokens
         for (unsigned elem_index = 1; elem_index < strs.size(); ++elem_index) {
-          std::string elem = strs[elem_index];
+          const boost::string_ref elem = strs[elem_index];
           if (elem.size() == 0) {
             continue;
           }
@@ -597,42 +1269,44 @@ CollectionParserInfo CollectionParser::ParseVowpalWabbit() {
               if (elem.size() == 2) {
                 // end of previous transaction
                 if (tokens.size() > 0) {
-                  batch_collector.RecordTransaction(class_ids, tokens, weights, current_tt_name);
+                  batch_collector.RecordTransaction(token_class_ids, tokens, weights, 0, tokens.size(),
+                                                    current_tt_name, &current_tt_id);
                 }
               } else {
                 // change of transaction typename
                 // dump all previous tokens, each as one transaction
                 for (int i = 0; i < tokens.size(); ++i) {
-                  batch_collector.RecordTransaction({ class_ids[i] }, { tokens[i] }, { weights[i] }, current_tt_name);
+                  batch_collector.RecordTransaction(token_class_ids, tokens, weights, i, i + 1,
+                                                    current_tt_name, &current_tt_id);
                 }
-                current_tt_name = elem.substr(2);
+                current_tt_name = elem.substr(2).to_string();
+                current_tt_id = -1;
               }
 
               // reset class_id in context to default when change tt_name of finish transaction
               tokens.clear();
               weights.clear();
-              class_ids.clear();
-              current_class_id = DefaultClass;
+              token_class_ids.clear();
+              current_class_id = default_class_id;
+              use_current_class_id = UseClassId(default_class_id, class_ids, collection_parser_config, &use_class_id);
 
               continue;
             } else {
-              current_class_id = elem.substr(1);
-              if (current_class_id.empty()) {
-                current_class_id = DefaultClass;
-              }
+              current_class_id = (elem.size() > 1) ? class_ids.Intern(elem.substr(1)) : default_class_id;
+              use_current_class_id = UseClassId(current_class_id, class_ids, collection_parser_config, &use_class_id);
               continue;
             }
           }
 
           // Skip token when it is not among modalities that user has requested to parse
-          if (!useClassId(current_class_id, collection_parser_config)) {
+          if (!use_current_class_id) {
             continue;
           }
 
           float token_weight = 1.0f;
-          std::string token = elem;
+          boost::string_ref token = elem;
           size_t split_index = elem.find(':');
-          if (split_index != std::string::npos) {
+          if (split_index != boost::string_ref::npos) {
             if (split_index == 0 || split_index == (elem.size() - 1)) {
               std::stringstream ss;
               ss << "Error in " << collection_parser_config.docword_file_path() << ":" << line_no
@@ -641,7 +1315,7 @@ CollectionParserInfo CollectionParser::ParseVowpalWabbit() {
             }
             token = elem.substr(0, split_index);
             try {
-              token_weight = boost::lexical_cast<float>(elem.substr(split_index + 1));
+              token_weight = boost::lexical_cast<float>(elem.data() + split_index + 1, elem.size() - split_index - 1);
             }
             catch (boost::bad_lexical_cast &) {
               std::stringstream ss;
@@ -651,16 +1325,16 @@ CollectionParserInfo CollectionParser::ParseVowpalWabbit() {
             }
           }
 
-          tokens.push_back(token);
-          class_ids.push_back(current_class_id);
+          tokens.push_back(keywords.Intern(token));
+          token_class_ids.push_back(current_class_id);
           weights.push_back(token_weight);
 
           if (collection_parser_config.gather_cooc()) {  // Co-occurence gathering starts here
-            const ClassId first_token_class_id = current_class_id;
+            const ClassId first_token_class_id = class_ids.str(current_class_id);
 
             int first_token_id = -1;
             if (collection_parser_config.has_vocab_file_path()) {
-              std::string first_token = DropWeightSuffix(elem);
+              std::string first_token = token.to_string();
               first_token_id = cooc_collector.FindTokenIdInVocab(first_token, first_token_class_id);
               if (first_token_id == TOKEN_NOT_FOUND) {
                 continue;
@@ -675,116 +1349,93 @@ CollectionParserInfo CollectionParser::ParseVowpalWabbit() {
               ++cooc_collector.num_of_documents_token_occurred_in_[first_token_id];
             }
             // Take window_width tokens (parameter) to the right of the current one
-            // If there are some words beginnig with '|' in the text the window should be extended
-            // and it's extended using not_a_word_counter
-            ClassId second_token_class_id = first_token_class_id;
-            unsigned not_a_word_counter = 0;
-            // Loop through tokens in the window
-            for (unsigned neighbour_index = 1; neighbour_index <= cooc_collector.config_.cooc_window_width() +
-                                               not_a_word_counter &&
-                                               elem_index + neighbour_index < strs.size();
-                                               ++neighbour_index) {
-              if (strs[elem_index + neighbour_index].empty()) {
-                continue;
-              }
-              if (strs[elem_index + neighbour_index][0] == '|') {
-                second_token_class_id = strs[elem_index + neighbour_index].substr(1);
-                ++not_a_word_counter;
-                continue;
-              }
-              // Take into consideration only tokens from the same modality
-              if (second_token_class_id != first_token_class_id) {
-                continue;
-              }
-              int second_token_id = -1;
-              const std::string neighbour = strs[elem_index + neighbour_index];
-              if (collection_parser_config.has_vocab_file_path()) {
-                std::string second_token = DropWeightSuffix(neighbour);
-                second_token_id = cooc_collector.FindTokenIdInVocab(second_token, second_token_class_id);
-                if (second_token_id == TOKEN_NOT_FOUND) {
-                  continue;
-                }
-              } else {  // ToDo (MichaelSolotky): consider the case if there is no vocab
-                BOOST_THROW_EXCEPTION(InvalidOperation("No vocab file specified. Can't gather co-occurrences"));
-              }
-
-              if (cooc_collector.config_.store_symmetric_cooc_values()) {
-                if (first_token_id < second_token_id) {
-                  cooc_stat_holder.SavePairOfTokens(first_token_id, second_token_id, str_index);
-                } else if (first_token_id > second_token_id) {
-                  cooc_stat_holder.SavePairOfTokens(second_token_id, first_token_id, str_index);
-                } else {
-                  cooc_stat_holder.SavePairOfTokens(first_token_id, first_token_id, str_index, 2);
-                }
-              } else {
-                cooc_stat_holder.SavePairOfTokens(first_token_id, second_token_id, str_index);
-                cooc_stat_holder.SavePairOfTokens(second_token_id, first_token_id, str_index);
-              }
+            ForEachTokenInCoocWindow(strs, elem_index, first_token_class_id,
+                                     cooc_collector.config_.cooc_window_width(), &cooc_collector,
+                                     [&cooc_stat_holder, &local_num_of_pairs, first_token_id,
+                                      str_index](int second_token_id) {
+              cooc_stat_holder->SaveCooccurrence(first_token_id, second_token_id, str_index);
               local_num_of_pairs += 2;
-            }  // End of token's neghbors parsing
+            });  // End of token's neghbors parsing
           }  // End of token parsing
         }  // End of item parsing
 
         // dump all previous tokens, each as one transaction
         for (int i = 0; i < tokens.size(); ++i) {
-          batch_collector.RecordTransaction({ class_ids[i] }, { tokens[i] }, { weights[i] }, current_tt_name);
+          batch_collector.RecordTransaction(token_class_ids, tokens, weights, i, i + 1,
+                                            current_tt_name, &current_tt_id);
         }
 
         batch_collector.FinishItem(line_no, item_title);
+
+        // When the buffer is full, pairs are dumped between documents, so that cooc_df stays exact
+        if (collection_parser_config.gather_cooc() && cooc_stat_holder->IsFull()) {
+          cooc_collector.UploadOnDisk(cooc_stat_holder.get());
+        }
       }  // End of parsing the items of 1 batch
-      if (collection_parser_config.gather_cooc() && !cooc_stat_holder.Empty()) {
+      if (collection_parser_config.gather_cooc() && !cooc_stat_holder->Empty()) {
         // This function saves gathered statistics to the external storage
         // After saving to the external storage statistics from all the batches needs to be merged
         // This is implemented in ReadAndMergeCooccurrenceBatches(), so the next step is to call this method
         // Sorting is needed before storing all pairs of tokens to the external storage
         // (it's for the future aggregation)
-        cooc_collector.UploadOnDisk(cooc_stat_holder);
+        cooc_collector.UploadOnDisk(cooc_stat_holder.get());
       }
 
       if (all_strs_for_batch.size() > 0) {
-        artm::Batch batch;
-        {
-          std::lock_guard<std::mutex> guard(token_map_access);
-          batch = batch_collector.FinishBatch(&parser_info);
-          for (int token_id = 0; token_id < batch.token_size(); ++token_id) {
-            token_map[artm::core::Token(batch.class_id(token_id), batch.token(token_id))] = true;
-          }
-        }
-        ::artm::core::Helpers::SaveBatch(batch, collection_parser_config.target_folder(), batch_name);
+        artm::Batch batch = batch_collector.FinishBatch(&local_parser_info, &local_token_keys);
+
+        StoreBatch(&batch, batch_name, &local_manifest);
       }
     }  // End of collection parsing
 
+    {  // Merge token statistics of this worker
+      std::lock_guard<std::mutex> guard(parser_info_access);
+      parser_info.set_num_items(parser_info.num_items() + local_parser_info.num_items());
+      parser_info.set_num_tokens(parser_info.num_tokens() + local_parser_info.num_tokens());
+      parser_info.set_total_token_weight(parser_info.total_token_weight() + local_parser_info.total_token_weight());
+      parser_info.set_num_batches(parser_info.num_batches() + local_parser_info.num_batches());
+      token_keys.insert(local_token_keys.begin(), local_token_keys.end());
+    }
+
+    {
+      std::lock_guard<std::mutex> guard(manifest_access);
+      manifest.MergeFrom(local_manifest);
+    }
+
     {  // Save number of pairs (needed for ppmi)
       std::unique_lock<std::mutex> lock(cooc_config_access);
       total_num_of_pairs += local_num_of_pairs;
     }
-  };
 
-  int num_threads = 0;
-  if (!collection_parser_config.has_num_threads() || collection_parser_config.num_threads() < 0) {
-    int n = std::thread::hardware_concurrency();
-    if (n == 0) {
-      num_threads = 1;
-      LOG(INFO) << "CollectionParserConfig.num_threads is set to 1 (default)";
-    } else {
-      num_threads = n;
-      LOG(INFO) << "CollectionParserConfig.num_threads is automatically set to " << num_threads;
+    if (collection_parser_config.gather_cooc()) {  // Save number of pairs every token occurred in (needed for ppmi)
+      std::unique_lock<std::mutex> lock(token_statistics_access);
+      const std::vector<int64_t>& local_num_of_pairs_token_occurred_in =
+          cooc_stat_holder->num_of_pairs_token_occurred_in();
+      for (size_t token_id = 0; token_id < local_num_of_pairs_token_occurred_in.size(); ++token_id) {
+        cooc_collector.num_of_pairs_token_occurred_in_[token_id] += local_num_of_pairs_token_occurred_in[token_id];
+      }
     }
-  } else {
-    num_threads = collection_parser_config.num_threads();
+  };
+
+  if (batch_sink_ == nullptr) {
+    Helpers::CreateFolderIfNotExists(collection_parser_config.target_folder());
+  }
+
+  if (docword_data != nullptr) {
+    batch_begin = SplitIntoBatches(docword_data, stream_or_cin.size(),
+                                   collection_parser_config.num_items_per_batch(), std::max(1, num_threads));
   }
 
-  Helpers::CreateFolderIfNotExists(collection_parser_config.target_folder());
+  if (collection_parser_config.gather_cooc() && collection_parser_config.cooc_sketch_error() > 0) {
+    cooc_sketch = GatherCoocSketch(docword_data, batch_begin, std::max(1, num_threads), &cooc_collector);
+  }
 
   // The func may throw an exception if docword is malformed.
   // This exception will be re-thrown on the main thread.
-  // http://stackoverflow.com/questions/14222899/exception-propagation-and-stdfuture
-  std::vector<std::shared_future<void>> tasks;
-  for (int i = 0; i < num_threads; i++) {
-    tasks.push_back(std::move(std::async(std::launch::async, func)));
-  }
-  for (int i = 0; i < num_threads; i++) {
-    tasks[i].get();
+  RunInParallel(num_threads, [&func](int thread_index) { func(); });
+
+  if (manifest.entry_size() > 0) {
+    Helpers::UpdateBatchManifest(collection_parser_config.target_folder(), manifest);
   }
 
   if (gather_transaction_cooc) {
@@ -801,7 +1452,136 @@ CollectionParserInfo CollectionParser::ParseVowpalWabbit() {
     }
   }
 
-  parser_info.set_dictionary_size(token_map.size());
+  parser_info.set_dictionary_size(token_keys.size());
+  return parser_info;
+}
+
+// Gathers co-occurrences from batches in docword_file_path folder, new batches aren't created.
+// Tokens of an item are stored in the order of the document, so windows are the same as in ParseVowpalWabbit
+// (there are no modality markers and empty entries in batches, they don't take places in windows anyway).
+// Tokens of modalities which aren't in CollectionParserConfig.class_id still take places in windows here,
+// as they do in ParseVowpalWabbit. The exception is batches that were parsed with a class_id filter themselves:
+// they don't contain tokens of the filtered modalities, so windows are shorter than in the original VW file,
+// where these tokens are counted (see ForEachTokenInCoocWindow), and co-occurrences may differ.
+// Batches are processed in parallel, the rest (cooc batches, merging, ppmi) is the same as for VW files
+CollectionParserInfo CollectionParser::GatherCoocFromBatches() {
+  auto collection_parser_config = config_;
+  if (!collection_parser_config.gather_cooc()) {
+    BOOST_THROW_EXCEPTION(InvalidOperation(
+      "Only co-occurrences can be gathered from batches, CollectionParserConfig.gather_cooc must be set"));
+  }
+  // Cooc batches are temporarily stored in the folder with batches, unless another folder is given
+  if (!collection_parser_config.has_target_folder()) {
+    collection_parser_config.set_target_folder(collection_parser_config.docword_file_path());
+  }
+
+  const std::vector<boost::filesystem::path> batches =
+      Helpers::ListAllBatches(collection_parser_config.docword_file_path());
+  if (batches.empty()) {
+    BOOST_THROW_EXCEPTION(DiskReadException("No batches found in " + collection_parser_config.docword_file_path()));
+  }
+
+  ::artm::core::CooccurrenceCollector cooc_collector(collection_parser_config);
+  const int vocab_size = static_cast<int>(cooc_collector.VocabSize());
+  const int num_threads = std::max(1, GetNumThreads(collection_parser_config));
+  const int64_t max_num_of_pairs_per_thread = GetMaxNumOfPairsPerThread(collection_parser_config, num_threads);
+
+  std::mutex token_statistics_access;
+  std::atomic<int> next_batch(0);
+  int64_t total_num_of_pairs = 0;
+  CollectionParserInfo parser_info;
+
+  RunInParallel(num_threads, [&batches, &collection_parser_config, &cooc_collector, &token_statistics_access,
+                              &next_batch, &total_num_of_pairs, &parser_info, vocab_size,
+                              max_num_of_pairs_per_thread](int thread_index) {
+    const unsigned cooc_window_width = collection_parser_config.cooc_window_width();
+    CooccurrenceStatisticsHolder cooc_stat_holder(vocab_size,
+        collection_parser_config.store_symmetric_cooc_values(), max_num_of_pairs_per_thread);
+    std::vector<unsigned> local_num_of_documents_token_occurred_in(vocab_size, 0);
+    std::vector<int> num_of_the_last_document_token_occurred_in(vocab_size, -1);
+    CollectionParserInfo local_parser_info;
+    int64_t local_num_of_pairs = 0;
+
+    Batch batch;
+    for (int batch_index = next_batch++; batch_index < static_cast<int>(batches.size()); batch_index = next_batch++) {
+      Helpers::LoadMessage(batches[batch_index].string(), &batch);
+
+      // Tokens of the batch are found in vocab once, modalities are compared as indices in the batch
+      std::vector<int> token_ids(batch.token_size(), TOKEN_NOT_FOUND);
+      std::vector<int> class_indices(batch.token_size(), 0);
+      std::unordered_map<ClassId, int> class_index_map;
+      for (int i = 0; i < batch.token_size(); ++i) {
+        const ClassId class_id = (i < batch.class_id_size()) ? batch.class_id(i) : DefaultClass;
+        class_indices[i] = class_index_map.emplace(class_id, class_index_map.size()).first->second;
+        if (useClassId(class_id, collection_parser_config)) {
+          token_ids[i] = cooc_collector.FindTokenIdInVocab(batch.token(i), class_id);
+        }
+      }
+
+      std::fill(num_of_the_last_document_token_occurred_in.begin(),
+                num_of_the_last_document_token_occurred_in.end(), -1);
+      for (int item_index = 0; item_index < batch.item_size(); ++item_index) {
+        const Item& item = batch.item(item_index);
+        const int num_tokens = item.token_id_size();
+        for (int i = 0; i < num_tokens; ++i) {
+          const int first_token_id = token_ids[item.token_id(i)];
+          if (first_token_id == TOKEN_NOT_FOUND) {
+            continue;
+          }
+          if (num_of_the_last_document_token_occurred_in[first_token_id] != item_index) {
+            num_of_the_last_document_token_occurred_in[first_token_id] = item_index;
+            ++local_num_of_documents_token_occurred_in[first_token_id];
+          }
+
+          const int first_class_index = class_indices[item.token_id(i)];
+          const int window_end = static_cast<int>(std::min<int64_t>(num_tokens, i + 1 + cooc_window_width));
+          for (int j = i + 1; j < window_end; ++j) {
+            // Take into consideration only tokens from the same modality
+            const int second_token_id = token_ids[item.token_id(j)];
+            if (second_token_id == TOKEN_NOT_FOUND || class_indices[item.token_id(j)] != first_class_index) {
+              continue;
+            }
+            cooc_stat_holder.SaveCooccurrence(first_token_id, second_token_id, item_index);
+            local_num_of_pairs += 2;
+          }
+        }
+
+        // When the buffer is full, pairs are dumped between documents, so that cooc_df stays exact
+        if (cooc_stat_holder.IsFull()) {
+          cooc_collector.UploadOnDisk(&cooc_stat_holder);
+        }
+      }
+      if (!cooc_stat_holder.Empty()) {
+        cooc_collector.UploadOnDisk(&cooc_stat_holder);
+      }
+
+      local_parser_info.set_num_items(local_parser_info.num_items() + batch.item_size());
+      local_parser_info.set_num_batches(local_parser_info.num_batches() + 1);
+    }
+
+    {  // Merge statistics of this worker
+      std::lock_guard<std::mutex> guard(token_statistics_access);
+      parser_info.set_num_items(parser_info.num_items() + local_parser_info.num_items());
+      parser_info.set_num_batches(parser_info.num_batches() + local_parser_info.num_batches());
+      total_num_of_pairs += local_num_of_pairs;
+      const std::vector<int64_t>& local_num_of_pairs_token_occurred_in =
+          cooc_stat_holder.num_of_pairs_token_occurred_in();
+      for (int token_id = 0; token_id < vocab_size; ++token_id) {
+        cooc_collector.num_of_documents_token_occurred_in_[token_id] +=
+            local_num_of_documents_token_occurred_in[token_id];
+        cooc_collector.num_of_pairs_token_occurred_in_[token_id] += local_num_of_pairs_token_occurred_in[token_id];
+      }
+    }
+  });
+
+  cooc_collector.config_.set_total_num_of_pairs(total_num_of_pairs);
+  cooc_collector.config_.set_total_num_of_documents(parser_info.num_items());
+
+  // Launch merging of co-occurrence bathces and ppmi calculation
+  if (cooc_collector.VocabSize() >= 2 && cooc_collector.NumOfCooccurrenceBatches() != 0) {
+    cooc_collector.ReadAndMergeCooccurrenceBatches();
+  }
+
   return parser_info;
 }
 
@@ -819,12 +1599,48 @@ CollectionParserInfo CollectionParser::Parse() {
     case CollectionParserConfig_CollectionFormat_VowpalWabbit:
       return ParseVowpalWabbit();
 
+    case CollectionParserConfig_CollectionFormat_Batches:
+      return GatherCoocFromBatches();
+
     default:
       BOOST_THROW_EXCEPTION(ArgumentOutOfRangeException(
         "CollectionParserConfig.format", config_.format()));
   }
 }
 
+CollectionStream::CollectionStream(const ::artm::CollectionParserConfig& config, int capacity)
+    : queue_(static_cast<size_t>(std::max(capacity, 1))) {
+  parser_ = std::async(std::launch::async, [this, config]() {
+    call_on_destruction c([this]() { queue_.close(); });  // NOLINT
+    CollectionParser parser(config, [this](std::shared_ptr<Batch> batch) {
+      if (!queue_.push(batch)) {
+        BOOST_THROW_EXCEPTION(InvalidOperation("Collection stream was closed before the parser has finished"));
+      }
+    });
+    parser.Parse();
+  });
+}
+
+CollectionStream::~CollectionStream() {
+  queue_.close();
+  if (parser_.valid()) {
+    try { parser_.get(); }
+    catch (...) { }
+  }
+}
+
+std::shared_ptr<Batch> CollectionStream::Next() {
+  std::shared_ptr<Batch> batch;
+  if (queue_.pop(&batch)) {
+    return batch;
+  }
+
+  if (parser_.valid()) {
+    parser_.get();  // re-throws the exception of the parser, if any
+  }
+  return nullptr;
+}
+
 }  // namespace core
 }  // namespace artm
 // vim: set ts=2 sw=2:
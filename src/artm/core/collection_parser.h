@@ -2,6 +2,8 @@
 
 #pragma once
 
+#include <functional>
+#include <future>  // NOLINT
 #include <map>
 #include <memory>
 #include <set>
@@ -15,6 +17,7 @@
 #include "artm/core/common.h"
 #include "artm/core/token.h"
 #include "artm/core/cooccurrence_collector.h"
+#include "artm/core/thread_safe_holder.h"
 
 namespace artm {
 namespace core {
@@ -34,10 +37,18 @@ class BatchNameGenerator {
 
 std::string DropWeightSuffix(const std::string& token);
 
+class CooccurrenceCollector;
+class CooccurrenceSketch;
+
 // CollectionParser class is responsible for parsing all text formats, available in BigARTM (UCI Bow and VW parser).
 class CollectionParser : boost::noncopyable {
  public:
+  // BatchSink receives batches instead of saving them into CollectionParserConfig.target_folder.
+  // The sink may be called concurrently from several parser threads; it may throw to stop parsing.
+  typedef std::function<void(std::shared_ptr<Batch>)> BatchSink;
+
   explicit CollectionParser(const ::artm::CollectionParserConfig& config);
+  CollectionParser(const ::artm::CollectionParserConfig& config, BatchSink batch_sink);
 
   // Parses the collection from disk according to all options,
   // specified in CollectionParserConfig.
@@ -58,16 +69,46 @@ class CollectionParser : boost::noncopyable {
   typedef std::unordered_map<int, CollectionParserTokenInfo> TokenMap;
 
   class BatchCollector;
+  class UciBatchCollector;
 
   // ParseDocwordBagOfWordsUci is also used to parse MatrixMarket format, because
   // the format of docword file is the same for both.
   CollectionParserInfo ParseDocwordBagOfWordsUci(TokenMap* token_map);
   CollectionParserInfo ParseVowpalWabbit();
+  CollectionParserInfo GatherCoocFromBatches();
+  // Counts co-occurrences approximately in an extra pass over the collection (if cooc_sketch_error is positive)
+  std::unique_ptr<CooccurrenceSketch> GatherCoocSketch(const char* docword_data, const std::vector<size_t>& batch_begin,
+                                                       int num_threads, CooccurrenceCollector* cooc_collector);
 
   TokenMap ParseVocabBagOfWordsUci();
   TokenMap ParseVocabMatrixMarket();
 
+  // Saves the batch to target_folder (adding an entry to the manifest), or passes it to batch_sink_.
+  void StoreBatch(Batch* batch, const std::string& batch_name, BatchManifest* manifest);
+
   CollectionParserConfig config_;
+  BatchSink batch_sink_;
+};
+
+// CollectionStream runs CollectionParser on a background thread and passes parsed batches
+// to the consumer through a bounded in-memory queue, so that the batches can be processed
+// while the rest of the collection is being parsed, and without saving them to disk.
+// The parser is paused whenever the consumer falls behind by more than capacity batches.
+// Batches produced by several parser threads may arrive in any order.
+class CollectionStream : boost::noncopyable {
+ public:
+  CollectionStream(const ::artm::CollectionParserConfig& config, int capacity);
+
+  // Stops the parser if the collection was not consumed till the end.
+  ~CollectionStream();
+
+  // Blocks until the next batch is parsed. Returns nullptr after the last batch;
+  // errors of the parser are re-thrown at this point.
+  std::shared_ptr<Batch> Next();
+
+ private:
+  ThreadSafeBoundedQueue<std::shared_ptr<Batch>> queue_;
+  std::future<void> parser_;
 };
 
 }  // namespace core
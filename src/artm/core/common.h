@@ -36,6 +36,7 @@ typedef std::string TopicName;
 const int UnknownId = -1;
 
 const std::string kBatchExtension = ".batch";
+const std::string kBatchManifestFilename = "batches.manifest";
 
 const int kIdleLoopFrequency = 1;  // 1 ms
 
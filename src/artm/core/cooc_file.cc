@@ -0,0 +1,209 @@
+// Copyright 2017, Additive Regularization of Topic Models.
+
+#include "artm/core/cooc_file.h"
+
+#include <cstring>
+#include <sstream>
+
+#include "boost/filesystem.hpp"
+
+#include "artm/core/common.h"
+#include "artm/core/exceptions.h"
+
+namespace fs = boost::filesystem;
+
+namespace artm {
+namespace core {
+
+namespace {
+
+// The first byte is not ASCII, so a binary file can not be mistaken for a text co-occurrence file.
+const char kCoocFileMagic[8] = { '\x89', 'C', 'O', 'O', 'C', '\r', '\n', '\x1a' };
+const int32_t kCoocFileVersion = 1;
+
+}  // namespace
+
+CoocFileWriter::CoocFileWriter(const std::string& file_name, const std::vector<Token>& tokens)
+    : file_name_(file_name), values_file_name_(file_name + ".values"),
+      row_ptr_(tokens.size() + 1, 0), vocab_bytes_(0), last_row_(-1), last_col_(-1) {
+  out_.open(file_name_, std::ios::out | std::ios::binary | std::ios::trunc);
+  values_out_.open(values_file_name_, std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!out_.is_open() || !values_out_.is_open()) {
+    BOOST_THROW_EXCEPTION(DiskWriteException("Unable to create co-occurrence file " + file_name_));
+  }
+
+  // The header is written again by Close(), when num_values is known
+  CoocFileHeader header;
+  std::memset(&header, 0, sizeof(header));
+  out_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+  std::stringstream vocab;
+  for (const auto& token : tokens) {
+    vocab << token.keyword() << ' ' << token.class_id() << '\n';
+  }
+  std::string vocab_str = vocab.str();
+  vocab_str.resize((vocab_str.size() + 7) / 8 * 8, '\0');
+  out_.write(vocab_str.data(), vocab_str.size());
+  vocab_bytes_ = vocab_str.size();
+}
+
+CoocFileWriter::~CoocFileWriter() {
+  if (out_.is_open()) {
+    // The file was not completed, so it is removed rather than left corrupted
+    out_.close();
+    values_out_.close();
+    boost::system::error_code error_code;
+    fs::remove(file_name_, error_code);
+    fs::remove(values_file_name_, error_code);
+  }
+}
+
+void CoocFileWriter::AddValue(int row, int col, float value) {
+  if (!out_.is_open()) {
+    return;
+  }
+
+  const int num_tokens = static_cast<int>(row_ptr_.size()) - 1;
+  if (row < 0 || row >= num_tokens || col < 0 || col >= num_tokens) {
+    BOOST_THROW_EXCEPTION(InvalidOperation("Token index is out of range in co-occurrence file " + file_name_));
+  }
+
+  if (row < last_row_ || (row == last_row_ && col <= last_col_)) {
+    BOOST_THROW_EXCEPTION(InvalidOperation(
+      "Co-occurrences must be written in ascending order of token indices, file " + file_name_));
+  }
+
+  out_.write(reinterpret_cast<const char*>(&col), sizeof(col));
+  values_out_.write(reinterpret_cast<const char*>(&value), sizeof(value));
+  row_ptr_[row + 1]++;
+  last_row_ = row;
+  last_col_ = col;
+}
+
+void CoocFileWriter::Close() {
+  if (!out_.is_open()) {
+    return;
+  }
+
+  for (size_t i = 1; i < row_ptr_.size(); ++i) {
+    row_ptr_[i] += row_ptr_[i - 1];
+  }
+  const int64_t num_values = row_ptr_.back();
+
+  values_out_.close();
+  if (num_values > 0) {
+    std::ifstream values_in(values_file_name_, std::ios::in | std::ios::binary);
+    out_ << values_in.rdbuf();
+  }
+  out_.write(reinterpret_cast<const char*>(row_ptr_.data()), sizeof(int64_t) * row_ptr_.size());
+
+  CoocFileHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, kCoocFileMagic, sizeof(header.magic));
+  header.version = kCoocFileVersion;
+  header.num_tokens = static_cast<int32_t>(row_ptr_.size() - 1);
+  header.num_values = num_values;
+  header.vocab_bytes = vocab_bytes_;
+  out_.seekp(0);
+  out_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+  bool ok = out_.good();
+  out_.close();
+  boost::system::error_code error_code;
+  fs::remove(values_file_name_, error_code);
+  if (!ok) {
+    BOOST_THROW_EXCEPTION(DiskWriteException("Unable to write co-occurrence file " + file_name_));
+  }
+}
+
+bool CoocFile::IsCoocFile(const std::string& file_name) {
+  std::ifstream fin(file_name, std::ios::in | std::ios::binary);
+  char magic[sizeof(kCoocFileMagic)];
+  if (!fin.read(magic, sizeof(magic))) {
+    return false;
+  }
+  return std::memcmp(magic, kCoocFileMagic, sizeof(magic)) == 0;
+}
+
+std::shared_ptr<CoocFile> CoocFile::Open(const std::string& file_name) {
+  if (!fs::exists(file_name) || !fs::is_regular_file(file_name)) {
+    BOOST_THROW_EXCEPTION(DiskReadException("File " + file_name + " does not exist"));
+  }
+
+  const uint64_t file_size = fs::file_size(file_name);
+  if (file_size < sizeof(CoocFileHeader)) {
+    BOOST_THROW_EXCEPTION(CorruptedMessageException("Co-occurrence file " + file_name + " is truncated"));
+  }
+
+  std::shared_ptr<CoocFile> cooc_file(new CoocFile());
+  cooc_file->file_.open(file_name);
+  if (!cooc_file->file_.is_open()) {
+    BOOST_THROW_EXCEPTION(DiskReadException("Unable to open file " + file_name));
+  }
+  const char* data = cooc_file->file_.data();
+
+  CoocFileHeader header;
+  std::memcpy(&header, data, sizeof(header));
+  if (std::memcmp(header.magic, kCoocFileMagic, sizeof(header.magic)) != 0) {
+    BOOST_THROW_EXCEPTION(CorruptedMessageException(file_name + " is not a binary co-occurrence file"));
+  }
+
+  if (header.version != kCoocFileVersion) {
+    std::stringstream ss;
+    ss << "Unsupported version " << header.version << " of co-occurrence file " << file_name;
+    BOOST_THROW_EXCEPTION(CorruptedMessageException(ss.str()));
+  }
+
+  if (header.num_tokens < 0 || header.num_values < 0 || header.vocab_bytes < 0 || header.vocab_bytes % 8 != 0 ||
+      file_size != sizeof(header) + header.vocab_bytes + (sizeof(int) + sizeof(float)) * header.num_values +
+                   sizeof(int64_t) * (header.num_tokens + 1)) {
+    BOOST_THROW_EXCEPTION(CorruptedMessageException("Co-occurrence file " + file_name + " has invalid size"));
+  }
+
+  const char* vocab = data + sizeof(header);
+  const char* vocab_end = vocab + header.vocab_bytes;
+  cooc_file->tokens_.reserve(header.num_tokens);
+  TokenBuilder token_builder;
+  for (const char* line = vocab; line < vocab_end && *line != '\0'; ) {
+    const char* line_end = static_cast<const char*>(std::memchr(line, '\n', vocab_end - line));
+    const char* space = line_end ? static_cast<const char*>(std::memchr(line, ' ', line_end - line)) : nullptr;
+    if (space == nullptr) {
+      BOOST_THROW_EXCEPTION(CorruptedMessageException("Co-occurrence file " + file_name + " has invalid vocab"));
+    }
+    cooc_file->tokens_.push_back(token_builder.Intern(ClassId(space + 1, line_end), std::string(line, space)));
+    line = line_end + 1;
+  }
+
+  if (cooc_file->num_tokens() != header.num_tokens) {
+    BOOST_THROW_EXCEPTION(CorruptedMessageException("Co-occurrence file " + file_name + " has invalid vocab"));
+  }
+
+  cooc_file->num_values_ = header.num_values;
+  cooc_file->col_ = reinterpret_cast<const int*>(vocab_end);
+  cooc_file->value_ = reinterpret_cast<const float*>(cooc_file->col_ + header.num_values);
+  cooc_file->row_ptr_ = reinterpret_cast<const int64_t*>(cooc_file->value_ + header.num_values);
+
+  // Validate the structure once, so that users of the file may rely on it
+  const int64_t* row_ptr = cooc_file->row_ptr_;
+  const int* col = cooc_file->col_;
+  bool valid = (row_ptr[0] == 0) && (row_ptr[header.num_tokens] == header.num_values);
+  for (int row = 0; valid && row < header.num_tokens; ++row) {
+    valid = row_ptr[row + 1] >= row_ptr[row];
+  }
+
+  for (int row = 0; valid && row < header.num_tokens; ++row) {
+    for (int64_t i = row_ptr[row]; valid && i < row_ptr[row + 1]; ++i) {
+      valid = col[i] >= 0 && col[i] < header.num_tokens && (i == row_ptr[row] || col[i] > col[i - 1]);
+    }
+  }
+
+  if (!valid) {
+    BOOST_THROW_EXCEPTION(CorruptedMessageException("Co-occurrence file " + file_name + " is corrupted"));
+  }
+
+  return cooc_file;
+}
+
+}  // namespace core
+}  // namespace artm
+// vim: set ts=2 sw=2:
@@ -0,0 +1,96 @@
+// Copyright 2017, Additive Regularization of Topic Models.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "boost/iostreams/device/mapped_file.hpp"
+#include "boost/utility.hpp"
+
+#include "artm/core/token.h"
+
+namespace artm {
+namespace core {
+
+// Binary co-occurrence file stores a sparse matrix of co-occurrence values (cooc tf, cooc df or ppmi)
+// in compressed sparse rows, so that it can be memory-mapped and used without parsing.
+// Rows and columns are indices of tokens in the vocabulary of the file. The layout is:
+//   header   - CoocFileHeader (32 bytes);
+//   vocab    - header.vocab_bytes bytes, one "<keyword> <class_id>\n" line per token, padded with zeros
+//              to a multiple of 8 bytes;
+//   col      - header.num_values int32 columns, sorted and unique within each row;
+//   value    - header.num_values float values;
+//   row_ptr  - header.num_tokens + 1 int64 offsets of rows in col and value arrays.
+// All numbers are stored in the native byte order.
+struct CoocFileHeader {
+  char magic[8];
+  int32_t version;
+  int32_t num_tokens;
+  int64_t num_values;
+  int64_t vocab_bytes;
+};
+
+// CoocFileWriter writes a binary co-occurrence file row by row.
+// Values are streamed to a temporary file next to the target, so memory usage does not depend on num_values.
+class CoocFileWriter : private boost::noncopyable {
+ public:
+  CoocFileWriter(const std::string& file_name, const std::vector<Token>& tokens);
+  ~CoocFileWriter();
+
+  // Rows must be added in ascending order, and columns must be ascending within a row.
+  void AddValue(int row, int col, float value);
+
+  // Completes the file. Values added after Close() are ignored.
+  void Close();
+
+  // The number of files the writer keeps open (the file itself and a temporary file of values).
+  int num_open_files() const {
+    return static_cast<int>(out_.is_open()) + static_cast<int>(values_out_.is_open());
+  }
+
+ private:
+  std::string file_name_;
+  std::string values_file_name_;
+  std::ofstream out_;
+  std::ofstream values_out_;
+  std::vector<int64_t> row_ptr_;
+  int64_t vocab_bytes_;
+  int last_row_;
+  int last_col_;
+};
+
+// CoocFile is a read-only view of a binary co-occurrence file, mapped into memory.
+class CoocFile : private boost::noncopyable {
+ public:
+  // Returns true if the file starts with the signature of a binary co-occurrence file.
+  static bool IsCoocFile(const std::string& file_name);
+
+  // Maps the file and validates its structure. Throws DiskReadException or CorruptedMessageException.
+  static std::shared_ptr<CoocFile> Open(const std::string& file_name);
+
+  const std::vector<Token>& tokens() const { return tokens_; }
+  int num_tokens() const { return static_cast<int>(tokens_.size()); }
+  int64_t num_values() const { return num_values_; }
+
+  const int64_t* row_ptr() const { return row_ptr_; }
+  const int* col() const { return col_; }
+  const float* value() const { return value_; }
+
+ private:
+  CoocFile() : num_values_(0), row_ptr_(nullptr), col_(nullptr), value_(nullptr) { }
+
+  boost::iostreams::mapped_file_source file_;
+  std::vector<Token> tokens_;
+  int64_t num_values_;
+  const int64_t* row_ptr_;
+  const int* col_;
+  const float* value_;
+};
+
+}  // namespace core
+}  // namespace artm
@@ -0,0 +1,195 @@
+// Copyright 2017, Additive Regularization of Topic Models.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+namespace artm {
+namespace core {
+
+// CoocMatrix is a sparse matrix of co-occurrence statistics, indexed by positions of tokens in the dictionary.
+// The matrix is filled in two phases. During construction Add() appends (row, col, value) triples
+// to a pending list; Freeze() converts them into compressed sparse rows (CSR): one array of row offsets,
+// and two arrays with columns (sorted within each row) and values. Readers only see the frozen part,
+// so scans of a row are sequential and a single value is found by binary search.
+// If the same (row, col) pair is added several times, the first value is kept.
+// Alternatively, Attach() turns the matrix into a read-only view of CSR arrays owned by someone else
+// (for example, a memory-mapped co-occurrence file, see CoocFile), without copying them.
+class CoocMatrix {
+ public:
+  // Row is a lightweight view of one row of the frozen matrix.
+  class Row {
+   public:
+    Row() : col_(nullptr), value_(nullptr), size_(0) { }
+    Row(const int* col, const float* value, int size) : col_(col), value_(value), size_(size) { }
+
+    int size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    int col(int index) const { return col_[index]; }
+    float value(int index) const { return value_[index]; }
+
+    // Returns nullptr if the row has no value in the column.
+    const float* find(int col) const {
+      const int* iter = std::lower_bound(col_, col_ + size_, col);
+      if (iter == col_ + size_ || *iter != col) {
+        return nullptr;
+      }
+      return value_ + (iter - col_);
+    }
+
+   private:
+    const int* col_;
+    const float* value_;
+    int size_;
+  };
+
+  CoocMatrix() : num_rows_(0), num_nonempty_rows_(0), external_row_ptr_(nullptr),
+                 external_col_(nullptr), external_value_(nullptr) { }
+
+  void Add(int row, int col, float value) { pending_.push_back({ row, col, value }); }
+
+  // Merges pending triples into the frozen arrays.
+  void Freeze() {
+    if (pending_.empty()) {
+      return;
+    }
+
+    // Values that are already frozen were added earlier, so they go first and win over duplicates.
+    std::vector<Triple> triples;
+    triples.reserve(size() + pending_.size());
+    for (int row_index = 0; row_index < num_rows_; ++row_index) {
+      Row frozen_row = row(row_index);
+      for (int i = 0; i < frozen_row.size(); ++i) {
+        triples.push_back({ row_index, frozen_row.col(i), frozen_row.value(i) });
+      }
+    }
+    triples.insert(triples.end(), pending_.begin(), pending_.end());
+    std::vector<Triple>().swap(pending_);
+
+    // Triples often come already ordered (e.g. from an exported dictionary), then sorting is skipped.
+    auto less = [](const Triple& lhs, const Triple& rhs) {
+      return lhs.row < rhs.row || (lhs.row == rhs.row && lhs.col < rhs.col);
+    };
+    if (!std::is_sorted(triples.begin(), triples.end(), less)) {
+      std::stable_sort(triples.begin(), triples.end(), less);
+    }
+
+    const int num_rows = triples.empty() ? 0 : triples.back().row + 1;
+    std::vector<int64_t> row_ptr(num_rows + 1, 0);
+    std::vector<int> col;
+    std::vector<float> value;
+    col.reserve(triples.size());
+    value.reserve(triples.size());
+    num_nonempty_rows_ = 0;
+    for (size_t i = 0; i < triples.size(); ++i) {
+      const Triple& triple = triples[i];
+      if (i > 0 && triple.row == triples[i - 1].row && triple.col == triples[i - 1].col) {
+        continue;
+      }
+      if (i == 0 || triple.row != triples[i - 1].row) {
+        num_nonempty_rows_++;
+      }
+
+      row_ptr[triple.row + 1]++;
+      col.push_back(triple.col);
+      value.push_back(triple.value);
+    }
+
+    for (int row = 0; row < num_rows; ++row) {
+      row_ptr[row + 1] += row_ptr[row];
+    }
+
+    row_ptr_.swap(row_ptr);
+    col_.swap(col);
+    value_.swap(value);
+    num_rows_ = num_rows;
+    external_.reset();
+  }
+
+  // Replaces the frozen part of the matrix with a view of external CSR arrays: row_ptr has num_rows + 1 offsets,
+  // columns must be sorted and unique within each row. The arrays must stay valid while holder is alive.
+  void Attach(std::shared_ptr<const void> holder, int num_rows,
+              const int64_t* row_ptr, const int* col, const float* value) {
+    std::vector<int64_t>().swap(row_ptr_);
+    std::vector<int>().swap(col_);
+    std::vector<float>().swap(value_);
+
+    external_ = holder;
+    external_row_ptr_ = row_ptr;
+    external_col_ = col;
+    external_value_ = value;
+    num_rows_ = num_rows;
+    num_nonempty_rows_ = 0;
+    for (int row = 0; row < num_rows; ++row) {
+      if (row_ptr[row + 1] > row_ptr[row]) {
+        num_nonempty_rows_++;
+      }
+    }
+  }
+
+  // Returns an empty row if the row is not in the matrix.
+  Row row(int index) const {
+    if (index < 0 || index >= num_rows_) {
+      return Row();
+    }
+    const int64_t* row_ptr = row_ptr_data();
+    const int64_t begin = row_ptr[index];
+    return Row(col_data() + begin, value_data() + begin, static_cast<int>(row_ptr[index + 1] - begin));
+  }
+
+  // Number of rows with at least one value.
+  int num_nonempty_rows() const { return num_nonempty_rows_; }
+
+  // Number of stored values.
+  int64_t size() const { return num_rows_ > 0 ? row_ptr_data()[num_rows_] : 0; }
+  bool empty() const { return size() == 0; }
+
+  // True if the matrix is a view of external arrays (see Attach()).
+  bool is_attached() const { return external_ != nullptr; }
+
+  void clear() {
+    std::vector<Triple>().swap(pending_);
+    std::vector<int64_t>().swap(row_ptr_);
+    std::vector<int>().swap(col_);
+    std::vector<float>().swap(value_);
+    external_.reset();
+    num_rows_ = 0;
+    num_nonempty_rows_ = 0;
+  }
+
+  // Attached arrays are not counted.
+  int64_t ByteSize() const {
+    return sizeof(*this) + sizeof(Triple) * pending_.capacity() + sizeof(int64_t) * row_ptr_.capacity() +
+           sizeof(int) * col_.capacity() + sizeof(float) * value_.capacity();
+  }
+
+ private:
+  struct Triple {
+    int row;
+    int col;
+    float value;
+  };
+
+  const int64_t* row_ptr_data() const { return is_attached() ? external_row_ptr_ : row_ptr_.data(); }
+  const int* col_data() const { return is_attached() ? external_col_ : col_.data(); }
+  const float* value_data() const { return is_attached() ? external_value_ : value_.data(); }
+
+  std::vector<Triple> pending_;
+  std::vector<int64_t> row_ptr_;  // empty, or num_rows_ + 1 offsets into col_ and value_
+  std::vector<int> col_;
+  std::vector<float> value_;
+  int num_rows_;
+  int num_nonempty_rows_;
+
+  std::shared_ptr<const void> external_;
+  const int64_t* external_row_ptr_;
+  const int* external_col_;
+  const float* external_value_;
+};
+
+}  // namespace core
+}  // namespace artm
@@ -4,6 +4,9 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <condition_variable>  // NOLINT
+#include <cstring>
 #include <iomanip>
 #include <iostream>
 #include <fstream>
@@ -27,6 +30,7 @@
 #include "boost/uuid/uuid_io.hpp"
 #include "boost/uuid/uuid_generators.hpp"
 
+#include "artm/core/call_on_destruction.h"
 #include "artm/core/collection_parser.h"
 #include "artm/core/common.h"
 #include "artm/core/exceptions.h"
@@ -48,6 +52,22 @@ namespace core {
 
 // ToDo (MichaelSolotky): search for all bad-written parts of code with CLion
 
+namespace {
+
+// Varints are used to store numbers in cooc batches: 7 bits of the value per byte, lower bits go first,
+// the highest bit of a byte is set if there are more bytes
+const size_t kMaxVarintSize = 10;
+
+void AppendVarint(uint64_t value, std::string* buffer) {
+  while (value >= 0x80) {
+    buffer->push_back(static_cast<char>((value & 0x7F) | 0x80));
+    value >>= 7;
+  }
+  buffer->push_back(static_cast<char>(value));
+}
+
+}  // namespace
+
 // ************************************ Methods of class CooccurrenceCollector ************************************
 
 CooccurrenceCollector::CooccurrenceCollector(
@@ -57,12 +77,14 @@ CooccurrenceCollector::CooccurrenceCollector(
     config_.set_gather_cooc_tf(collection_parser_config.gather_cooc_tf());
     config_.set_gather_cooc_df(collection_parser_config.gather_cooc_df());
     config_.set_store_symmetric_cooc_values(collection_parser_config.store_symmetric_cooc_values());
+    config_.set_binary_cooc_files(collection_parser_config.binary_cooc_files());
     config_.set_vw_file_path(collection_parser_config.docword_file_path());
 
     if (collection_parser_config.has_vocab_file_path()) {
       config_.set_vocab_file_path(collection_parser_config.vocab_file_path());
       vocab_ = Vocab(config_.vocab_file_path());
       num_of_documents_token_occurred_in_.resize(vocab_.token_map_.size());
+      num_of_pairs_token_occurred_in_.resize(vocab_.token_map_.size());
     } else {
       BOOST_THROW_EXCEPTION(InvalidOperation("No vocab file specified. Can't gather co-occurrences"));
     }
@@ -107,18 +129,17 @@ CooccurrenceCollector::CooccurrenceCollector(
     max_num_of_open_files_in_a_process -= 10;
     config_.set_max_num_of_open_files_in_a_process(max_num_of_open_files_in_a_process);
 
-    if (!collection_parser_config.has_num_threads() || collection_parser_config.num_threads() < 0) {
+    // Every merging thread keeps at most one co-occurrence batch open at a time
+    if (!collection_parser_config.has_num_threads() || collection_parser_config.num_threads() <= 0) {
       int n = std::thread::hardware_concurrency();
       if (n == 0) {
         config_.set_num_threads(1);
         LOG(INFO) << "CooccurrenceCollectorConfig.num_threads is set to 1 (default)";
       } else {
-        // In agglomerative merge a larger number of threads would be suboptimal
         config_.set_num_threads(std::min(n, max_num_of_open_files_in_a_process / 3));
         LOG(INFO) << "CooccurrenceCollectorConfig.num_threads is automatically set to " << config_.num_threads();
       }
     } else {
-      // In agglomerative merge a larger number of threads would be suboptimal
       config_.set_num_threads(std::min(collection_parser_config.num_threads(),
                                        max_num_of_open_files_in_a_process / 3));
     }
@@ -188,22 +209,30 @@ std::vector<std::string> CooccurrenceCollector::ReadPortionOfDocuments(
   return portion;
 }
 
-void CooccurrenceCollector::UploadOnDisk(const CooccurrenceStatisticsHolder& cooc_stat_holder) {
+void CooccurrenceCollector::UploadOnDisk(CooccurrenceStatisticsHolder* cooc_stat_holder) {
   // Uploading is implemented as folowing:
-  // 1. Create a batch which is associated with a specific file on a disk
-  // 2. For every first token id create an object Cell and for every second token
+  // 1. Sort pairs in cooccurrence statistics holder
+  // 2. Create a batch which is associated with a specific file on a disk
+  // 3. For every first token id create an object Cell and for every second token
   // that co-occurred with first write it's id, cooc_tf, cooc_df
-  // 3. Write the cell in output file and continue the cicle while there are
+  // 4. Write the cell in output file and continue the cicle while there are
   // first token ids in cooccurrence statistics holder
   // Note that there can't be two cells stored in ram simultaniously
-  // 4. Save batch in vector of objects
+  // 5. Save batch in vector of objects and clear the holder
+  cooc_stat_holder->SortPairs();
+  const std::vector<CooccurrenceStatisticsHolder::PairOfTokens>& pairs = cooc_stat_holder->pairs_;
+
   std::shared_ptr<CooccurrenceBatch> batch(CreateNewCooccurrenceBatch());
   OpenBatchOutputFile(batch);
-  for (auto iter = cooc_stat_holder.storage_.begin(); iter != cooc_stat_holder.storage_.end(); ++iter) {
-    batch->FormNewCell(iter);
+  for (size_t begin = 0, end = 0; begin < pairs.size(); begin = end) {
+    while (end < pairs.size() && pairs[end].first_token_id == pairs[begin].first_token_id) {
+      ++end;
+    }
+    batch->FormNewCell(pairs.data() + begin, pairs.data() + end);
     batch->WriteCell();
   }
   CloseBatchOutputFile(batch);
+  cooc_stat_holder->Clear();
   {
     std::unique_lock<std::mutex> vector_of_batches_access_lock(vector_of_batches_access_mutex_);
     vector_of_batches_.push_back(std::move(batch));
@@ -219,7 +248,7 @@ void CooccurrenceCollector::OpenBatchOutputFile(std::shared_ptr<CooccurrenceBatc
   if (!batch->out_batch_.is_open()) {
     std::unique_lock<std::mutex> open_close_file_lock(open_close_file_mutex_);
     assert(open_files_counter_ < config_.max_num_of_open_files_in_a_process());
-    batch->out_batch_.open(batch->filename_, std::ios::out);
+    batch->out_batch_.open(batch->filename_, std::ios::out | std::ios::binary);
     if (!batch->out_batch_.is_open()) {
       BOOST_THROW_EXCEPTION(InvalidOperation(
         "Failed to open co-occurrence batch file for writing, path = " + batch->filename_));
@@ -230,6 +259,7 @@ void CooccurrenceCollector::OpenBatchOutputFile(std::shared_ptr<CooccurrenceBatc
 
 void CooccurrenceCollector::CloseBatchOutputFile(std::shared_ptr<CooccurrenceBatch> batch) {
   if (batch->out_batch_.is_open()) {
+    batch->FlushBlock();
     std::unique_lock<std::mutex> open_close_file_lock(open_close_file_mutex_);
     batch->out_batch_.close();
     if (batch->out_batch_.is_open()) {
@@ -247,276 +277,241 @@ unsigned CooccurrenceCollector::NumOfCooccurrenceBatches() const {
 void CooccurrenceCollector::ReadAndMergeCooccurrenceBatches() {
   // After that all the statistics has been gathered and saved in form of cooc batches on disk, it
   // needs to be read and merged from cooc batches into one storage
-  // If number of cooc batches <= number of files than can be open simultaniously, then
-  // all the cooc batches are divided equally into n groups where n = number of cores.
-  // Else maximal number of open files is taken and divided into n groups.
-  // After that 1 thread has eliberated that can handle another portion of batches than aren't merged yet
-  // There are two stages of merging:
-  // 1. merging of files of one group (is done asynchroniously, without dropping of rare pairs of tokens)
-  // n files are written back in the same form (of cooccurrence batches)
-  // If n is too large to merge all the batches into some small number of batches
-  // this operation can be in cicle launched many times.
-  // 2. then that n files need to be read and merged again (with dropping of rare pairs of tokens)
-  // Merging of k files is implemented in KWayMerge function
-  // After the second stage the data is written in format of output file (not in format of cooc batches)
-  // If there would be a need to calculate ppmi or other values which depend on co-occurrences
-  // this data can be read back from output file.
-
-  std::cerr << "\nMerging co-occurrence batches. Stage 1: parallel agglomerative merge" << std::endl;
-  // This magic constant isn't the best and can be set to another value found in experiments
-  // This value should be lower than maximal number of open files in a process to avoid frequent
-  // openning-closing of the files
-  const unsigned min_num_of_batches_to_be_merged_in_parallel = 32;
-  while (NumOfCooccurrenceBatches() > min_num_of_batches_to_be_merged_in_parallel) {
-    FirstStageOfMerging();  // number of files is decreasing here
-  }
-  std::cerr << "Merging co-occurrence batches. Stage 2: sequential merge" << std::endl;
+  // The range of first token ids is split into ranges with approximately equal amount of data in batches
+  // (it's known from positions of cells in every batch). Every range is merged independently:
+  // cells of this range are read from all the batches and merged with k-way merge (see MergeRangeOfCells).
+  // Ranges are merged by num_threads workers, every worker takes the next range as soon as it has merged
+  // the previous one. Merged ranges are written in output files by this thread in ascending order of
+  // first token ids (with dropping of rare pairs of tokens)
+  // Occurrences of every token in pairs and documents are already known after parsing, so ppmi
+  // is calculated right from merged cells, at the same pass with co-occurrences.
+  std::cerr << "\nMerging co-occurrence batches" << std::endl;
+  int64_t total_size_of_batches = 0;
+  for (const auto& batch : vector_of_batches_) {
+    total_size_of_batches += batch->file_size_;
+  }
+  LOG(INFO) << "Merging " << vector_of_batches_.size() << " co-occurrence batches, "
+            << total_size_of_batches << " bytes";
+  const int num_threads = std::max(1, config_.num_threads());
+  // Several ranges per thread allow to balance the load and to keep memory usage low
+  const int num_of_ranges_per_thread = 8;
+  std::vector<int> range_begins = SplitIntoRangesOfFirstTokens(num_threads * num_of_ranges_per_thread);
+
   // vocab will be coppyied here into buffer_for_output_files
-  BufferOfCooccurrences buffer_for_output_files(OUTPUT_FILE, vocab_, num_of_documents_token_occurred_in_, config_);
+  BufferOfCooccurrences buffer_for_output_files(OUTPUT_FILE, vocab_, num_of_documents_token_occurred_in_,
+                                                num_of_pairs_token_occurred_in_, config_);
   open_files_counter_ += buffer_for_output_files.open_files_counter_;
-  SecondStageOfMerging(&buffer_for_output_files, &vector_of_batches_);
-  buffer_for_output_files.CalculatePpmi();
-  open_files_counter_ -= buffer_for_output_files.open_files_counter_;
-}
+  const int num_of_ranges = static_cast<int>(range_begins.size()) - 1;
+
+  // To keep memory usage low, a worker doesn't take a range which is too far ahead of the next range to write
+  const int max_num_of_ranges_ahead = 2 * num_threads;
+  std::vector<std::shared_ptr<MergedRangeOfCells>> merged_ranges(num_of_ranges);
+  std::mutex ranges_mutex;
+  std::condition_variable ranges_condition;
+  int next_range_to_merge = 0;
+  int next_range_to_write = 0;
+  bool stopped = false;  // set on errors, and when all the ranges are written
+
+  auto merge_ranges = [this, &buffer_for_output_files, &range_begins, &merged_ranges, &ranges_mutex,
+                       &ranges_condition, &next_range_to_merge, &next_range_to_write, &stopped,
+                       num_of_ranges, max_num_of_ranges_ahead]() {
+    while (true) {
+      int range_index = 0;
+      {
+        std::unique_lock<std::mutex> lock(ranges_mutex);
+        ranges_condition.wait(lock, [&next_range_to_merge, &next_range_to_write, &stopped,
+                                     num_of_ranges, max_num_of_ranges_ahead]() {
+          return stopped || next_range_to_merge >= num_of_ranges ||
+                 next_range_to_merge < next_range_to_write + max_num_of_ranges_ahead;
+        });
+        if (stopped || next_range_to_merge >= num_of_ranges) {
+          return;
+        }
+        range_index = next_range_to_merge++;
+      }
 
-// ToDo (MichaelSolotky): remove batches after merging
-void CooccurrenceCollector::FirstStageOfMerging() {
-  // Stage 1: merging portions of batches into intermediate batches
-  // The strategy is the folowing: divide the vector of batches into as much buckets as it's possible
-  // and gives advantages (the best case is 2 batches into each bucket, and all these batches are open
-  // simultaneously), then create several threads which will take a portion of batches, merge them,
-  // then a free thread will take another not-merged portion of batches and so on until
-  // there are no portions left. This procedure produces new batches, but their number is much lower
-  // then but their number is much smaller than those which were sent at the input,
-  // so it could be needed to run it again in order to make that number small enough
-  const int num_of_batches = static_cast<int>(vector_of_batches_.size());
-  // Let k be number of buckets in which all the batches will be divided
-  // Let n be total number of batches
-  // k ≤ upper bound of n / 2
-  const int upper_constraint_due_to_num_of_batches = num_of_batches / 2 + num_of_batches % 2;
-  // The procedure would be uneffective if there had been some buckets with at least 1 closed file,
-  // so there should be at least 3 open files in each bucket: 1 for writing and at least 2 merging files
-  const int upper_constraint_due_to_num_of_open_files = config_.max_num_of_open_files_in_a_thread() / 3;
-  const int optimal_num_of_threads = std::min(upper_constraint_due_to_num_of_batches,
-                                              upper_constraint_due_to_num_of_open_files);
-  int num_of_threads = optimal_num_of_threads;
-  // The real number of threads shouldn't be higher the than value set by the user of number of cores in computer
-  if (config_.has_num_threads() && config_.num_threads() > 0) {
-    num_of_threads = std::min(optimal_num_of_threads, config_.num_threads());
-  }
-  // 1 is subtracted here because 1 file will be needed for writing in it
-  const int optimal_portion_size = std::min(static_cast<int>(vector_of_batches_.size() / num_of_threads),
-                                            config_.max_num_of_open_files_in_a_thread() - 1);
-  // Portion size < 2 would lead to cycling or an error,
-  // if it would be > 10, much RAM space would be needed and i/o operations would be to frequent that
-  // the merging would slow due to pauses for reading and writing
-  const int portion_size = std::min(std::max(optimal_portion_size, 2), 10);
-  std::shared_ptr<std::mutex> open_close_file_mutex_ptr(new std::mutex);
-
-  auto func = [&open_close_file_mutex_ptr, portion_size, this](int portion_index) {  // Wrapper around KWayMerge
-    const int total_num_of_batches = vector_of_batches_.size();
-    std::shared_ptr<CooccurrenceBatch> batch(CreateNewCooccurrenceBatch());
-    OpenBatchOutputFile(batch);
-    // vocab will be coppied here into buffer_for_a_batch
-    BufferOfCooccurrences buffer_for_a_batch(BATCH, vocab_,
-                                             num_of_documents_token_occurred_in_,
-                                             config_);
-    std::vector<std::shared_ptr<CooccurrenceBatch>> portion_of_batches;
-    // Stage 1: take i-th portion from pull of batches
-    {
-      std::unique_lock<std::mutex> vector_of_batches_access_lock(vector_of_batches_access_mutex_);
-      for (int batch_index = portion_index * portion_size;
-           batch_index < (portion_index + 1) * portion_size && batch_index < total_num_of_batches;
-           ++batch_index) {
-        portion_of_batches.push_back(std::move(vector_of_batches_[batch_index]));
+      std::shared_ptr<MergedRangeOfCells> merged_range;
+      try {
+        merged_range = MergeRangeOfCells(buffer_for_output_files, range_begins[range_index],
+                                         range_begins[range_index + 1]);
       }
+      catch (...) {
+        std::unique_lock<std::mutex> lock(ranges_mutex);
+        stopped = true;
+        ranges_condition.notify_all();
+        throw;  // re-thrown by future::get()
+      }
+
+      std::unique_lock<std::mutex> lock(ranges_mutex);
+      merged_ranges[range_index] = merged_range;
+      ranges_condition.notify_all();
     }
-    KWayMerge(&buffer_for_a_batch, BATCH, &portion_of_batches, batch, open_close_file_mutex_ptr);
-    CloseBatchOutputFile(batch);
-    return batch;
   };
 
-  std::vector<std::shared_ptr<CooccurrenceBatch>> intermediate_batches;
-  std::mutex intermediate_batches_access_mutex;
-  std::queue<unsigned> queue_of_indices;
-  std::mutex queue_access_mutex;
-
-  auto worker = [&intermediate_batches, &intermediate_batches_access_mutex,
-                 &queue_of_indices, &queue_access_mutex, &func]() {
-    while (true) {
-      unsigned index;
-      {  // take one task from queue of tasks
-        std::unique_lock<std::mutex> queue_access_lock(queue_access_mutex);
-        if (queue_of_indices.empty()) {
-          break;
-        } else {
-          index = queue_of_indices.front();
-          queue_of_indices.pop();
-        }
-      }
-      std::shared_ptr<CooccurrenceBatch> batch = func(index);
-      {
-        std::unique_lock<std::mutex> intermediate_batches_access_lock(intermediate_batches_access_mutex);
-        intermediate_batches.push_back(std::move(batch));
+  std::vector<std::future<void>> workers;
+  call_on_destruction stop_workers([&workers, &ranges_mutex, &ranges_condition, &stopped]() {
+    {
+      std::unique_lock<std::mutex> lock(ranges_mutex);
+      stopped = true;
+      ranges_condition.notify_all();
+    }
+    for (auto& worker : workers) {
+      if (worker.valid()) {
+        worker.wait();
       }
     }
-  };
-  // Prepare indices for threads (each thread will take index and send in func)
-  for (int i = 0; i * portion_size < static_cast<int>(vector_of_batches_.size()); ++i) {
-    queue_of_indices.push(i);
+  });
+  for (int thread_index = 0; thread_index < std::min(num_threads, num_of_ranges); ++thread_index) {
+    workers.push_back(std::async(std::launch::async, merge_ranges));
   }
-  // Launch workers
-  std::vector<std::thread> workers;
-  for (int i = 0; i < num_of_threads; ++i) {
-    workers.emplace_back(worker);
+
+  for (int range_index = 0; range_index < num_of_ranges; ++range_index) {
+    std::shared_ptr<MergedRangeOfCells> merged_range;
+    {
+      std::unique_lock<std::mutex> lock(ranges_mutex);
+      ranges_condition.wait(lock, [&merged_ranges, &stopped, range_index]() {
+        return stopped || merged_ranges[range_index] != nullptr;
+      });
+      if (merged_ranges[range_index] == nullptr) {
+        break;  // one of the workers has failed
+      }
+      merged_range.swap(merged_ranges[range_index]);
+    }
+
+    buffer_for_output_files.WriteMergedRange(*merged_range);
+
+    std::unique_lock<std::mutex> lock(ranges_mutex);
+    ++next_range_to_write;
+    ranges_condition.notify_all();
   }
-  for (int i = 0; i < num_of_threads; ++i) {
-    workers[i].join();
+  for (auto& worker : workers) {
+    worker.get();  // re-throws exceptions from the workers
   }
-  vector_of_batches_ = std::move(intermediate_batches);
-}
 
-void CooccurrenceCollector::SecondStageOfMerging(BufferOfCooccurrences* buffer_for_output_files,
-                               std::vector<std::shared_ptr<CooccurrenceBatch>>* intermediate_batches) {
-  // Stage 2: merging of final batches (in single thread)
-  std::shared_ptr<std::mutex> open_close_file_mutex_ptr(new std::mutex);
-  // Note: the 4th arg is fake, it's not used later if mode == OUTPUT_FILE
-  KWayMerge(buffer_for_output_files, OUTPUT_FILE, intermediate_batches,
-            (*intermediate_batches)[0], open_close_file_mutex_ptr);
   // Files are explicitly closed here, because it's necesery to push the data in files on this step
-  if (config_.gather_cooc_tf()) {
-    buffer_for_output_files->cooc_tf_dict_out_.close();
+  buffer_for_output_files.CloseOutputFiles();
+  open_files_counter_ -= buffer_for_output_files.open_files_counter_;
+  RemoveCooccurrenceBatches();
+}
+
+std::vector<int> CooccurrenceCollector::SplitIntoRangesOfFirstTokens(int num_of_ranges) const {
+  // Returns begins of ranges of first token ids (the last element is the end of the last range)
+  // The size of a range is the total size of its cells in all the batches. It's estimated from the
+  // block index: the size of a block is spread evenly over first token ids of its cells (from the first
+  // to the last one), the sums over all the blocks are accumulated in a difference array
+  const int vocab_size = static_cast<int>(vocab_.VocabSize());
+  std::vector<double> size_of_cells_diff(vocab_size + 1, 0.0);
+  int64_t total_size = 0;
+  for (const auto& batch : vector_of_batches_) {
+    const std::vector<CooccurrenceBatch::BlockPosition>& positions = batch->block_positions_;
+    for (size_t i = 0; i < positions.size(); ++i) {
+      const int64_t next_offset = (i + 1 < positions.size()) ? positions[i + 1].offset : batch->file_size_;
+      const int64_t block_size = next_offset - positions[i].offset;
+      const double size_per_token = static_cast<double>(block_size) /
+                                    (positions[i].last_token_id - positions[i].first_token_id + 1);
+      size_of_cells_diff[positions[i].first_token_id] += size_per_token;
+      size_of_cells_diff[positions[i].last_token_id + 1] -= size_per_token;
+      total_size += block_size;
+    }
   }
-  if (config_.gather_cooc_df()) {
-    buffer_for_output_files->cooc_df_dict_out_.close();
+
+  // Large ranges are split further, so that merged cells of one range could be kept in memory
+  const int64_t max_range_size = 64 * 1024 * 1024;
+  const int64_t range_size = std::max<int64_t>(1, std::min(max_range_size, total_size / num_of_ranges));
+  std::vector<int> range_begins(1, 0);
+  double size_of_cell = 0.0;
+  double current_range_size = 0.0;
+  for (int first_token_id = 0; first_token_id < vocab_size; ++first_token_id) {
+    size_of_cell += size_of_cells_diff[first_token_id];
+    current_range_size += size_of_cell;
+    if (current_range_size >= range_size && first_token_id + 1 < vocab_size) {
+      range_begins.push_back(first_token_id + 1);
+      current_range_size = 0;
+    }
   }
-  buffer_for_output_files->open_files_counter_ -= 2;
-  open_files_counter_ -= 2;
+  range_begins.push_back(vocab_size);
+  return range_begins;
 }
 
-void CooccurrenceCollector::KWayMerge(BufferOfCooccurrences* buffer, const int mode,
-                                      std::vector<std::shared_ptr<CooccurrenceBatch>>* vector_of_input_batches_ptr,
-                                      std::shared_ptr<CooccurrenceBatch> out_batch,
-                                      std::shared_ptr<std::mutex> open_close_file_mutex_ptr) {
-  // All cooc batches has it's local buffer in RAM (look the CooccurrenceBatch class implementation)
-  // Information in batches is stored in cells.
-  // There are 2 different output formats, which are set via mode parameter:
-  // 1. Batches
-  // 2. Output file
+std::shared_ptr<MergedRangeOfCells> CooccurrenceCollector::MergeRangeOfCells(
+    const BufferOfCooccurrences& buffer, int first_token_begin, int first_token_end) const {
   // Here's the k-way merge algorithm for external sorting:
-  // 1. Initially first cells of all the batches are read in their buffers
-  // 2. Then batches are sorted (std::make_heap) by first_token_id of the cell
-  // 3. Then a cell with the lowest first_token_id is extaracted and put in
-  // buffer and the next cell is read from corresponding batch
-  // 4. If the lowest first token id equals first token id of cell of this buffer, they are merged
-  // else the current cell is written in file and the new one is loaded.
-  // Writing and empting is done in order to keep low memory consumption
-  // During execution of this function (if mode is OUTPUT_FILE) n_u is calculated and saved,
-  // so after merge all the information needed to calculate ppmi will be gathered and
-  // available from class BufferOfCooccurrences
-  // Note: here's only 1 way to communicate between threads - through open_files_counter
+  // 1. Initially first cells of the range are read from all the batches
+  // 2. Then readers are sorted (std::make_heap) by first_token_id of the cell
+  // 3. Then a cell with the lowest first_token_id is extaracted and the next cell is read from
+  // corresponding batch
+  // 4. If the lowest first token id equals first token id of the last merged cell, they are merged
+  // else the cell starts a new merged cell
+  // The memory for read buffers is shared between the batches
+  const int64_t memory_for_read_buffers = 64 * 1024 * 1024;
+  const int64_t min_buffer_size = 64 * 1024;
+  const int64_t max_buffer_size = 1024 * 1024;
+  const int64_t buffer_size = std::min(max_buffer_size, std::max(min_buffer_size,
+      memory_for_read_buffers / std::max<int64_t>(1, vector_of_batches_.size())));
+  // Readers keep their files open while the range is merged, unless there are too many batches
+  const bool keep_files_open =
+      static_cast<int64_t>(vector_of_batches_.size()) < config_.max_num_of_open_files_in_a_thread();
 
   // Step 1:
-  std::vector<std::shared_ptr<CooccurrenceBatch>>& vector_of_input_batches = *vector_of_input_batches_ptr;
-  auto iter = vector_of_input_batches.begin();
-  {  // Open all files and read the first cell
-    std::unique_lock<std::mutex> open_close_file_lock(*open_close_file_mutex_ptr);
-    for (; iter != vector_of_input_batches.end(); ++iter) {
-      OpenBatchInputFile(*iter);
-      (*iter)->ReadCell();
+  std::vector<std::shared_ptr<CooccurrenceBatchReader>> readers;
+  for (const auto& batch : vector_of_batches_) {
+    std::shared_ptr<CooccurrenceBatchReader> reader(
+        new CooccurrenceBatchReader(*batch, first_token_begin, first_token_end, buffer_size, keep_files_open));
+    if (reader->ReadCell()) {
+      readers.push_back(reader);
     }
   }
+
   // Step 2:
-  std::make_heap(vector_of_input_batches.begin(), vector_of_input_batches.end(),
-                 CooccurrenceBatch::CoocBatchComparator());
-  if (!vector_of_input_batches.empty()) {
-    buffer->cell_ = Cell();
-    buffer->cell_.first_token_id = (*vector_of_input_batches[0]).cell_.first_token_id;
-  }
-  while (!vector_of_input_batches.empty()) {
+  std::make_heap(readers.begin(), readers.end(), CooccurrenceBatchReader::Comparator());
+  std::shared_ptr<MergedRangeOfCells> range(new MergedRangeOfCells());
+  while (!readers.empty()) {
     // Step 4:
-    if (buffer->cell_.first_token_id == (*vector_of_input_batches[0]).cell_.first_token_id) {
-      buffer->MergeWithExistingCell(*vector_of_input_batches[0]);
+    const Cell& cell = readers[0]->cell();
+    if (range->cells.empty() || range->cells.back().first_token_id != cell.first_token_id) {
+      range->cells.push_back(cell);
     } else {
-      if (mode == BATCH) {
-        out_batch->cell_ = buffer->cell_;
-        out_batch->WriteCell();
-      } else if (mode == OUTPUT_FILE) {
-        if (config_.calculate_ppmi_tf()) {
-          buffer->CalculateTFStatistics();
-        }
-        if (config_.gather_cooc_tf()) {
-          buffer->WriteCoocFromCell(TokenCoocFrequency, config_.cooc_min_tf());
-        }
-        if (config_.gather_cooc_df()) {
-          buffer->WriteCoocFromCell(DocumentCoocFrequency, config_.cooc_min_df());
-        }
-        // It's importants to set size = 0 after popping, because this value will be checked later
-        buffer->cell_.records.resize(0);
-      }
-      buffer->cell_ = (*vector_of_input_batches[0]).cell_;
+      BufferOfCooccurrences::MergeWithExistingCell(cell, &range->cells.back());
     }
     // Step 3:
-    std::pop_heap(vector_of_input_batches.begin(), vector_of_input_batches.end(),
-                  CooccurrenceBatch::CoocBatchComparator());
+    std::pop_heap(readers.begin(), readers.end(), CooccurrenceBatchReader::Comparator());
     // if there are some data to read ReadCell reads it and returns true, else returns false
-    if (vector_of_input_batches.back()->ReadCell()) {
-      std::push_heap(vector_of_input_batches.begin(), vector_of_input_batches.end(),
-                     CooccurrenceBatch::CoocBatchComparator());
+    if (readers.back()->ReadCell()) {
+      std::push_heap(readers.begin(), readers.end(), CooccurrenceBatchReader::Comparator());
     } else {
-      std::unique_lock<std::mutex> open_close_file_lock(*open_close_file_mutex_ptr);
-      CloseBatchInputFile(vector_of_input_batches.back());
-      vector_of_input_batches.pop_back();
+      readers.pop_back();
     }
   }
-  if (!buffer->cell_.records.empty()) {
-    if (mode == BATCH) {
-      out_batch->cell_ = buffer->cell_;
-      out_batch->WriteCell();
-    } else if (mode == OUTPUT_FILE) {
-      if (config_.calculate_ppmi_tf()) {
-        buffer->CalculateTFStatistics();
-      }
+
+  // Formatting of text output (with ppmi calculation) is the most expensive part of writing,
+  // so it's also done here
+  if (!config_.binary_cooc_files()) {
+    for (const Cell& cell : range->cells) {
       if (config_.gather_cooc_tf()) {
-        buffer->WriteCoocFromCell(TokenCoocFrequency, config_.cooc_min_tf());
+        buffer.FormatCoocFromCell(cell, TokenCoocFrequency, config_.cooc_min_tf(), &range->cooc_tf_text);
       }
       if (config_.gather_cooc_df()) {
-        buffer->WriteCoocFromCell(DocumentCoocFrequency, config_.cooc_min_df());
+        buffer.FormatCoocFromCell(cell, DocumentCoocFrequency, config_.cooc_min_df(), &range->cooc_df_text);
+      }
+      if (config_.calculate_ppmi_tf()) {
+        buffer.FormatPpmiFromCell(cell, TokenCoocFrequency, config_.cooc_min_tf(),
+                                  config_.total_num_of_pairs(), &range->ppmi_tf_text);
+      }
+      if (config_.calculate_ppmi_df()) {
+        buffer.FormatPpmiFromCell(cell, DocumentCoocFrequency, config_.cooc_min_df(),
+                                  config_.total_num_of_documents(), &range->ppmi_df_text);
       }
     }
   }
+  return range;
 }
 
-void CooccurrenceCollector::OpenBatchInputFile(std::shared_ptr<CooccurrenceBatch> batch) {
-  if (!batch->in_batch_.is_open()) {
-    std::unique_lock<std::mutex> open_close_file_lock(open_close_file_mutex_);
-    assert(open_files_counter_ < config_.max_num_of_open_files_in_a_process());
-    batch->in_batch_.open(batch->filename_, std::ios::in);
-    if (!batch->in_batch_.is_open()) {
-      BOOST_THROW_EXCEPTION(InvalidOperation(
-        "Failed to open co-occurrence batch file for reading, path = " + batch->filename_));
-    }
-    // ToDo (MichaelSolotky): find the way to check correctness of the seekg procedure
-    batch->in_batch_.seekg(batch->in_batch_offset_);
-    ++open_files_counter_;
-  }
-}
-
-bool CooccurrenceCollector::IsOpenBatchInputFile(const CooccurrenceBatch& batch) const {
-  return batch.in_batch_.is_open();
-}
-
-void CooccurrenceCollector::CloseBatchInputFile(std::shared_ptr<CooccurrenceBatch> batch) {
-  if (batch->in_batch_.is_open()) {
-    std::unique_lock<std::mutex> open_close_file_lock(open_close_file_mutex_);
-    batch->in_batch_offset_ = batch->in_batch_.tellg();
-    batch->in_batch_.close();
-    if (batch->in_batch_.is_open()) {
-      BOOST_THROW_EXCEPTION(InvalidOperation(
-        "Failed to close co-occurrence batch file, path = " + batch->filename_));
-    }
-    --open_files_counter_;
+void CooccurrenceCollector::RemoveCooccurrenceBatches() {
+  for (const auto& batch : vector_of_batches_) {
+    boost::system::error_code error_code;
+    fs::remove(batch->filename_, error_code);
   }
+  vector_of_batches_.clear();
 }
 
 // ********************************** Methods of class Vocab **********************************
@@ -581,127 +576,309 @@ unsigned Vocab::VocabSize() const {
   return token_map_.size();
 }
 
+std::vector<Token> Vocab::Tokens() const {
+  std::vector<Token> tokens;
+  tokens.reserve(VocabSize());
+  TokenBuilder token_builder;
+  for (unsigned token_id = 0; token_id < VocabSize(); ++token_id) {
+    TokenModality token = FindTokenStr(token_id);
+    tokens.push_back(token_builder.Intern(token.modality, token.token_str));
+  }
+  return tokens;
+}
+
+// ******************************* Methods of class CooccurrenceSketch *******************************
+
+CooccurrenceSketch::CooccurrenceSketch(double error, unsigned cooc_min_tf, unsigned cooc_min_df)
+    : width_(static_cast<size_t>(std::ceil(std::exp(1.0) / error))),
+      cooc_min_tf_(cooc_min_tf), cooc_min_df_(cooc_min_df),
+      cooc_tf_counters_(cooc_min_tf > 0 ? kDepth * width_ : 0),
+      cooc_df_counters_(cooc_min_df > 0 ? kDepth * width_ : 0) { }
+
+uint64_t CooccurrenceSketch::MakeKey(int first_token_id, int second_token_id) {
+  if (first_token_id > second_token_id) {
+    std::swap(first_token_id, second_token_id);
+  }
+  return (static_cast<uint64_t>(first_token_id) << 32) | static_cast<uint32_t>(second_token_id);
+}
+
+void CooccurrenceSketch::AddDocument(std::vector<uint64_t>* keys_of_pairs) {
+  if (!cooc_tf_counters_.empty()) {
+    for (uint64_t key : *keys_of_pairs) {
+      // Pair <u u> is counted twice in cooc_tf, as pairs <u v> and <v u> are
+      const uint64_t weight = ((key >> 32) == (key & 0xFFFFFFFF)) ? 2 : 1;
+      for (int row = 0; row < kDepth; ++row) {
+        cooc_tf_counters_[GetIndex(key, row)].fetch_add(weight, std::memory_order_relaxed);
+      }
+    }
+  }
+  if (!cooc_df_counters_.empty()) {
+    std::sort(keys_of_pairs->begin(), keys_of_pairs->end());
+    auto end = std::unique(keys_of_pairs->begin(), keys_of_pairs->end());
+    for (auto iter = keys_of_pairs->begin(); iter != end; ++iter) {
+      for (int row = 0; row < kDepth; ++row) {
+        cooc_df_counters_[GetIndex(*iter, row)].fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+  }
+}
+
+bool CooccurrenceSketch::MayBeFrequent(int first_token_id, int second_token_id) const {
+  const uint64_t key = MakeKey(first_token_id, second_token_id);
+  return (!cooc_tf_counters_.empty() && Estimate(cooc_tf_counters_, key) >= cooc_min_tf_) ||
+         (!cooc_df_counters_.empty() && Estimate(cooc_df_counters_, key) >= cooc_min_df_);
+}
+
+int64_t CooccurrenceSketch::SizeInBytes() const {
+  return (cooc_tf_counters_.size() + cooc_df_counters_.size()) * sizeof(uint64_t);
+}
+
+size_t CooccurrenceSketch::GetIndex(uint64_t key, int row) const {
+  // Every row has its own hash function (splitmix64 finalizer with different seeds)
+  uint64_t hash = key + (row + 1) * 0x9E3779B97F4A7C15ULL;
+  hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EBULL;
+  hash ^= hash >> 31;
+  return row * width_ + hash % width_;
+}
+
+uint64_t CooccurrenceSketch::Estimate(const std::vector<std::atomic<uint64_t>>& counters, uint64_t key) const {
+  uint64_t estimate = counters[GetIndex(key, 0)].load(std::memory_order_relaxed);
+  for (int row = 1; row < kDepth; ++row) {
+    estimate = std::min(estimate, counters[GetIndex(key, row)].load(std::memory_order_relaxed));
+  }
+  return estimate;
+}
+
 // ****************************** Methods of class CooccurrenceStatisticsHolder ******************************
 
 // This class stores temporarily added statistics about pairs of tokens (how often these pairs
 // occurred in documents in a window and in how many documents they occurred together in a window).
-// The data is stored in rb tree (std::map)
+// Occurrences are only appended here (no lookups), they are aggregated later, in UploadOnDisk()
+CooccurrenceStatisticsHolder::CooccurrenceStatisticsHolder(int vocab_size, bool store_symmetric_cooc_values,
+                                                           int64_t max_num_of_pairs,
+                                                           const CooccurrenceSketch* cooc_sketch)
+    : num_of_pairs_token_occurred_in_(vocab_size, 0), store_symmetric_cooc_values_(store_symmetric_cooc_values),
+      max_num_of_pairs_(max_num_of_pairs), cooc_sketch_(cooc_sketch) { }
+
 void CooccurrenceStatisticsHolder::SavePairOfTokens(const int first_token_id, const int second_token_id,
-                                                    const unsigned doc_id, const double weight) {
-  // There are 2 levels of indexing
-  // The first level keeps information about first token and the second level
-  // about co-occurrence between the first and the second tokens
-  // If first token id is known (exists in the structure), corresponding node should be modified
-  // else it should be added to the structure
-  auto it1 = storage_.find(first_token_id);
-  if (it1 == storage_.end()) {
-    FirstToken first_token;
-    first_token.second_token_reference = std::map<int, SecondTokenAndCooccurrence> {
-      {second_token_id, SecondTokenAndCooccurrence(doc_id, weight)}
-    };
-    storage_.insert(std::pair<int, FirstToken>(first_token_id, first_token));
-  } else {
-    std::map<int, SecondTokenAndCooccurrence>& second_tokens = it1->second.second_token_reference;
-    auto it2 = second_tokens.find(second_token_id);
-    if (it2 == second_tokens.end()) {
-      SecondTokenAndCooccurrence second_token(doc_id, weight);
-      second_tokens.insert(std::pair<int, SecondTokenAndCooccurrence>(second_token_id, second_token));
+                                                    const unsigned doc_id, const unsigned cooc_tf) {
+  // In symmetric case only one of pairs <u v> and <v u> is saved, so it's counted for both tokens
+  // Pairs <u u> have double weight so in symmetric case they should be counted once
+  // Rare pairs (which aren't stored) are counted too, because ppmi depends on all the pairs
+  num_of_pairs_token_occurred_in_[first_token_id] += cooc_tf;
+  if (store_symmetric_cooc_values_ && first_token_id != second_token_id) {
+    num_of_pairs_token_occurred_in_[second_token_id] += cooc_tf;
+  }
+  if (cooc_sketch_ == nullptr || cooc_sketch_->MayBeFrequent(first_token_id, second_token_id)) {
+    // Capacity is doubled as usual, but capped by the budget of the buffer
+    const int64_t capacity = static_cast<int64_t>(pairs_.capacity());
+    if (static_cast<int64_t>(pairs_.size()) == capacity && capacity < max_num_of_pairs_) {
+      pairs_.reserve(std::min(max_num_of_pairs_, std::max<int64_t>(2 * capacity, 1024)));
+    }
+    pairs_.push_back({ first_token_id, second_token_id, doc_id, cooc_tf });
+  }
+}
+
+void CooccurrenceStatisticsHolder::SaveCooccurrence(const int first_token_id, const int second_token_id,
+                                                    const unsigned doc_id) {
+  if (store_symmetric_cooc_values_) {
+    if (first_token_id < second_token_id) {
+      SavePairOfTokens(first_token_id, second_token_id, doc_id);
+    } else if (first_token_id > second_token_id) {
+      SavePairOfTokens(second_token_id, first_token_id, doc_id);
     } else {
-      if (it2->second.last_doc_id != doc_id) {
-        it2->second.last_doc_id = doc_id;
-        ++(it2->second.cooc_df);
-      }
-      it2->second.cooc_tf += weight;
+      SavePairOfTokens(first_token_id, first_token_id, doc_id, 2);
     }
+  } else {
+    SavePairOfTokens(first_token_id, second_token_id, doc_id);
+    SavePairOfTokens(second_token_id, first_token_id, doc_id);
   }
 }
 
-bool CooccurrenceStatisticsHolder::Empty() {
-  return storage_.empty();
+bool CooccurrenceStatisticsHolder::Empty() const {
+  return pairs_.empty();
+}
+
+bool CooccurrenceStatisticsHolder::IsFull() const {
+  return max_num_of_pairs_ > 0 && static_cast<int64_t>(pairs_.size()) >= max_num_of_pairs_;
+}
+
+void CooccurrenceStatisticsHolder::SortPairs() {
+  // Pairs are packed into 64-bit keys; within a key pairs from the same document become adjacent
+  std::sort(pairs_.begin(), pairs_.end(), [](const PairOfTokens& left, const PairOfTokens& right) {
+    const uint64_t left_key = (static_cast<uint64_t>(left.first_token_id) << 32) |
+                              static_cast<uint32_t>(left.second_token_id);
+    const uint64_t right_key = (static_cast<uint64_t>(right.first_token_id) << 32) |
+                               static_cast<uint32_t>(right.second_token_id);
+    return left_key < right_key || (left_key == right_key && left.doc_id < right.doc_id);
+  });
+}
+
+void CooccurrenceStatisticsHolder::Clear() {
+  pairs_.clear();
 }
 
 // ******************************** Methods of class CooccurrenceBatch ********************************
 
-CooccurrenceBatch::CooccurrenceBatch(const std::string& path_to_batches) : in_batch_offset_(0) {
+CooccurrenceBatch::CooccurrenceBatch(const std::string& path_to_batches) : file_size_(0) {
   boost::uuids::uuid uuid = boost::uuids::random_generator()();
   fs::path batch(boost::lexical_cast<std::string>(uuid));
   fs::path full_filename = fs::path(path_to_batches) / batch;
   filename_ = full_filename.string();
 }
 
-void CooccurrenceBatch::FormNewCell(const std::map<int, CooccurrenceStatisticsHolder::FirstToken>
-                                             ::const_iterator& cooc_stat_node) {
+void CooccurrenceBatch::FormNewCell(const CooccurrenceStatisticsHolder::PairOfTokens* begin,
+                                    const CooccurrenceStatisticsHolder::PairOfTokens* end) {
   // Here is initialization of a new cell
   // A cell consists on first_token_id, number of records it includes
   // Then records go, every reord consists on second_token_id, cooc_tf, cooc_df
-  cell_.first_token_id = cooc_stat_node->first;
-  // while reading from file it's necessery to know how many records to read
-  auto second_token_reference = cooc_stat_node->second.second_token_reference;
-  cell_.num_of_records = second_token_reference.size();
-  cell_.records.resize(cell_.num_of_records);
-  unsigned i = 0;
-  for (auto iter = second_token_reference.begin(); iter != second_token_reference.end(); ++iter, ++i) {
-    cell_.records[i].second_token_id = iter->first;
-    cell_.records[i].cooc_tf = iter->second.cooc_tf;
-    cell_.records[i].cooc_df = iter->second.cooc_df;
+  // Pairs are sorted, so all occurrences of a second token are adjacent and ordered by doc_id
+  cell_.first_token_id = begin->first_token_id;
+  cell_.records.clear();
+  for (auto iter = begin; iter != end; ++iter) {
+    if (iter == begin || iter->second_token_id != (iter - 1)->second_token_id) {
+      cell_.records.push_back({ iter->second_token_id, iter->cooc_tf, 1 });
+      continue;
+    }
+
+    CoocInfo& record = cell_.records.back();
+    record.cooc_tf += iter->cooc_tf;
+    if (iter->doc_id != (iter - 1)->doc_id) {
+      ++record.cooc_df;
+    }
   }
+  // while reading from file it's necessery to know how many records to read
+  cell_.num_of_records = cell_.records.size();
 }
 
 void CooccurrenceBatch::WriteCell() {
-  // Cells are written in following form: first line consists of first token id and num of triples
-  // the second line consists of numbers triples, which are separeted with a
-  // space and numbers in these triples are separeted the same
-  // stringstream is used for fast bufferized i/o operations
-  // Initially data is written into stringstreams and then one large stringstream is written in file
-  std::stringstream ss;
-  ss << cell_.first_token_id << ' ';
-  // The value of the variable cell_.num_of_records is invalid (wasn't updated from first read from batch)
-  ss << cell_.records.size() << std::endl;
-  for (unsigned i = 0; i < cell_.records.size(); ++i) {
-    ss << cell_.records[i].second_token_id << ' ';
-    ss << cell_.records[i].cooc_tf << ' ';
-    ss << cell_.records[i].cooc_df << ' ';
+  // Cells are written in following form: first token id and num of records,
+  // then records (second token id, cooc_tf, cooc_df) one after another
+  // All the numbers are varints, second token ids are stored as differences with previous ones
+  // (they are sorted, so the differences are small)
+  // Cells are collected in block_ and then the whole block is written in file
+  if (block_.empty()) {
+    block_positions_.push_back({ cell_.first_token_id, cell_.first_token_id, file_size_ });
+  }
+  block_positions_.back().last_token_id = cell_.first_token_id;
+
+  // The value of the variable cell_.num_of_records can be invalid, so the size of records is used
+  AppendVarint(cell_.first_token_id, &block_);
+  AppendVarint(cell_.records.size(), &block_);
+  int prev_second_token_id = 0;
+  for (const CoocInfo& record : cell_.records) {
+    AppendVarint(record.second_token_id - prev_second_token_id, &block_);
+    AppendVarint(record.cooc_tf, &block_);
+    AppendVarint(record.cooc_df, &block_);
+    prev_second_token_id = record.second_token_id;
+  }
+
+  if (block_.size() >= kBlockSize) {
+    FlushBlock();
+  }
+}
+
+void CooccurrenceBatch::FlushBlock() {
+  out_batch_.write(block_.data(), block_.size());
+  file_size_ += block_.size();
+  block_.clear();
+}
+
+// ***************************** Methods of class CooccurrenceBatchReader ******************************
+
+CooccurrenceBatchReader::CooccurrenceBatchReader(const CooccurrenceBatch& batch, int first_token_begin,
+                                                 int first_token_end, int64_t buffer_size, bool keep_file_open)
+    : filename_(batch.filename_), first_token_begin_(first_token_begin), first_token_end_(first_token_end),
+      keep_file_open_(keep_file_open), buffer_begin_(0), buffer_end_(0) {
+  // Blocks of the range are found by binary search in the block index
+  // The first block of the range is the last one that starts not after first_token_begin,
+  // the range ends before the first block that starts with first_token_end or a larger id
+  const std::vector<CooccurrenceBatch::BlockPosition>& positions = batch.block_positions_;
+  auto begin = std::upper_bound(positions.begin(), positions.end(), first_token_begin,
+      [](int first_token_id, const CooccurrenceBatch::BlockPosition& position) {
+    return first_token_id < position.first_token_id;
+  });
+  if (begin != positions.begin()) {
+    --begin;
   }
-  ss << std::endl;
-  out_batch_ << ss.str();
+  auto end = std::lower_bound(begin, positions.end(), first_token_end,
+      [](const CooccurrenceBatch::BlockPosition& position, int first_token_id) {
+    return position.first_token_id < first_token_id;
+  });
+  offset_ = (begin == positions.end()) ? batch.file_size_ : begin->offset;
+  end_offset_ = (end == positions.end()) ? batch.file_size_ : end->offset;
+  // Small ranges don't need large buffers
+  buffer_.resize(std::max<int64_t>(kMaxVarintSize, std::min(buffer_size, end_offset_ - offset_)));
 }
 
-bool CooccurrenceBatch::ReadCell() {
-  if (ReadCellHeader()) {
-    ReadRecords();
-    return true;
+bool CooccurrenceBatchReader::ReadCell() {
+  // Blocks at the borders of the range can contain cells of other ranges, they are skipped
+  while (buffer_begin_ != buffer_end_ || offset_ != end_offset_) {
+    // Values were written from variables of the same types, so they are narrowed back without checks
+    cell_.first_token_id = static_cast<int>(ReadVarint());
+    cell_.num_of_records = static_cast<unsigned>(ReadVarint());
+    if (cell_.first_token_id >= first_token_end_) {
+      break;
+    }
+
+    cell_.records.resize(cell_.num_of_records);
+    int second_token_id = 0;
+    for (CoocInfo& record : cell_.records) {
+      second_token_id += static_cast<int>(ReadVarint());
+      record.second_token_id = second_token_id;
+      record.cooc_tf = static_cast<int64_t>(ReadVarint());
+      record.cooc_df = static_cast<unsigned>(ReadVarint());
+    }
+
+    if (cell_.first_token_id >= first_token_begin_) {
+      return true;
+    }
   }
+
+  buffer_begin_ = buffer_end_;
+  offset_ = end_offset_;
+  in_batch_.close();
   return false;
 }
 
-bool CooccurrenceBatch::ReadCellHeader() {
-  // stringstream is used for fast bufferized i/o operations
-  std::string str;
-  getline(in_batch_, str);
-  std::stringstream ss(str);
-  ss >> cell_.first_token_id;
-  ss >> cell_.num_of_records;
-  if (!in_batch_.eof()) {
-    return true;
-  } else {
-    return false;
+uint64_t CooccurrenceBatchReader::ReadVarint() {
+  if (buffer_end_ - buffer_begin_ < kMaxVarintSize && offset_ < end_offset_) {
+    FillBuffer();
+  }
+
+  uint64_t value = 0;
+  for (int shift = 0; buffer_begin_ < buffer_end_ && shift < 64; shift += 7) {
+    const uint8_t byte = static_cast<uint8_t>(buffer_[buffer_begin_++]);
+    value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) {
+      return value;
+    }
   }
+
+  BOOST_THROW_EXCEPTION(InvalidOperation("Error while reading from batch. File is corrupted, path = " + filename_));
 }
 
-void CooccurrenceBatch::ReadRecords() {
-  // It's not good if there are no records in batch after header
-  if (in_batch_.eof()) {
-    BOOST_THROW_EXCEPTION(InvalidOperation("Error while reading from batch. File is corrupted"));
+void CooccurrenceBatchReader::FillBuffer() {
+  // The rest of the buffer is moved to its beginning, then the buffer is filled from file
+  std::memmove(buffer_.data(), buffer_.data() + buffer_begin_, buffer_end_ - buffer_begin_);
+  buffer_end_ -= buffer_begin_;
+  buffer_begin_ = 0;
+
+  const size_t bytes_to_read = std::min<int64_t>(buffer_.size() - buffer_end_, end_offset_ - offset_);
+  if (!in_batch_.is_open()) {
+    in_batch_.open(filename_, std::ios::in | std::ios::binary);
+    in_batch_.seekg(offset_);
   }
-  std::string str;
-  getline(in_batch_, str);
-  // stringstream is used for fast bufferized i/o operations
-  std::stringstream ss(str);
-  cell_.records.resize(cell_.num_of_records);
-  for (unsigned i = 0; i < cell_.num_of_records; ++i) {
-    ss >> cell_.records[i].second_token_id;
-    ss >> cell_.records[i].cooc_tf;
-    ss >> cell_.records[i].cooc_df;
+  in_batch_.read(buffer_.data() + buffer_end_, bytes_to_read);
+  if (!in_batch_) {
+    BOOST_THROW_EXCEPTION(InvalidOperation("Error while reading from batch. File is corrupted, path = " +
+                                           filename_));
+  }
+  buffer_end_ += bytes_to_read;
+  offset_ += bytes_to_read;
+  if (!keep_file_open_ || offset_ == end_offset_) {
+    in_batch_.close();
   }
 }
 
@@ -723,24 +900,40 @@ void CooccurrenceBatch::ReadRecords() {
 BufferOfCooccurrences::BufferOfCooccurrences(
     const int target, const Vocab& vocab,
     const std::vector<unsigned>& num_of_documents_token_occurred_in,
+    const std::vector<int64_t>& num_of_pairs_token_occurred_in,
     const CooccurrenceCollectorConfig& config) : target_(target), vocab_(vocab),
                       num_of_documents_token_occurred_in_(num_of_documents_token_occurred_in),
+                      num_of_pairs_token_occurred_in_(num_of_pairs_token_occurred_in),
                       open_files_counter_(0), config_(config) {
-  num_of_pairs_token_occurred_in_.resize(vocab_.token_map_.size());
-  if (target_ == OUTPUT_FILE) {  // Open that files only if planning to write in them
-    if (config_.gather_cooc_tf()) {  // It's important firstly to create file (open output file)
+  if (target_ == OUTPUT_FILE && config_.binary_cooc_files()) {
+    // Every binary file is written in one pass (a writer keeps a temporary file of values open)
+    std::vector<Token> tokens = vocab_.Tokens();
+    if (config_.gather_cooc_tf()) {
+      cooc_tf_file_.reset(new CoocFileWriter(config_.cooc_tf_file_path(), tokens));
+      open_files_counter_ += cooc_tf_file_->num_open_files();
+    }
+    if (config_.gather_cooc_df()) {
+      cooc_df_file_.reset(new CoocFileWriter(config_.cooc_df_file_path(), tokens));
+      open_files_counter_ += cooc_df_file_->num_open_files();
+    }
+    if (config_.calculate_ppmi_tf()) {
+      ppmi_tf_file_.reset(new CoocFileWriter(config_.ppmi_tf_file_path(), tokens));
+      open_files_counter_ += ppmi_tf_file_->num_open_files();
+    }
+    if (config_.calculate_ppmi_df()) {
+      ppmi_df_file_.reset(new CoocFileWriter(config_.ppmi_df_file_path(), tokens));
+      open_files_counter_ += ppmi_df_file_->num_open_files();
+    }
+  } else if (target_ == OUTPUT_FILE) {  // Open that files only if planning to write in them
+    if (config_.gather_cooc_tf()) {
       cooc_tf_dict_out_.open(config_.cooc_tf_file_path(), std::ios::out);
       CheckOutputFile(cooc_tf_dict_out_, config_.cooc_tf_file_path());
-      cooc_tf_dict_in_.open(config_.cooc_tf_file_path(), std::ios::in);
-      CheckInputFile(cooc_tf_dict_in_, config_.cooc_tf_file_path());
-      open_files_counter_ += 2;
+      ++open_files_counter_;
     }
     if (config_.gather_cooc_df()) {
       cooc_df_dict_out_.open(config_.cooc_df_file_path(), std::ios::out);
       CheckOutputFile(cooc_df_dict_out_, config_.cooc_df_file_path());
-      cooc_df_dict_in_.open(config_.cooc_df_file_path(), std::ios::in);
-      CheckInputFile(cooc_df_dict_in_, config_.cooc_df_file_path());
-      open_files_counter_ += 2;
+      ++open_files_counter_;
     }
     if (config_.calculate_ppmi_tf()) {
       ppmi_tf_dict_.open(config_.ppmi_tf_file_path(), std::ios::out);
@@ -755,13 +948,6 @@ BufferOfCooccurrences::BufferOfCooccurrences(
   }
 }
 
-void BufferOfCooccurrences::CheckInputFile(const std::ifstream& file, const std::string& filename) {
-  if (!file.good()) {
-    BOOST_THROW_EXCEPTION(InvalidOperation("Failed to open input file " +
-                                            filename + " in working directory"));
-  }
-}
-
 void BufferOfCooccurrences::CheckOutputFile(const std::ofstream& file, const std::string& filename) {
   if (!file.good()) {
     BOOST_THROW_EXCEPTION(InvalidOperation("Failed to open or create output file " +
@@ -769,165 +955,191 @@ void BufferOfCooccurrences::CheckOutputFile(const std::ofstream& file, const std
   }
 }
 
-// ToDo (MichaelSolotky): may be this can be implemented in more optimal way
-void BufferOfCooccurrences::MergeWithExistingCell(const CooccurrenceBatch& batch) {
+void BufferOfCooccurrences::MergeWithExistingCell(const Cell& cell, Cell* existing_cell) {
   // All the data in buffer are stored in a cell, so here are rules of updating each cell
-  // This function takes two vectors (one of the current cell and one which is stored in batch),
+  // This function takes two vectors (one of the existing cell and one of the new cell),
   // merges them in folowing way:
   // 1. If two elements of vector are different (different second token id),
   // stacks them one to another in ascending order
   // 2. It these two elemnts are equal, adds their cooc_tf and cooc_df and
   // stores fianl cell with this parameters
   // After merging final vector is sorted in ascending order
-  std::vector<CoocInfo> old_vector = cell_.records;
-  cell_.records.resize(old_vector.size() + batch.cell_.records.size());
+  const std::vector<CoocInfo>& old_vector = existing_cell->records;
+  std::vector<CoocInfo> new_vector;
+  new_vector.reserve(old_vector.size() + cell.records.size());
   auto fi_iter = old_vector.begin();
-  auto se_iter = batch.cell_.records.begin();
-  auto th_iter = cell_.records.begin();
-  while (fi_iter != old_vector.end() && se_iter != batch.cell_.records.end()) {
+  auto se_iter = cell.records.begin();
+  while (fi_iter != old_vector.end() && se_iter != cell.records.end()) {
     if (fi_iter->second_token_id == se_iter->second_token_id) {
-      th_iter->second_token_id = fi_iter->second_token_id;
-      th_iter->cooc_tf = fi_iter->cooc_tf + se_iter->cooc_tf;
-      th_iter->cooc_df = fi_iter->cooc_df + se_iter->cooc_df;
+      new_vector.push_back({ fi_iter->second_token_id, fi_iter->cooc_tf + se_iter->cooc_tf,
+                             fi_iter->cooc_df + se_iter->cooc_df });
       ++fi_iter;
       ++se_iter;
     } else if (fi_iter->second_token_id < se_iter->second_token_id) {
-      *th_iter = *fi_iter;
+      new_vector.push_back(*fi_iter);
       ++fi_iter;
     } else {
-      *th_iter = *se_iter;
+      new_vector.push_back(*se_iter);
       ++se_iter;
     }
-    ++th_iter;
   }
-  cell_.records.resize(th_iter - cell_.records.begin());
-  std::copy(fi_iter, old_vector.end(), std::back_inserter(cell_.records));
-  std::copy(se_iter, batch.cell_.records.end(), std::back_inserter(cell_.records));
+  new_vector.insert(new_vector.end(), fi_iter, old_vector.end());
+  new_vector.insert(new_vector.end(), se_iter, cell.records.end());
+  existing_cell->records.swap(new_vector);
+  existing_cell->num_of_records = existing_cell->records.size();
 }
 
-void BufferOfCooccurrences::CalculateTFStatistics() {
-  // Calculate statistics of occurrence (of first token which is associated with current cell)
-  int64_t n_u = 0;
-  for (unsigned i = 0; i < cell_.records.size(); ++i) {
-    if (config_.store_symmetric_cooc_values() && cell_.first_token_id != cell_.records[i].second_token_id) {
-      num_of_pairs_token_occurred_in_[cell_.records[i].second_token_id] += cell_.records[i].cooc_tf;
-    }  // pairs <u u> have double weight so in symmetric case they should be taken once
-    n_u += cell_.records[i].cooc_tf;
-  }
-  num_of_pairs_token_occurred_in_[cell_.first_token_id] += n_u;
-}
-
-void BufferOfCooccurrences::WriteCoocFromCell(const std::string mode, const unsigned cooc_min) {
-  // This function takes a cell from buffer and writes data from cell in file
-  // Output file format(s) are defined here
+void BufferOfCooccurrences::FormatCoocFromCell(const Cell& cell, const std::string& mode, const unsigned cooc_min,
+                                               std::string* output) const {
+  // This function takes a cell and appends data from the cell to the output in format of text output file
   // stringstream is used for fast bufferized i/o operations
-  // Note: before writing in file all the information is stored in ram
   std::stringstream output_buf;
   bool no_cooc_found = true;
   std::string prev_modality = DefaultClass;
-  Vocab::TokenModality first_token = vocab_.FindTokenStr(cell_.first_token_id);
+  Vocab::TokenModality first_token = vocab_.FindTokenStr(cell.first_token_id);
   if (first_token.modality != DefaultClass) {
     output_buf << '|' << first_token.modality << ' ';
     prev_modality = first_token.modality;
   }
   output_buf << first_token.token_str << ' ';
-  for (unsigned i = 0; i < cell_.records.size(); ++i) {
-    if (cell_.GetCoocFromCell(mode, i) >= cooc_min && cell_.first_token_id != cell_.records[i].second_token_id) {
+  for (unsigned i = 0; i < cell.records.size(); ++i) {
+    if (cell.GetCoocFromCell(mode, i) >= cooc_min && cell.first_token_id != cell.records[i].second_token_id) {
       no_cooc_found = false;
-      Vocab::TokenModality second_token = vocab_.FindTokenStr(cell_.records[i].second_token_id);
+      Vocab::TokenModality second_token = vocab_.FindTokenStr(cell.records[i].second_token_id);
       if (second_token.modality != prev_modality) {
         output_buf << " |" << second_token.modality << ' ';
         prev_modality = second_token.modality;
       }
-      output_buf << second_token.token_str << ':' << cell_.GetCoocFromCell(mode, i) << ' ';
+      output_buf << second_token.token_str << ':' << cell.GetCoocFromCell(mode, i) << ' ';
     }
   }
   if (!no_cooc_found) {
     output_buf << '\n';
-    if (mode == TokenCoocFrequency) {
-      cooc_tf_dict_out_ << output_buf.str();
-    } else {
-      cooc_df_dict_out_ << output_buf.str();
-    }
+    output->append(output_buf.str());
   }
 }
 
-void BufferOfCooccurrences::CalculatePpmi() {  // Wrapper around CalculateAndWritePpmi
-  std::cerr << "Calculating pPMI" << std::endl;
-  if (config_.calculate_ppmi_tf()) {
-    CalculateAndWritePpmi(TokenCoocFrequency, config_.total_num_of_pairs());
+void BufferOfCooccurrences::FormatPpmiFromCell(const Cell& cell, const std::string& mode, const unsigned cooc_min,
+                                               const long double n, std::string* output) const {
+  // This function takes a cell, calculates ppmi of pairs of tokens which weren't dropped from the cooc file
+  // and appends positive values to the output in format of text ppmi file
+  std::stringstream output_buf;
+  bool new_first_token = true;
+  Vocab::TokenModality first_token = vocab_.FindTokenStr(cell.first_token_id);
+  std::string prev_modality = first_token.modality;
+  for (unsigned i = 0; i < cell.records.size(); ++i) {
+    if (cell.GetCoocFromCell(mode, i) < cooc_min || cell.first_token_id == cell.records[i].second_token_id) {
+      continue;
+    }
+    const long double n_uv = static_cast<long double>(cell.GetCoocFromCell(mode, i));
+    double value_inside_logarithm = CalculateValueInsideLogarithm(mode, n, cell.first_token_id,
+                                                                  cell.records[i].second_token_id, n_uv);
+    if (value_inside_logarithm > 1.0) {
+      if (new_first_token) {
+        if (first_token.modality != DefaultClass) {
+          output_buf << first_token.modality << ' ';
+        }
+        output_buf << first_token.token_str;
+        new_first_token = false;
+      }
+      Vocab::TokenModality second_token = vocab_.FindTokenStr(cell.records[i].second_token_id);
+      if (second_token.modality != prev_modality) {
+        output_buf << ' ' << second_token.modality;
+        prev_modality = second_token.modality;
+      }
+      output_buf << ' ' << second_token.token_str << ':' << log(value_inside_logarithm);
+    }
   }
-  if (config_.calculate_ppmi_df()) {
-    CalculateAndWritePpmi(DocumentCoocFrequency, config_.total_num_of_documents());
+  if (!new_first_token) {
+    output_buf << '\n';
+    output->append(output_buf.str());
   }
 }
 
-void BufferOfCooccurrences::CalculateAndWritePpmi(const std::string mode, const long double n) {
-  // This function reads cooc file line by line, calculates ppmi and saves them in external file of ppmi
-  // stringstream is used for fast bufferized i/o operations
-  // Note: before writing in file all the information is stored in ram
-  std::stringstream output_buf;
-  std::string str;
-  while (getline(mode == TokenCoocFrequency ? cooc_tf_dict_in_ : cooc_df_dict_in_, str)) {
-    boost::algorithm::trim(str);
-    std::string first_token_modality = DefaultClass;  // Here's how modality is indicated in output file
-    bool new_first_token = true;
-    std::vector<std::string> strs;
-    boost::split(strs, str, boost::is_any_of(" :\t\r"));
-    unsigned index_of_first_token = 0;
-    // Find modality
-    for (; index_of_first_token < strs.size() && (strs[index_of_first_token].empty() ||
-                                                  strs[index_of_first_token][0] == '|'); ++index_of_first_token) {
-      if (!strs[index_of_first_token].empty()) {
-        first_token_modality = strs[index_of_first_token].substr(1);
-      }
+void BufferOfCooccurrences::WriteMergedRange(const MergedRangeOfCells& range) {
+  // Ranges come in ascending order of first token ids, so they can be simply appended to output files
+  if (!config_.binary_cooc_files()) {
+    if (config_.gather_cooc_tf()) {
+      cooc_tf_dict_out_ << range.cooc_tf_text;
     }
-    std::string first_token_str = strs[index_of_first_token];
-    unsigned not_a_word_counter = 0;
-    std::string prev_modality = first_token_modality;
-    for (unsigned i = index_of_first_token + 1; i + not_a_word_counter < strs.size(); i += 2) {
-      std::string second_token_modality = first_token_modality;
-      for (; i + not_a_word_counter < strs.size() && (strs[i + not_a_word_counter].empty() ||
-                                                      strs[i + not_a_word_counter][0] == '|'); ++not_a_word_counter) {
-        if (!strs[i + not_a_word_counter].empty()) {
-          second_token_modality = strs[i + not_a_word_counter].substr(1);
-        }
-      }
-      if (i + not_a_word_counter + 1 >= strs.size()) {
-        break;
+    if (config_.gather_cooc_df()) {
+      cooc_df_dict_out_ << range.cooc_df_text;
+    }
+    if (config_.calculate_ppmi_tf()) {
+      ppmi_tf_dict_ << range.ppmi_tf_text;
+    }
+    if (config_.calculate_ppmi_df()) {
+      ppmi_df_dict_ << range.ppmi_df_text;
+    }
+    return;
+  }
+
+  // Values in binary files are stored as floats, ppmi is calculated from them as if they were read back
+  const unsigned cooc_min_tf = config_.cooc_min_tf();
+  const unsigned cooc_min_df = config_.cooc_min_df();
+  for (const Cell& cell : range.cells) {
+    for (unsigned i = 0; i < cell.records.size(); ++i) {
+      const int second_token_id = cell.records[i].second_token_id;
+      if (cell.first_token_id == second_token_id) {
+        continue;
       }
-      std::string second_token_str = strs[i + not_a_word_counter];
-      int64_t cooc = std::stoull(strs[i + not_a_word_counter + 1]);
-      long double n_u = GetTokenFreq(mode, vocab_.FindTokenId(first_token_str, first_token_modality));
-      long double n_v = GetTokenFreq(mode, vocab_.FindTokenId(second_token_str, second_token_modality));
-      long double n_uv = static_cast<long double>(cooc);
-      double value_inside_logarithm = (n / n_u) / (n_v / n_uv);
-      if (value_inside_logarithm > 1.0) {
-        if (new_first_token) {
-          if (first_token_modality != DefaultClass) {
-            output_buf << first_token_modality << ' ';
+      if (cell.records[i].cooc_tf >= cooc_min_tf) {
+        const float cooc_tf = static_cast<float>(cell.records[i].cooc_tf);
+        if (config_.gather_cooc_tf()) {
+          cooc_tf_file_->AddValue(cell.first_token_id, second_token_id, cooc_tf);
+        }
+        if (config_.calculate_ppmi_tf()) {
+          double value_inside_logarithm = CalculateValueInsideLogarithm(TokenCoocFrequency,
+              config_.total_num_of_pairs(), cell.first_token_id, second_token_id, cooc_tf);
+          if (value_inside_logarithm > 1.0) {
+            ppmi_tf_file_->AddValue(cell.first_token_id, second_token_id,
+                                    static_cast<float>(log(value_inside_logarithm)));
           }
-          output_buf << first_token_str;
-          new_first_token = false;
         }
-        if (second_token_modality != prev_modality) {
-          output_buf << ' ' << second_token_modality;
-          prev_modality = second_token_modality;
+      }
+      if (cell.records[i].cooc_df >= cooc_min_df) {
+        const float cooc_df = static_cast<float>(cell.records[i].cooc_df);
+        if (config_.gather_cooc_df()) {
+          cooc_df_file_->AddValue(cell.first_token_id, second_token_id, cooc_df);
+        }
+        if (config_.calculate_ppmi_df()) {
+          double value_inside_logarithm = CalculateValueInsideLogarithm(DocumentCoocFrequency,
+              config_.total_num_of_documents(), cell.first_token_id, second_token_id, cooc_df);
+          if (value_inside_logarithm > 1.0) {
+            ppmi_df_file_->AddValue(cell.first_token_id, second_token_id,
+                                    static_cast<float>(log(value_inside_logarithm)));
+          }
         }
-        output_buf << ' ' << second_token_str << ':' << log(value_inside_logarithm);
       }
     }
-    if (!new_first_token) {
-      output_buf << '\n';
+  }
+}
+
+void BufferOfCooccurrences::CloseOutputFiles() {
+  for (std::ofstream* file : { &cooc_tf_dict_out_, &cooc_df_dict_out_, &ppmi_tf_dict_, &ppmi_df_dict_ }) {
+    if (file->is_open()) {
+      file->close();
+      --open_files_counter_;
     }
   }
-  if (mode == TokenCoocFrequency) {
-    ppmi_tf_dict_ << output_buf.str();
-  } else {
-    ppmi_df_dict_ << output_buf.str();
+  for (CoocFileWriter* file : { cooc_tf_file_.get(), cooc_df_file_.get(), ppmi_tf_file_.get(), ppmi_df_file_.get() }) {
+    if (file != nullptr) {
+      open_files_counter_ -= file->num_open_files();
+      file->Close();
+      open_files_counter_ += file->num_open_files();
+    }
   }
 }
 
+double BufferOfCooccurrences::CalculateValueInsideLogarithm(const std::string& mode, const long double n,
+                                                            const int first_token_id, const int second_token_id,
+                                                            const long double n_uv) const {
+  // ppmi(u, v) = max(0, log((n / n_u) / (n_v / n_uv))), so it's positive only if this value is greater than 1
+  long double n_u = GetTokenFreq(mode, first_token_id);
+  long double n_v = GetTokenFreq(mode, second_token_id);
+  return (n / n_u) / (n_v / n_uv);
+}
+
 double BufferOfCooccurrences::GetTokenFreq(const std::string& mode, const int token_id) const {
   if (mode == TokenCoocFrequency) {
     return num_of_pairs_token_occurred_in_[token_id];
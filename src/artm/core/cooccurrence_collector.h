@@ -2,6 +2,7 @@
 
 #pragma once
 
+#include <atomic>
 #include <iomanip>
 #include <iostream>
 #include <fstream>
@@ -19,6 +20,8 @@
 
 #include "artm/core/collection_parser.h"
 #include "artm/core/common.h"
+#include "artm/core/cooc_file.h"
+#include "artm/core/token.h"
 
 namespace artm {
 namespace core {
@@ -55,10 +58,21 @@ struct Cell {
   std::vector<CoocInfo> records;
 };
 
+// Cells with first token ids from some range, merged from all the co-occurrence batches
+// Ranges are merged in parallel and then written in output files in ascending order
+struct MergedRangeOfCells {
+  std::vector<Cell> cells;
+  std::string cooc_tf_text;  // formatted output (it's used only if output files are text)
+  std::string cooc_df_text;
+  std::string ppmi_tf_text;
+  std::string ppmi_df_text;
+};
+
 class CooccurrenceCollector;
 class Vocab;
 class CooccurrenceStatisticsHolder;
 class CooccurrenceBatch;
+class CooccurrenceBatchReader;
 class BufferOfCooccurrences;
 
 class Vocab {
@@ -81,6 +95,7 @@ class Vocab {
   int FindTokenId(const std::string& token_str, const std::string& modality) const;
   TokenModality FindTokenStr(const int token_id) const;
   unsigned VocabSize() const;
+  std::vector<Token> Tokens() const;  // tokens in the order of their ids
 
   std::unordered_map<std::string, int> token_map_;  // "token|modality" -> token_id (str -> int)
   std::unordered_map<int, TokenModality> inverse_token_map_;  // token_id -> ("token", "modality") (int -> strs)
@@ -95,31 +110,26 @@ class CooccurrenceCollector {
                                                   std::shared_ptr<std::ifstream> vowpal_wabbit_doc_ptr);
   unsigned NumOfCooccurrenceBatches() const;
   void ReadAndMergeCooccurrenceBatches();
+  int FindTokenIdInVocab(const std::string& token_str, const std::string& modality);
 
  private:
   std::string MakeKeyForVocab(const std::string& token_str, const std::string& modality) const;
-  int FindTokenIdInVocab(const std::string& token_str, const std::string& modality);
   Vocab::TokenModality FindTokenStrInVocab(const int token_id);
   unsigned VocabSize();
   void CreateAndSetTargetFolder();
   std::string CreateFileInBatchDir() const;
-  void UploadOnDisk(const CooccurrenceStatisticsHolder& cooc_stat_holder);
-  void FirstStageOfMerging();
-  void SecondStageOfMerging(BufferOfCooccurrences* res,
-                            std::vector<std::shared_ptr<CooccurrenceBatch>>* intermediate_batches);
-  void KWayMerge(BufferOfCooccurrences* res, const int mode,
-                 std::vector<std::shared_ptr<CooccurrenceBatch>>* vector_of_batches_ptr,
-                 std::shared_ptr<CooccurrenceBatch> out_batch,
-                 std::shared_ptr<std::mutex> open_close_file_mutex_ptr);
+  void UploadOnDisk(CooccurrenceStatisticsHolder* cooc_stat_holder);
+  std::vector<int> SplitIntoRangesOfFirstTokens(int num_of_ranges) const;
+  std::shared_ptr<MergedRangeOfCells> MergeRangeOfCells(const BufferOfCooccurrences& buffer,
+                                                        int first_token_begin, int first_token_end) const;
   CooccurrenceBatch* CreateNewCooccurrenceBatch();
-  void OpenBatchInputFile(std::shared_ptr<CooccurrenceBatch> batch);
   void OpenBatchOutputFile(std::shared_ptr<CooccurrenceBatch> batch);
-  bool IsOpenBatchInputFile(const CooccurrenceBatch& batch) const;
-  void CloseBatchInputFile(std::shared_ptr<CooccurrenceBatch> batch);
   void CloseBatchOutputFile(std::shared_ptr<CooccurrenceBatch> batch);
+  void RemoveCooccurrenceBatches();
 
   Vocab vocab_;  // Holds mapping tokens to their indices
   std::vector<unsigned> num_of_documents_token_occurred_in_;  // the index here is token_id
+  std::vector<int64_t> num_of_pairs_token_occurred_in_;  // it's gathered while parsing (needed for ppmi)
   std::vector<std::shared_ptr<CooccurrenceBatch>> vector_of_batches_;
   int open_files_counter_;
   std::mutex open_close_file_mutex_;
@@ -129,97 +139,177 @@ class CooccurrenceCollector {
   CooccurrenceCollectorConfig config_;
 };
 
+// Count-min sketch of co-occurrences of pairs of tokens (pairs <u v> and <v u> share one counter)
+// It's filled during an extra pass over the collection and then it's used to drop pairs of tokens
+// that can't pass cooc_min_tf / cooc_min_df before they are counted exactly.
+// Estimates are never less than real values, and with probability 1 - exp(-kDepth) an estimate exceeds
+// the real value by at most error * (sum of all the counters in a row). Counters are updated atomically,
+// so one sketch can be filled by several threads
+class CooccurrenceSketch : private boost::noncopyable {
+ public:
+  // cooc_min_tf (cooc_min_df) equal to 0 means that cooc_tf (cooc_df) isn't needed and isn't counted
+  CooccurrenceSketch(double error, unsigned cooc_min_tf, unsigned cooc_min_df);
+  static uint64_t MakeKey(int first_token_id, int second_token_id);
+  // Adds all the occurrences of pairs of tokens in one document, the keys are reordered
+  void AddDocument(std::vector<uint64_t>* keys_of_pairs);
+  bool MayBeFrequent(int first_token_id, int second_token_id) const;
+  int64_t SizeInBytes() const;
+
+ private:
+  static const int kDepth = 4;
+  size_t GetIndex(uint64_t key, int row) const;
+  uint64_t Estimate(const std::vector<std::atomic<uint64_t>>& counters, uint64_t key) const;
+
+  size_t width_;
+  unsigned cooc_min_tf_;
+  unsigned cooc_min_df_;
+  std::vector<std::atomic<uint64_t>> cooc_tf_counters_;  // kDepth rows of width_ counters
+  std::vector<std::atomic<uint64_t>> cooc_df_counters_;
+};
+
+// Every occurrence of a pair of tokens is appended to a flat buffer. Before the buffer is dumped
+// on disk it's sorted, and occurrences of the same pair are reduced to cooc_tf and cooc_df.
+// The buffer is considered full when it reaches max_num_of_pairs (0 means no limit). Its memory grows
+// as needed, but never beyond max_num_of_pairs (unless a single document doesn't fit in the rest of the buffer,
+// because the buffer is dumped between documents), and is reused after the buffer is dumped.
+// The holder also counts in how many pairs every token occurred, these counters aren't cleared
+// with the buffer, so that ppmi could be calculated right during the merge of cooc batches
+// If cooc_sketch is given, pairs of tokens which can't pass cooc_min_tf / cooc_min_df aren't stored
 class CooccurrenceStatisticsHolder {
   friend class CooccurrenceCollector;
  public:
-  struct FirstToken;
-  struct SecondTokenAndCooccurrence;
+  struct PairOfTokens;
+  CooccurrenceStatisticsHolder(int vocab_size, bool store_symmetric_cooc_values, int64_t max_num_of_pairs = 0,
+                               const CooccurrenceSketch* cooc_sketch = nullptr);
   void SavePairOfTokens(const int first_token_id, const int second_token_id,
-                        const unsigned doc_id, const double weight = 1);
-  bool Empty();
+                        const unsigned doc_id, const unsigned cooc_tf = 1);
+  // Saves one or two pairs for second token found in the window of first token (it depends on symmetry)
+  void SaveCooccurrence(const int first_token_id, const int second_token_id, const unsigned doc_id);
+  bool Empty() const;
+  bool IsFull() const;
+  void SortPairs();  // orders pairs by first token id, second token id and doc id
+  void Clear();  // clears only the buffer of pairs
+  const std::vector<int64_t>& num_of_pairs_token_occurred_in() const { return num_of_pairs_token_occurred_in_; }
 
  private:
-  // Here's two-level structure storage_
-  // Vector was chosen because it has a very low memory overhead
-  std::map<int, FirstToken> storage_;
-};
-
-struct CooccurrenceStatisticsHolder::FirstToken {
-  std::map<int, SecondTokenAndCooccurrence> second_token_reference;
+  std::vector<PairOfTokens> pairs_;
+  std::vector<int64_t> num_of_pairs_token_occurred_in_;
+  bool store_symmetric_cooc_values_;
+  int64_t max_num_of_pairs_;
+  const CooccurrenceSketch* cooc_sketch_;
 };
 
-struct CooccurrenceStatisticsHolder::SecondTokenAndCooccurrence {
-  explicit SecondTokenAndCooccurrence(const unsigned doc_id, const int64_t cooc_tf = 1) :
-                                      last_doc_id(doc_id), cooc_tf(cooc_tf), cooc_df(1) { }
-  // When a new pair comes, this field is checked and if current doc_id isn't
-  // equal to previous cooc_df should be incremented
-  unsigned last_doc_id;  // id of the last document where the pair occurred
-  int64_t cooc_tf;
-  unsigned cooc_df;
+struct CooccurrenceStatisticsHolder::PairOfTokens {
+  int first_token_id;
+  int second_token_id;
+  unsigned doc_id;
+  unsigned cooc_tf;
 };
 
 // Cooccurrence Batch is an intermidiate buffer between other data in RAM and
 // a spesific file stored on disc. This buffer holds only one cell at a time.
-// Also it's a wrapper around a ifstream and ofstream of an external file
+// Cells are written in ascending order of first token ids in compact binary form: all numbers are varints,
+// and second token ids are delta-encoded. Cells are grouped into blocks of about kBlockSize bytes,
+// and the position of every block is kept in memory (block index), so a range of first token ids
+// can be read from the batch without scanning it
 // Co-occurrence batch can be created only by a special method of class CooccurrenceCollector
 class CooccurrenceBatch: private boost::noncopyable {
   friend class CooccurrenceCollector;
-  friend class BufferOfCooccurrences;
+  friend class CooccurrenceBatchReader;
  public:
-  struct CoocBatchComparator;
-  void FormNewCell(const std::map<int, CooccurrenceStatisticsHolder::FirstToken>::const_iterator& cooc_stat_node);
+  struct BlockPosition {
+    int first_token_id;  // first token id of the first cell in the block
+    int last_token_id;  // first token id of the last cell in the block
+    int64_t offset;
+  };
+
+  // Reduces sorted pairs with the same first token into a cell
+  void FormNewCell(const CooccurrenceStatisticsHolder::PairOfTokens* begin,
+                   const CooccurrenceStatisticsHolder::PairOfTokens* end);
   void WriteCell();
-  bool ReadCellHeader();
-  void ReadRecords();
-  bool ReadCell();  // Initiates reading of a cell from a file (e.g. call of ReadCellHeader() and ReadRecords())
+  void FlushBlock();  // it's necessary to call this method before the file is closed
 
  private:
   explicit CooccurrenceBatch(const std::string& path_to_batches);
+  static const size_t kBlockSize = 64 * 1024;
 
   Cell cell_;
-  std::ifstream in_batch_;
   std::ofstream out_batch_;
   std::string filename_;
-  int64_t in_batch_offset_;
+  std::string block_;  // encoded cells that aren't written in file yet
+  std::vector<BlockPosition> block_positions_;
+  int64_t file_size_;
 };
 
-struct CooccurrenceBatch::CoocBatchComparator {
-  bool operator()(const std::shared_ptr<CooccurrenceBatch>& left,
-                  const std::shared_ptr<CooccurrenceBatch>& right) const {
+// Reads cells with first token ids in [first_token_begin, first_token_end) from a co-occurrence batch
+// The file is read in large blocks. It's kept open until the whole range is read if keep_file_open is set,
+// otherwise it's open only while the buffer is refilled, so the number of open files doesn't depend on
+// the number of batches that are merged simultaneously
+class CooccurrenceBatchReader: private boost::noncopyable {
+ public:
+  struct Comparator;
+  CooccurrenceBatchReader(const CooccurrenceBatch& batch, int first_token_begin, int first_token_end,
+                          int64_t buffer_size, bool keep_file_open);
+  bool ReadCell();  // returns false if there are no cells left in the range
+  const Cell& cell() const { return cell_; }
+
+ private:
+  uint64_t ReadVarint();  // refills the buffer if needed
+  void FillBuffer();
+
+  std::string filename_;
+  int first_token_begin_;
+  int first_token_end_;
+  bool keep_file_open_;
+  std::ifstream in_batch_;
+  int64_t offset_;  // position in file of the first byte that isn't read into the buffer yet
+  int64_t end_offset_;
+  std::vector<char> buffer_;
+  size_t buffer_begin_;
+  size_t buffer_end_;
+  Cell cell_;
+};
+
+struct CooccurrenceBatchReader::Comparator {
+  bool operator()(const std::shared_ptr<CooccurrenceBatchReader>& left,
+                  const std::shared_ptr<CooccurrenceBatchReader>& right) const {
     return left->cell_.first_token_id > right->cell_.first_token_id;
   }
 };
 
 class BufferOfCooccurrences {
   friend class CooccurrenceCollector;
- public:
-  void CalculatePpmi();
-
  private:
   BufferOfCooccurrences(const int target, const Vocab& vocab,
-                        const std::vector<unsigned>& num_of_documents_token_occurred_in_,
+                        const std::vector<unsigned>& num_of_documents_token_occurred_in,
+                        const std::vector<int64_t>& num_of_pairs_token_occurred_in,
                         const CooccurrenceCollectorConfig& config);
-  void CheckInputFile(const std::ifstream& file, const std::string& filename);
   void CheckOutputFile(const std::ofstream& file, const std::string& filename);
-  void MergeWithExistingCell(const CooccurrenceBatch& batch);
-  void CalculateTFStatistics();
-  void WriteCoocFromCell(const std::string mode, const unsigned cooc_min);  // Output file formats are defined here
-  int64_t GetCoocFromCell(const std::string& mode, const unsigned record_pos) const;
-  void CalculateAndWritePpmi(const std::string mode, const long double n);
+  static void MergeWithExistingCell(const Cell& cell, Cell* existing_cell);
+  // Output file formats are defined here; it's safe to call these methods from several threads
+  void FormatCoocFromCell(const Cell& cell, const std::string& mode, const unsigned cooc_min,
+                          std::string* output) const;
+  void FormatPpmiFromCell(const Cell& cell, const std::string& mode, const unsigned cooc_min,
+                          const long double n, std::string* output) const;
+  void WriteMergedRange(const MergedRangeOfCells& range);
+  void CloseOutputFiles();
+  double CalculateValueInsideLogarithm(const std::string& mode, const long double n, const int first_token_id,
+                                       const int second_token_id, const long double n_uv) const;
   double GetTokenFreq(const std::string& mode, const int token_id) const;
 
   const int target_;  // can be either OUTPUT_FILE or BATCH
   const Vocab& vocab_;  // Holds mapping tokens to their indices
   const std::vector<unsigned>& num_of_documents_token_occurred_in_;
-  std::vector<int64_t> num_of_pairs_token_occurred_in_;
-  std::ifstream cooc_tf_dict_in_;
+  const std::vector<int64_t>& num_of_pairs_token_occurred_in_;
   std::ofstream cooc_tf_dict_out_;
-  std::ifstream cooc_df_dict_in_;
   std::ofstream cooc_df_dict_out_;
   std::ofstream ppmi_tf_dict_;
   std::ofstream ppmi_df_dict_;
+  std::unique_ptr<CoocFileWriter> cooc_tf_file_;  // used instead of text files if config_.binary_cooc_files()
+  std::unique_ptr<CoocFileWriter> cooc_df_file_;
+  std::unique_ptr<CoocFileWriter> ppmi_tf_file_;
+  std::unique_ptr<CoocFileWriter> ppmi_df_file_;
   int open_files_counter_;
-  Cell cell_;
   CooccurrenceCollectorConfig config_;
 };
 
@@ -3,6 +3,7 @@
 #include "artm/core/dense_phi_matrix.h"
 
 #include <algorithm>
+#include <atomic>
 
 #include "artm/core/helpers.h"
 #include "artm/utility/memory_usage.h"
@@ -14,6 +15,13 @@ namespace core {
 // TokenCollection methods
 // =======================================================
 
+static int64_t NextTokensVersion() {
+  static std::atomic<int64_t> last_version(0);
+  return ++last_version;
+}
+
+TokenCollection::TokenCollection() : version_(NextTokensVersion()) { }
+
 int TokenCollection::AddToken(const Token& token) {
   int token_id = this->token_id(token);
   if (token_id != -1) {
@@ -21,24 +29,24 @@ int TokenCollection::AddToken(const Token& token) {
   }
 
   token_id = token_size();
-  token_to_token_id_.insert(
-    std::make_pair(token, token_id));
+  token_to_token_id_.insert(token, token_id);
   token_id_to_token_.push_back(token);
+  version_ = NextTokensVersion();
   return token_id;
 }
 
 void TokenCollection::Swap(TokenCollection* rhs) {
-  token_to_token_id_.swap(rhs->token_to_token_id_);
+  token_to_token_id_.swap(&rhs->token_to_token_id_);
   token_id_to_token_.swap(rhs->token_id_to_token_);
+  std::swap(version_, rhs->version_);
 }
 
 bool TokenCollection::has_token(const Token& token) const {
-  return token_to_token_id_.count(token) > 0;
+  return token_to_token_id_.has_token(token);
 }
 
 int TokenCollection::token_id(const Token& token) const {
-  auto iter = token_to_token_id_.find(token);
-  return (iter != token_to_token_id_.end()) ? iter->second : -1;
+  return token_to_token_id_.find(token);
 }
 
 const Token& TokenCollection::token(int index) const {
@@ -48,19 +56,17 @@ const Token& TokenCollection::token(int index) const {
 void TokenCollection::Clear() {
   token_to_token_id_.clear();
   token_id_to_token_.clear();
+  version_ = NextTokensVersion();
 }
 
 int TokenCollection::token_size() const {
-  return static_cast<int>(token_to_token_id_.size());
+  return static_cast<int>(token_id_to_token_.size());
 }
 
 int64_t TokenCollection::ByteSize() const {
   int64_t retval = 0;
   retval += artm::utility::getMemoryUsage(token_id_to_token_);
-  retval += artm::utility::getMemoryUsage(token_to_token_id_);
-  for (const auto& token : token_id_to_token_) {
-    retval += 2 * (token.keyword.size() + token.class_id.size());
-  }
+  retval += token_to_token_id_.ByteSize();
   return retval;
 }
 
@@ -490,5 +496,74 @@ int AttachedPhiMatrix::AddToken(const Token& token) {
   BOOST_THROW_EXCEPTION(artm::core::InternalError("Tokens addition is not allowed for attached model."));
 }
 
+// =======================================================
+// TokenRangePhiMatrix methods
+// =======================================================
+
+TokenRangePhiMatrix::TokenRangePhiMatrix(const PhiMatrix& source, int token_begin, int token_end)
+    : source_(source), token_begin_(token_begin), token_end_(token_end), values_() {
+  assert(token_begin >= 0 && token_begin <= token_end && token_end <= source.token_size());
+  values_.resize(static_cast<int64_t>(token_end - token_begin) * source.topic_size(), 0.0f);
+}
+
+float* TokenRangePhiMatrix::row(int token_id) {
+  CheckTokenId(token_id);
+  return &values_[static_cast<int64_t>(token_id - token_begin_) * topic_size()];
+}
+
+const float* TokenRangePhiMatrix::row(int token_id) const {
+  CheckTokenId(token_id);
+  return &values_[static_cast<int64_t>(token_id - token_begin_) * topic_size()];
+}
+
+void TokenRangePhiMatrix::CheckTokenId(int token_id) const {
+  if (token_id < token_begin_ || token_id >= token_end_) {
+    std::stringstream ss;
+    ss << "Token " << token_id << " is out of the token range [" << token_begin_ << ", " << token_end_
+       << ") of model " << model_name();
+    BOOST_THROW_EXCEPTION(artm::core::InvalidOperation(ss.str()));
+  }
+}
+
+void TokenRangePhiMatrix::set_topic_name(int topic_id, const std::string& topic_name) {
+  BOOST_THROW_EXCEPTION(artm::core::InternalError("Topics renaming is not allowed for token range of model."));
+}
+
+int64_t TokenRangePhiMatrix::ByteSize() const {
+  return ::artm::utility::getMemoryUsage(values_);
+}
+
+void TokenRangePhiMatrix::get(int token_id, std::vector<float>* buffer) const {
+  assert(topic_size() > 0 && buffer->size() == topic_size());
+  memcpy(&buffer->at(0), row(token_id), sizeof(float) * topic_size());
+}
+
+void TokenRangePhiMatrix::increase(int token_id, const std::vector<float>& increment) {
+  // Unlike other phi matrices, a token range is filled by a single thread, so there are no locks here
+  const int topic_size = this->topic_size();
+  assert(increment.size() == topic_size);
+  float* values = row(token_id);
+  for (int topic_index = 0; topic_index < topic_size; ++topic_index) {
+    values[topic_index] += increment[topic_index];
+  }
+}
+
+void TokenRangePhiMatrix::get_sparse(int token_id, std::vector<float>* value_buffer,
+                                     std::vector<int>* index_buffer) const {
+  get(token_id, value_buffer);
+}
+
+void TokenRangePhiMatrix::Clear() {
+  values_.assign(values_.size(), 0.0f);
+}
+
+int TokenRangePhiMatrix::AddToken(const Token& token) {
+  BOOST_THROW_EXCEPTION(artm::core::InternalError("Tokens addition is not allowed for token range of model."));
+}
+
+std::shared_ptr<PhiMatrix> TokenRangePhiMatrix::Duplicate() const {
+  BOOST_THROW_EXCEPTION(artm::core::InternalError("Duplication is not allowed for token range of model."));
+}
+
 }  // namespace core
 }  // namespace artm
@@ -13,6 +13,7 @@
 
 #include "artm/core/common.h"
 #include "artm/core/phi_matrix.h"
+#include "artm/core/token_index.h"
 
 namespace artm {
 namespace core {
@@ -22,6 +23,7 @@ namespace core {
 // For tokens that are not present in the collection loop up method will return 'UnknownId' constant.
 class TokenCollection {
  public:
+  TokenCollection();
   void Clear();
   int  AddToken(const Token& token);
   void Swap(TokenCollection* rhs);
@@ -31,10 +33,12 @@ class TokenCollection {
   bool has_token(const Token& token) const;
   int token_id(const Token& token) const;
   const Token& token(int index) const;
+  int64_t version() const { return version_; }
 
  private:
-  std::unordered_map<Token, int, TokenHasher> token_to_token_id_;
+  TokenIndex token_to_token_id_;
   std::vector<Token> token_id_to_token_;
+  int64_t version_;
 };
 
 // A simple spin lock class, used for synchronization.
@@ -69,6 +73,7 @@ class PhiMatrixFrame : public PhiMatrix {
   virtual const Token& token(int index) const;
   virtual bool has_token(const Token& token) const;
   virtual int token_index(const Token& token) const;
+  virtual int64_t tokens_version() const { return token_collection_.version(); }
   virtual google::protobuf::RepeatedPtrField<std::string> topic_name() const;
   virtual const std::string& topic_name(int topic_id) const;
   virtual void set_topic_name(int topic_id, const std::string& topic_name);
@@ -193,5 +198,58 @@ class AttachedPhiMatrix : boost::noncopyable, public PhiMatrixFrame {
   std::vector<float*> values_;
 };
 
+// TokenRangePhiMatrix class implements PhiMatrix interface for a range of tokens [token_begin, token_end)
+// of another phi matrix. It shares tokens and topics with the source matrix, but owns the values
+// (initially zeros) only for the tokens of the range. Access to values of other tokens throws InvalidOperation,
+// although token_size() and token(), shared with the source matrix, cover all its tokens.
+// It allows to calculate phi regularizers block by block without allocating the full r_wt matrix.
+class TokenRangePhiMatrix : boost::noncopyable, public PhiMatrix {
+ public:
+  TokenRangePhiMatrix(const PhiMatrix& source, int token_begin, int token_end);
+  virtual ~TokenRangePhiMatrix() { }
+
+  virtual int token_size() const { return source_.token_size(); }
+  virtual int topic_size() const { return source_.topic_size(); }
+  virtual google::protobuf::RepeatedPtrField<std::string> topic_name() const { return source_.topic_name(); }
+  virtual const std::string& topic_name(int topic_id) const { return source_.topic_name(topic_id); }
+  virtual void set_topic_name(int topic_id, const std::string& topic_name);
+  virtual ModelName model_name() const { return source_.model_name(); }
+  virtual int64_t ByteSize() const;
+  virtual bool is_packable() const { return false; }
+
+  virtual const Token& token(int index) const { return source_.token(index); }
+  virtual bool has_token(const Token& token) const { return source_.has_token(token); }
+  virtual int token_index(const Token& token) const { return source_.token_index(token); }
+  virtual int64_t tokens_version() const { return source_.tokens_version(); }
+
+  virtual float get(int token_id, int topic_id) const { return row(token_id)[topic_id]; }
+  virtual void get(int token_id, std::vector<float>* buffer) const;
+  virtual void set(int token_id, int topic_id, float value) { row(token_id)[topic_id] = value; }
+  virtual void increase(int token_id, int topic_id, float increment) { row(token_id)[topic_id] += increment; }
+  // Unlike other phi matrices this is not thread-safe: a token range is filled by a single thread
+  virtual void increase(int token_id, const std::vector<float>& increment);
+
+  virtual int get_non_zero_topic_size(int token_id) const { return topic_size(); }
+  virtual void get_sparse(int token_id, std::vector<float>* value_buffer, std::vector<int>* index_buffer) const;
+
+  virtual void Clear();
+  virtual int AddToken(const Token& token);
+
+  virtual std::shared_ptr<PhiMatrix> Duplicate() const;
+
+  int token_begin() const { return token_begin_; }
+  int token_end() const { return token_end_; }
+
+ private:
+  float* row(int token_id);
+  const float* row(int token_id) const;
+  void CheckTokenId(int token_id) const;
+
+  const PhiMatrix& source_;
+  int token_begin_;
+  int token_end_;
+  std::vector<float> values_;
+};
+
 }  // namespace core
 }  // namespace artm
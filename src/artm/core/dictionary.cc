@@ -1,50 +1,43 @@
 // Copyright 2017, Additive Regularization of Topic Models.
 
 #include "artm/core/dictionary.h"
+#include "artm/core/phi_matrix.h"
 #include "artm/utility/memory_usage.h"
 
 namespace artm {
 namespace core {
 
 void Dictionary::AddEntry(const DictionaryEntry& entry) {
-  if (token_index_.find(entry.token()) != token_index_.end()) {
-    LOG(WARNING) << "Token " << entry.token().keyword << " (" << entry.token().class_id
+  if (!token_index_.insert(entry.token(), static_cast<int>(entries_.size()))) {
+    LOG(WARNING) << "Token " << entry.token().keyword() << " (" << entry.token().class_id()
       << ") is already in dictionary";
     return;
   }
 
   entries_.push_back(entry);
-  token_index_.insert(std::make_pair(entry.token(), entries_.size() - 1));
 }
 
-void Dictionary::AddCoocImpl(const Token& token_1, const Token& token_2, float value, CoocMap* cooc_map) {
+void Dictionary::Reserve(int size) {
+  entries_.reserve(size);
+  token_index_.reserve(size);
+}
+
+void Dictionary::AddCoocImpl(const Token& token_1, const Token& token_2, float value, CoocMatrix* cooc_matrix) {
   // check tokens are in the dictionary, e.g. exist in token_index_
-  auto token_1_index = token_index_.find(token_1);
-  if (token_1_index == token_index_.end()) {
-    LOG(WARNING) << "No token " << token_1.keyword
-                 << " (" << token_1.class_id << ") in dictionary";
+  int token_1_index = token_index_.find(token_1);
+  if (token_1_index == TokenIndex::kNotFound) {
+    LOG(WARNING) << "No token " << token_1.keyword()
+                 << " (" << token_1.class_id() << ") in dictionary";
     return;
   }
 
-  auto token_2_index = token_index_.find(token_2);
-  if (token_2_index == token_index_.end()) {
-    LOG(WARNING) << "No token " << token_2.keyword << " (" << token_2.class_id << ") in dictionary";
+  int token_2_index = token_index_.find(token_2);
+  if (token_2_index == TokenIndex::kNotFound) {
+    LOG(WARNING) << "No token " << token_2.keyword() << " (" << token_2.class_id() << ") in dictionary";
     return;
   }
 
-  AddCoocImpl(token_1_index->second, token_2_index->second, value, cooc_map);
-}
-
-void Dictionary::AddCoocImpl(int index_1, int index_2, float value, CoocMap* cooc_map) {
-  // try to find token_1 in the first level of cooc_map, if no one was found, add token_1
-  auto iter_1 = cooc_map->find(index_1);
-  if (iter_1 == cooc_map->end()) {
-    cooc_map->insert(std::make_pair(index_1, std::unordered_map<int, float>()));
-    iter_1 = cooc_map->find(index_1);
-  }
-
-  // std::map::insert() ignores attempts to write several pairs with same key
-  iter_1->second.insert(std::make_pair(index_2, value));
+  cooc_matrix->Add(token_1_index, token_2_index, value);
 }
 
 void Dictionary::AddCoocValue(const Token& token_1, const Token& token_2, float value) {
@@ -60,78 +53,70 @@ void Dictionary::AddCoocDf(const Token& token_1, const Token& token_2, float df)
 }
 
 void Dictionary::AddCoocValue(int index_1, int index_2, float value) {
-  AddCoocImpl(index_1, index_2, value, &cooc_values_);
+  cooc_values_.Add(index_1, index_2, value);
 }
 void Dictionary::AddCoocTf(int index_1, int index_2, float value) {
-  AddCoocImpl(index_1, index_2, value, &cooc_tfs_);
+  cooc_tfs_.Add(index_1, index_2, value);
 }
 void Dictionary::AddCoocDf(int index_1, int index_2, float value) {
-  AddCoocImpl(index_1, index_2, value, &cooc_dfs_);
+  cooc_dfs_.Add(index_1, index_2, value);
+}
+
+void Dictionary::FreezeCooc() {
+  cooc_values_.Freeze();
+  cooc_tfs_.Freeze();
+  cooc_dfs_.Freeze();
+}
+
+void Dictionary::AttachCoocValues(std::shared_ptr<const void> holder, int num_rows,
+                                  const int64_t* row_ptr, const int* col, const float* value) {
+  cooc_values_.Attach(holder, num_rows, row_ptr, col, value);
 }
 
 bool Dictionary::has_valid_cooc_state() const {
-  if (cooc_tfs_.size() == 0 && cooc_dfs_.size() == 0) {
+  if (cooc_tfs_.empty() && cooc_dfs_.empty()) {
     return true;
   }
 
-  return (cooc_dfs_.size() == cooc_tfs_.size()) && (cooc_dfs_.size() == cooc_values_.size());
+  return (cooc_dfs_.num_nonempty_rows() == cooc_tfs_.num_nonempty_rows()) &&
+         (cooc_dfs_.num_nonempty_rows() == cooc_values_.num_nonempty_rows());
 }
 
 int64_t Dictionary::ByteSize() const {
   int64_t retval = 0;
   retval += ::artm::utility::getMemoryUsage(entries_);
-  retval += ::artm::utility::getMemoryUsage(token_index_);
-  retval += ::artm::utility::getMemoryUsage(cooc_values_);
-  retval += ::artm::utility::getMemoryUsage(cooc_tfs_);
-  retval += ::artm::utility::getMemoryUsage(cooc_dfs_);
-  for (const auto& entry : cooc_values_) {
-    retval += ::artm::utility::getMemoryUsage(entry.second);
-  }
-
-  for (const auto& entry : cooc_tfs_) {
-    retval += ::artm::utility::getMemoryUsage(entry.second);
-  }
-
-  for (const auto& entry : cooc_dfs_) {
-    retval += ::artm::utility::getMemoryUsage(entry.second);
-  }
-
-  for (const auto& entry : entries_) {
-    retval += 2 * (entry.token().keyword.size() + entry.token().class_id.size());
-  }
+  retval += token_index_.ByteSize();
+  retval += cooc_values_.ByteSize();
+  retval += cooc_tfs_.ByteSize();
+  retval += cooc_dfs_.ByteSize();
   return retval;
 }
 
-const std::unordered_map<int, float>* Dictionary::cooc_info_impl(const Token& token, const CoocMap& cooc_map) const {
-  auto index_iter = token_index_.find(token);
-  if (index_iter == token_index_.end()) {
-    return nullptr;
+CoocMatrix::Row Dictionary::cooc_info_impl(const Token& token, const CoocMatrix& cooc_matrix) const {
+  int index = token_index_.find(token);
+  if (index == TokenIndex::kNotFound) {
+    return CoocMatrix::Row();
   }
 
-  auto cooc_map_iter = cooc_map.find(index_iter->second);
-  if (cooc_map_iter == cooc_map.end()) {
-    return nullptr;
-  }
-
-  return &(cooc_map_iter->second);
+  return cooc_matrix.row(index);
 }
 
-const std::unordered_map<int, float>*  Dictionary::token_cooc_values(const Token& token) const {
+CoocMatrix::Row Dictionary::token_cooc_values(const Token& token) const {
   return cooc_info_impl(token, cooc_values_);
 }
 
-const std::unordered_map<int, float>*  Dictionary::token_cooc_tfs(const Token& token) const {
+CoocMatrix::Row Dictionary::token_cooc_tfs(const Token& token) const {
   return cooc_info_impl(token, cooc_tfs_);
 }
 
-const std::unordered_map<int, float>*  Dictionary::token_cooc_dfs(const Token& token) const {
+CoocMatrix::Row Dictionary::token_cooc_dfs(const Token& token) const {
   return cooc_info_impl(token, cooc_dfs_);
 }
 
 const DictionaryEntry* Dictionary::entry(const Token& token) const {
-  auto find_iter = token_index_.find(token);
-  if (find_iter != token_index_.end()) {
-    return &entries_[find_iter->second];
+  int index = token_index_.find(token);
+  if (index != TokenIndex::kNotFound) {
+    return &entries_[index];
   } else {
     return nullptr;
   }
@@ -151,14 +136,10 @@ float Dictionary::CountTopicCoherence(const std::vector<core::Token>& tokens_to_
     return 0.0f;
   }
 
-  // -1 means that find() result == end()
-  auto indices = std::vector<int>(k, -1);
+  // TokenIndex::kNotFound (-1) means that the token is not in the dictionary
+  auto indices = std::vector<int>(k, TokenIndex::kNotFound);
   for (int i = 0; i < k; ++i) {
-    auto token_index_iter = token_index_.find(tokens_to_score[i]);
-    if (token_index_iter == token_index_.end()) {
-      continue;
-    }
-    indices[i] = token_index_iter->second;
+    indices[i] = token_index_.find(tokens_to_score[i]);
   }
 
   for (int i = 0; i < k - 1; ++i) {
@@ -166,8 +147,8 @@ float Dictionary::CountTopicCoherence(const std::vector<core::Token>& tokens_to_
       continue;
     }
 
-    auto cooc_map_iter = cooc_values_.find(indices[i]);
-    if (cooc_map_iter == cooc_values_.end()) {
+    CoocMatrix::Row cooc_row = cooc_values_.row(indices[i]);
+    if (cooc_row.empty()) {
       continue;
     }
 
@@ -176,15 +157,15 @@ float Dictionary::CountTopicCoherence(const std::vector<core::Token>& tokens_to_
         continue;
       }
 
-      if (tokens_to_score[j].class_id != tokens_to_score[i].class_id) {
+      if (tokens_to_score[j].class_id_id() != tokens_to_score[i].class_id_id()) {
         continue;
       }
 
-      auto value_iter = cooc_map_iter->second.find(indices[j]);
-      if (value_iter == cooc_map_iter->second.end()) {
+      const float* value = cooc_row.find(indices[j]);
+      if (value == nullptr) {
         continue;
       }
-      coherence_value += static_cast<float>(value_iter->second);
+      coherence_value += *value;
     }
   }
 
@@ -204,6 +185,54 @@ void Dictionary::clear_cooc() {
   cooc_dfs_.clear();
 }
 
+std::shared_ptr<const DictionaryPhiIndex::Mapping>
+DictionaryPhiIndex::get(const std::shared_ptr<Dictionary>& dictionary, const PhiMatrix& phi_matrix) {
+  std::lock_guard<std::mutex> guard(lock_);
+  const int64_t tokens_version = phi_matrix.tokens_version();
+  const bool same_dictionary = (mapping_ != nullptr) && (dictionary_.lock() == dictionary);
+  if (same_dictionary && tokens_version == tokens_version_) {
+    return mapping_;
+  }
+
+  // Copies of phi matrix keep the version of their tokens, but matrices that were filled independently
+  // (for example, n_wt and p_wt rebuilt on the next iteration) get new versions even when their tokens
+  // are the same, so it is cheaper to compare the tokens than to rebuild the mapping
+  const int token_size = phi_matrix.token_size();
+  bool same_tokens = (static_cast<int>(phi_tokens_.size()) == token_size);
+  for (int token_id = 0; same_tokens && token_id < token_size; ++token_id) {
+    same_tokens = (phi_tokens_[token_id] == phi_matrix.token(token_id));
+  }
+
+  tokens_version_ = tokens_version;
+  if (same_dictionary && same_tokens) {
+    return mapping_;
+  }
+
+  if (!same_tokens) {
+    phi_tokens_.clear();
+    phi_tokens_.reserve(token_size);
+    for (int token_id = 0; token_id < token_size; ++token_id) {
+      phi_tokens_.push_back(phi_matrix.token(token_id));
+    }
+  }
+
+  std::shared_ptr<Mapping> mapping(new Mapping());
+  mapping->dict_to_phi.resize(dictionary->size(), -1);
+  mapping->phi_to_dict.resize(token_size, -1);
+  const std::vector<DictionaryEntry>& entries = dictionary->entries();
+  for (int index = 0; index < dictionary->size(); ++index) {
+    const int token_id = phi_matrix.token_index(entries[index].token());
+    mapping->dict_to_phi[index] = token_id;
+    if (token_id != -1) {
+      mapping->phi_to_dict[token_id] = index;
+    }
+  }
+
+  dictionary_ = dictionary;
+  mapping_ = mapping;
+  return mapping_;
+}
+
 }  // namespace core
 }  // namespace artm
 // vim: set ts=2 sw=2:
@@ -3,6 +3,8 @@
 #pragma once
 
 #include <map>
+#include <memory>
+#include <mutex>  // NOLINT
 #include <string>
 #include <vector>
 #include <unordered_map>
@@ -10,13 +12,16 @@
 #include <utility>
 
 #include "artm/core/common.h"
+#include "artm/core/cooc_matrix.h"
 #include "artm/core/thread_safe_holder.h"
 #include "artm/core/token.h"
+#include "artm/core/token_index.h"
 
 namespace artm {
 namespace core {
 
 class Dictionary;
+class PhiMatrix;
 
 // ThreadSafeDictionaryCollection is a collection of dictionaries.
 // It is typically accessed via a ThreadSafeDictionaryCollection::singleton(),
@@ -24,8 +29,6 @@ class Dictionary;
 // The key (std::string) corresponds to the name of the dictionary.
 typedef ThreadSafeCollectionHolder<std::string, Dictionary> ThreadSafeDictionaryCollection;
 
-typedef std::unordered_map<int, std::unordered_map<int, float> > CoocMap;
-
 // DictionaryEntry represents one entry in the dictionary, associated with a specific token.
 class DictionaryEntry {
  public:
@@ -50,6 +53,8 @@ class DictionaryEntry {
 // entries will define the order of tokens in the PhiMatrix.
 // Dictionary also supports an efficient lookup of the entries by its token.
 // Dictionary also stores a co-occurence data, used by Coherence score and regularizer.
+// Co-occurences are added during construction of the dictionary and become visible after FreezeCooc(),
+// which packs them into compact sparse rows (see CoocMatrix).
 class Dictionary {
  public:
   explicit Dictionary(const std::string& name) : name_(name) { }
@@ -57,6 +62,9 @@ class Dictionary {
   // SECTION OF SETTERS
   void AddEntry(const DictionaryEntry& entry);
 
+  // Prepares the dictionary to hold size entries without reallocations.
+  void Reserve(int size);
+
   void AddCoocValue(const Token& token_1, const Token& token_2, float value);
   void AddCoocTf(const Token& token_1, const Token& token_2, float value);
   void AddCoocDf(const Token& token_1, const Token& token_2, float value);
@@ -65,15 +73,23 @@ class Dictionary {
   void AddCoocTf(int index_1, int index_2, float value);
   void AddCoocDf(int index_1, int index_2, float value);
 
+  void FreezeCooc();
+
+  // Makes cooc values a view of external CSR arrays, indexed by positions of tokens in the dictionary
+  // (see CoocMatrix::Attach()).
+  void AttachCoocValues(std::shared_ptr<const void> holder, int num_rows,
+                        const int64_t* row_ptr, const int* col, const float* value);
+
   void SetNumItems(int num_items) { num_items_in_collection_ = num_items; }
 
   // SECTION OF GETTERS
-  bool HasToken(const Token& token) const { return token_index_.find(token) != token_index_.end(); }
+  bool HasToken(const Token& token) const { return token_index_.has_token(token); }
 
   // general method to return all cooc tokens with their values for given token
-  const std::unordered_map<int, float>* token_cooc_values(const Token& token) const;
-  const std::unordered_map<int, float>* token_cooc_tfs(const Token& token) const;
-  const std::unordered_map<int, float>* token_cooc_dfs(const Token& token) const;
+  // (the row is empty if the token has no co-occurences)
+  CoocMatrix::Row token_cooc_values(const Token& token) const;
+  CoocMatrix::Row token_cooc_tfs(const Token& token) const;
+  CoocMatrix::Row token_cooc_dfs(const Token& token) const;
 
   const DictionaryEntry* entry(const Token& token) const;
   const DictionaryEntry* entry(int index) const;
@@ -85,11 +101,11 @@ class Dictionary {
   int64_t ByteSize() const;
 
   const std::vector<DictionaryEntry>& entries() const { return entries_; }
-  const std::unordered_map<Token, int, TokenHasher>& token_index() const { return token_index_; }
+  const TokenIndex& token_index() const { return token_index_; }
 
-  const std::unordered_map<int, std::unordered_map<int, float> >& cooc_values() const { return cooc_values_; }
-  const std::unordered_map<int, std::unordered_map<int, float> >& cooc_tfs() const { return cooc_tfs_; }
-  const std::unordered_map<int, std::unordered_map<int, float> >& cooc_dfs() const { return cooc_dfs_; }
+  const CoocMatrix& cooc_values() const { return cooc_values_; }
+  const CoocMatrix& cooc_tfs() const { return cooc_tfs_; }
+  const CoocMatrix& cooc_dfs() const { return cooc_dfs_; }
 
   // SECTION OF OPERATIONS
   float CountTopicCoherence(const std::vector<core::Token>& tokens_to_score);
@@ -102,15 +118,36 @@ class Dictionary {
  private:
   std::string name_;
   std::vector<DictionaryEntry> entries_;
-  std::unordered_map<Token, int, TokenHasher> token_index_;
-  CoocMap cooc_values_;
-  CoocMap cooc_tfs_;
-  CoocMap cooc_dfs_;
+  TokenIndex token_index_;
+  CoocMatrix cooc_values_;
+  CoocMatrix cooc_tfs_;
+  CoocMatrix cooc_dfs_;
   size_t num_items_in_collection_;
 
-  void AddCoocImpl(const Token& token_1, const Token& token_2, float value, CoocMap* cooc_map);
-  void AddCoocImpl(int index_1, int index_2, float value, CoocMap* cooc_map);
-  const std::unordered_map<int, float>* cooc_info_impl(const Token& token, const CoocMap& cooc_map) const;
+  void AddCoocImpl(const Token& token_1, const Token& token_2, float value, CoocMatrix* cooc_matrix);
+  CoocMatrix::Row cooc_info_impl(const Token& token, const CoocMatrix& cooc_matrix) const;
+};
+
+// DictionaryPhiIndex maps positions of tokens in a dictionary to their indices in a phi matrix and back
+// (-1 stands for an absent token). Phi regularizers keep it between iterations to avoid a hash lookup
+// per token: the mapping is rebuilt only when the dictionary or the set of tokens of the phi matrix changes.
+class DictionaryPhiIndex {
+ public:
+  struct Mapping {
+    std::vector<int> dict_to_phi;
+    std::vector<int> phi_to_dict;
+  };
+
+  DictionaryPhiIndex() : tokens_version_(-1) { }
+
+  std::shared_ptr<const Mapping> get(const std::shared_ptr<Dictionary>& dictionary, const PhiMatrix& phi_matrix);
+
+ private:
+  std::mutex lock_;
+  std::weak_ptr<Dictionary> dictionary_;
+  int64_t tokens_version_;
+  std::vector<Token> phi_tokens_;
+  std::shared_ptr<const Mapping> mapping_;
 };
 
 }  // namespace core
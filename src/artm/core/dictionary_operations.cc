@@ -2,23 +2,33 @@
 
 #include <algorithm>
 #include <climits>
+#include <cstring>
 #include <fstream>
 #include <functional>
+#include <limits>
 #include <map>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
 #include <memory>
+#include <queue>
+#include <thread>  // NOLINT
+#include <future>  // NOLINT
 #include <vector>
 #include <utility>
 
 #include "boost/algorithm/string.hpp"
 #include "boost/algorithm/string/predicate.hpp"
+#include "boost/filesystem.hpp"
+#include "boost/iostreams/device/mapped_file.hpp"
 #include "boost/lexical_cast.hpp"
 #include "boost/uuid/uuid_io.hpp"
 #include "boost/uuid/uuid_generators.hpp"
 
+#include "artm/core/call_on_destruction.h"
+#include "artm/core/cooc_file.h"
 #include "artm/core/helpers.h"
+#include "artm/core/token_index.h"
 #include "artm/utility/ifstream_or_cin.h"
 
 #include "artm/core/dictionary_operations.h"
@@ -28,6 +38,132 @@ using ::artm::utility::ifstream_or_cin;
 namespace artm {
 namespace core {
 
+// Loads cooc values from a binary co-occurrence file (see CoocFile). Tokens of the file, that are not
+// in the dictionary, are skipped. If the file lists tokens in the same order as the dictionary,
+// the dictionary refers to the memory-mapped file instead of copying it.
+static void LoadCoocFile(const std::string& file_name, bool symmetric_cooc_values, Dictionary* dictionary) {
+  std::shared_ptr<CoocFile> cooc_file = CoocFile::Open(file_name);
+  const int num_tokens = cooc_file->num_tokens();
+
+  std::vector<int> dictionary_index(num_tokens, TokenIndex::kNotFound);
+  bool same_order = (num_tokens <= dictionary->size());
+  int num_missing_tokens = 0;
+  for (int token_id = 0; token_id < num_tokens; ++token_id) {
+    dictionary_index[token_id] = dictionary->token_index().find(cooc_file->tokens()[token_id]);
+    if (dictionary_index[token_id] == TokenIndex::kNotFound) {
+      num_missing_tokens++;
+    }
+    if (dictionary_index[token_id] != token_id) {
+      same_order = false;
+    }
+  }
+
+  if (num_missing_tokens > 0) {
+    LOG(WARNING) << num_missing_tokens << " tokens from " << file_name << " are not in dictionary "
+                 << dictionary->name() << ", their co-occurrences are skipped";
+  }
+
+  if (same_order && !symmetric_cooc_values && dictionary->cooc_values().empty()) {
+    dictionary->AttachCoocValues(cooc_file, num_tokens, cooc_file->row_ptr(), cooc_file->col(), cooc_file->value());
+    return;
+  }
+
+  const int64_t* row_ptr = cooc_file->row_ptr();
+  for (int token_id = 0; token_id < num_tokens; ++token_id) {
+    const int first_index = dictionary_index[token_id];
+    if (first_index == TokenIndex::kNotFound) {
+      continue;
+    }
+
+    for (int64_t i = row_ptr[token_id]; i < row_ptr[token_id + 1]; ++i) {
+      const int second_index = dictionary_index[cooc_file->col()[i]];
+      if (second_index == TokenIndex::kNotFound) {
+        continue;
+      }
+
+      dictionary->AddCoocValue(first_index, second_index, cooc_file->value()[i]);
+      if (symmetric_cooc_values) {
+        dictionary->AddCoocValue(second_index, first_index, cooc_file->value()[i]);
+      }
+    }
+  }
+  dictionary->FreezeCooc();
+}
+
+// Loads cooc values from a text co-occurrence file, where every line holds the first token and pairs
+// <second token>:<value> (tokens can be preceded by |<class_id>). All the tokens must be in token_to_token_id.
+static void LoadTextCoocFile(const std::string& file_name,
+                             const std::unordered_map<Token, int, TokenHasher>& token_to_token_id,
+                             bool symmetric_cooc_values, Dictionary* dictionary) {
+  ifstream_or_cin stream_or_cin(file_name);
+  std::istream& user_cooc_data = stream_or_cin.get_stream();
+
+  // Craft the co-occurence part of dictionary
+  std::string str;
+  while (!user_cooc_data.eof()) {
+    std::getline(user_cooc_data, str);
+    boost::algorithm::trim(str);
+
+    ClassId first_token_class_id = DefaultClass;  // Here's how modality is indicated in output file
+    std::vector<std::string> strs;
+    boost::split(strs, str, boost::is_any_of(" :\t\r"));
+    unsigned pos_of_first_token = 0;
+    // Find modality and position of the first token
+    for (; pos_of_first_token < strs.size() && (strs[pos_of_first_token].empty() ||
+                                                strs[pos_of_first_token][0] == '|'); ++pos_of_first_token) {
+      if (!strs[pos_of_first_token].empty()) {
+        first_token_class_id = strs[pos_of_first_token];
+        first_token_class_id.erase(0, 1);
+      }
+    }
+    if (pos_of_first_token >= strs.size()) {
+      continue;
+    }
+    std::string first_token_str = strs[pos_of_first_token];
+    Token first_token = Token::Find(first_token_class_id, first_token_str);
+    auto first_token_ptr = token_to_token_id.find(first_token);
+    if (first_token_ptr == token_to_token_id.end()) {
+      std::stringstream ss;
+      ss << "Token (" << first_token_str << ", " << first_token_class_id << ") not found in vocab";
+      BOOST_THROW_EXCEPTION(InvalidOperation(ss.str()));
+    }
+    unsigned not_a_word_counter = 0;
+    for (unsigned i = pos_of_first_token + 1; i + not_a_word_counter < strs.size(); i += 2) {
+      ClassId second_token_class_id = first_token_class_id;
+      for (; i + not_a_word_counter < strs.size() && (strs[i + not_a_word_counter].empty() ||
+                                                      strs[i + not_a_word_counter][0] == '|');
+                                                      ++not_a_word_counter) {
+        if (!strs[i + not_a_word_counter].empty()) {
+          second_token_class_id = strs[i + not_a_word_counter];
+          second_token_class_id.erase(0, 1);
+        }
+      }
+      if (i + not_a_word_counter + 1 >= strs.size()) {
+        break;
+      }
+      std::string second_token_str = strs[i + not_a_word_counter];
+      Token second_token = Token::Find(second_token_class_id, second_token_str);
+      auto second_token_ptr = token_to_token_id.find(second_token);
+      if (second_token_ptr == token_to_token_id.end()) {
+        std::stringstream ss;
+        ss << "Token (" << second_token_str << ", " << second_token_class_id << ") not found in vocab";
+        BOOST_THROW_EXCEPTION(InvalidOperation(ss.str()));
+      }
+      int first_index = first_token_ptr->second;
+      int second_index = second_token_ptr->second;
+      float value = std::stof(strs[i + not_a_word_counter + 1]);
+
+      dictionary->AddCoocValue(first_index, second_index, value);
+
+      // ToDo(MelLain): support adding tf/df in future
+
+      if (symmetric_cooc_values) {
+        dictionary->AddCoocValue(second_index, first_index, value);
+      }
+    }
+  }
+}
+
 std::shared_ptr<Dictionary> DictionaryOperations::Create(const DictionaryData& data) {
   auto dictionary = std::make_shared<Dictionary>(Dictionary(data.name()));
 
@@ -50,6 +186,81 @@ std::shared_ptr<Dictionary> DictionaryOperations::Create(const DictionaryData& d
   return dictionary;
 }
 
+// Exported dictionary starts with a format version (one byte). Version 0 is a sequence of DictionaryData chunks,
+// each prefixed with its int32 length: all tokens in the first chunk, then chunks with co-occurrences.
+// Version 1 has the same chunks (but tokens are split into several chunks), followed by an index of chunks
+// (int32 number of chunks, then one DictionaryChunkIndexEntry per chunk) and by the int64 offset of the index.
+// The index lets several threads serialize and parse chunks independently.
+// Version 0 is still written on request (ExportDictionaryArgs.format_version), for older releases.
+const char kDictionaryFormatVersion = 1;
+const int kTokensPerChunk = 256 * 1024;
+const int kCoocValuesPerChunk = 1000 * 1000;
+
+struct DictionaryChunkIndexEntry {
+  int64_t offset;  // offset of serialized DictionaryData (after its length)
+  int32_t length;
+  int32_t num_tokens;  // zero for chunks with co-occurrences
+};
+
+template <typename Args>
+static int GetNumThreads(const Args& args, int num_tasks) {
+  int num_threads = args.num_threads();
+  if (!args.has_num_threads() || num_threads < 0) {
+    num_threads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+  }
+  return std::max(1, std::min(num_threads, num_tasks));
+}
+
+// Serializes entries of the dictionary with indices in [begin, end), or their co-occurrences.
+static std::string SerializeDictionaryChunk(const ExportDictionaryArgs& args, const Dictionary& dict,
+                                            bool is_cooc_chunk, int begin, int end) {
+  DictionaryData dict_data;
+  if (!is_cooc_chunk) {
+    dict_data.set_name(args.dictionary_name());
+    dict_data.set_num_items_in_collection(dict.num_items());
+    for (int token_id = begin; token_id < end; ++token_id) {
+      auto entry = dict.entry(token_id);
+      dict_data.add_token(entry->token().keyword());
+      dict_data.add_class_id(entry->token().class_id());
+      dict_data.add_token_value(entry->token_value());
+      dict_data.add_token_tf(entry->token_tf());
+      dict_data.add_token_df(entry->token_df());
+    }
+  } else {
+    for (int token_id = begin; token_id < end; ++token_id) {
+      CoocMatrix::Row cooc_values_info = dict.cooc_values().row(token_id);
+      CoocMatrix::Row cooc_tfs_info = dict.cooc_tfs().row(token_id);
+      CoocMatrix::Row cooc_dfs_info = dict.cooc_dfs().row(token_id);
+
+      for (int i = 0; i < cooc_values_info.size(); ++i) {
+        dict_data.add_cooc_first_index(token_id);
+        dict_data.add_cooc_second_index(cooc_values_info.col(i));
+        dict_data.add_cooc_value(cooc_values_info.value(i));
+        if (!cooc_tfs_info.empty()) {
+          const float* tf = cooc_tfs_info.find(cooc_values_info.col(i));
+          const float* df = cooc_dfs_info.find(cooc_values_info.col(i));
+
+          if (tf == nullptr || df == nullptr) {
+            BOOST_THROW_EXCEPTION(InvalidOperation("Dictionary " +
+                args.dictionary_name() + " has internal cooc tf/df inconsistence"));
+          }
+
+          dict_data.add_cooc_tf(*tf);
+          dict_data.add_cooc_df(*df);
+        }
+      }
+    }
+  }
+
+  std::string str = dict_data.SerializeAsString();
+  if (str.size() >= kProtobufCodedStreamTotalBytesLimit) {
+    BOOST_THROW_EXCEPTION(InvalidOperation("Dictionary " +
+      args.dictionary_name() + " is too large to export"));
+  }
+
+  return str;
+}
+
 void DictionaryOperations::Export(const ExportDictionaryArgs& args, const Dictionary& dict) {
   std::string file_name = args.file_name();
   if (!boost::algorithm::ends_with(file_name, ".dict")) {
@@ -69,127 +280,143 @@ void DictionaryOperations::Export(const ExportDictionaryArgs& args, const Dictio
   if (!dict.has_valid_cooc_state()) {
     BOOST_THROW_EXCEPTION(InvalidOperation("Dictionary " +
       args.dictionary_name() + " has invalid cooc state (num values: " +
-      std::to_string(dict.cooc_values().size()) +
-      ", num tfs: " + std::to_string(dict.cooc_tfs().size()) +
-      ", num dfs: " + std::to_string(dict.cooc_dfs().size()) + ")"));
+      std::to_string(dict.cooc_values().num_nonempty_rows()) +
+      ", num tfs: " + std::to_string(dict.cooc_tfs().num_nonempty_rows()) +
+      ", num dfs: " + std::to_string(dict.cooc_dfs().num_nonempty_rows()) + ")"));
   }
 
   LOG(INFO) << "Exporting dictionary " << args.dictionary_name() << " to " << file_name;
 
   const int token_size = static_cast<int>(dict.size());
 
-  // ToDo: MelLain
-  // Add ability to save and load several token_dict_data
-  // int tokens_per_chunk = std::min<int>(token_size, 3e+7);
-
-  const char version = 0;
-  fout << version;
-
-  DictionaryData token_dict_data;
-  token_dict_data.set_name(args.dictionary_name());
-  token_dict_data.set_num_items_in_collection(dict.num_items());
-  for (int token_id = 0; token_id < token_size; ++token_id) {
-    auto entry = dict.entry(token_id);
-    token_dict_data.add_token(entry->token().keyword);
-    token_dict_data.add_class_id(entry->token().class_id);
-    token_dict_data.add_token_value(entry->token_value());
-    token_dict_data.add_token_tf(entry->token_tf());
-    token_dict_data.add_token_df(entry->token_df());
+  // split the dictionary into chunks: entries go first, then co-occurrences
+  struct ChunkRange {
+    bool is_cooc_chunk;
+    int begin;
+    int end;
+  };
+
+  // version 0 keeps all tokens in the first chunk
+  const char version = static_cast<char>(args.format_version());
+  std::vector<ChunkRange> chunks;
+  if (version == 0) {
+    chunks.push_back({ false, 0, token_size });
+  } else {
+    for (int begin = 0; begin < token_size; begin += kTokensPerChunk) {
+      chunks.push_back({ false, begin, std::min(token_size, begin + kTokensPerChunk) });
+    }
   }
 
-  std::string str = token_dict_data.SerializeAsString();
-  if (str.size() >= kProtobufCodedStreamTotalBytesLimit) {
-    BOOST_THROW_EXCEPTION(InvalidOperation("Dictionary " +
-      args.dictionary_name() + " is too large to export"));
+  int64_t current_cooc_length = 0;
+  for (int token_id = 0, begin = 0; token_id < token_size && !dict.cooc_values().empty(); ++token_id) {
+    current_cooc_length += dict.cooc_values().row(token_id).size();
+    if ((current_cooc_length >= kCoocValuesPerChunk) || ((token_id + 1) == token_size)) {
+      if (current_cooc_length > 0) {
+        chunks.push_back({ true, begin, token_id + 1 });
+      }
+      begin = token_id + 1;
+      current_cooc_length = 0;
+    }
   }
 
-  int length = static_cast<int>(str.size());
-  fout.write(reinterpret_cast<char *>(&length), sizeof(length));
-  fout << str;
+  fout << version;
 
-  DictionaryData cooc_dict_data;
-  int current_cooc_length = 0;
-  const int max_cooc_length = 10 * 1000 * 1000;
-  if (dict.cooc_values().size()) {
-    for (int token_id = 0; token_id < token_size; ++token_id) {
-      auto entry = dict.entry(token_id);
-      auto cooc_values_info = dict.token_cooc_values(entry->token());
-      auto cooc_tfs_info = dict.token_cooc_tfs(entry->token());
-      auto cooc_dfs_info = dict.token_cooc_dfs(entry->token());
-
-      if (cooc_values_info != nullptr) {
-        for (auto iter = cooc_values_info->begin(); iter != cooc_values_info->end(); ++iter) {
-          cooc_dict_data.add_cooc_first_index(token_id);
-          cooc_dict_data.add_cooc_second_index(iter->first);
-          cooc_dict_data.add_cooc_value(iter->second);
-          if (cooc_tfs_info != nullptr) {
-            auto tf_iter = cooc_tfs_info->find(iter->first);
-            auto df_iter = cooc_dfs_info->find(iter->first);
-
-            if (tf_iter == cooc_tfs_info->end() || df_iter == cooc_dfs_info->end()) {
-              BOOST_THROW_EXCEPTION(InvalidOperation("Dictionary " +
-                  args.dictionary_name() + " has internal cooc tf/df inconsistence"));
-            }
-
-            cooc_dict_data.add_cooc_tf(tf_iter->second);
-            cooc_dict_data.add_cooc_df(df_iter->second);
-          }
-          current_cooc_length++;
-        }
-      }
+  // chunks are serialized by num_threads threads at a time and written in their order
+  const int num_threads = GetNumThreads(args, static_cast<int>(chunks.size()));
+  std::vector<DictionaryChunkIndexEntry> index;
+  for (size_t first_chunk = 0; first_chunk < chunks.size(); first_chunk += num_threads) {
+    const size_t last_chunk = std::min(chunks.size(), first_chunk + num_threads);
+    std::vector<std::future<std::string>> serialized_chunks;
+    for (size_t chunk_index = first_chunk; chunk_index < last_chunk; ++chunk_index) {
+      const ChunkRange chunk = chunks[chunk_index];
+      serialized_chunks.push_back(std::async(std::launch::async, [&args, &dict, chunk]() {
+        return SerializeDictionaryChunk(args, dict, chunk.is_cooc_chunk, chunk.begin, chunk.end);
+      }));
+    }
 
-      if ((current_cooc_length >= max_cooc_length) || ((token_id + 1) == token_size)) {
-        std::string str = cooc_dict_data.SerializeAsString();
-        if (str.size() >= kProtobufCodedStreamTotalBytesLimit) {
-          BOOST_THROW_EXCEPTION(InvalidOperation(
-            "Unable to serialize coocurence information in Dictionary " +
-            args.dictionary_name()));
-        }
+    for (size_t chunk_index = first_chunk; chunk_index < last_chunk; ++chunk_index) {
+      std::string str = serialized_chunks[chunk_index - first_chunk].get();
+      const ChunkRange& chunk = chunks[chunk_index];
 
-        int length = static_cast<int>(str.size());
-        fout.write(reinterpret_cast<char *>(&length), sizeof(length));
-        fout << str;
-        cooc_dict_data.clear_cooc_first_index();
-        cooc_dict_data.clear_cooc_second_index();
-        cooc_dict_data.clear_cooc_value();
-        cooc_dict_data.clear_cooc_tf();
-        cooc_dict_data.clear_cooc_df();
-        current_cooc_length = 0;
-      }
+      int length = static_cast<int>(str.size());
+      fout.write(reinterpret_cast<char *>(&length), sizeof(length));
+
+      DictionaryChunkIndexEntry index_entry;
+      index_entry.offset = fout.tellp();
+      index_entry.length = length;
+      index_entry.num_tokens = chunk.is_cooc_chunk ? 0 : (chunk.end - chunk.begin);
+      index.push_back(index_entry);
+
+      fout.write(str.data(), length);
     }
   }
 
+  if (version == kDictionaryFormatVersion) {
+    int64_t index_offset = fout.tellp();
+    int num_chunks = static_cast<int>(index.size());
+    fout.write(reinterpret_cast<char *>(&num_chunks), sizeof(num_chunks));
+    fout.write(reinterpret_cast<const char *>(index.data()), sizeof(DictionaryChunkIndexEntry) * index.size());
+    fout.write(reinterpret_cast<char *>(&index_offset), sizeof(index_offset));
+  }
+
   fout.close();
+  if (!fout) {
+    BOOST_THROW_EXCEPTION(DiskWriteException("Unable to write file " + file_name));
+  }
+
   LOG(INFO) << "Export completed, token_size = " << dict.size();
 }
 
-std::shared_ptr<Dictionary> DictionaryOperations::Import(const ImportDictionaryArgs& args) {
-  auto dictionary = std::make_shared<Dictionary>(Dictionary(args.dictionary_name()));
+// Converts tokens of DictionaryData into dictionary entries. This is the expensive part of import
+// (tokens are interned), so it runs in parallel for different chunks.
+static std::vector<DictionaryEntry> ParseDictionaryEntries(const DictionaryData& dict_data) {
+  std::vector<DictionaryEntry> entries;
+  entries.reserve(dict_data.token_size());
+  TokenBuilder token_builder;
+  for (int token_id = 0; token_id < dict_data.token_size(); ++token_id) {
+    entries.push_back(DictionaryEntry(
+      token_builder.Intern(dict_data.class_id(token_id), dict_data.token(token_id)),
+      dict_data.token_value(token_id), dict_data.token_tf(token_id), dict_data.token_df(token_id)));
+  }
+  return entries;
+}
 
-  if (!boost::algorithm::ends_with(args.file_name(), ".dict")) {
-    BOOST_THROW_EXCEPTION(CorruptedMessageException(
-      "The importing dictionary should have .dict exstension, abort."));
+// Moves one chunk of exported dictionary into the dictionary.
+static void AddDictionaryChunk(const DictionaryData& dict_data, const std::vector<DictionaryEntry>& entries,
+                               const std::string& file_name, Dictionary* dictionary) {
+  if ((dict_data.token_size() > 0) == (dict_data.cooc_value_size() > 0)) {
+    BOOST_THROW_EXCEPTION(CorruptedMessageException("Error while reading from " + file_name));
   }
 
-  std::ifstream fin(args.file_name(), std::ifstream::binary);
-  if (!fin.is_open()) {
-    BOOST_THROW_EXCEPTION(DiskReadException("Unable to open file " + args.file_name()));
+  // part with main dictionary
+  if (dict_data.token_size() > 0) {
+    dictionary->SetNumItems(dict_data.num_items_in_collection());
+    for (const auto& entry : entries) {
+      dictionary->AddEntry(entry);
+    }
   }
 
-  LOG(INFO) << "Importing dictionary " << args.dictionary_name() << " from " << args.file_name();
+  // part with cooc dictionary
+  if (dict_data.cooc_value_size() > 0) {
+    for (int index = 0; index < dict_data.cooc_first_index_size(); ++index) {
+      int index_1 = dict_data.cooc_first_index(index);
+      int index_2 = dict_data.cooc_second_index(index);
+      dictionary->AddCoocValue(index_1, index_2, dict_data.cooc_value(index));
 
-  char version;
-  fin >> version;
-  if (version != 0) {
-    std::stringstream ss;
-    ss << "Unsupported format version: " << static_cast<int>(version);
-    BOOST_THROW_EXCEPTION(DiskReadException(ss.str()));
+      if (dict_data.cooc_tf_size() > 0) {
+        dictionary->AddCoocTf(index_1, index_2, dict_data.cooc_tf(index));
+        dictionary->AddCoocDf(index_1, index_2, dict_data.cooc_df(index));
+      }
+    }
   }
+}
 
-  while (!fin.eof()) {
+// Imports a dictionary in format version 0: chunks are read and added one by one.
+static void ImportSequentialChunks(const ImportDictionaryArgs& args, std::ifstream* fin, Dictionary* dictionary) {
+  while (!fin->eof()) {
     int length;
-    fin.read(reinterpret_cast<char *>(&length), sizeof(length));
-    if (fin.eof()) {
+    fin->read(reinterpret_cast<char *>(&length), sizeof(length));
+    if (fin->eof()) {
       break;
     }
 
@@ -198,42 +425,109 @@ std::shared_ptr<Dictionary> DictionaryOperations::Import(const ImportDictionaryA
     }
 
     std::string buffer(length, '\0');
-    fin.read(&buffer[0], length);
+    fin->read(&buffer[0], length);
     ::artm::DictionaryData dict_data;
     if (!dict_data.ParseFromArray(buffer.c_str(), length)) {
       BOOST_THROW_EXCEPTION(CorruptedMessageException("Unable to read from " + args.file_name()));
     }
 
-    // move data from DictionaryData into dictionary
-    if ((dict_data.token_size() > 0) == (dict_data.cooc_value_size() > 0)) {
-      BOOST_THROW_EXCEPTION(CorruptedMessageException("Error while reading from " + args.file_name()));
-    }
+    AddDictionaryChunk(dict_data, ParseDictionaryEntries(dict_data), args.file_name(), dictionary);
+  }
+}
 
-    // part with main dictionary
-    if (dict_data.token_size() > 0) {
-      dictionary->SetNumItems(dict_data.num_items_in_collection());
-      for (int token_id = 0; token_id < dict_data.token_size(); ++token_id) {
-        dictionary->AddEntry(DictionaryEntry(
-          Token(dict_data.class_id(token_id), dict_data.token(token_id)),
-          dict_data.token_value(token_id), dict_data.token_tf(token_id), dict_data.token_df(token_id)));
-      }
-    }
+// Imports a dictionary in format version 1: the file is memory-mapped, chunks are parsed
+// by num_threads threads at a time and added to the dictionary in their order.
+static void ImportIndexedChunks(const ImportDictionaryArgs& args, Dictionary* dictionary) {
+  boost::iostreams::mapped_file_source file(args.file_name());
+  const char* data = file.data();
+  const int64_t file_size = static_cast<int64_t>(file.size());
+
+  int64_t index_offset = -1;
+  int num_chunks = -1;
+  if (file_size >= static_cast<int64_t>(1 + sizeof(num_chunks) + sizeof(index_offset))) {
+    std::memcpy(&index_offset, data + file_size - sizeof(index_offset), sizeof(index_offset));
+  }
+  if (index_offset > 0 && index_offset + static_cast<int64_t>(sizeof(num_chunks)) <= file_size) {
+    std::memcpy(&num_chunks, data + index_offset, sizeof(num_chunks));
+  }
+  if (num_chunks < 0 || index_offset + static_cast<int64_t>(sizeof(num_chunks) +
+      num_chunks * sizeof(DictionaryChunkIndexEntry) + sizeof(index_offset)) != file_size) {
+    BOOST_THROW_EXCEPTION(CorruptedMessageException("Unable to read index from " + args.file_name()));
+  }
 
-    // part with cooc dictionary
-    if (dict_data.cooc_value_size() > 0) {
-      for (int index = 0; index < dict_data.cooc_first_index_size(); ++index) {
-        int index_1 = dict_data.cooc_first_index(index);
-        int index_2 = dict_data.cooc_second_index(index);
-        dictionary->AddCoocValue(index_1, index_2, dict_data.cooc_value(index));
+  std::vector<DictionaryChunkIndexEntry> index(num_chunks);
+  std::memcpy(index.data(), data + index_offset + sizeof(num_chunks), sizeof(DictionaryChunkIndexEntry) * num_chunks);
 
-        if (dict_data.cooc_tf_size() > 0) {
-          dictionary->AddCoocTf(index_1, index_2, dict_data.cooc_tf(index));
-          dictionary->AddCoocDf(index_1, index_2, dict_data.cooc_df(index));
+  int64_t num_tokens = 0;
+  for (const auto& index_entry : index) {
+    if (index_entry.offset <= 0 || index_entry.length <= 0 || index_entry.offset + index_entry.length > index_offset) {
+      BOOST_THROW_EXCEPTION(CorruptedMessageException("Unable to read from " + args.file_name()));
+    }
+    num_tokens += index_entry.num_tokens;
+  }
+  dictionary->Reserve(static_cast<int>(num_tokens));
+
+  struct ParsedChunk {
+    DictionaryData dict_data;
+    std::vector<DictionaryEntry> entries;
+  };
+
+  const int num_threads = GetNumThreads(args, num_chunks);
+  for (int first_chunk = 0; first_chunk < num_chunks; first_chunk += num_threads) {
+    const int last_chunk = std::min(num_chunks, first_chunk + num_threads);
+    std::vector<std::future<std::shared_ptr<ParsedChunk>>> parsed_chunks;
+    for (int chunk_index = first_chunk; chunk_index < last_chunk; ++chunk_index) {
+      const DictionaryChunkIndexEntry index_entry = index[chunk_index];
+      parsed_chunks.push_back(std::async(std::launch::async, [&args, data, index_entry]() {
+        auto parsed_chunk = std::make_shared<ParsedChunk>();
+        if (!parsed_chunk->dict_data.ParseFromArray(data + index_entry.offset, index_entry.length)) {
+          BOOST_THROW_EXCEPTION(CorruptedMessageException("Unable to read from " + args.file_name()));
         }
-      }
+        parsed_chunk->entries = ParseDictionaryEntries(parsed_chunk->dict_data);
+        return parsed_chunk;
+      }));
+    }
+
+    for (auto& parsed_chunk_future : parsed_chunks) {
+      std::shared_ptr<ParsedChunk> parsed_chunk = parsed_chunk_future.get();
+      AddDictionaryChunk(parsed_chunk->dict_data, parsed_chunk->entries, args.file_name(), dictionary);
     }
   }
-  fin.close();
+}
+
+std::shared_ptr<Dictionary> DictionaryOperations::Import(const ImportDictionaryArgs& args) {
+  auto dictionary = std::make_shared<Dictionary>(Dictionary(args.dictionary_name()));
+
+  if (!boost::algorithm::ends_with(args.file_name(), ".dict")) {
+    BOOST_THROW_EXCEPTION(CorruptedMessageException(
+      "The importing dictionary should have .dict exstension, abort."));
+  }
+
+  std::ifstream fin(args.file_name(), std::ifstream::binary);
+  if (!fin.is_open()) {
+    BOOST_THROW_EXCEPTION(DiskReadException("Unable to open file " + args.file_name()));
+  }
+
+  LOG(INFO) << "Importing dictionary " << args.dictionary_name() << " from " << args.file_name();
+
+  char version;
+  fin >> version;
+  if (version == 0) {
+    ImportSequentialChunks(args, &fin, dictionary.get());
+    fin.close();
+  } else if (version == kDictionaryFormatVersion) {
+    fin.close();
+    ImportIndexedChunks(args, dictionary.get());
+  } else {
+    std::stringstream ss;
+    ss << "Unsupported format version: " << static_cast<int>(version);
+    BOOST_THROW_EXCEPTION(DiskReadException(ss.str()));
+  }
+
+  dictionary->FreezeCooc();
+  if (args.has_cooc_file_path()) {
+    LoadCoocFile(args.cooc_file_path(), /* symmetric_cooc_values = */ false, dictionary.get());
+  }
 
   return dictionary;
 }
@@ -244,18 +538,277 @@ class TokenValues {
   TokenValues()
       : token_value(0.0f)
       , token_tf(0.0f)
-      , token_df(0.0f) { }
+      , token_df(0.0f)
+      , first_occurrence(std::numeric_limits<int64_t>::max()) { }
+
+  void MergeFrom(const TokenValues& rhs) {
+    token_tf += rhs.token_tf;
+    token_df += rhs.token_df;
+    first_occurrence = std::min(first_occurrence, rhs.first_occurrence);
+  }
+
+  // Position of the first occurrence of the token in the collection,
+  // see Dictionary::Gather for details.
+  static int64_t Occurrence(int batch_index, int token_index) {
+    return (static_cast<int64_t>(batch_index) << 32) + token_index;
+  }
 
   float token_value;
   float token_tf;
   float token_df;
+  int64_t first_occurrence;
+};
+
+// SpilledTokenCountsWriter writes a file that can be read by SpilledTokenCounts.
+// Tokens must be written sorted by Token::operator<.
+class SpilledTokenCountsWriter {
+ public:
+  explicit SpilledTokenCountsWriter(const std::string& file_name)
+      : file_name_(file_name), fout_(file_name, std::ios::binary) {
+    if (!fout_.is_open()) {
+      BOOST_THROW_EXCEPTION(DiskWriteException("Unable to create file " + file_name));
+    }
+  }
+
+  void Write(const Token& token, const TokenValues& values) {
+    WriteString(token.keyword());
+    WriteString(token.class_id());
+    fout_.write(reinterpret_cast<const char*>(&values.token_tf), sizeof(float));
+    fout_.write(reinterpret_cast<const char*>(&values.token_df), sizeof(float));
+    fout_.write(reinterpret_cast<const char*>(&values.first_occurrence), sizeof(int64_t));
+  }
+
+  void Close() {
+    fout_.close();
+    if (!fout_.good()) {
+      BOOST_THROW_EXCEPTION(DiskWriteException("Unable to write file " + file_name_));
+    }
+  }
+
+ private:
+  void WriteString(const std::string& str) {
+    const int length = static_cast<int>(str.size());
+    fout_.write(reinterpret_cast<const char*>(&length), sizeof(length));
+    fout_.write(str.data(), length);
+  }
+
+  std::string file_name_;
+  std::ofstream fout_;
 };
 
+// TokenCounts accumulates tf and df of tokens in Dictionary::Gather method.
+// Tokens are kept in the order of their insertion.
+class TokenCounts {
+ public:
+  TokenValues& operator[](const Token& token) {
+    int index = token_index_.find(token);
+    if (index == TokenIndex::kNotFound) {
+      index = static_cast<int>(tokens_.size());
+      token_index_.insert(token, index);
+      tokens_.push_back(token);
+      values_.push_back(TokenValues());
+    }
+    return values_[index];
+  }
+
+  // Returns nullptr if there is no such token.
+  const TokenValues* find(const Token& token) const {
+    int index = token_index_.find(token);
+    return (index == TokenIndex::kNotFound) ? nullptr : &values_[index];
+  }
+
+  void MergeFrom(const TokenCounts& rhs) {
+    for (int i = 0; i < rhs.size(); ++i) {
+      (*this)[rhs.tokens_[i]].MergeFrom(rhs.values_[i]);
+    }
+  }
+
+  // Writes tokens sorted by Token::operator< into a binary file, and clears the counts.
+  void Spill(const std::string& file_name) {
+    std::vector<int> order = Order([this](int lhs, int rhs) { return tokens_[lhs] < tokens_[rhs]; });
+
+    SpilledTokenCountsWriter writer(file_name);
+    for (int index : order) {
+      writer.Write(tokens_[index], values_[index]);
+    }
+    writer.Close();
+
+    token_index_.clear();
+    tokens_.clear();
+    values_.clear();
+  }
+
+  // Reorders tokens by their first occurrence in the collection.
+  void SortByFirstOccurrence() {
+    std::vector<int> order = Order([this](int lhs, int rhs) {
+      return values_[lhs].first_occurrence < values_[rhs].first_occurrence;
+    });
+
+    std::vector<Token> tokens;
+    std::vector<TokenValues> values;
+    tokens.reserve(tokens_.size());
+    values.reserve(values_.size());
+    token_index_.clear();
+    for (int index : order) {
+      token_index_.insert(tokens_[index], static_cast<int>(tokens.size()));
+      tokens.push_back(tokens_[index]);
+      values.push_back(values_[index]);
+    }
+    tokens_.swap(tokens);
+    values_.swap(values);
+  }
+
+  int size() const { return static_cast<int>(tokens_.size()); }
+  const Token& token(int index) const { return tokens_[index]; }
+  TokenValues& values(int index) { return values_[index]; }
+
+ private:
+  template<typename Less>
+  std::vector<int> Order(Less less) const {
+    std::vector<int> order(tokens_.size());
+    for (int i = 0; i < static_cast<int>(order.size()); ++i) {
+      order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), less);
+    return order;
+  }
+
+  TokenIndex token_index_;
+  std::vector<Token> tokens_;
+  std::vector<TokenValues> values_;
+};
+
+// SpilledTokenCounts reads a file written by SpilledTokenCountsWriter
+class SpilledTokenCounts {
+ public:
+  explicit SpilledTokenCounts(const std::string& file_name)
+      : fin_(file_name, std::ios::binary), token_(DefaultClass, std::string()) {
+    if (!fin_.is_open()) {
+      BOOST_THROW_EXCEPTION(DiskReadException("Unable to open file " + file_name));
+    }
+  }
+
+  // Returns false at the end of the file.
+  bool Next() {
+    std::string keyword;
+    if (!ReadString(&keyword)) {
+      return false;
+    }
+
+    std::string class_id;
+    if (!ReadString(&class_id) ||
+        !fin_.read(reinterpret_cast<char*>(&values_.token_tf), sizeof(float)) ||
+        !fin_.read(reinterpret_cast<char*>(&values_.token_df), sizeof(float)) ||
+        !fin_.read(reinterpret_cast<char*>(&values_.first_occurrence), sizeof(int64_t))) {
+      BOOST_THROW_EXCEPTION(CorruptedMessageException("Unexpected end of spilled dictionary file"));
+    }
+
+    token_ = Token(class_id, keyword);
+    return true;
+  }
+
+  const Token& token() const { return token_; }
+  const TokenValues& values() const { return values_; }
+
+ private:
+  bool ReadString(std::string* str) {
+    int length = 0;
+    if (!fin_.read(reinterpret_cast<char*>(&length), sizeof(length))) {
+      return false;
+    }
+    str->resize(length);
+    return length == 0 || static_cast<bool>(fin_.read(&(*str)[0], length));
+  }
+
+  std::ifstream fin_;
+  Token token_;
+  TokenValues values_;
+};
+
+// Merges sorted spilled files, summing up tf and df of equal tokens.
+// Calls consume(token, values) for each unique token in the order of Token::operator<.
+static void MergeSpilledFiles(const std::vector<std::string>& file_names,
+                              std::function<void(const Token&, const TokenValues&)> consume) {
+  std::vector<std::unique_ptr<SpilledTokenCounts>> files;
+  for (const std::string& file_name : file_names) {
+    files.emplace_back(new SpilledTokenCounts(file_name));
+  }
+
+  // Min-heap of indices of files ordered by their current token
+  auto greater = [&files](int lhs, int rhs) { return files[rhs]->token() < files[lhs]->token(); };
+  std::priority_queue<int, std::vector<int>, decltype(greater)> heap(greater);
+  for (int i = 0; i < static_cast<int>(files.size()); ++i) {
+    if (files[i]->Next()) {
+      heap.push(i);
+    }
+  }
+
+  bool has_token = false;
+  Token token(DefaultClass, std::string());
+  TokenValues values;
+  while (!heap.empty()) {
+    const int file_index = heap.top();
+    heap.pop();
+
+    if (has_token && !(token == files[file_index]->token())) {
+      consume(token, values);
+      has_token = false;
+    }
+
+    if (!has_token) {
+      token = files[file_index]->token();
+      values = TokenValues();
+      has_token = true;
+    }
+    values.MergeFrom(files[file_index]->values());
+
+    if (files[file_index]->Next()) {
+      heap.push(file_index);
+    }
+  }
+
+  if (has_token) {
+    consume(token, values);
+  }
+}
+
+// Merges spilled files into token_counts. To avoid running out of file descriptors at most
+// kMaxSpilledFilesToMerge files are opened at once; if there are more files, they are first
+// merged by groups into intermediate files in spill_folder (the merged files are removed).
+static void MergeSpilledTokenCounts(std::vector<std::string> file_names,
+                                    const boost::filesystem::path& spill_folder,
+                                    TokenCounts* token_counts) {
+  const int kMaxSpilledFilesToMerge = 64;
+  while (file_names.size() > kMaxSpilledFilesToMerge) {
+    std::vector<std::string> merged_file_names;
+    for (size_t begin = 0; begin < file_names.size(); begin += kMaxSpilledFilesToMerge) {
+      const size_t end = std::min(file_names.size(), begin + kMaxSpilledFilesToMerge);
+      std::vector<std::string> group(file_names.begin() + begin, file_names.begin() + end);
+
+      merged_file_names.push_back((spill_folder / boost::filesystem::unique_path()).string());
+      SpilledTokenCountsWriter writer(merged_file_names.back());
+      MergeSpilledFiles(group, [&writer](const Token& token, const TokenValues& values) {
+        writer.Write(token, values);
+      });
+      writer.Close();
+
+      for (const std::string& file_name : group) {
+        boost::system::error_code error_code;
+        boost::filesystem::remove(file_name, error_code);
+      }
+    }
+    file_names.swap(merged_file_names);
+  }
+
+  MergeSpilledFiles(file_names, [token_counts](const Token& token, const TokenValues& values) {
+    (*token_counts)[token].MergeFrom(values);
+  });
+}
+
 std::shared_ptr<Dictionary> DictionaryOperations::Gather(const GatherDictionaryArgs& args,
   const ThreadSafeCollectionHolder<std::string, Batch>& mem_batches) {
   auto dictionary = std::make_shared<Dictionary>(Dictionary(args.dictionary_target_name()));
 
-  std::unordered_map<Token, TokenValues, TokenHasher> token_freq_map;
   std::vector<std::string> batches;
 
   if (args.has_data_path()) {
@@ -269,63 +822,143 @@ std::shared_ptr<Dictionary> DictionaryOperations::Gather(const GatherDictionaryA
     }
   }
 
-  int total_items_count = 0;
-  std::unordered_map<ClassId, float> sum_w_tf;
-  for (const std::string& batch_file : batches) {
-    std::shared_ptr<Batch> batch_ptr = mem_batches.get(batch_file);
-    try {
-      if (batch_ptr == nullptr) {
-        batch_ptr = std::make_shared<Batch>();
-        ::artm::core::Helpers::LoadMessage(batch_file, batch_ptr.get());
-      }
-    }
-    catch (std::exception& ex) {
-      LOG(ERROR) << ex.what() << ", the batch will be skipped.";
-      continue;
+  // Batches are split into num_threads contiguous ranges, processed in parallel.
+  // Each thread accumulates token counts of its range, and the counts are merged in the order of ranges,
+  // so that tokens are ordered by their first occurrence just as if batches were processed sequentially.
+  // If max_tokens_in_memory is set, each thread spills its counts to disk (sorted by token) whenever it has
+  // more tokens than max_tokens_in_memory / num_threads, and all spilled files are merged at the end.
+  // Each token remembers its first occurrence (batch index, index in Batch.token), and the merged tokens
+  // are reordered by it, so the order does not depend on num_threads and on whether spilling happened.
+  const int num_threads = GetNumThreads(args, static_cast<int>(batches.size()));
+  const bool spill = args.max_tokens_in_memory() > 0;
+  const int max_tokens_per_thread = std::max(1, args.max_tokens_in_memory() / num_threads);
+
+  boost::filesystem::path spill_folder;
+  if (spill) {
+    spill_folder = args.has_spill_folder() ? boost::filesystem::path(args.spill_folder())
+                                           : boost::filesystem::temp_directory_path();
+    spill_folder /= boost::filesystem::unique_path();
+    boost::filesystem::create_directories(spill_folder);
+  }
+  call_on_destruction remove_spill_folder([&spill_folder]() {
+    boost::system::error_code error_code;
+    if (!spill_folder.empty()) {
+      boost::filesystem::remove_all(spill_folder, error_code);
     }
+  });
+
+  struct ThreadResult {
+    ThreadResult() : total_items_count(0) { }
+    TokenCounts token_counts;
+    std::unordered_map<int, float> sum_w_tf;  // class_id_id -> sum of tf
+    int total_items_count;
+    std::vector<std::string> spilled_files;
+  };
+  std::vector<ThreadResult> results(num_threads);
+
+  auto func = [&results, &batches, &mem_batches, &spill_folder, num_threads, spill,
+               max_tokens_per_thread](int thread_index) {
+    ThreadResult& result = results[thread_index];
+    const int begin = static_cast<int>(batches.size() * thread_index / num_threads);
+    const int end = static_cast<int>(batches.size() * (thread_index + 1) / num_threads);
+
+    std::vector<float> token_df;
+    std::vector<float> token_n_w;
+    std::vector<int> last_item_id;  // the last item where the token occurred
+    for (int batch_index = begin; batch_index < end; ++batch_index) {
+      const std::string& batch_file = batches[batch_index];
+      std::shared_ptr<Batch> batch_ptr = mem_batches.get(batch_file);
+      try {
+        if (batch_ptr == nullptr) {
+          batch_ptr = std::make_shared<Batch>();
+          ::artm::core::Helpers::LoadMessage(batch_file, batch_ptr.get());
+        }
+      }
+      catch (std::exception& ex) {
+        LOG(ERROR) << ex.what() << ", the batch will be skipped.";
+        continue;
+      }
 
-    if (batch_ptr->token_size() == 0) {
-      BOOST_THROW_EXCEPTION(InvalidOperation(
-      "Dictionary::Gather() can not process batches with empty Batch.token field."));
-    }
+      if (batch_ptr->token_size() == 0) {
+        BOOST_THROW_EXCEPTION(InvalidOperation(
+        "Dictionary::Gather() can not process batches with empty Batch.token field."));
+      }
 
-    const Batch& batch = *batch_ptr;
-    std::vector<float> token_df(batch.token_size(), 0);
-    std::vector<float> token_n_w(batch.token_size(), 0);
+      const Batch& batch = *batch_ptr;
+      token_df.assign(batch.token_size(), 0.0f);
+      token_n_w.assign(batch.token_size(), 0.0f);
+      last_item_id.assign(batch.token_size(), -1);
+
+      for (int item_id = 0; item_id < batch.item_size(); ++item_id) {
+        result.total_items_count++;
+        // Find cumulative weight for each token in item
+        // (assume that token might have multiple occurence in each item)
+        const Item& item = batch.item(item_id);
+
+        for (int token_index = 0; token_index < item.token_weight_size(); ++token_index) {
+          const int token_id = item.token_id(token_index);
+          token_n_w[token_id] += item.token_weight(token_index);
+          if (last_item_id[token_id] != item_id) {
+            last_item_id[token_id] = item_id;
+            token_df[token_id] += 1.0f;
+          }
+        }
+      }
 
-    for (int item_id = 0; item_id < batch.item_size(); ++item_id) {
-      total_items_count++;
-      // Find cumulative weight for each token in item
-      // (assume that token might have multiple occurence in each item)
-      std::vector<bool> local_token_df(batch.token_size(), false);
-      const Item& item = batch.item(item_id);
+      TokenBuilder token_builder;
+      for (int index = 0; index < batch.token_size(); ++index) {
+        const Token token = token_builder.Intern(batch.class_id(index), batch.token(index));
+        TokenValues& token_info = result.token_counts[token];
+        token_info.token_tf += token_n_w[index];
+        token_info.token_df += token_df[index];
+        token_info.first_occurrence = std::min(token_info.first_occurrence,
+                                               TokenValues::Occurrence(batch_index, index));
 
-      for (int token_index = 0; token_index < item.token_weight_size(); ++token_index) {
-        const float token_weight = item.token_weight(token_index);
-        const int token_id = item.token_id(token_index);
-        token_n_w[token_id] += token_weight;
-        local_token_df[token_id] = true;
+        result.sum_w_tf[token.class_id_id()] += token_n_w[index];
       }
 
-      for (int i = 0; i < batch.token_size(); ++i) {
-        token_df[i] += local_token_df[i] ? 1.0f : 0.0f;
+      if (spill && result.token_counts.size() > max_tokens_per_thread) {
+        result.spilled_files.push_back((spill_folder / boost::filesystem::unique_path()).string());
+        result.token_counts.Spill(result.spilled_files.back());
       }
     }
 
-    for (int index = 0; index < batch.token_size(); ++index) {
-      // unordered_map.operator[] creates element using default constructor if the key doesn't exist
-      const ClassId& token_class_id = batch.class_id(index);
-      TokenValues& token_info = token_freq_map[Token(token_class_id, batch.token(index))];
-      token_info.token_tf += token_n_w[index];
-      token_info.token_df += token_df[index];
+    if (spill && result.token_counts.size() > 0) {
+      result.spilled_files.push_back((spill_folder / boost::filesystem::unique_path()).string());
+      result.token_counts.Spill(result.spilled_files.back());
+    }
+  };
 
-      sum_w_tf[token_class_id] += token_n_w[index];
+  std::vector<std::shared_future<void>> tasks;
+  for (int thread_index = 0; thread_index < num_threads; ++thread_index) {
+    tasks.push_back(std::async(std::launch::async, func, thread_index));
+  }
+  for (auto& task : tasks) {
+    task.get();  // re-throws exceptions from the threads
+  }
+
+  TokenCounts token_freq_map;
+  std::unordered_map<int, float> sum_w_tf;
+  int total_items_count = 0;
+  std::vector<std::string> spilled_files;
+  for (ThreadResult& result : results) {
+    token_freq_map.MergeFrom(result.token_counts);
+    for (const auto& class_sum : result.sum_w_tf) {
+      sum_w_tf[class_sum.first] += class_sum.second;
     }
+    total_items_count += result.total_items_count;
+    spilled_files.insert(spilled_files.end(), result.spilled_files.begin(), result.spilled_files.end());
   }
+  results.clear();
 
-  for (auto& token_freq : token_freq_map) {
-    token_freq.second.token_value = static_cast<float>(token_freq.second.token_tf /
-                                                       sum_w_tf[token_freq.first.class_id]);
+  if (!spilled_files.empty()) {
+    MergeSpilledTokenCounts(spilled_files, spill_folder, &token_freq_map);
+  }
+  token_freq_map.SortByFirstOccurrence();
+
+  for (int index = 0; index < token_freq_map.size(); ++index) {
+    TokenValues& values = token_freq_map.values(index);
+    values.token_value = static_cast<float>(values.token_tf / sum_w_tf[token_freq_map.token(index).class_id_id()]);
   }
 
   LOG(INFO) << "Find " << token_freq_map.size()
@@ -371,7 +1004,7 @@ std::shared_ptr<Dictionary> DictionaryOperations::Gather(const GatherDictionaryA
 
         if (token_to_token_id.find(token) != token_to_token_id.end()) {
           std::stringstream ss;
-          ss << "Token (" << token.keyword << ", " << token.class_id << "' found twice, lines "
+          ss << "Token (" << token.keyword() << ", " << token.class_id() << "' found twice, lines "
             << (token_to_token_id.find(token)->second + 1)
             << " and " << (token_id + 1) << ", file " << args.vocab_file_path();
           BOOST_THROW_EXCEPTION(InvalidOperation(ss.str()));
@@ -388,93 +1021,36 @@ std::shared_ptr<Dictionary> DictionaryOperations::Gather(const GatherDictionaryA
     }
   }
 
-  if (!use_vocab_file) {  // fill dictionary in map order
+  if (!use_vocab_file) {  // fill dictionary in the order of tokens in token_freq_map
     collection_vocab.clear();
-    for (auto iter = token_freq_map.begin(); iter != token_freq_map.end(); ++iter) {
-      collection_vocab.push_back(iter->first);
+    for (int index = 0; index < token_freq_map.size(); ++index) {
+      collection_vocab.push_back(token_freq_map.token(index));
     }
   }
 
   dictionary->SetNumItems(total_items_count);
   for (const auto& token : collection_vocab) {
-    dictionary->AddEntry(DictionaryEntry(token, token_freq_map[token].token_value,
-      token_freq_map[token].token_tf, token_freq_map[token].token_df));
+    const TokenValues* values = token_freq_map.find(token);
+    if (values == nullptr) {
+      dictionary->AddEntry(DictionaryEntry(token, 0.0f, 0.0f, 0.0f));
+    } else {
+      dictionary->AddEntry(DictionaryEntry(token, values->token_value, values->token_tf, values->token_df));
+    }
   }
 
   if (args.has_cooc_file_path()) {
     try {
-      ifstream_or_cin stream_or_cin(args.cooc_file_path());
-      std::istream& user_cooc_data = stream_or_cin.get_stream();
-
-      // Craft the co-occurence part of dictionary
-      std::string str;
-      while (!user_cooc_data.eof()) {
-        std::getline(user_cooc_data, str);
-        boost::algorithm::trim(str);
-
-        ClassId first_token_class_id = DefaultClass;  // Here's how modality is indicated in output file
-        std::vector<std::string> strs;
-        boost::split(strs, str, boost::is_any_of(" :\t\r"));
-        unsigned pos_of_first_token = 0;
-        // Find modality and position of the first token
-        for (; pos_of_first_token < strs.size() && (strs[pos_of_first_token].empty() ||
-                                                    strs[pos_of_first_token][0] == '|'); ++pos_of_first_token) {
-          if (!strs[pos_of_first_token].empty()) {
-            first_token_class_id = strs[pos_of_first_token];
-            first_token_class_id.erase(0, 1);
-          }
-        }
-        if (pos_of_first_token >= strs.size()) {
-          continue;
-        }
-        std::string first_token_str = strs[pos_of_first_token];
-        Token first_token(first_token_class_id, first_token_str);
-        auto first_token_ptr = token_to_token_id.find(first_token);
-        if (first_token_ptr == token_to_token_id.end()) {
-          std::stringstream ss;
-          ss << "Token (" << first_token.keyword << ", " << first_token.class_id << ") not found in vocab";
-          BOOST_THROW_EXCEPTION(InvalidOperation(ss.str()));
-        }
-        unsigned not_a_word_counter = 0;
-        for (unsigned i = pos_of_first_token + 1; i + not_a_word_counter < strs.size(); i += 2) {
-          ClassId second_token_class_id = first_token_class_id;
-          for (; i + not_a_word_counter < strs.size() && (strs[i + not_a_word_counter].empty() ||
-                                                          strs[i + not_a_word_counter][0] == '|');
-                                                          ++not_a_word_counter) {
-            if (!strs[i + not_a_word_counter].empty()) {
-              second_token_class_id = strs[i + not_a_word_counter];
-              second_token_class_id.erase(0, 1);
-            }
-          }
-          if (i + not_a_word_counter + 1 >= strs.size()) {
-            break;
-          }
-          std::string second_token_str = strs[i + not_a_word_counter];
-          Token second_token(second_token_class_id, second_token_str);
-          auto second_token_ptr = token_to_token_id.find(second_token);
-          if (second_token_ptr == token_to_token_id.end()) {
-            std::stringstream ss;
-            ss << "Token (" << second_token.keyword << ", " << second_token.class_id << ") not found in vocab";
-            BOOST_THROW_EXCEPTION(InvalidOperation(ss.str()));
-          }
-          int first_index = first_token_ptr->second;
-          int second_index = second_token_ptr->second;
-          float value = std::stof(strs[i + not_a_word_counter + 1]);
-
-          dictionary->AddCoocValue(first_index, second_index, value);
-
-          // ToDo(MelLain): support adding tf/df in future
-
-          if (args.symmetric_cooc_values()) {
-            dictionary->AddCoocValue(second_index, first_index, value);
-          }
-        }
+      if (CoocFile::IsCoocFile(args.cooc_file_path())) {
+        LoadCoocFile(args.cooc_file_path(), args.symmetric_cooc_values(), dictionary.get());
+      } else {
+        LoadTextCoocFile(args.cooc_file_path(), token_to_token_id, args.symmetric_cooc_values(), dictionary.get());
       }
     }
     catch (std::exception& ex) {
       dictionary->clear_cooc();
       LOG(ERROR) << ex.what() << ", dictionary will be gathered without cooc info";
     }
+    dictionary->FreezeCooc();
   }
 
   return dictionary;
@@ -485,7 +1061,6 @@ std::shared_ptr<Dictionary> DictionaryOperations::Filter(const FilterDictionaryA
   dictionary->SetNumItems(dict.num_items());
 
   auto& src_entries = dict.entries();
-  auto& dictionary_token_index = dict.token_index();
   std::unordered_map<int, int> old_index_new_index;
 
   float size = static_cast<float>(dict.num_items());
@@ -495,7 +1070,7 @@ std::shared_ptr<Dictionary> DictionaryOperations::Filter(const FilterDictionaryA
 
   for (int entry_index = 0; entry_index < (int64_t) src_entries.size(); entry_index++) {
     auto& entry = src_entries[entry_index];
-    if (!args.has_class_id() || (entry.token().class_id == args.class_id())) {
+    if (!args.has_class_id() || (entry.token().class_id() == args.class_id())) {
       if (args.has_min_df() && entry.token_df() < args.min_df()) {
         continue;
       }
@@ -557,29 +1132,29 @@ std::shared_ptr<Dictionary> DictionaryOperations::Filter(const FilterDictionaryA
       dictionary->AddEntry(entry);
     }
 
-    old_index_new_index.insert(std::pair<int, int>(dictionary_token_index.find(entry.token())->second,
-      accepted_tokens_count - 1));
+    old_index_new_index.insert(std::pair<int, int>(entry_index, accepted_tokens_count - 1));
   }
 
-  auto& cooc_values = dict.cooc_values();
-
-  for (auto iter = cooc_values.begin(); iter != cooc_values.end(); ++iter) {
-    auto first_index_iter = old_index_new_index.find(iter->first);
+  const CoocMatrix& cooc_values = dict.cooc_values();
+  for (int entry_index = 0; entry_index < (int64_t) src_entries.size(); entry_index++) {
+    auto first_index_iter = old_index_new_index.find(entry_index);
     if (first_index_iter == old_index_new_index.end()) {
       continue;
     }
 
-    for (auto cooc_iter = iter->second.begin(); cooc_iter != iter->second.end(); ++cooc_iter) {
-      auto second_index_iter = old_index_new_index.find(cooc_iter->first);
+    CoocMatrix::Row cooc_row = cooc_values.row(entry_index);
+    for (int i = 0; i < cooc_row.size(); ++i) {
+      auto second_index_iter = old_index_new_index.find(cooc_row.col(i));
       if (second_index_iter == old_index_new_index.end()) {
         continue;
       }
 
-      dictionary->AddCoocValue(first_index_iter->second, second_index_iter->second, cooc_iter->second);
+      dictionary->AddCoocValue(first_index_iter->second, second_index_iter->second, cooc_row.value(i));
       // ToDo(MelLain): deal with tf/df
     }
   }
 
+  dictionary->FreezeCooc();
   return dictionary;
 }
 
@@ -588,8 +1163,8 @@ void DictionaryOperations::StoreIntoDictionaryData(const Dictionary& dict, Dicti
   data->set_num_items_in_collection(dict.num_items());
   auto& entries = dict.entries();
   for (int i = 0; i < (int64_t) dict.size(); ++i) {
-    data->add_token(entries[i].token().keyword);
-    data->add_class_id(entries[i].token().class_id);
+    data->add_token(entries[i].token().keyword());
+    data->add_class_id(entries[i].token().class_id());
     data->add_token_value(entries[i].token_value());
     data->add_token_tf(entries[i].token_tf());
     data->add_token_df(entries[i].token_df());
@@ -601,7 +1176,7 @@ void DictionaryOperations::WriteDictionarySummaryToLog(const Dictionary& dict) {
   for (int i = 0; i < dict.size(); i++) {
     const DictionaryEntry* entry = dict.entry(i);
     if (entry != nullptr) {
-      entries_per_class[entry->token().class_id]++;
+      entries_per_class[entry->token().class_id()]++;
     }
   }
   std::stringstream ss; ss << "Dictionary name='" << dict.name() << "' contains entries: ";
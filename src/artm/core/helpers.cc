@@ -1,10 +1,13 @@
 // Copyright 2017, Additive Regularization of Topic Models.
 
 #include <stdlib.h>
+#include <string.h>
 
+#include <algorithm>
 #include <fstream>  // NOLINT
 #include <sstream>
 #include <thread>  // NOLINT
+#include <unordered_map>
 
 #include "boost/filesystem.hpp"
 #include "boost/lexical_cast.hpp"
@@ -112,16 +115,16 @@ std::vector<float> Helpers::GenerateRandomVector(int size, size_t seed, float gu
 std::vector<float> Helpers::GenerateRandomVector(int size, const Token& token, int seed, float guaranteed_zeros_rate) {
   size_t h = 1125899906842597L;  // prime
 
-  if (token.class_id != DefaultClass) {
-    for (unsigned i = 0; i < token.class_id.size(); i++) {
-      h = 31 * h + token.class_id[i];
+  if (token.class_id() != DefaultClass) {
+    for (unsigned i = 0; i < token.class_id().size(); i++) {
+      h = 31 * h + token.class_id()[i];
     }
   }
 
   h = 31 * h + 255;  // separate class_id and token
 
-  for (unsigned i = 0; i < token.keyword.size(); i++) {
-    h = 31 * h + token.keyword[i];
+  for (unsigned i = 0; i < token.keyword().size(); i++) {
+    h = 31 * h + token.keyword()[i];
   }
 
   if (seed > 0) {
@@ -131,12 +134,29 @@ std::vector<float> Helpers::GenerateRandomVector(int size, const Token& token, i
   return GenerateRandomVector(size, h, guaranteed_zeros_rate);
 }
 
+// Appends the path if it is a batch, or all batches under it if it is a folder.
+static void AppendBatchesFromPath(const boost::filesystem::path& path,
+                                  std::vector<boost::filesystem::path>* batches) {
+  if (boost::filesystem::is_directory(path)) {
+    for (const auto& batch_path : Helpers::ListAllBatches(path)) {
+      batches->push_back(batch_path);
+    }
+  } else if (boost::filesystem::is_regular_file(path) && path.extension() == kBatchExtension) {
+    batches->push_back(path);
+  }
+}
+
 // Return the filenames of all files that have the specified extension
 // in the specified directory.
-std::vector<boost::filesystem::path> Helpers::ListAllBatches(const boost::filesystem::path& root) {
+std::vector<boost::filesystem::path> Helpers::ListAllBatches(const boost::filesystem::path& root,
+                                                             bool largest_first) {
   std::vector<boost::filesystem::path> batches;
+  if (!boost::filesystem::exists(root) || !boost::filesystem::is_directory(root)) {
+    return batches;
+  }
 
-  if (boost::filesystem::exists(root) && boost::filesystem::is_directory(root)) {
+  BatchManifest manifest;
+  if (!LoadBatchManifest(root, &manifest)) {
     boost::filesystem::recursive_directory_iterator it(root);
     boost::filesystem::recursive_directory_iterator endit;
     while (it != endit) {
@@ -145,12 +165,102 @@ std::vector<boost::filesystem::path> Helpers::ListAllBatches(const boost::filesy
       }
       ++it;
     }
+    return batches;
+  }
+
+  // Files listed in the manifest are matched by name only, without querying their status;
+  // other entries of the folder (new batches and subfolders) are inspected as usual.
+  std::unordered_map<std::string, int> manifest_index;
+  for (int i = 0; i < manifest.entry_size(); ++i) {
+    manifest_index.emplace(manifest.entry(i).filename(), i);
+  }
+
+  // Batches listed in the manifest keep their place in directory order, unless largest_first is set
+  std::vector<int> listed_entries;
+  std::vector<boost::filesystem::path> other_paths;
+  boost::filesystem::directory_iterator endit;
+  for (boost::filesystem::directory_iterator it(root); it != endit; ++it) {
+    auto iter = manifest_index.find(it->path().filename().string());
+    if (iter != manifest_index.end()) {
+      if (largest_first) {
+        listed_entries.push_back(iter->second);
+      } else {
+        batches.push_back(it->path());
+      }
+    } else if (it->path().filename() != kBatchManifestFilename) {
+      if (largest_first) {
+        other_paths.push_back(it->path());
+      } else {
+        AppendBatchesFromPath(it->path(), &batches);
+      }
+    }
   }
+
+  if (largest_first) {
+    std::stable_sort(listed_entries.begin(), listed_entries.end(), [&manifest](int lhs, int rhs) {  // NOLINT
+      return manifest.entry(lhs).byte_size() > manifest.entry(rhs).byte_size();
+    });
+
+    for (int index : listed_entries) {
+      batches.push_back(root / manifest.entry(index).filename());
+    }
+
+    for (const auto& path : other_paths) {
+      AppendBatchesFromPath(path, &batches);
+    }
+  }
+
   return batches;
 }
 
+bool Helpers::LoadBatchManifest(const boost::filesystem::path& root, BatchManifest* manifest) {
+  boost::filesystem::path manifest_path = root / kBatchManifestFilename;
+  if (!boost::filesystem::exists(manifest_path)) {
+    return false;
+  }
+
+  try {
+    LoadMessage(manifest_path.string(), manifest);
+  } catch (const DiskReadException& ex) {
+    LOG(WARNING) << "Ignoring malformed batch manifest " << manifest_path.string() << ": " << ex.what();
+    manifest->Clear();
+    return false;
+  }
+
+  return true;
+}
+
+void Helpers::UpdateBatchManifest(const std::string& disk_path, const BatchManifest& manifest) {
+  BatchManifest result;
+  LoadBatchManifest(disk_path, &result);
+
+  std::unordered_map<std::string, int> manifest_index;
+  for (int i = 0; i < result.entry_size(); ++i) {
+    manifest_index.emplace(result.entry(i).filename(), i);
+  }
+
+  for (const auto& entry : manifest.entry()) {
+    auto iter = manifest_index.find(entry.filename());
+    if (iter != manifest_index.end()) {
+      result.mutable_entry(iter->second)->CopyFrom(entry);
+    } else {
+      manifest_index.emplace(entry.filename(), result.entry_size());
+      result.add_entry()->CopyFrom(entry);
+    }
+  }
+
+  // Write into a temporary file first, so that readers never see a partially written manifest
+  CreateFolderIfNotExists(disk_path);
+  boost::filesystem::path manifest_path = boost::filesystem::path(disk_path) / kBatchManifestFilename;
+  boost::filesystem::path temp_path = manifest_path;
+  temp_path += ".tmp";
+  SaveMessage(temp_path.string(), result);
+  boost::filesystem::rename(temp_path, manifest_path);
+}
+
 boost::uuids::uuid Helpers::SaveBatch(const Batch& batch,
-                                      const std::string& disk_path, const std::string& name) {
+                                      const std::string& disk_path, const std::string& name,
+                                      BatchManifestEntry* manifest_entry) {
   if (!batch.has_id()) {
     BOOST_THROW_EXCEPTION(InvalidOperation("Helpers::SaveBatch: batch expecting id"));
   }
@@ -164,6 +274,19 @@ boost::uuids::uuid Helpers::SaveBatch(const Batch& batch,
 
   boost::filesystem::path file(name + kBatchExtension);
   Helpers::SaveMessage(file.string(), disk_path, batch);
+  if (manifest_entry == nullptr) {
+    return uuid;
+  }
+
+  int64_t token_count = 0;
+  for (const auto& item : batch.item()) {
+    token_count += item.token_id_size();
+  }
+
+  manifest_entry->set_filename(file.string());
+  manifest_entry->set_byte_size(batch.ByteSize());
+  manifest_entry->set_item_count(batch.item_size());
+  manifest_entry->set_token_count(token_count);
   return uuid;
 }
 
@@ -248,6 +371,75 @@ void Helpers::SaveMessage(const std::string& full_filename,
   fout.close();
 }
 
+uint16_t Helpers::FloatToHalf(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+
+  const uint32_t sign = (bits >> 16) & 0x8000;
+  const uint32_t float_exponent = (bits >> 23) & 0xff;
+  uint32_t mantissa = bits & 0x7fffff;
+  if (float_exponent == 0xff) {  // inf or nan
+    return static_cast<uint16_t>(sign | 0x7c00 | (mantissa != 0 ? 0x200 : 0));
+  }
+
+  const int exponent = static_cast<int>(float_exponent) - 127 + 15;
+  if (exponent >= 0x1f) {  // overflow
+    return static_cast<uint16_t>(sign | 0x7c00);
+  }
+
+  if (exponent <= 0) {  // subnormal half or underflow
+    if (exponent < -10) {
+      return static_cast<uint16_t>(sign);
+    }
+
+    mantissa |= 0x800000;
+    const int shift = 14 - exponent;
+    uint32_t half = mantissa >> shift;
+    const uint32_t remainder = mantissa & ((1u << shift) - 1);
+    const uint32_t halfway = 1u << (shift - 1);
+    if (remainder > halfway || (remainder == halfway && (half & 1))) {
+      ++half;
+    }
+    return static_cast<uint16_t>(sign | half);
+  }
+
+  // Rounding may carry into the exponent, which still yields the correct result.
+  uint32_t half = sign | (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+  const uint32_t remainder = mantissa & 0x1fff;
+  if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1))) {
+    ++half;
+  }
+  return static_cast<uint16_t>(half);
+}
+
+float Helpers::HalfToFloat(uint16_t value) {
+  const uint32_t sign = static_cast<uint32_t>(value & 0x8000) << 16;
+  uint32_t exponent = (value >> 10) & 0x1f;
+  uint32_t mantissa = value & 0x3ff;
+
+  uint32_t bits;
+  if (exponent == 0) {
+    if (mantissa == 0) {
+      bits = sign;
+    } else {  // subnormal half, normalize it
+      exponent = 127 - 15 + 1;
+      while ((mantissa & 0x400) == 0) {
+        mantissa <<= 1;
+        --exponent;
+      }
+      bits = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+    }
+  } else if (exponent == 0x1f) {
+    bits = sign | 0x7f800000 | (mantissa << 13);
+  } else {
+    bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+  }
+
+  float result;
+  memcpy(&result, &bits, sizeof(result));
+  return result;
+}
+
 bool isZero(float value, float tol) {
   return std::fabs(value) < tol;
 }
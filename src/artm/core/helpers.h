@@ -36,13 +36,26 @@ class Helpers {
   static std::vector<float> GenerateRandomVector(int size, const Token& token,
                                                  int seed = -1, float guaranteed_zeros_rate = 0.0);
 
-  // Lists all batches in a given folder
-  static std::vector<boost::filesystem::path> ListAllBatches(const boost::filesystem::path& root);
+  // Lists all batches in a given folder.
+  // When the folder has a manifest (see kBatchManifestFilename) the batches listed in it are not re-validated.
+  // Batches are returned in directory order. With largest_first (used by offline fitting, which processes all batches
+  // before the model is updated) the batches from the manifest are returned first, ordered by size,
+  // and other batches found in the folder are appended.
+  static std::vector<boost::filesystem::path> ListAllBatches(const boost::filesystem::path& root,
+                                                             bool largest_first = false);
 
-  // Saves batch to disk
+  // Saves batch to disk. If manifest_entry is provided it is filled with the size
+  // and statistics of the saved batch.
   static boost::uuids::uuid SaveBatch(const Batch& batch,
                                       const std::string& disk_path,
-                                      const std::string& name);
+                                      const std::string& name,
+                                      BatchManifestEntry* manifest_entry = nullptr);
+
+  // Loads the manifest of a batch folder; returns false if the folder has no manifest.
+  static bool LoadBatchManifest(const boost::filesystem::path& root, BatchManifest* manifest);
+
+  // Adds entries to the manifest of a batch folder (replacing existing entries with the same filename).
+  static void UpdateBatchManifest(const std::string& disk_path, const BatchManifest& manifest);
 
   // Loads protobuf message from disk.
   static void LoadMessage(const std::string& full_filename,
@@ -57,6 +70,11 @@ class Helpers {
                           const ::google::protobuf::Message& message);
   static void SaveMessage(const std::string& filename, const std::string& disk_path,
                           const ::google::protobuf::Message& message);
+
+  // Converts between float and IEEE 754 half-precision (fp16) values.
+  // Rounds to the nearest representable value; used for compact storage of theta cache entries.
+  static uint16_t FloatToHalf(float value);
+  static float HalfToFloat(uint16_t value);
 };
 
 bool isZero(float value, float tol = 1e-16f);
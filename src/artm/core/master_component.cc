@@ -29,6 +29,7 @@
 #include "artm/core/cache_manager.h"
 #include "artm/core/call_on_destruction.h"
 #include "artm/core/check_messages.h"
+#include "artm/core/collection_parser.h"
 #include "artm/core/instance.h"
 #include "artm/core/processor.h"
 #include "artm/core/protobuf_helpers.h"
@@ -60,11 +61,10 @@ static void HandleExternalThetaMatrixRequest(::artm::ThetaMatrix* theta_matrix,
   lm->resize(sizeof(float) * theta_matrix->item_id_size() * theta_matrix->num_topics());
   char* lm_ptr = &(*lm)[0];
   float* lm_float = reinterpret_cast<float*>(lm_ptr);
-  for (int64_t topic_index = 0; topic_index < theta_matrix->num_topics(); ++topic_index) {
-    for (int64_t item_index = 0; item_index < theta_matrix->item_id_size(); ++item_index) {
-      int64_t index = item_index * theta_matrix->num_topics() + topic_index;
-      lm_float[index] = theta_matrix->item_weights(item_index).value(topic_index);
-    }
+  for (int64_t item_index = 0; item_index < theta_matrix->item_id_size(); ++item_index) {
+    const ::artm::FloatArray& item_weights = theta_matrix->item_weights(item_index);
+    float* row = lm_float + item_index * theta_matrix->num_topics();
+    std::copy(item_weights.value().begin(), item_weights.value().end(), row);
   }
 
   theta_matrix->clear_item_weights();
@@ -406,8 +406,8 @@ void MasterComponent::ExportModel(const ExportModelArgs& args) {
 
   for (int token_id = 0; token_id < token_size; ++token_id) {
     Token token = n_wt.token(token_id);
-    get_topic_model_args.add_token(token.keyword);
-    get_topic_model_args.add_class_id(token.class_id);
+    get_topic_model_args.add_token(token.keyword());
+    get_topic_model_args.add_class_id(token.class_id());
 
     if (((token_id + 1) == token_size) || (get_topic_model_args.token_size() >= tokens_per_chunk)) {
       ::artm::TopicModel external_topic_model;
@@ -584,6 +584,15 @@ void MasterComponent::AttachModel(const AttachModelArgs& args, int address_lengt
   instance_->SetPhiMatrix(model_name, attached);
 }
 
+void MasterComponent::CopyThetaMatrix(const GetThetaMatrixArgs& args,
+                                      int64_t theta_length, float* theta_address,
+                                      ::artm::ThetaMatrix* theta_info) {
+  // Length is given in bytes (as for AttachModel), while CacheManager expects number of elements.
+  // An empty buffer requests only the size of the matrix.
+  instance_->cache_manager()->CopyThetaMatrix(args, theta_length / sizeof(float),
+                                              (theta_length > 0) ? theta_address : nullptr, theta_info);
+}
+
 void MasterComponent::InitializeModel(const InitializeModelArgs& args) {
   std::shared_ptr<MasterModelConfig> config = instance_->config();
   if (config != nullptr) {
@@ -626,7 +635,7 @@ void MasterComponent::InitializeModel(const InitializeModelArgs& args) {
     for (int index = 0; index < (int64_t) dict->size(); ++index) {
       ::artm::core::Token token = dict->entry(index)->token();
 
-      if (config->class_id_size() > 0 && !is_member(token.class_id, config->class_id())) {
+      if (config->class_id_size() > 0 && !is_member(token.class_id(), config->class_id())) {
         continue;
       }
       new_ttm->AddToken(token);
@@ -830,9 +839,11 @@ void MasterComponent::RequestProcessBatchesImpl(const ProcessBatchesArgs& proces
     }
   }
 
-  if (asynchronous && args.theta_matrix_type() != ThetaMatrixType_None) {
+  // ThetaMatrixType_Cache is fine in asynchronous mode as the cache is owned by the instance.
+  if (asynchronous && args.theta_matrix_type() != ThetaMatrixType_None &&
+      args.theta_matrix_type() != ThetaMatrixType_Cache) {
     BOOST_THROW_EXCEPTION(InvalidOperation(
-        "ArtmAsyncProcessBatches require ProcessBatchesArgs.theta_matrix_type to be set to None"));
+        "ArtmAsyncProcessBatches require ProcessBatchesArgs.theta_matrix_type to be set to None or Cache"));
   }
 
   // The code below must not use cache_manger in asynchronous mode.
@@ -1172,6 +1183,9 @@ void MasterComponent::Request(const TransformMasterModelArgs& args, ::artm::Thet
   if (config->has_reuse_theta()) {
     process_batches_args.set_reuse_theta(config->reuse_theta());
   }
+  if (config->has_cache_theta_eps()) {
+    process_batches_args.set_cache_theta_eps(config->cache_theta_eps());
+  }
 
   process_batches_args.mutable_class_id()->CopyFrom(config->class_id());
   process_batches_args.mutable_class_weight()->CopyFrom(config->class_weight());
@@ -1217,22 +1231,91 @@ class BatchesIterator {
   virtual void move(ProcessBatchesArgs* args) = 0;
 };
 
+// StreamedBatches puts batches parsed by CollectionStream into the in-memory storage of the instance,
+// where processors find them by batch id (exactly as batches imported via ArtmImportBatches).
+// Unless keep_batches is set the batches are removed from memory once they are processed.
+class StreamedBatches {
+ public:
+  StreamedBatches(const CollectionParserConfig& config, Instance* instance, bool keep_batches)
+      : stream_(config, std::max(2 * static_cast<int>(instance->processor_size()), 1))
+      , instance_(instance)
+      , keep_batches_(keep_batches)
+      , next_batch_()
+      , is_finished_(false)
+      , batch_ids_() { }
+
+  ~StreamedBatches() {
+    if (!keep_batches_) {
+      for (const auto& batch_id : batch_ids_) {
+        instance_->batches()->erase(batch_id);
+      }
+    }
+  }
+
+  // Returns true if there are batches that were not yet taken by Next() (waits for the parser if needed).
+  bool has_next() {
+    if (next_batch_ == nullptr && !is_finished_) {
+      next_batch_ = stream_.Next();
+      is_finished_ = (next_batch_ == nullptr);
+    }
+    return next_batch_ != nullptr;
+  }
+
+  bool Next(std::string* batch_id) {
+    if (!has_next()) {
+      return false;
+    }
+
+    *batch_id = next_batch_->id();
+    instance_->batches()->set(*batch_id, next_batch_);
+    batch_ids_.push_back(*batch_id);
+    next_batch_.reset();
+    return true;
+  }
+
+  void Release(const std::string& batch_id) {
+    if (!keep_batches_) {
+      instance_->batches()->erase(batch_id);
+    }
+  }
+
+  const std::vector<std::string>& batch_ids() const { return batch_ids_; }
+
+ private:
+  CollectionStream stream_;
+  Instance* instance_;
+  bool keep_batches_;
+  std::shared_ptr<Batch> next_batch_;
+  bool is_finished_;
+  std::vector<std::string> batch_ids_;
+};
+
 class OfflineBatchesIterator : public BatchesIterator {
  public:
   OfflineBatchesIterator(const ::google::protobuf::RepeatedPtrField<std::string>& batch_filename,
-                         const ::google::protobuf::RepeatedField<float>& batch_weight)
+                         const ::google::protobuf::RepeatedField<float>& batch_weight,
+                         StreamedBatches* streamed_batches = nullptr)
       : batch_filename_(batch_filename)
-      , batch_weight_(batch_weight) { }
+      , batch_weight_(batch_weight)
+      , streamed_batches_(streamed_batches) { }
 
   virtual ~OfflineBatchesIterator() { }
 
  private:
   const ::google::protobuf::RepeatedPtrField<std::string>& batch_filename_;
   const ::google::protobuf::RepeatedField<float>& batch_weight_;
+  StreamedBatches* streamed_batches_;
 
+  // Also returns all batches received from the stream so far (none during the first pass).
   virtual void move(ProcessBatchesArgs* args) {
     args->mutable_batch_filename()->CopyFrom(batch_filename_);
     args->mutable_batch_weight()->CopyFrom(batch_weight_);
+    if (streamed_batches_ != nullptr) {
+      for (const auto& batch_id : streamed_batches_->batch_ids()) {
+        args->add_batch_filename(batch_id);
+        args->add_batch_weight(1.0f);
+      }
+    }
   }
 };
 
@@ -1242,22 +1325,48 @@ class OnlineBatchesIterator : public BatchesIterator {
                         const ::google::protobuf::RepeatedField<float>& batch_weight,
                         const ::google::protobuf::RepeatedField<int>& update_after,
                         const ::google::protobuf::RepeatedField<float>& apply_weight,
-                        const ::google::protobuf::RepeatedField<float>& decay_weight)
+                        const ::google::protobuf::RepeatedField<float>& decay_weight,
+                        StreamedBatches* streamed_batches = nullptr)
       : batch_filename_(batch_filename)
       , batch_weight_(batch_weight)
       , update_after_(update_after)
       , apply_weight_(apply_weight)
       , decay_weight_(decay_weight)
+      , streamed_batches_(streamed_batches)
+      , update_batch_ids_()
       , current_(0) { }
 
   virtual ~OnlineBatchesIterator() { }
 
-  bool more() const { return current_ < static_cast<int>(update_after_.size()); }
+  // The number of streamed batches is not known in advance. The stream may end before update_after.back(),
+  // or continue after it; in the later case the last interval between updates and the last weights are repeated.
+  bool more() {
+    if (streamed_batches_ != nullptr) {
+      return streamed_batches_->has_next();
+    }
+
+    return static_cast<int>(current_) < update_after_.size();
+  }
 
   virtual void move(ProcessBatchesArgs* args) {
     args->clear_batch_filename();
     args->clear_batch_weight();
 
+    if (streamed_batches_ != nullptr) {
+      update_batch_ids_.push_back(std::vector<std::string>());
+      std::string batch_id;
+      unsigned first = (current_ == 0) ? 0 : update_after(current_ - 1);
+      unsigned last = update_after(current_);
+      for (unsigned i = first; i < last && streamed_batches_->Next(&batch_id); ++i) {
+        args->add_batch_filename(batch_id);
+        args->add_batch_weight(1.0f);
+        update_batch_ids_.back().push_back(batch_id);
+      }
+
+      current_++;
+      return;
+    }
+
     if (static_cast<int>(current_) >= update_after_.size()) {
       return;
     }
@@ -1272,13 +1381,32 @@ class OnlineBatchesIterator : public BatchesIterator {
     current_++;
   }
 
-  float apply_weight() { return apply_weight_.Get(current_); }
-  float decay_weight() { return decay_weight_.Get(current_); }
-  int update_after() { return update_after_.Get(current_); }
+  // Called once all batches of the update are processed.
+  void processed(int index) {
+    if (streamed_batches_ != nullptr && index < static_cast<int>(update_batch_ids_.size())) {
+      for (const auto& batch_id : update_batch_ids_[index]) {
+        streamed_batches_->Release(batch_id);
+      }
+      update_batch_ids_[index].clear();
+    }
+  }
 
-  float apply_weight(int index) { return apply_weight_.Get(index); }
-  float decay_weight(int index) { return decay_weight_.Get(index); }
-  int update_after(int index) { return update_after_.Get(index); }
+  float apply_weight() { return apply_weight(current_); }
+  float decay_weight() { return decay_weight(current_); }
+  int update_after() { return update_after(current_); }
+
+  float apply_weight(int index) { return apply_weight_.Get(std::min(index, apply_weight_.size() - 1)); }
+  float decay_weight(int index) { return decay_weight_.Get(std::min(index, decay_weight_.size() - 1)); }
+  int update_after(int index) {
+    const int size = update_after_.size();
+    if (index < size) {
+      return update_after_.Get(index);
+    }
+
+    const int last = update_after_.Get(size - 1);
+    const int step = last - ((size > 1) ? update_after_.Get(size - 2) : 0);
+    return last + step * (index - size + 1);
+  }
 
   void reset() { current_ = 0; }
 
@@ -1288,6 +1416,8 @@ class OnlineBatchesIterator : public BatchesIterator {
   const ::google::protobuf::RepeatedField<int>& update_after_;
   const ::google::protobuf::RepeatedField<float>& apply_weight_;
   const ::google::protobuf::RepeatedField<float>& decay_weight_;
+  StreamedBatches* streamed_batches_;
+  std::vector<std::vector<std::string>> update_batch_ids_;
   unsigned current_;  // index in update_after_ array
 };
 
@@ -1345,14 +1475,24 @@ class ArtmExecutor {
     if (master_model_config.has_reuse_theta()) {
       process_batches_args_.set_reuse_theta(master_model_config.reuse_theta());
     }
+    if (master_model_config.has_cache_theta_eps()) {
+      process_batches_args_.set_cache_theta_eps(master_model_config.cache_theta_eps());
+    }
   }
 
-  void ExecuteOfflineAlgorithm(int num_collection_passes, OfflineBatchesIterator* iter) {
+  // With streamed_batches the first pass processes batches as soon as they are parsed;
+  // the following passes process the same batches from memory (the caller adds them to iter).
+  void ExecuteOfflineAlgorithm(int num_collection_passes, OfflineBatchesIterator* iter,
+                               StreamedBatches* streamed_batches = nullptr) {
     const std::string rwt_name = "rwt";
     master_component_->ClearScoreCache(ClearScoreCacheArgs());
     for (int pass = 0; pass < num_collection_passes; ++pass) {
       ::artm::core::ScoreManager score_manager(master_component_->instance_.get());
-      ProcessBatches(pwt_name_, nwt_name_, iter, &score_manager);
+      if (pass == 0 && streamed_batches != nullptr) {
+        ProcessBatches(pwt_name_, nwt_name_, iter, streamed_batches, &score_manager);
+      } else {
+        ProcessBatches(pwt_name_, nwt_name_, iter, &score_manager);
+      }
       Regularize(pwt_name_, nwt_name_, rwt_name);
       Normalize(pwt_name_, nwt_name_, rwt_name);
       StoreScores(&score_manager);
@@ -1372,6 +1512,7 @@ class ArtmExecutor {
 
       ::artm::core::ScoreManager score_manager(master_component_->instance_.get());
       ProcessBatches(pwt_name_, nwt_hat_index, iter, &score_manager);
+      iter->processed(nwt_hat_index.get_index());
       Merge(nwt_name_, decay_weight, nwt_hat_index, apply_weight);
       Dispose(nwt_hat_index);
       Regularize(pwt_name_, nwt_name_, rwt_name);
@@ -1419,6 +1560,7 @@ class ArtmExecutor {
       }
 
       Await(temp_op_id);
+      iter->processed(temp_op_id);
       Merge(nwt_name_, decay_weight, nwt_hat_index - 1, apply_weight);
       Dispose(nwt_hat_index - 1);
       Regularize(pwt_active, nwt_name_, rwt_name);
@@ -1467,6 +1609,38 @@ class ArtmExecutor {
     process_batches_args_.clear_batch_filename();
   }
 
+  // Processes the batches of iter together with the batches that arrive from the stream.
+  // Streamed batches are sent to processors one by one, all accumulating into the same nwt matrix.
+  void ProcessBatches(std::string pwt, std::string nwt, BatchesIterator* iter,
+                      StreamedBatches* streamed_batches, ScoreManager* score_manager) {
+    process_batches_args_.set_pwt_source_name(pwt);
+    process_batches_args_.set_nwt_target_name(nwt);
+    iter->move(&process_batches_args_);
+
+    const bool reset_nwt = process_batches_args_.reset_nwt();
+    BatchManager batch_manager;
+    std::string batch_id;
+    do {
+      master_component_->RequestProcessBatchesImpl(process_batches_args_,
+                                                   &batch_manager,
+                                                   /* asynchronous =*/ true,
+                                                   /* score_manager =*/ score_manager,
+                                                   /* theta_matrix*/ nullptr);
+      process_batches_args_.set_reset_nwt(false);
+      process_batches_args_.clear_batch_filename();
+      process_batches_args_.clear_batch_weight();
+      if (streamed_batches->Next(&batch_id)) {
+        process_batches_args_.add_batch_filename(batch_id);
+        process_batches_args_.add_batch_weight(1.0f);
+      }
+    } while (process_batches_args_.batch_filename_size() > 0);
+
+    while (!batch_manager.IsEverythingProcessed()) {
+      boost::this_thread::sleep(boost::posix_time::milliseconds(kIdleLoopFrequency));
+    }
+    process_batches_args_.set_reset_nwt(reset_nwt);
+  }
+
   int AsyncProcessBatches(std::string pwt, std::string nwt, BatchesIterator* iter) {
     process_batches_args_.set_pwt_source_name(pwt);
     process_batches_args_.set_nwt_target_name(nwt);
@@ -1560,9 +1734,16 @@ void MasterComponent::FitOnline(const FitOnlineMasterModelArgs& args) {
     }
   }
 
+  // Batches may come directly from the collection parser rather than from disk
+  std::shared_ptr<StreamedBatches> streamed_batches;
+  if (args.has_collection_parser_config()) {
+    streamed_batches = std::make_shared<StreamedBatches>(args.collection_parser_config(), instance_.get(),
+                                                         args.keep_batches());
+  }
+
   ArtmExecutor artm_executor(*config, this);
   OnlineBatchesIterator iter(args.batch_filename(), args.batch_weight(), args.update_after(),
-                             args.apply_weight(), args.decay_weight());
+                             args.apply_weight(), args.decay_weight(), streamed_batches.get());
   if (args.asynchronous()) {
     artm_executor.ExecuteAsyncOnlineAlgorithm(&iter);
   } else {
@@ -1580,7 +1761,16 @@ void MasterComponent::FitOffline(const FitOfflineMasterModelArgs& args) {
   }
 
   FitOfflineMasterModelArgs* mutable_args = const_cast<FitOfflineMasterModelArgs*>(&args);
-  if (args.batch_filename_size() == 0) {
+
+  // Batches streamed from the collection parser are kept in memory for further passes (and further calls),
+  // as if they were imported via ArtmImportBatches.
+  std::shared_ptr<StreamedBatches> streamed_batches;
+  if (args.has_collection_parser_config()) {
+    streamed_batches = std::make_shared<StreamedBatches>(args.collection_parser_config(), instance_.get(),
+                                                         /* keep_batches =*/ true);
+  }
+
+  if (args.batch_filename_size() == 0 && streamed_batches == nullptr) {
     std::vector<std::string> batch_names;
     if (!args.has_batch_folder()) {
       // Default to processing all in-memory batches
@@ -1591,7 +1781,8 @@ void MasterComponent::FitOffline(const FitOfflineMasterModelArgs& args) {
           "Populate this field or provide batches via ArtmImportBatches API"));
       }
     } else {
-      for (const auto& batch_path : artm::core::Helpers::ListAllBatches(args.batch_folder())) {
+      for (const auto& batch_path : artm::core::Helpers::ListAllBatches(args.batch_folder(),
+                                                                         /* largest_first =*/ true)) {
         batch_names.push_back(batch_path.string());
       }
       if (batch_names.empty()) {
@@ -1634,9 +1825,9 @@ void MasterComponent::FitOffline(const FitOfflineMasterModelArgs& args) {
   }
 
   ArtmExecutor artm_executor(*config, this);
-  OfflineBatchesIterator iter(args.batch_filename(), args.batch_weight());
+  OfflineBatchesIterator iter(args.batch_filename(), args.batch_weight(), streamed_batches.get());
   artm_executor.mutable_process_batches_args()->set_reset_nwt(args.reset_nwt());
-  artm_executor.ExecuteOfflineAlgorithm(args.num_collection_passes(), &iter);
+  artm_executor.ExecuteOfflineAlgorithm(args.num_collection_passes(), &iter, streamed_batches.get());
 
   ValidateProcessedItems("FitOffline", this);
 }
@@ -100,6 +100,9 @@ class MasterComponent : boost::noncopyable {
 
   void AttachModel(const AttachModelArgs& args, int address_length, float* address);
 
+  void CopyThetaMatrix(const GetThetaMatrixArgs& args, int64_t theta_length, float* theta_address,
+                       ::artm::ThetaMatrix* theta_info);
+
  private:
   friend class ArtmExecutor;
 
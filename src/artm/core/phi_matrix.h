@@ -31,11 +31,16 @@ class PhiMatrix {
   virtual bool has_token(const Token& token) const = 0;
   virtual int token_index(const Token& token) const = 0;
 
+  // The version changes whenever the set of tokens changes, and is preserved by copies of the matrix.
+  // Equal versions guarantee equal tokens, so data, prepared for the tokens, can be reused.
+  virtual int64_t tokens_version() const = 0;
+
   virtual float get(int token_id, int topic_id) const = 0;
   virtual void get(int token_id, std::vector<float>* buffer) const = 0;
   virtual void set(int token_id, int topic_id, float value) = 0;
   virtual void increase(int token_id, int topic_id, float increment) = 0;
-  virtual void increase(int token_id, const std::vector<float>& increment) = 0;  // must be thread-safe
+  // adds increment[topic_id] to every value of the row in one call; must be thread-safe
+  virtual void increase(int token_id, const std::vector<float>& increment) = 0;
 
   virtual int get_non_zero_topic_size(int token_id) const = 0;
   virtual void get_sparse(int token_id, std::vector<float>* value_buffer, std::vector<int>* index_buffer) const = 0;
@@ -5,6 +5,12 @@
 #include <assert.h>
 
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>  // NOLINT
+#include <exception>
+#include <functional>
+#include <mutex>  // NOLINT
+#include <thread>  // NOLINT
 #include <utility>
 #include <string>
 #include <set>
@@ -22,14 +28,145 @@ namespace artm {
 namespace core {
 
 namespace {
+
+// Splits tokens into ranges and calls func(token_begin, token_end) for the ranges in parallel.
+// Worker threads are started on the first parallel call and reused by the following calls,
+// the calling thread processes ranges too. Small matrices are processed on the calling thread.
+// Exceptions from workers are re-thrown on the calling thread.
+class TokenRangeRunner {
+ public:
+  explicit TokenRangeRunner(int num_threads)
+      : num_threads_(num_threads), num_ranges_(0), next_range_(0), num_finished_(0), stopped_(false) { }
+
+  ~TokenRangeRunner() {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      stopped_ = true;
+    }
+    condition_.notify_all();
+    for (auto& worker : workers_) {
+      worker.join();
+    }
+  }
+
+  void Run(int token_size, std::function<void(int, int)> func) {  // NOLINT
+    const int min_tokens_per_range = 1024;
+    const int num_ranges = std::max(1, std::min(num_threads_, token_size / min_tokens_per_range));
+    if (num_ranges == 1) {
+      func(0, token_size);
+      return;
+    }
+
+    while (static_cast<int>(workers_.size()) < num_threads_ - 1) {
+      workers_.push_back(std::thread(&TokenRangeRunner::WorkerLoop, this));
+    }
+
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      task_ = [&func, token_size, num_ranges](int range) {
+        const int token_begin = static_cast<int64_t>(token_size) * range / num_ranges;
+        const int token_end = static_cast<int64_t>(token_size) * (range + 1) / num_ranges;
+        func(token_begin, token_end);
+      };
+      num_ranges_ = num_ranges;
+      next_range_ = 0;
+      num_finished_ = 0;
+      error_ = nullptr;
+    }
+    condition_.notify_all();
+
+    ProcessRanges();
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    condition_.wait(lock, [this]() { return num_finished_ == num_ranges_; });
+    task_ = nullptr;
+    if (error_ != nullptr) {
+      std::rethrow_exception(error_);
+    }
+  }
+
+ private:
+  void WorkerLoop() {
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        condition_.wait(lock, [this]() { return stopped_ || next_range_ < num_ranges_; });
+        if (stopped_) {
+          return;
+        }
+      }
+      ProcessRanges();
+    }
+  }
+
+  // task_ isn't changed until all the ranges are finished, so it's called without the lock
+  void ProcessRanges() {
+    while (true) {
+      int range = 0;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (next_range_ >= num_ranges_) {
+          return;
+        }
+        range = next_range_++;
+      }
+
+      std::exception_ptr error;
+      try {
+        task_(range);
+      }
+      catch (...) {
+        error = std::current_exception();
+      }
+
+      std::unique_lock<std::mutex> lock(mutex_);
+      if (error != nullptr && error_ == nullptr) {
+        error_ = error;
+      }
+      if (++num_finished_ == num_ranges_) {
+        condition_.notify_all();
+      }
+    }
+  }
+
+  int num_threads_;
+  std::vector<std::thread> workers_;
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  std::function<void(int)> task_;  // NOLINT
+  int num_ranges_;
+  int next_range_;
+  int num_finished_;
+  bool stopped_;
+  std::exception_ptr error_;
+};
+
+}  // namespace
+
+namespace {
+  typedef std::pair<std::shared_ptr<artm::RegularizerInterface>, float> RegularizerAndTau;
+
+  // Applies regularizers, that support token ranges, to r_wt in parallel.
+  // Each thread applies all the regularizers to its own range of tokens (in the given order),
+  // so every element of r_wt gets the same sequence of increments as in sequential execution.
+  void RegularizePhiInParallel(TokenRangeRunner* runner, const std::vector<RegularizerAndTau>& regularizers,
+                               const PhiMatrix& p_wt, const PhiMatrix& n_wt, PhiMatrix* r_wt) {
+    runner->Run(n_wt.token_size(), [&regularizers, &p_wt, &n_wt, r_wt](int token_begin, int token_end) {
+      for (const auto& reg : regularizers) {
+        reg.first->RegularizePhiRange(p_wt, n_wt, r_wt, &reg.second, token_begin, token_end);
+      }
+    });
+  }
+
+  // Sums of absolute values of regularizer (r_it) for each class_id and topic
+  typedef std::unordered_map<ClassId, std::vector<double>> AbsoluteSums;
+
   std::unordered_map<ClassId, std::vector<float>> FindRelativeRegularizationCoefficients(
           const std::shared_ptr<artm::RegularizerInterface>& regularizer,
-          const PhiMatrix& n_wt,
-          const DensePhiMatrix& local_r_wt,
+          const AbsoluteSums& r_it_all,
           const Normalizers& n_t_all,
           const std::vector<bool>& topics_to_regularize,
           int topic_size,
-          int token_size,
           float gamma) {
     std::unordered_map<ClassId, std::vector<float>> relative_coefficients;
 
@@ -52,6 +189,7 @@ namespace {
         double n = 0.0;
         double r_i = 0.0;
         std::vector<float> n_t = iter->second;
+        auto r_it_iter = r_it_all.find(class_id);
 
         for (int topic_id = 0; topic_id < topic_size; ++topic_id) {
           if (!topics_to_regularize[topic_id]) {
@@ -59,15 +197,7 @@ namespace {
           }
           n += n_t[topic_id];
 
-          float r_it_current = 0.0f;
-          for (int token_id = 0; token_id < token_size; ++token_id) {
-            if (n_wt.token(token_id).class_id != iter->first) {
-              continue;
-            }
-
-            r_it_current += fabs(local_r_wt.get(token_id, topic_id));
-          }
-
+          float r_it_current = (r_it_iter != r_it_all.end()) ? static_cast<float>(r_it_iter->second[topic_id]) : 0.0f;
           r_it[topic_id] = r_it_current;
           r_i += r_it_current;
         }
@@ -88,6 +218,118 @@ namespace {
     }
     return relative_coefficients;
   }
+
+  // Calls func(values, token_begin, token_end) in parallel for blocks of tokens with values of the regularizer
+  // (not multiplied by tau). Regularizers that support token ranges are calculated by small blocks,
+  // so the values are never stored for the whole matrix. Other regularizers should be calculated
+  // into local_r_wt before the call. Returns false if the regularizer hasn't been applied.
+  bool ForEachBlockOfRegularizer(TokenRangeRunner* runner,
+                                 const std::shared_ptr<artm::RegularizerInterface>& regularizer,
+                                 const DensePhiMatrix* local_r_wt, const PhiMatrix& p_wt, const PhiMatrix& n_wt,
+                                 std::function<void(const PhiMatrix&, int, int)> func) {  // NOLINT
+    if (local_r_wt != nullptr) {
+      runner->Run(n_wt.token_size(), [&func, local_r_wt](int token_begin, int token_end) {
+        func(*local_r_wt, token_begin, token_end);
+      });
+      return true;
+    }
+
+    const int tokens_per_block = 256;
+    std::atomic<bool> retval(false);
+    runner->Run(n_wt.token_size(),
+                [&func, &regularizer, &p_wt, &n_wt, &retval, tokens_per_block](int token_begin, int token_end) {
+      for (int block_begin = token_begin; block_begin < token_end; block_begin += tokens_per_block) {
+        const int block_end = std::min(token_end, block_begin + tokens_per_block);
+        TokenRangePhiMatrix block(n_wt, block_begin, block_end);
+        if (regularizer->RegularizePhiRange(p_wt, n_wt, &block, nullptr, block_begin, block_end)) {
+          retval = true;
+          func(block, block_begin, block_end);
+        }
+      }
+    });
+    return retval;
+  }
+
+  // Relative regularization needs sums of absolute values of the regularizer over the tokens of each class
+  // before any value can be added to r_wt (see FindRelativeRegularizationCoefficients).
+  // So regularizers that support token ranges are calculated twice: the first pass finds the sums,
+  // the second pass adds scaled values to r_wt. This is cheaper than a full-size copy of r_wt.
+  // Other regularizers are calculated once into a temporary matrix of the same size as n_wt.
+  void ApplyRelativeRegularizer(TokenRangeRunner* runner, float min_sparsity_rate,
+                                const std::shared_ptr<artm::RegularizerInterface>& regularizer,
+                                float tau, float gamma, const Normalizers& n_t_all,
+                                const PhiMatrix& p_wt, const PhiMatrix& n_wt, PhiMatrix* r_wt) {
+    const int topic_size = n_wt.topic_size();
+
+    std::shared_ptr<DensePhiMatrix> local_r_wt;
+    if (!regularizer->SupportsTokenRanges()) {
+      local_r_wt = std::make_shared<DensePhiMatrix>(ModelName(), n_wt.topic_name(), min_sparsity_rate);
+      local_r_wt->Reshape(n_wt);
+      if (!regularizer->RegularizePhi(p_wt, n_wt, local_r_wt.get())) {
+        return;
+      }
+    }
+
+    std::mutex r_it_lock;
+    AbsoluteSums r_it_all;
+    bool retval = ForEachBlockOfRegularizer(runner, regularizer, local_r_wt.get(), p_wt, n_wt,
+        [&n_wt, &r_it_lock, &r_it_all, topic_size](const PhiMatrix& values, int token_begin, int token_end) {
+      AbsoluteSums local_r_it;
+      std::vector<float> row(topic_size);
+      for (int token_id = token_begin; token_id < token_end; ++token_id) {
+        std::vector<double>& r_it = local_r_it[n_wt.token(token_id).class_id()];
+        r_it.resize(topic_size, 0.0);
+        values.get(token_id, &row);
+        for (int topic_id = 0; topic_id < topic_size; ++topic_id) {
+          r_it[topic_id] += fabs(row[topic_id]);
+        }
+      }
+
+      std::lock_guard<std::mutex> guard(r_it_lock);
+      for (const auto& local : local_r_it) {
+        std::vector<double>& r_it = r_it_all[local.first];
+        r_it.resize(topic_size, 0.0);
+        for (int topic_id = 0; topic_id < topic_size; ++topic_id) {
+          r_it[topic_id] += local.second[topic_id];
+        }
+      }
+    });
+    if (!retval) {
+      return;
+    }
+
+    std::vector<bool> topics_to_regularize;
+    if (!regularizer->topics_to_regularize().empty()) {
+      topics_to_regularize = core::is_member(n_wt.topic_name(), regularizer->topics_to_regularize());
+    } else {
+      topics_to_regularize.assign(topic_size, true);
+    }
+
+    std::unordered_map<ClassId, std::vector<float>> relative_coefficients =
+      FindRelativeRegularizationCoefficients(regularizer, r_it_all, n_t_all, topics_to_regularize, topic_size, gamma);
+
+    ForEachBlockOfRegularizer(runner, regularizer, local_r_wt.get(), p_wt, n_wt,
+        [&n_wt, &relative_coefficients, &topics_to_regularize, r_wt, topic_size, tau](const PhiMatrix& values,
+                                                                                       int token_begin,
+                                                                                       int token_end) {
+      std::vector<float> row(topic_size);
+      for (int token_id = token_begin; token_id < token_end; ++token_id) {
+        const auto& class_id = n_wt.token(token_id).class_id();
+        auto iter = relative_coefficients.find(class_id);
+        if (iter == relative_coefficients.end()) {
+          LOG(WARNING) << "No relative coefficients were provided for class_id " << class_id;
+          continue;
+        }
+
+        // update global r_wt using coefficient and tau
+        values.get(token_id, &row);
+        for (int topic_id = 0; topic_id < topic_size; ++topic_id) {
+          row[topic_id] = topics_to_regularize[topic_id] ? iter->second[topic_id] * tau * row[topic_id] : 0.0f;
+        }
+        r_wt->increase(token_id, row);
+      }
+    });
+  }
 }  // namespace
 
 void PhiMatrixOperations::RetrieveExternalTopicModel(const PhiMatrix& phi_matrix,
@@ -105,9 +347,7 @@ void PhiMatrixOperations::RetrieveExternalTopicModel(const PhiMatrix& phi_matrix
 
     for (int i = 0; i < get_model_args.token_size(); ++i) {
       ClassId class_id = use_default_class ? DefaultClass : get_model_args.class_id(i);
-      Token token(class_id, get_model_args.token(i));
-
-      int token_id = phi_matrix.token_index(token);
+      int token_id = phi_matrix.token_index(Token::Find(class_id, get_model_args.token(i)));
       if (token_id != -1) {
         assert(token_id >= 0 && token_id < phi_matrix.token_size());
         tokens_to_use.push_back(token_id);
@@ -117,7 +357,7 @@ void PhiMatrixOperations::RetrieveExternalTopicModel(const PhiMatrix& phi_matrix
     for (int i = 0; i < phi_matrix.token_size(); ++i) {
       bool use_token = true;
       if (!use_default_class) {
-        use_token = repeated_field_contains(get_model_args.class_id(), phi_matrix.token(i).class_id);
+        use_token = repeated_field_contains(get_model_args.class_id(), phi_matrix.token(i).class_id());
       }
 
       if (use_token) {
@@ -165,8 +405,8 @@ void PhiMatrixOperations::RetrieveExternalTopicModel(const PhiMatrix& phi_matrix
   for (int token_index : tokens_to_use) {
     const Token& current_token = phi_matrix.token(token_index);
 
-    topic_model->add_token(current_token.keyword);
-    topic_model->add_class_id(current_token.class_id);
+    topic_model->add_token(current_token.keyword());
+    topic_model->add_class_id(current_token.class_id());
 
     ::artm::FloatArray *target = topic_model->add_token_weights();
 
@@ -236,7 +476,8 @@ void PhiMatrixOperations::ApplyTopicModelOperation(const ::artm::TopicModel& top
     const std::string& token_keyword = topic_model.token(token_index);
     const ClassId& class_id = topic_model.class_id(token_index);
 
-    Token token(class_id, token_keyword);
+    // Tokens are only added to the vocabulary if they are going to be added to the matrix
+    const Token token = add_missing_tokens ? Token(class_id, token_keyword) : Token::Find(class_id, token_keyword);
     const ::artm::FloatArray& counters = topic_model.token_weights(token_index);
     const ::artm::IntArray* sparse_topic_indices =
       has_sparse_format ? &topic_model.topic_indices(token_index) : nullptr;
@@ -274,11 +515,9 @@ void PhiMatrixOperations::InvokePhiRegularizers(
     Instance* instance,
     const ::google::protobuf::RepeatedPtrField<RegularizerSettings>& regularizer_settings,
     const PhiMatrix& p_wt, const PhiMatrix& n_wt, PhiMatrix* r_wt) {
-
-  int topic_size = n_wt.topic_size();
-  int token_size = n_wt.token_size();
-
-  auto n_t_all = PhiMatrixOperations::FindNormalizers(n_wt);
+  // Processors are idle during regularization of phi matrix, so the same number of threads is used here
+  // The threads are reused by all the regularizers
+  TokenRangeRunner runner(std::max<int>(1, instance->processor_size()));
 
   bool use_any_relative_regularization = false;
   for (const auto &reg_it : regularizer_settings) {
@@ -288,96 +527,54 @@ void PhiMatrixOperations::InvokePhiRegularizers(
     }
   }
 
+  Normalizers n_t_all;
   if (use_any_relative_regularization) {
-    DensePhiMatrix local_r_wt(ModelName(), n_wt.topic_name(), instance->config()->min_sparsity_rate());
-    local_r_wt.Reshape(n_wt);
-
-    for (const auto &reg_it : regularizer_settings) {
-      auto regularizer = instance->regularizers()->get(reg_it.name().c_str());
-
-      if (regularizer == nullptr) {
-        LOG(ERROR) << "Phi Regularizer with name <" << reg_it.name().c_str() << "> does not exist.\n";
-        continue;
-      }
-
-      float tau = reg_it.tau();
-      bool use_relative_reg = reg_it.has_gamma();
-
-      // p_wt.token_size() != n_wt.token_size() --- this is possible
-      // if user chooses to change the number of topics in the model between calls to fit_offline.
-      if (p_wt.topic_size() != n_wt.topic_size() ||
-          local_r_wt.token_size() != n_wt.token_size() || local_r_wt.topic_size() != n_wt.topic_size()) {
-        LOG(ERROR) << "Inconsistent matrix size: Pwt( "
-                   << p_wt.token_size() << ", " << p_wt.topic_size() << ") vs Nwt("
-                   << n_wt.token_size() << ", " << n_wt.topic_size() << ") vs Rwt("
-                   << local_r_wt.token_size() << ", " << local_r_wt.topic_size() << ")";
-        continue;
-      }
-
-      bool retval = regularizer->RegularizePhi(p_wt, n_wt, &local_r_wt);
-      if (!retval) {
-        continue;
-      }
-
-      std::vector<bool> topics_to_regularize;
-      if (!regularizer->topics_to_regularize().empty()) {
-        topics_to_regularize = core::is_member(n_wt.topic_name(), regularizer->topics_to_regularize());
-      } else {
-        topics_to_regularize.assign(topic_size, true);
-      }
-
-      std::unordered_map<ClassId, std::vector<float>> relative_coefficients;
-      if (use_relative_reg) {
-        relative_coefficients = FindRelativeRegularizationCoefficients(regularizer, n_wt, local_r_wt, n_t_all,
-                                                                       topics_to_regularize, topic_size,
-                                                                       token_size, reg_it.gamma());
-      }
+    n_t_all = PhiMatrixOperations::FindNormalizers(n_wt);
+  }
 
-      for (int token_id = 0; token_id < token_size; ++token_id) {
-        const auto& class_id = n_wt.token(token_id).class_id;
-        auto iter = relative_coefficients.find(class_id);
+  // Consecutive regularizers that support token ranges are applied together in parallel,
+  // other regularizers are applied to the whole matrix on this thread
+  std::vector<RegularizerAndTau> parallel_regularizers;
+  for (const auto& reg_it : regularizer_settings) {
+    auto regularizer = instance->regularizers()->get(reg_it.name().c_str());
 
-        if (use_relative_reg && iter == relative_coefficients.end()) {
-          LOG(WARNING) << "No relative coefficients were provided for class_id " << class_id;
-          continue;
-        }
+    if (regularizer == nullptr) {
+      LOG(ERROR) << "Phi Regularizer with name <" << reg_it.name().c_str() << "> does not exist.\n";
+      continue;
+    }
 
-        for (int topic_id = 0; topic_id < topic_size; ++topic_id) {
-          if (use_relative_reg && !topics_to_regularize[topic_id]) {
-            continue;
-          }
+    float tau = reg_it.tau();
 
-          // update global r_wt using coefficient and tau
-          float coefficient = use_relative_reg ? iter->second[topic_id] : 1.0f;
-          float increment = coefficient * tau * local_r_wt.get(token_id, topic_id);
-          r_wt->increase(token_id, topic_id, increment);
-        }
-      }
-      local_r_wt.Reset();
+    // p_wt.token_size() != n_wt.token_size() --- this is possible
+    // if user chooses to change the number of topics in the model between calls to fit_offline.
+    if (p_wt.topic_size() != n_wt.topic_size()) {
+      LOG(ERROR) << "Inconsistent matrix size: Pwt( "
+                 << p_wt.token_size() << ", " << p_wt.topic_size() << ") vs Nwt("
+                 << n_wt.token_size() << ", " << n_wt.topic_size() << ")";
+      continue;
     }
-  } else {
-    for (const auto& reg_it : regularizer_settings) {
-      auto regularizer = instance->regularizers()->get(reg_it.name().c_str());
-
-      if (regularizer == nullptr) {
-        LOG(ERROR) << "Phi Regularizer with name <" << reg_it.name().c_str() << "> does not exist.\n";
-        continue;
-      }
 
-      float tau = reg_it.tau();
+    if (!reg_it.has_gamma() && regularizer->SupportsTokenRanges()) {
+      parallel_regularizers.push_back(std::make_pair(regularizer, tau));
+      continue;
+    }
 
-      // p_wt.token_size() != n_wt.token_size() --- this is possible
-      // if user chooses to change the number of topics in the model between calls to fit_offline.
-      if (p_wt.topic_size() != n_wt.topic_size()) {
-        LOG(ERROR) << "Inconsistent matrix size: Pwt( "
-                   << p_wt.token_size() << ", " << p_wt.topic_size() << ") vs Nwt("
-                   << n_wt.token_size() << ", " << n_wt.topic_size() << ")";
-        continue;
-      }
+    if (!parallel_regularizers.empty()) {
+      RegularizePhiInParallel(&runner, parallel_regularizers, p_wt, n_wt, r_wt);
+      parallel_regularizers.clear();
+    }
 
+    if (reg_it.has_gamma()) {
+      ApplyRelativeRegularizer(&runner, instance->config()->min_sparsity_rate(), regularizer, tau,
+                               reg_it.gamma(), n_t_all, p_wt, n_wt, r_wt);
+    } else {
       regularizer->RegularizePhi(p_wt, n_wt, r_wt, &tau);
     }
   }
+
+  if (!parallel_regularizers.empty()) {
+    RegularizePhiInParallel(&runner, parallel_regularizers, p_wt, n_wt, r_wt);
+  }
 }
 
 static Normalizers FindNormalizersImpl(const PhiMatrix& n_wt, const PhiMatrix* r_wt) {
@@ -386,7 +583,7 @@ static Normalizers FindNormalizersImpl(const PhiMatrix& n_wt, const PhiMatrix* r
 
   for (int token_id = 0; token_id < n_wt.token_size(); ++token_id) {
     const Token& token = n_wt.token(token_id);
-    auto normalizer_key = token.class_id;
+    auto normalizer_key = token.class_id();
 
     assert(r_wt == nullptr || r_wt->token(token_id) == token);
     auto iter = retval.find(normalizer_key);
@@ -423,7 +620,7 @@ static void FindPwtImpl(const PhiMatrix& n_wt, const PhiMatrix* r_wt, PhiMatrix*
     const Token& token = n_wt.token(token_id);
     assert(r_wt == nullptr || r_wt->token(token_id) == token);
     assert(p_wt->token(token_id) == token);
-    const std::vector<float>& nt = n_t[token.class_id];
+    const std::vector<float>& nt = n_t[token.class_id()];
     for (int topic_index = 0; topic_index < topic_size; ++topic_index) {
       if (nt[topic_index] <= 0) {
         p_wt->set(token_id, topic_index, 0.0f);
@@ -157,15 +157,11 @@ void Processor::ThreadFunction() {
         }
         VLOG(0) << "Processor: start processing batch " << batch.id() << " into model " << model_description.str();
 
-        std::shared_ptr<ThetaMatrix> cache;
-        if (part->has_reuse_theta_cache_manager()) {
-          CuckooWatch cuckoo2("FindReuseThetaCacheEntry", &cuckoo, kTimeLoggingThreshold);
-          cache = part->reuse_theta_cache_manager()->FindCacheEntry(batch);
-        }
         std::shared_ptr<LocalThetaMatrix<float>> theta_matrix;
         {
           CuckooWatch cuckoo2("InitializeTheta", &cuckoo, kTimeLoggingThreshold);
-          theta_matrix = ProcessorHelpers::InitializeTheta(p_wt.topic_size(), batch, args, cache.get());
+          theta_matrix = ProcessorHelpers::InitializeTheta(p_wt.topic_size(), batch, args,
+                                                           part->reuse_theta_cache_manager());
         }
 
         if (p_wt.token_size() == 0) {
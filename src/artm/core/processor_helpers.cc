@@ -25,9 +25,27 @@ void ProcessorHelpers::CreateThetaCacheEntry(ThetaMatrix* new_cache_entry_ptr,
   }
 
   if (!args.has_predict_class_id()) {
+    // With cache_theta_eps the entry is sparse: only values above eps are stored, along with their topic indices.
+    const bool sparse_cache = args.has_cache_theta_eps();
+    const float eps = args.cache_theta_eps();
     for (int item_index = 0; item_index < batch.item_size(); ++item_index) {
+      const float* item_theta = &(*theta_matrix)(0, item_index);  // theta_matrix is stored by columns
+      auto item_values = new_cache_entry_ptr->mutable_item_weights(item_index)->mutable_value();
+      if (!sparse_cache) {
+        item_values->Resize(topic_size, 0.0f);
+        std::copy(item_theta, item_theta + topic_size, item_values->mutable_data());
+        continue;
+      }
+
+      const int nnz = std::count_if(item_theta, item_theta + topic_size, [eps](float value) { return value > eps; });
+      auto item_topics = new_cache_entry_ptr->add_topic_indices()->mutable_value();
+      item_values->Reserve(nnz);
+      item_topics->Reserve(nnz);
       for (int topic_index = 0; topic_index < topic_size; ++topic_index) {
-        new_cache_entry_ptr->mutable_item_weights(item_index)->add_value((*theta_matrix)(topic_index, item_index));
+        if (item_theta[topic_index] > eps) {
+          item_values->AddAlreadyReserved(item_theta[topic_index]);
+          item_topics->AddAlreadyReserved(topic_index);
+        }
       }
     }
   } else {
@@ -35,7 +53,7 @@ void ProcessorHelpers::CreateThetaCacheEntry(ThetaMatrix* new_cache_entry_ptr,
     new_cache_entry_ptr->clear_topic_name();
     for (int token_index = 0; token_index < p_wt.token_size(); token_index++) {
       const Token& token = p_wt.token(token_index);
-      if (predict_class_id && token.class_id != args.predict_class_id()) {
+      if (predict_class_id && token.class_id() != args.predict_class_id()) {
         continue;
       }
     }
@@ -73,37 +91,33 @@ void ProcessorHelpers::CreatePtdwCacheEntry(ThetaMatrix* new_cache_entry_ptr,
 std::shared_ptr<LocalThetaMatrix<float>> ProcessorHelpers::InitializeTheta(int topic_size,
                                                                            const Batch& batch,
                                                                            const ProcessBatchesArgs& args,
-                                                                           const ThetaMatrix* cache) {
+                                                                           const CacheManager* cache_manager) {
   auto Theta = std::make_shared<LocalThetaMatrix<float>>(topic_size, batch.item_size());
 
   Theta->InitializeZeros();
 
+  std::vector<bool> is_cached(batch.item_size(), false);
+  if ((cache_manager != nullptr) && args.reuse_theta()) {
+    cache_manager->InitializeThetaFromCache(batch, Theta.get(), &is_cached);
+  }
+
   for (int item_index = 0; item_index < batch.item_size(); ++item_index) {
-    int index_of_item = -1;
-    if ((cache != nullptr) && args.reuse_theta()) {
-      index_of_item = repeated_field_index_of(cache->item_title(),
-        batch.item(item_index).title());
+    if (is_cached[item_index]) {
+      continue;
     }
 
-    if ((index_of_item != -1) && args.reuse_theta()) {
-      const FloatArray& old_thetas = cache->item_weights(index_of_item);
-      for (int topic_index = 0; topic_index < topic_size; ++topic_index) {
-        (*Theta)(topic_index, item_index) = old_thetas.value(topic_index);
+    if (args.use_random_theta()) {
+      size_t seed = 0;
+      boost::hash_combine(seed, std::hash<std::string>()(batch.id()));
+      boost::hash_combine(seed, std::hash<int>()(item_index));
+      std::vector<float> theta_values = Helpers::GenerateRandomVector(topic_size, seed);
+      for (int iTopic = 0; iTopic < topic_size; ++iTopic) {
+        (*Theta)(iTopic, item_index) = theta_values[iTopic];
       }
     } else {
-      if (args.use_random_theta()) {
-        size_t seed = 0;
-        boost::hash_combine(seed, std::hash<std::string>()(batch.id()));
-        boost::hash_combine(seed, std::hash<int>()(item_index));
-        std::vector<float> theta_values = Helpers::GenerateRandomVector(topic_size, seed);
-        for (int iTopic = 0; iTopic < topic_size; ++iTopic) {
-          (*Theta)(iTopic, item_index) = theta_values[iTopic];
-        }
-      } else {
-        const float default_theta = 1.0f / topic_size;
-        for (int iTopic = 0; iTopic < topic_size; ++iTopic) {
-          (*Theta)(iTopic, item_index) = default_theta;
-        }
+      const float default_theta = 1.0f / topic_size;
+      for (int iTopic = 0; iTopic < topic_size; ++iTopic) {
+        (*Theta)(iTopic, item_index) = default_theta;
       }
     }
   }
@@ -117,8 +131,9 @@ ProcessorHelpers::InitializePhi(const Batch& batch, const ::artm::core::PhiMatri
   int topic_size = p_wt.topic_size();
   auto phi_matrix = std::make_shared<LocalPhiMatrix<float>>(batch.token_size(), topic_size);
   phi_matrix->InitializeZeros();
+  TokenBuilder token_builder;
   for (int token_index = 0; token_index < batch.token_size(); ++token_index) {
-    Token token = Token(batch.class_id(token_index), batch.token(token_index));
+    Token token = token_builder.Find(batch.class_id(token_index), batch.token(token_index));
 
     int p_wt_token_index = p_wt.token_index(token);
     if (p_wt_token_index != ::artm::core::PhiMatrix::kUndefIndex) {
@@ -220,9 +235,12 @@ std::shared_ptr<CsrMatrix<float>> ProcessorHelpers::InitializeSparseNdw(const Ba
 
 void
 ProcessorHelpers::FindBatchTokenIds(const Batch& batch, const PhiMatrix& phi_matrix, std::vector<int>* token_id) {
+  // Tokens of the batch are only looked up, so new tokens (e.g. in transform) are not added to the vocabulary
   token_id->resize(batch.token_size(), -1);
+  TokenBuilder token_builder;
   for (int token_index = 0; token_index < batch.token_size(); ++token_index) {
-    token_id->at(token_index) = phi_matrix.token_index(Token(batch.class_id(token_index), batch.token(token_index)));
+    const Token token = token_builder.Find(batch.class_id(token_index), batch.token(token_index));
+    token_id->at(token_index) = phi_matrix.token_index(token);
   }
 }
 
@@ -235,9 +253,13 @@ std::shared_ptr<Score> ProcessorHelpers::CalcScores(ScoreCalculatorInterface* sc
     return nullptr;
   }
 
+  // Tokens are only looked up (see FindBatchTokenIds); tokens that are not in the vocabulary stay unknown,
+  // and scores skip them, because they can't belong to p_wt or to any dictionary
   std::vector<Token> batch_token_dict;
+  batch_token_dict.reserve(batch.token_size());
+  TokenBuilder token_builder;
   for (int token_index = 0; token_index < batch.token_size(); ++token_index) {
-    batch_token_dict.push_back(Token(batch.class_id(token_index), batch.token(token_index)));
+    batch_token_dict.push_back(token_builder.Find(batch.class_id(token_index), batch.token(token_index)));
   }
 
   std::shared_ptr<Score> score = score_calc->CreateScore();
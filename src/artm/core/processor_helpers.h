@@ -7,6 +7,7 @@
 #include <vector>
 #include <string>
 
+#include "artm/core/cache_manager.h"
 #include "artm/core/phi_matrix.h"
 #include "artm/core/phi_matrix_operations.h"
 #include "artm/core/instance.h"
@@ -134,7 +135,7 @@ class ProcessorHelpers {
   static std::shared_ptr<LocalThetaMatrix<float>> InitializeTheta(int topic_size,
                                                                   const Batch& batch,
                                                                   const ProcessBatchesArgs& args,
-                                                                  const ThetaMatrix* cache);
+                                                                  const CacheManager* cache_manager);
 
   static std::shared_ptr<LocalPhiMatrix<float>> InitializePhi(const Batch& batch,
                                                               const ::artm::core::PhiMatrix& p_wt);
@@ -0,0 +1,131 @@
+// Copyright 2017, Additive Regularization of Topic Models.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <mutex>  // NOLINT
+#include <string>
+#include <unordered_map>
+
+#include "boost/functional/hash.hpp"
+#include "boost/utility.hpp"
+#include "boost/utility/string_ref.hpp"
+
+#include "artm/core/exceptions.h"
+
+namespace artm {
+namespace core {
+
+// StringInterner assigns 32-bit ids to strings, so that tokens and class ids can be handled as integers
+// once they are parsed. Intern() may be called concurrently from many threads: strings are split into
+// kNumShards shards by their hash, and each shard is guarded by its own lock. Lookups take boost::string_ref,
+// so that no memory is allocated for strings that were already interned.
+// Ids are dense (0, 1, 2, ...) and never reused. Strings are stored in chunks of growing size that are never
+// moved or freed until the interner is destroyed, so str() takes no lock and the returned reference stays valid.
+// The number of strings is bounded by max_size: Intern() throws InvalidOperation instead of growing further.
+class StringInterner : boost::noncopyable {
+ public:
+  explicit StringInterner(int max_size = std::numeric_limits<int>::max()) : max_size_(max_size), size_(0) {
+    for (auto& chunk : chunks_) {
+      chunk.store(nullptr);
+    }
+  }
+
+  ~StringInterner() {
+    for (auto& chunk : chunks_) {
+      delete[] chunk.load();
+    }
+  }
+
+  int Intern(boost::string_ref str) {
+    Shard& shard = shards_[Hash(str) % kNumShards];
+
+    std::lock_guard<std::mutex> guard(shard.lock);
+    auto iter = shard.index.find(str);
+    if (iter != shard.index.end()) {
+      return iter->second;
+    }
+
+    const int id = size_.fetch_add(1);
+    if (id >= max_size_) {
+      size_.fetch_sub(1);
+      BOOST_THROW_EXCEPTION(InvalidOperation(
+        "StringInterner can't hold more than " + std::to_string(max_size_) + " strings"));
+    }
+
+    std::string* slot = Slot(id, /* allocate = */ true);
+    slot->assign(str.begin(), str.end());
+    shard.index.emplace(boost::string_ref(*slot), id);
+    return id;
+  }
+
+  // Returns -1 if the string was not interned.
+  int Find(boost::string_ref str) const {
+    const Shard& shard = shards_[Hash(str) % kNumShards];
+    std::lock_guard<std::mutex> guard(shard.lock);
+    auto iter = shard.index.find(str);
+    return (iter != shard.index.end()) ? iter->second : -1;
+  }
+
+  // id must be returned by Intern() or Find().
+  const std::string& str(int id) const {
+    return *const_cast<StringInterner*>(this)->Slot(id, /* allocate = */ false);
+  }
+
+  int size() const { return std::min(size_.load(), max_size_); }
+  int max_size() const { return max_size_; }
+
+ private:
+  static const int kNumShards = 64;
+  static const int kFirstChunkSize = 1024;  // chunk i holds kFirstChunkSize * 2^i strings
+  static const int kMaxChunks = 22;
+
+  struct StringRefHasher {
+    size_t operator()(boost::string_ref str) const { return Hash(str); }
+  };
+
+  struct Shard {
+    mutable std::mutex lock;
+    std::unordered_map<boost::string_ref, int, StringRefHasher> index;
+  };
+
+  static size_t Hash(boost::string_ref str) {
+    return boost::hash_range(str.begin(), str.end());
+  }
+
+  std::string* Slot(int id, bool allocate) {
+    int chunk_index = 0;
+    int64_t chunk_size = kFirstChunkSize;
+    int64_t offset = id;
+    while (offset >= chunk_size) {
+      offset -= chunk_size;
+      chunk_size *= 2;
+      chunk_index++;
+    }
+
+    std::string* chunk = chunks_[chunk_index].load(std::memory_order_acquire);
+    if (chunk == nullptr && allocate) {
+      // Several threads may allocate the chunk at the same time; only one of them succeeds.
+      std::string* new_chunk = new std::string[chunk_size];
+      if (chunks_[chunk_index].compare_exchange_strong(chunk, new_chunk, std::memory_order_acq_rel)) {
+        chunk = new_chunk;
+      } else {
+        delete[] new_chunk;
+      }
+    }
+
+    return chunk + offset;
+  }
+
+  Shard shards_[kNumShards];
+  const int max_size_;
+  std::atomic<int> size_;
+  std::atomic<std::string*> chunks_[kMaxChunks];
+};
+
+}  // namespace core
+}  // namespace artm
@@ -2,12 +2,14 @@
 
 #pragma once
 
+#include <algorithm>
 #include <queue>
 #include <map>
 #include <memory>
 #include <vector>
 #include <utility>
 
+#include "boost/thread/condition_variable.hpp"
 #include "boost/thread/locks.hpp"
 #include "boost/thread/mutex.hpp"
 #include "boost/utility.hpp"
@@ -192,5 +194,67 @@ class ThreadSafeQueue : boost::noncopyable {
   size_t reserved_;
 };
 
+// ThreadSafeBoundedQueue connects a producer and a consumer that run on different threads.
+// push() blocks while the queue holds capacity elements, pop() blocks while the queue is empty.
+// Once close() is called push() discards new elements and returns false,
+// while pop() returns the remaining elements and then returns false.
+template<typename T>
+class ThreadSafeBoundedQueue : boost::noncopyable {
+ public:
+  explicit ThreadSafeBoundedQueue(size_t capacity)
+      : lock_(), not_empty_(), not_full_(), queue_(), capacity_(std::max<size_t>(capacity, 1)), closed_(false) { }
+
+  bool push(const T& elem) {
+    boost::unique_lock<boost::mutex> lock(lock_);
+    while (!closed_ && queue_.size() >= capacity_) {
+      not_full_.wait(lock);
+    }
+
+    if (closed_) {
+      return false;
+    }
+
+    queue_.push(elem);
+    not_empty_.notify_one();
+    return true;
+  }
+
+  bool pop(T* elem) {
+    boost::unique_lock<boost::mutex> lock(lock_);
+    while (!closed_ && queue_.empty()) {
+      not_empty_.wait(lock);
+    }
+
+    if (queue_.empty()) {
+      return false;
+    }
+
+    *elem = queue_.front();
+    queue_.pop();
+    not_full_.notify_one();
+    return true;
+  }
+
+  void close() {
+    boost::lock_guard<boost::mutex> guard(lock_);
+    closed_ = true;
+    not_empty_.notify_all();
+    not_full_.notify_all();
+  }
+
+  size_t size() const {
+    boost::lock_guard<boost::mutex> guard(lock_);
+    return queue_.size();
+  }
+
+ private:
+  mutable boost::mutex lock_;
+  boost::condition_variable not_empty_;
+  boost::condition_variable not_full_;
+  std::queue<T> queue_;
+  size_t capacity_;
+  bool closed_;
+};
+
 }  // namespace core
 }  // namespace artm
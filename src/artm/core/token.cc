@@ -5,5 +5,33 @@
 namespace artm {
 namespace core {
 
+StringInterner& Token::vocabulary() {
+  static StringInterner vocabulary(kMaxVocabularySize);
+  return vocabulary;
+}
+
+Token TokenBuilder::Intern(const ClassId& class_id, const std::string& keyword) {
+  return Token(GetClassIdId(class_id, /* intern = */ true), Token::vocabulary().Intern(keyword));
+}
+
+Token TokenBuilder::Find(const ClassId& class_id, const std::string& keyword) {
+  const int class_id_id = GetClassIdId(class_id, /* intern = */ false);
+  if (class_id_id == Token::kUnknownId) {
+    return Token(Token::kUnknownId, Token::kUnknownId);
+  }
+
+  return Token(class_id_id, Token::vocabulary().Find(keyword));
+}
+
+int TokenBuilder::GetClassIdId(const ClassId& class_id, bool intern) {
+  // Unknown class id is not cached, so that it could be interned later
+  if (class_id_id_ == Token::kUnknownId || class_id != class_id_) {
+    class_id_id_ = intern ? Token::vocabulary().Intern(class_id) : Token::vocabulary().Find(class_id);
+    class_id_ = class_id;
+  }
+
+  return class_id_id_;
+}
+
 }  // namespace core
 }  // namespace artm
@@ -10,6 +10,7 @@
 #include "boost/functional/hash.hpp"
 
 #include "artm/core/common.h"
+#include "artm/core/string_interner.h"
 
 namespace artm {
 namespace core {
@@ -24,56 +25,92 @@ const TransactionTypeName DefaultTransactionTypeName = "@default_transaction";
 // Token is a tuple of keyword and its class_id (also known as tokens' modality).
 // Pay attention to the order of the arguments in the constructor.
 // For historical reasons ClassId goes first, followed by the keyword.
+// Keywords and class ids are interned in a process-wide vocabulary (see Token::vocabulary()),
+// so Token itself is a pair of 32-bit ids; it is hashed and compared for equality as an integer.
+// Strings are only looked up when they are needed, e.g. to export the model.
+// The constructor adds strings to the vocabulary, while Token::Find() only looks them up.
 struct Token {
  public:
-  Token(const ClassId& _class_id, const std::string& _keyword)
-    : keyword(_keyword)
-    , class_id(_class_id)
-    , hash_(calcHash(_class_id, _keyword)) { }
-
-  Token& operator=(const Token &token) {
-    if (this != &token) {
-      const_cast<std::string&>(keyword) = token.keyword;
-      const_cast<ClassId&>(class_id) = token.class_id;
-      const_cast<size_t&>(hash_) = token.hash_;
-    }
+  static const int kUnknownId = -1;
 
-    return *this;
+  Token(const ClassId& _class_id, const std::string& _keyword)
+    : class_id_id_(vocabulary().Intern(_class_id))
+    , keyword_id_(vocabulary().Intern(_keyword)) { }
+
+  // Creates a token from ids of strings in the vocabulary.
+  Token(int _class_id_id, int _keyword_id) : class_id_id_(_class_id_id), keyword_id_(_keyword_id) { }
+
+  // Finds a token without adding its strings to the vocabulary. If the keyword or the class_id was never
+  // interned, the token is absent from all dictionaries, batches and phi matrices, so the returned token is
+  // unknown (see known()). Unknown tokens may only be used as keys for lookups, their strings are not available.
+  // Code that only looks tokens up (e.g. transform of new documents) should use Find() to keep the vocabulary
+  // from growing.
+  static Token Find(const ClassId& _class_id, const std::string& _keyword) {
+    return Token(vocabulary().Find(_class_id), vocabulary().Find(_keyword));
   }
 
+  bool known() const { return class_id_id_ != kUnknownId && keyword_id_ != kUnknownId; }
+
+  // Tokens are ordered by their strings (not by ids), first by keyword and then by class_id.
   bool operator<(const Token& token) const {
-    if (keyword != token.keyword) {
-      return keyword < token.keyword;
+    if (keyword_id_ != token.keyword_id_) {
+      return keyword() < token.keyword();
     }
 
-    return class_id < token.class_id;
+    return (class_id_id_ != token.class_id_id_) && (class_id() < token.class_id());
   }
 
   bool operator==(const Token& token) const {
-    if (keyword == token.keyword && class_id == token.class_id) {
-      return true;
-    }
-    return false;
+    return keyword_id_ == token.keyword_id_ && class_id_id_ == token.class_id_id_;
   }
 
   bool operator!=(const Token& token) const {
     return !(*this == token);
   }
 
-  size_t hash() const { return hash_; }
+  size_t hash() const {
+    size_t hash = 0;
+    boost::hash_combine<int>(hash, keyword_id_);
+    boost::hash_combine<int>(hash, class_id_id_);
+    return hash;
+  }
+
+  const std::string& keyword() const { return vocabulary().str(keyword_id_); }
+  const ClassId& class_id() const { return vocabulary().str(class_id_id_); }
+
+  int keyword_id() const { return keyword_id_; }
+  int class_id_id() const { return class_id_id_; }
 
-  const std::string keyword;
-  const ClassId class_id;
+  // The vocabulary is never cleared, so ids stay valid for the lifetime of the process.
+  // It holds strings of tokens that were stored in batches, dictionaries and phi matrices,
+  // and it is bounded by kMaxVocabularySize strings.
+  static StringInterner& vocabulary();
+  static const int kMaxVocabularySize = 1 << 28;
 
  private:
-  const size_t hash_;
+  int class_id_id_;
+  int keyword_id_;
+};
 
-  static size_t calcHash(const ClassId& class_id, const std::string& keyword) {
-    size_t hash = 0;
-    boost::hash_combine<std::string>(hash, keyword);
-    boost::hash_combine<std::string>(hash, class_id);
-    return hash;
-  }
+// TokenBuilder creates tokens from strings and remembers the id of the last class_id.
+// Consecutive tokens usually share the same class_id (e.g. in batches and dictionaries),
+// so class ids are resolved once per batch instead of taking a lock of the vocabulary for each token.
+// TokenBuilder is not thread-safe; each thread should use its own builder.
+class TokenBuilder {
+ public:
+  TokenBuilder() : class_id_id_(Token::kUnknownId) { }
+
+  // Adds strings to the vocabulary, same as the constructor of Token.
+  Token Intern(const ClassId& class_id, const std::string& keyword);
+
+  // Looks strings up in the vocabulary, same as Token::Find().
+  Token Find(const ClassId& class_id, const std::string& keyword);
+
+ private:
+  int GetClassIdId(const ClassId& class_id, bool intern);
+
+  ClassId class_id_;
+  int class_id_id_;
 };
 
 struct TokenHasher {
@@ -0,0 +1,144 @@
+// Copyright 2017, Additive Regularization of Topic Models.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <cassert>
+#include <utility>
+#include <vector>
+
+#include "artm/core/token.h"
+
+namespace artm {
+namespace core {
+
+// TokenIndex maps tokens to non-negative integers (typically, to positions of tokens in a vector).
+// It is a flat open-addressing hash table with linear probing: ids of the token and the value are stored inline
+// in a single array of slots, so a lookup touches one or two adjacent cache lines and no memory is allocated
+// per token. The table is kept at most 3/4 full. Tokens can not be removed, except by clear().
+class TokenIndex {
+ public:
+  static const int kNotFound = -1;
+
+  TokenIndex() : size_(0) { }
+
+  // Returns kNotFound if the token is not in the index.
+  int find(const Token& token) const {
+    if (slots_.empty()) {
+      return kNotFound;
+    }
+
+    const size_t mask = slots_.size() - 1;
+    for (size_t pos = Hash(token) & mask; ; pos = (pos + 1) & mask) {
+      const Slot& slot = slots_[pos];
+      if (slot.value == kNotFound) {
+        return kNotFound;
+      }
+      if (slot.keyword_id == token.keyword_id() && slot.class_id_id == token.class_id_id()) {
+        return slot.value;
+      }
+    }
+  }
+
+  bool has_token(const Token& token) const { return find(token) != kNotFound; }
+
+  // Returns false (and keeps the old value) if the token is already in the index.
+  // The value must be non-negative, because kNotFound marks empty slots.
+  bool insert(const Token& token, int value) {
+    assert(value >= 0);
+    if (4 * static_cast<size_t>(size_ + 1) > 3 * slots_.size()) {
+      Rehash(std::max<size_t>(kMinCapacity, 2 * slots_.size()));
+    }
+
+    const size_t mask = slots_.size() - 1;
+    size_t pos = Hash(token) & mask;
+    for (; slots_[pos].value != kNotFound; pos = (pos + 1) & mask) {
+      if (slots_[pos].keyword_id == token.keyword_id() && slots_[pos].class_id_id == token.class_id_id()) {
+        return false;
+      }
+    }
+
+    slots_[pos].keyword_id = token.keyword_id();
+    slots_[pos].class_id_id = token.class_id_id();
+    slots_[pos].value = value;
+    size_++;
+    return true;
+  }
+
+  // Prepares the index to hold size tokens without rehashing.
+  void reserve(int size) {
+    size_t capacity = kMinCapacity;
+    while (3 * capacity < 4 * static_cast<size_t>(size)) {
+      capacity *= 2;
+    }
+
+    if (capacity > slots_.size()) {
+      Rehash(capacity);
+    }
+  }
+
+  int size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  void clear() {
+    slots_.clear();
+    size_ = 0;
+  }
+
+  void swap(TokenIndex* rhs) {
+    slots_.swap(rhs->slots_);
+    std::swap(size_, rhs->size_);
+  }
+
+  int64_t ByteSize() const { return sizeof(*this) + sizeof(Slot) * slots_.capacity(); }
+
+ private:
+  static const size_t kMinCapacity = 16;
+
+  struct Slot {
+    int keyword_id;
+    int class_id_id;
+    int value;  // kNotFound marks an empty slot
+
+    Slot() : keyword_id(0), class_id_id(0), value(kNotFound) { }
+  };
+
+  // Ids of consecutive tokens are close to each other, so they are mixed (the finalizer of MurmurHash3)
+  // to spread them over the table.
+  static size_t Hash(const Token& token) {
+    uint64_t key = (static_cast<uint64_t>(static_cast<uint32_t>(token.keyword_id())) << 32) |
+                   static_cast<uint32_t>(token.class_id_id());
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ULL;
+    key ^= key >> 33;
+    return static_cast<size_t>(key);
+  }
+
+  void Rehash(size_t capacity) {
+    std::vector<Slot> old_slots(capacity);
+    old_slots.swap(slots_);
+
+    const size_t mask = capacity - 1;
+    for (const Slot& slot : old_slots) {
+      if (slot.value == kNotFound) {
+        continue;
+      }
+
+      size_t pos = Hash(Token(slot.class_id_id, slot.keyword_id)) & mask;
+      while (slots_[pos].value != kNotFound) {
+        pos = (pos + 1) & mask;
+      }
+      slots_[pos] = slot;
+    }
+  }
+
+  std::vector<Slot> slots_;  // the size is zero or a power of two
+  int size_;
+};
+
+}  // namespace core
+}  // namespace artm
@@ -5,6 +5,7 @@
 #endif
 
 #include <iostream>  // NOLINT
+#include <vector>
 
 #include "google/protobuf/util/json_util.h"
 
@@ -202,8 +203,29 @@ ThetaMatrix MasterModel::GetThetaMatrix(Matrix* matrix) {
 }
 
 ThetaMatrix MasterModel::GetThetaMatrix(const GetThetaMatrixArgs& args, Matrix* matrix) {
-  auto retval = ArtmRequest< ::artm::ThetaMatrix>(id_, args, ArtmRequestThetaMatrixExternal);
-  ArtmRequestMatrix(retval.item_id_size(), retval.num_topics(), matrix);
+  if (matrix == nullptr || args.matrix_layout() != MatrixLayout_Dense) {
+    auto retval = ArtmRequest< ::artm::ThetaMatrix>(id_, args, ArtmRequestThetaMatrixExternal);
+    ArtmRequestMatrix(retval.item_id_size(), retval.num_topics(), matrix);
+    return retval;
+  }
+
+  // The first call only reports the size of the matrix (without decoding theta cache),
+  // the second one copies dense values directly into the matrix and returns item ids, titles and topic names.
+  std::string args_blob;
+  SerializeMessageToString(args, &args_blob);
+  int64_t length = HandleErrorCode(ArtmCopyThetaMatrix(id_, args_blob.size(), StringAsArray(&args_blob), 0, nullptr));
+  auto size = ArtmCopyResult< ::artm::ThetaMatrix>(length);
+  const int no_columns = size.num_topics();
+  matrix->resize((no_columns == 0) ? 0 : static_cast<int>(size.num_values() / no_columns), no_columns);
+
+  length = HandleErrorCode(ArtmCopyThetaMatrix(id_, args_blob.size(), StringAsArray(&args_blob),
+                                               sizeof(float) * matrix->no_columns() * matrix->no_rows(),
+                                               reinterpret_cast<char*>(matrix->get_data())));
+  auto retval = ArtmCopyResult< ::artm::ThetaMatrix>(length);
+  if (retval.item_id_size() != matrix->no_rows() || retval.num_topics() != matrix->no_columns()) {
+    throw InvalidOperationException("Theta cache has changed while theta matrix was copied");
+  }
+
   return retval;
 }
 
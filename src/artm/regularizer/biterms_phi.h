@@ -48,6 +48,7 @@ class BitermsPhi : public RegularizerInterface {
 
  private:
   BitermsPhiConfig config_;
+  core::DictionaryPhiIndex dictionary_phi_index_;
 };
 
 }  // namespace regularizer
@@ -2,12 +2,14 @@
 
 // Author: Murat Apishev (great-mel@yandex.ru)
 
+#include <algorithm>
 #include <string>
 #include <vector>
 #include <utility>
 
 #include "artm/core/protobuf_helpers.h"
 #include "artm/core/phi_matrix.h"
+#include "artm/utility/blas.h"
 
 #include "artm/regularizer/decorrelator_phi.h"
 
@@ -18,92 +20,156 @@ bool DecorrelatorPhi::RegularizePhi(const ::artm::core::PhiMatrix& p_wt,
                                     const ::artm::core::PhiMatrix& n_wt,
                                     ::artm::core::PhiMatrix* r_wt,
                                     const float* tau) {
-  // read the parameters from config and control their correctness
-  const bool use_topic_pairs = (topic_pairs_.size() > 0);
-
-  std::unordered_map<std::string, int> topics_to_regularize;
-  if (!use_topic_pairs) {
-    for (const auto& s : (config_.topic_name().size() ? config_.topic_name() : p_wt.topic_name())) {
-      bool valid_topic = false;
-      for (int i = 0; i < p_wt.topic_name().size(); ++i) {
-        if (p_wt.topic_name(i) == s) {
-          topics_to_regularize.insert(std::make_pair(s, i));
-          valid_topic = true;
-          break;
-        }
-      }
-      if (!valid_topic) {
-        LOG(WARNING) << "Topic name " << s << " is not presented into model and will be ignored";
-      }
-    }
-  }
+  return RegularizePhiRange(p_wt, n_wt, r_wt, tau, 0, n_wt.token_size());
+}
 
-  std::unordered_map<std::string, int> all_topics;
-  for (int i = 0; i < p_wt.topic_name().size(); ++i) {
-    all_topics.insert(std::make_pair(p_wt.topic_name(i), i));
-  }
+bool DecorrelatorPhi::RegularizePhiRange(const ::artm::core::PhiMatrix& p_wt,
+                                         const ::artm::core::PhiMatrix& n_wt,
+                                         ::artm::core::PhiMatrix* r_wt,
+                                         const float* tau,
+                                         int token_begin,
+                                         int token_end) {
+  // read the parameters from config and control their correctness
+  std::shared_ptr<const TopicIndices> indices = GetTopicIndices(p_wt);
+  const int topic_size = p_wt.topic_size();
+  const int first_size = static_cast<int>(indices->first_topics.size());
+  const int second_size = static_cast<int>(indices->second_topics.size());
+  const float tau_value = (tau != nullptr ? *tau : 1.0f);
 
   bool use_all_classes = false;
   if (config_.class_id_size() == 0) {
     use_all_classes = true;
   }
 
+  ::artm::utility::Blas* blas = ::artm::utility::Blas::builtin();
+  std::vector<float> weights(topic_size, 0.0f);
+  std::vector<float> values(topic_size, 0.0f);
+  std::vector<float> second_weights(second_size, 0.0f);
+
   // proceed the regularization
-  for (int token_pwt_id = 0; token_pwt_id < p_wt.token_size(); ++token_pwt_id) {
-    const auto& token = p_wt.token(token_pwt_id);
-    if (!use_all_classes && !core::is_member(token.class_id, config_.class_id())) {
+  for (int token_nwt_id = token_begin; token_nwt_id < token_end; ++token_nwt_id) {
+    const auto& token = n_wt.token(token_nwt_id);
+    if (!use_all_classes && !core::is_member(token.class_id(), config_.class_id())) {
       continue;
     }
 
-    int token_nwt_id = n_wt.token_index(token);
-    if (token_nwt_id == -1) {
+    int token_pwt_id = p_wt.token_index(token);
+    if (token_pwt_id == -1) {
       continue;
     }
 
-    // count sum of weights
-    float weights_sum = 0.0f;
+    // the row of p_wt is fetched once, values of other topics in the row of r_wt stay zero
+    p_wt.get(token_pwt_id, &weights);
 
-    // simple case (without topic_pairs)
-    if (!use_topic_pairs) {
-      // create general normalizer
-      for (const auto& pair : topics_to_regularize) {
-        weights_sum += p_wt.get(token_pwt_id, pair.second);
+    if (!indices->use_topic_pairs) {  // simple case (without topic_pairs)
+      if (indices->use_all_topics) {
+        float weights_sum = 0.0f;
+        for (int topic_id = 0; topic_id < topic_size; ++topic_id) {
+          weights_sum += weights[topic_id];
+        }
+        for (int topic_id = 0; topic_id < topic_size; ++topic_id) {
+          values[topic_id] = -weights[topic_id] * (weights_sum - weights[topic_id]) * tau_value;
+        }
+      } else {
+        float weights_sum = 0.0f;
+        for (int topic_id : indices->topics) {
+          weights_sum += weights[topic_id];
+        }
+        for (int topic_id : indices->topics) {
+          values[topic_id] = -weights[topic_id] * (weights_sum - weights[topic_id]) * tau_value;
+        }
       }
+    } else {  // complex case
+      // custom normalizers of the first topics are the product of pair values and weights of the second topics
+      for (int i = 0; i < second_size; ++i) {
+        second_weights[i] = weights[indices->second_topics[i]];
+      }
+      for (int i = 0; i < first_size; ++i) {
+        const float weights_sum = (second_size == 0) ? 0.0f :
+          blas->sdot(second_size, &indices->pair_values[i * second_size], 1, &second_weights[0], 1);
+        const int topic_id = indices->first_topics[i];
+        values[topic_id] = -weights[topic_id] * (weights_sum - weights[topic_id]) * tau_value;
+      }
+    }
+
+    r_wt->increase(token_nwt_id, values);
+  }
+  return true;
+}
+
+std::shared_ptr<const DecorrelatorPhi::TopicIndices> DecorrelatorPhi::GetTopicIndices(
+    const ::artm::core::PhiMatrix& p_wt) {
+  const google::protobuf::RepeatedPtrField<std::string> topic_name = p_wt.topic_name();
+
+  std::lock_guard<std::mutex> guard(topic_indices_lock_);
+  if (topic_indices_ != nullptr && topic_indices_->topic_name.size() == topic_name.size() &&
+      std::equal(topic_name.begin(), topic_name.end(), topic_indices_->topic_name.begin())) {
+    return topic_indices_;
+  }
 
-      // process every topic from topic_names
-      for (const auto& pair : topics_to_regularize) {
-        float weight = p_wt.get(token_pwt_id, pair.second);
-        float value = static_cast<float>(-weight * (weights_sum - weight));
-        r_wt->increase(token_nwt_id, pair.second, value * (tau != nullptr ? *tau : 1.0f));
+  std::shared_ptr<TopicIndices> indices = std::make_shared<TopicIndices>();
+  indices->topic_name = topic_name;
+  indices->use_topic_pairs = (topic_pairs_.size() > 0);
+  indices->use_all_topics = false;
+
+  std::unordered_map<std::string, int> all_topics;
+  for (int i = 0; i < topic_name.size(); ++i) {
+    all_topics.insert(std::make_pair(topic_name.Get(i), i));
+  }
+
+  if (!indices->use_topic_pairs) {
+    std::vector<bool> is_regularized(topic_name.size(), false);
+    for (const auto& s : (config_.topic_name().size() ? config_.topic_name() : topic_name)) {
+      auto iter = all_topics.find(s);
+      if (iter == all_topics.end()) {
+        LOG(WARNING) << "Topic name " << s << " is not presented into model and will be ignored";
+        continue;
+      }
+      if (!is_regularized[iter->second]) {
+        is_regularized[iter->second] = true;
+        indices->topics.push_back(iter->second);
+      }
+    }
+    std::sort(indices->topics.begin(), indices->topics.end());
+    indices->use_all_topics = (static_cast<int>(indices->topics.size()) == topic_name.size());
+  } else {
+    // topics that don't exist in the model are skipped
+    std::vector<int> second_topic_column(topic_name.size(), -1);
+    std::vector<std::vector<std::pair<int, float>>> rows;
+    for (const auto& pair : topic_pairs_) {
+      auto first_iter = all_topics.find(pair.first);
+      if (first_iter == all_topics.end()) {
+        continue;
       }
-    } else {  // complex case
-      for (const auto& pair : topic_pairs_) {
-        weights_sum = 0.0f;
 
-        // check given topic exists in model
-        auto first_iter = all_topics.find(pair.first);
-        if (first_iter == all_topics.end()) {
+      indices->first_topics.push_back(first_iter->second);
+      rows.push_back(std::vector<std::pair<int, float>>());
+      for (const auto& topic_and_value : pair.second) {
+        auto second_iter = all_topics.find(topic_and_value.first);
+        if (second_iter == all_topics.end()) {
           continue;
         }
 
-        // create custom normilizer for this topic
-        for (const auto& topic_and_value : pair.second) {
-          auto second_iter = all_topics.find(topic_and_value.first);
-          if (second_iter == all_topics.end()) {
-            continue;
-          }
-
-          weights_sum += p_wt.get(token_pwt_id, second_iter->second) * topic_and_value.second;
+        int& column = second_topic_column[second_iter->second];
+        if (column == -1) {
+          column = static_cast<int>(indices->second_topics.size());
+          indices->second_topics.push_back(second_iter->second);
         }
+        rows.back().push_back(std::make_pair(column, topic_and_value.second));
+      }
+    }
 
-        // process this topic value
-        float weight = p_wt.get(token_pwt_id, first_iter->second);
-        float value = static_cast<float>(-weight * (weights_sum - weight));
-        r_wt->increase(token_nwt_id, first_iter->second, value * (tau != nullptr ? *tau : 1.0f));
+    const int second_size = static_cast<int>(indices->second_topics.size());
+    indices->pair_values.resize(rows.size() * second_size, 0.0f);
+    for (unsigned i = 0; i < rows.size(); ++i) {
+      for (const auto& column_and_value : rows[i]) {
+        indices->pair_values[i * second_size + column_and_value.first] += column_and_value.second;
       }
     }
   }
-  return true;
+
+  topic_indices_ = indices;
+  return topic_indices_;
 }
 
 google::protobuf::RepeatedPtrField<std::string> DecorrelatorPhi::topics_to_regularize() {
@@ -151,6 +217,9 @@ bool DecorrelatorPhi::Reconfigure(const RegularizerConfig& config) {
   config_.CopyFrom(regularizer_config);
   UpdateTopicPairs(regularizer_config);
 
+  std::lock_guard<std::mutex> guard(topic_indices_lock_);
+  topic_indices_.reset();
+
   return true;
 }
 
@@ -23,8 +23,11 @@ Note, that in case of topic_pairs usage the topic_names parameter will be ignore
 
 #pragma once
 
+#include <memory>
+#include <mutex>  // NOLINT
 #include <unordered_map>
 #include <string>
+#include <vector>
 
 #include "artm/regularizer_interface.h"
 
@@ -45,16 +48,41 @@ class DecorrelatorPhi : public RegularizerInterface {
                              ::artm::core::PhiMatrix* r_wt,
                              const float* tau);
 
+  virtual bool SupportsTokenRanges() const { return true; }
+  virtual bool RegularizePhiRange(const ::artm::core::PhiMatrix& p_wt,
+                                  const ::artm::core::PhiMatrix& n_wt,
+                                  ::artm::core::PhiMatrix* r_wt,
+                                  const float* tau,
+                                  int token_begin,
+                                  int token_end);
+
   virtual google::protobuf::RepeatedPtrField<std::string> topics_to_regularize();
   virtual google::protobuf::RepeatedPtrField<std::string> class_ids_to_regularize();
 
   virtual bool Reconfigure(const RegularizerConfig& config);
 
  private:
+  // Topics to regularize, prepared as indices of topics in p_wt
+  struct TopicIndices {
+    google::protobuf::RepeatedPtrField<std::string> topic_name;  // topics of p_wt the indices are valid for
+    bool use_topic_pairs;
+    bool use_all_topics;             // simple case: all topics of p_wt are regularized
+    std::vector<int> topics;         // simple case: topics to regularize
+    std::vector<int> first_topics;   // topic_pairs case: rows of pair_values
+    std::vector<int> second_topics;  // topic_pairs case: columns of pair_values
+    std::vector<float> pair_values;  // topic_pairs case: first_topics.size() x second_topics.size() matrix
+  };
+
   void UpdateTopicPairs(const DecorrelatorPhiConfig& config);
 
+  // RegularizePhiRange is called for many ranges of tokens, so the indices are cached
+  std::shared_ptr<const TopicIndices> GetTopicIndices(const ::artm::core::PhiMatrix& p_wt);
+
   DecorrelatorPhiConfig config_;
   TopicMap topic_pairs_;
+
+  std::mutex topic_indices_lock_;
+  std::shared_ptr<const TopicIndices> topic_indices_;
 };
 
 }  // namespace regularizer
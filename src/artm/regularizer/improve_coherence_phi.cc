@@ -17,8 +17,16 @@ bool ImproveCoherencePhi::RegularizePhi(const ::artm::core::PhiMatrix& p_wt,
                                         const ::artm::core::PhiMatrix& n_wt,
                                         ::artm::core::PhiMatrix* r_wt,
                                         const float* tau) {
+  return RegularizePhiRange(p_wt, n_wt, r_wt, tau, 0, n_wt.token_size());
+}
+
+bool ImproveCoherencePhi::RegularizePhiRange(const ::artm::core::PhiMatrix& p_wt,
+                                             const ::artm::core::PhiMatrix& n_wt,
+                                             ::artm::core::PhiMatrix* r_wt,
+                                             const float* tau,
+                                             int token_begin,
+                                             int token_end) {
   const int topic_size = n_wt.topic_size();
-  const int token_size = n_wt.token_size();
 
   std::vector<bool> topics_to_regularize;
   if (config_.topic_name().size() == 0) {
@@ -43,40 +51,41 @@ bool ImproveCoherencePhi::RegularizePhi(const ::artm::core::PhiMatrix& p_wt,
     return false;
   }
 
-  // create the conversion from index if token in Dictionary -> index of token in Phi
-  // -1 means that token from dictionary doesn't present in Phi matrix
-  std::vector<int> dict_to_phi_indices(dictionary_ptr->size(), -1);
-  for (int index = 0; index < dictionary_ptr->size(); ++index) {
-    const auto& entry = dictionary_ptr->entries()[index];
-    dict_to_phi_indices[index] = n_wt.token_index(entry.token());
-  }
+  // the conversion between indices of tokens in Dictionary and in Phi is cached between the calls
+  // -1 means that token from dictionary doesn't present in Phi matrix (or vice versa)
+  std::shared_ptr<const core::DictionaryPhiIndex::Mapping> mapping = dictionary_phi_index_.get(dictionary_ptr, n_wt);
+  const std::vector<int>& dict_to_phi_indices = mapping->dict_to_phi;
+  const std::vector<int>& phi_to_dict_indices = mapping->phi_to_dict;
+
+  std::vector<float> n_wt_values(topic_size, 0.0f);
 
   // proceed the regularization
-  for (int token_id = 0; token_id < token_size; ++token_id) {
+  for (int token_id = token_begin; token_id < token_end; ++token_id) {
     const auto& token = n_wt.token(token_id);
-    if (!use_all_classes && !core::is_member(token.class_id, config_.class_id())) {
+    if (!use_all_classes && !core::is_member(token.class_id(), config_.class_id())) {
       continue;
     }
 
-    auto cooc_tokens_info = dictionary_ptr->token_cooc_values(token);
-    if (cooc_tokens_info == nullptr) {
+    auto cooc_tokens_info = dictionary_ptr->cooc_values().row(phi_to_dict_indices[token_id]);
+    if (cooc_tokens_info.empty()) {
       continue;
     }
 
     std::vector<float> values(topic_size, 0.0);
-    for (const auto& elem : *cooc_tokens_info) {
-      float mult_coef = elem.second;
-      int cooc_token_index = dict_to_phi_indices[elem.first];
+    for (int i = 0; i < cooc_tokens_info.size(); ++i) {
+      float mult_coef = cooc_tokens_info.value(i);
+      int cooc_token_index = dict_to_phi_indices[cooc_tokens_info.col(i)];
       if (cooc_token_index == -1) {
         continue;
       }
 
+      n_wt.get(cooc_token_index, &n_wt_values);
       for (int topic_id = 0; topic_id < topic_size; ++topic_id) {
         if (!topics_to_regularize[topic_id]) {
           continue;
         }
 
-        values[topic_id] += n_wt.get(cooc_token_index, topic_id) * mult_coef;
+        values[topic_id] += n_wt_values[topic_id] * mult_coef;
       }
     }
 
@@ -37,6 +37,14 @@ class ImproveCoherencePhi : public RegularizerInterface {
                              ::artm::core::PhiMatrix* r_wt,
                              const float* tau);
 
+  virtual bool SupportsTokenRanges() const { return true; }
+  virtual bool RegularizePhiRange(const ::artm::core::PhiMatrix& p_wt,
+                                  const ::artm::core::PhiMatrix& n_wt,
+                                  ::artm::core::PhiMatrix* r_wt,
+                                  const float* tau,
+                                  int token_begin,
+                                  int token_end);
+
   virtual google::protobuf::RepeatedPtrField<std::string> topics_to_regularize();
   virtual google::protobuf::RepeatedPtrField<std::string> class_ids_to_regularize();
 
@@ -44,6 +52,7 @@ class ImproveCoherencePhi : public RegularizerInterface {
 
  private:
   ImproveCoherencePhiConfig config_;
+  core::DictionaryPhiIndex dictionary_phi_index_;
 };
 
 }  // namespace regularizer
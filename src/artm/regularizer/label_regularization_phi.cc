@@ -18,9 +18,17 @@ bool LabelRegularizationPhi::RegularizePhi(const ::artm::core::PhiMatrix& p_wt,
                                            const ::artm::core::PhiMatrix& n_wt,
                                            ::artm::core::PhiMatrix* r_wt,
                                            const float* tau) {
+  return RegularizePhiRange(p_wt, n_wt, r_wt, tau, 0, n_wt.token_size());
+}
+
+bool LabelRegularizationPhi::RegularizePhiRange(const ::artm::core::PhiMatrix& p_wt,
+                                                const ::artm::core::PhiMatrix& n_wt,
+                                                ::artm::core::PhiMatrix* r_wt,
+                                                const float* tau,
+                                                int token_begin,
+                                                int token_end) {
   // read the parameters from config and control their correctness
   const int topic_size = n_wt.topic_size();
-  const int token_size = n_wt.token_size();
 
   std::vector<bool> topics_to_regularize;
   if (config_.topic_name().size() == 0) {
@@ -39,10 +47,14 @@ bool LabelRegularizationPhi::RegularizePhi(const ::artm::core::PhiMatrix& p_wt,
     dictionary_ptr = dictionary(config_.dictionary_name());
   }
 
+  const float tau_value = (tau != nullptr ? *tau : 1.0f);
+  std::vector<float> n_wt_values(topic_size, 0.0f);
+  std::vector<float> values(topic_size, 0.0f);
+
   // proceed the regularization
-  for (int token_id = 0; token_id < token_size; ++token_id) {
+  for (int token_id = token_begin; token_id < token_end; ++token_id) {
     const auto& token = p_wt.token(token_id);
-    if (!use_all_classes && !core::is_member(token.class_id, config_.class_id())) {
+    if (!use_all_classes && !core::is_member(token.class_id(), config_.class_id())) {
       continue;
     }
 
@@ -54,21 +66,22 @@ bool LabelRegularizationPhi::RegularizePhi(const ::artm::core::PhiMatrix& p_wt,
     }
 
     // count sum of weights
+    n_wt.get(token_id, &n_wt_values);
     float weights_sum = 0.0f;
     for (int topic_id = 0; topic_id < topic_size; ++topic_id) {
       if (topics_to_regularize[topic_id]) {
         // token_class_id is anyway presented in n_t
-        weights_sum += n_wt.get(token_id, topic_id);
+        weights_sum += n_wt_values[topic_id];
       }
     }
     // form the value
     for (int topic_id = 0; topic_id < topic_size; ++topic_id) {
       if (topics_to_regularize[topic_id]) {
-        float weight = n_wt.get(token_id, topic_id);
-        float value = static_cast<float>(coefficient * weight / weights_sum);
-        r_wt->increase(token_id, topic_id, value * (tau != nullptr ? *tau : 1.0f));
+        float value = static_cast<float>(coefficient * n_wt_values[topic_id] / weights_sum);
+        values[topic_id] = value * tau_value;
       }
     }
+    r_wt->increase(token_id, values);
   }
 
   return true;
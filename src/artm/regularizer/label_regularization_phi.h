@@ -39,6 +39,14 @@ class LabelRegularizationPhi : public RegularizerInterface {
                              ::artm::core::PhiMatrix* r_wt,
                              const float* tau);
 
+  virtual bool SupportsTokenRanges() const { return true; }
+  virtual bool RegularizePhiRange(const ::artm::core::PhiMatrix& p_wt,
+                                  const ::artm::core::PhiMatrix& n_wt,
+                                  ::artm::core::PhiMatrix* r_wt,
+                                  const float* tau,
+                                  int token_begin,
+                                  int token_end);
+
   virtual google::protobuf::RepeatedPtrField<std::string> topics_to_regularize();
   virtual google::protobuf::RepeatedPtrField<std::string> class_ids_to_regularize();
 
@@ -59,7 +59,7 @@ bool NetPlsaPhi::RegularizePhi(const ::artm::core::PhiMatrix& p_wt,
       continue;
     }
 
-    const int token_id = p_wt.token_index(::artm::core::Token(class_id, vertex_name_[vertex_id]));
+    const int token_id = p_wt.token_index(::artm::core::Token::Find(class_id, vertex_name_[vertex_id]));
     if (token_id < 0) {
       continue;
     }
@@ -80,7 +80,7 @@ bool NetPlsaPhi::RegularizePhi(const ::artm::core::PhiMatrix& p_wt,
           continue;
         }
 
-        const int index = p_wt.token_index(::artm::core::Token(class_id, vertex_name_[pair_id.first]));
+        const int index = p_wt.token_index(::artm::core::Token::Find(class_id, vertex_name_[pair_id.first]));
         if (index < 0) {
           continue;
         }
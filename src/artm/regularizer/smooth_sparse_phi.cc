@@ -2,6 +2,7 @@
 
 // Author: Murat Apishev (great-mel@yandex.ru)
 
+#include <algorithm>
 #include <string>
 #include <vector>
 
@@ -26,6 +27,15 @@ bool SmoothSparsePhi::RegularizePhi(const ::artm::core::PhiMatrix& p_wt,
                                     const ::artm::core::PhiMatrix& n_wt,
                                     ::artm::core::PhiMatrix* r_wt,
                                     const float* tau) {
+  return RegularizePhiRange(p_wt, n_wt, r_wt, tau, 0, n_wt.token_size());
+}
+
+bool SmoothSparsePhi::RegularizePhiRange(const ::artm::core::PhiMatrix& p_wt,
+                                         const ::artm::core::PhiMatrix& n_wt,
+                                         ::artm::core::PhiMatrix* r_wt,
+                                         const float* tau,
+                                         int token_begin,
+                                         int token_end) {
   // read the parameters from config and control their correctness
   const int topic_size = p_wt.topic_size();
 
@@ -42,41 +52,73 @@ bool SmoothSparsePhi::RegularizePhi(const ::artm::core::PhiMatrix& p_wt,
   }
 
   std::shared_ptr<core::Dictionary> dictionary_ptr = nullptr;
+  std::shared_ptr<const core::DictionaryPhiIndex::Mapping> dictionary_mapping = nullptr;
   if (config_.has_dictionary_name()) {
     dictionary_ptr = dictionary(config_.dictionary_name());
+    if (dictionary_ptr != nullptr) {
+      dictionary_mapping = dictionary_phi_index_.get(dictionary_ptr, n_wt);
+    }
   }
 
+  // zero elements of p_wt can be skipped if they produce zero values (e.g. for log transform)
+  const bool skip_zeros = p_wt.is_packable() && (transform_function_->apply(0.0f) == 0.0f);
+  const bool same_tokens = (p_wt.tokens_version() == n_wt.tokens_version());
+  const float tau_value = (tau != nullptr ? *tau : 1.0f);
+
+  std::vector<float> p_wt_values(topic_size, 0.0f);
+  std::vector<int> p_wt_indices(topic_size, 0);
+  std::vector<float> values(topic_size, 0.0f);
+
   // proceed the regularization
-  for (int token_pwt_id = 0; token_pwt_id < p_wt.token_size(); ++token_pwt_id) {
+  for (int token_nwt_id = token_begin; token_nwt_id < token_end; ++token_nwt_id) {
     float coefficient = 1.0f;
-    const auto& token = p_wt.token(token_pwt_id);
+    const auto& token = n_wt.token(token_nwt_id);
 
-    if (!use_all_classes && !core::is_member(token.class_id, config_.class_id())) {
+    if (!use_all_classes && !core::is_member(token.class_id(), config_.class_id())) {
       continue;
     }
 
     if (dictionary_ptr != nullptr) {
-      auto entry_ptr = dictionary_ptr->entry(token);
+      const int dictionary_index = dictionary_mapping->phi_to_dict[token_nwt_id];
 
       // don't process tokens without value in the dictionary
-      if (entry_ptr == nullptr) {
+      if (dictionary_index == -1) {
         continue;
       }
 
-      coefficient = entry_ptr->token_value();
+      coefficient = dictionary_ptr->entry(dictionary_index)->token_value();
     }
 
-    int token_nwt_id = n_wt.token_index(token);
-    if (token_nwt_id == -1) {
+    int token_pwt_id = same_tokens ? token_nwt_id : p_wt.token_index(token);
+    if (token_pwt_id == -1) {
       continue;
     }
 
-    for (int topic_id = 0; topic_id < topic_size; ++topic_id) {
-      if (topics_to_regularize[topic_id]) {
-        float value = transform_function_->apply(p_wt.get(token_pwt_id, topic_id));
-        r_wt->increase(token_nwt_id, topic_id, coefficient * value * (tau != nullptr ? *tau : 1.0f));
+    const int non_zero_topic_size = skip_zeros ? p_wt.get_non_zero_topic_size(token_pwt_id) : topic_size;
+    if (non_zero_topic_size == 0) {
+      continue;
+    }
+
+    const float multiplier = coefficient * tau_value;
+    if (non_zero_topic_size < topic_size) {
+      // the row is packed, so only its non-zero elements are processed
+      p_wt.get_sparse(token_pwt_id, &p_wt_values, &p_wt_indices);
+      std::fill(values.begin(), values.end(), 0.0f);
+      for (int i = 0; i < non_zero_topic_size; ++i) {
+        const int topic_id = p_wt_indices[i];
+        if (topics_to_regularize[topic_id]) {
+          values[topic_id] = multiplier * transform_function_->apply(p_wt_values[i]);
+        }
+      }
+    } else {
+      p_wt.get(token_pwt_id, &p_wt_values);
+      for (int topic_id = 0; topic_id < topic_size; ++topic_id) {
+        values[topic_id] = topics_to_regularize[topic_id] ?
+          multiplier * transform_function_->apply(p_wt_values[topic_id]) : 0.0f;
       }
     }
+
+    r_wt->increase(token_nwt_id, values);
   }
 
   return true;
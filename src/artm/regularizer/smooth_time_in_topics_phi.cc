@@ -41,7 +41,7 @@ bool SmoothTimeInTopicsPhi::RegularizePhi(const ::artm::core::PhiMatrix& p_wt,
   for (int token_id = 0; token_id < token_size; ++token_id) {
     const auto& token = p_wt.token(token_id);
 
-    if (token.class_id != class_id) {
+    if (token.class_id() != class_id) {
       continue;
     }
 
@@ -49,7 +49,7 @@ bool SpecifiedSparsePhi::RegularizePhi(const ::artm::core::PhiMatrix& p_wt,
       }
     } else {
       const auto& token = n_wt.token(global_index);
-      if (token.class_id != class_id) {
+      if (token.class_id() != class_id) {
         continue;
       }
     }
@@ -64,7 +64,7 @@ bool SpecifiedSparsePhi::RegularizePhi(const ::artm::core::PhiMatrix& p_wt,
     for (int local_index = 0; local_index < local_end; ++local_index) {
       if (mode_topics) {
         const auto& token = n_wt.token(local_index);
-        if (token.class_id != class_id) {
+        if (token.class_id() != class_id) {
           continue;
         }
       } else {
@@ -85,6 +85,19 @@ class RegularizerInterface {
                              ::artm::core::PhiMatrix* r_wt,
                              const float* tau = nullptr) { return false; }
 
+  // Phi regularizers which calculate each row of r_wt independently of other rows
+  // may support token-parallel execution. Such regularizers return true from SupportsTokenRanges()
+  // and implement RegularizePhiRange, which must update only rows [token_begin, token_end) of r_wt
+  // (i.e. indices of tokens in n_wt). RegularizePhiRange may be called concurrently for disjoint ranges,
+  // so it must be thread-safe.
+  virtual bool SupportsTokenRanges() const { return false; }
+  virtual bool RegularizePhiRange(const ::artm::core::PhiMatrix& p_wt,
+                                  const ::artm::core::PhiMatrix& n_wt,
+                                  ::artm::core::PhiMatrix* r_wt,
+                                  const float* tau,
+                                  int token_begin,
+                                  int token_end) { return false; }
+
   virtual google::protobuf::RepeatedPtrField<std::string> topics_to_regularize() {
     return google::protobuf::RepeatedPtrField<std::string>();
   }
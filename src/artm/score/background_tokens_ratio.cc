@@ -54,7 +54,7 @@ std::shared_ptr<Score> BackgroundTokensRatio::CalculateScore(const artm::core::P
   std::vector<artm::core::Token> bcg_tokens;
   for (int token_index = 0; token_index < token_size; ++token_index) {
     const auto& token = p_wt.token(token_index);
-    if (token.class_id == class_id) {
+    if (token.class_id() == class_id) {
       float p_w = 0.0f;
       for (int topic_index = 0; topic_index < topic_size; ++topic_index) {
         p_w += p_wt.get(token_index, topic_index) * n_t[topic_index];
@@ -85,7 +85,7 @@ std::shared_ptr<Score> BackgroundTokensRatio::CalculateScore(const artm::core::P
 
   btp_score->set_value(token_size > 0 ? (static_cast<float>(num_bgr_tokens) / token_size) : 0.0f);
   for (const auto& token : bcg_tokens) {
-    btp_score->add_token(token.keyword);
+    btp_score->add_token(token.keyword());
   }
 
   return retval;
@@ -30,7 +30,7 @@ void ClassPrecision::AppendScore(
   std::string keyword;
   for (int token_index = 0; token_index < p_wt.token_size(); token_index++) {
     const auto& token = p_wt.token(token_index);
-    if (token.class_id != args.predict_class_id()) {
+    if (token.class_id() != args.predict_class_id()) {
       continue;
     }
 
@@ -40,7 +40,7 @@ void ClassPrecision::AppendScore(
     }
 
     if (weight >= max_token_weight) {
-      keyword = token.keyword;
+      keyword = token.keyword();
       max_token_weight = weight;
     }
   }
@@ -52,7 +52,11 @@ void ClassPrecision::AppendScore(
 
     for (int token_id = start_index; token_id < end_index; ++token_id) {
       const auto& token = token_dict[item.token_id(token_id)];
-      if (token.class_id == args.predict_class_id() && token.keyword == keyword) {
+      if (!token.known()) {  // unknown tokens can't match a class of the model
+        continue;
+      }
+
+      if (token.class_id() == args.predict_class_id() && token.keyword() == keyword) {
         error = false;
         break;
       }
@@ -181,8 +181,7 @@ void Perplexity::AppendScore(
 
     std::vector<float> phi_values(topic_size, 1.0f);
     for (int token_id = start_index; token_id < end_index; ++token_id) {
-      const auto& temp_token = token_dict[item.token_id(token_id)];
-      const auto token = artm::core::Token(temp_token.class_id, temp_token.keyword);
+      const auto& token = token_dict[item.token_id(token_id)];
 
       int p_wt_token_index = p_wt.token_index(token);
       if (p_wt_token_index == ::artm::core::PhiMatrix::kUndefIndex) {
@@ -206,16 +205,15 @@ void Perplexity::AppendScore(
       } else {
         sum = 1.0;
         bool failed = true;
-        const artm::core::Token* err_token;
+        int err_token_id = -1;  // index in the batch, as unknown tokens have no strings in the vocabulary
         for (int token_id = start_index; token_id < end_index; ++token_id) {
-          const auto& temp_token = token_dict[item.token_id(token_id)];
-          const auto token = artm::core::Token(temp_token.class_id, temp_token.keyword);
+          const auto& token = token_dict[item.token_id(token_id)];
 
-          auto entry_ptr = dictionary_ptr->entry(token);
+          auto entry_ptr = token.known() ? dictionary_ptr->entry(token) : nullptr;
           if (entry_ptr != nullptr && entry_ptr->token_value()) {
             sum *= entry_ptr->token_value();
           } else {
-            err_token = &token;
+            err_token_id = item.token_id(token_id);
             break;
           }
           if (token_id == end_index - 1) {
@@ -225,7 +223,8 @@ void Perplexity::AppendScore(
 
         if (failed) {
           LOG_FIRST_N(WARNING, 100)
-            << "Error in perplexity dictionary for token " << err_token->keyword << ", class " << err_token->class_id
+            << "Error in perplexity dictionary for token " << batch.token(err_token_id)
+            << ", class " << batch.class_id(err_token_id)
             << " (and potentially for other tokens)"
             << ". Verify that the token exists in the dictionary and it's value > 0. "
             << "Document unigram model will be used for this token "
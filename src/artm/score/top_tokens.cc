@@ -50,7 +50,7 @@ std::shared_ptr<Score> TopTokens::CalculateScore(const artm::core::PhiMatrix& p_
   std::vector<artm::core::Token> tokens;
   for (int token_index = 0; token_index < token_size; token_index++) {
     auto token = p_wt.token(token_index);
-    if (token.class_id == class_id) {
+    if (token.class_id() == class_id) {
       tokens.push_back(token);
     }
   }
@@ -67,7 +67,7 @@ std::shared_ptr<Score> TopTokens::CalculateScore(const artm::core::PhiMatrix& p_
 
     for (int token_index = 0; token_index < token_size; token_index++) {
       const auto& token = p_wt.token(token_index);
-      if (token.class_id != class_id) {
+      if (token.class_id() != class_id) {
         continue;
       }
 
@@ -91,7 +91,7 @@ std::shared_ptr<Score> TopTokens::CalculateScore(const artm::core::PhiMatrix& p_
         continue;
       }
 
-      top_tokens_score->add_token(token.keyword);
+      top_tokens_score->add_token(token.keyword());
       top_tokens_score->add_weight(weight);
       top_tokens_score->add_topic_index(topic_ids[i]);
       top_tokens_score->add_topic_name(topic_name.Get(topic_ids[i]));
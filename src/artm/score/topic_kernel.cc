@@ -89,7 +89,7 @@ std::shared_ptr<Score> TopicKernel::CalculateScore(const artm::core::PhiMatrix&
 
   for (int token_index = 0; token_index < token_size; ++token_index) {
     const auto& token = p_wt.token(token_index);
-    if (token.class_id == class_id) {
+    if (token.class_id() == class_id) {
       float p_w = 0.0;
       for (int topic_index = 0; topic_index < topic_size; ++topic_index) {
         if (topics_to_score[topic_index]) {
@@ -152,7 +152,7 @@ std::shared_ptr<Score> TopicKernel::CalculateScore(const artm::core::PhiMatrix&
 
       StringArray* tokens = kernel_tokens->Add();
       for (unsigned token_id = 0; token_id < topic_kernel_tokens[topic_index].size(); ++token_id) {
-        tokens->add_value(topic_kernel_tokens[topic_index][token_id].keyword);
+        tokens->add_value(topic_kernel_tokens[topic_index][token_id].keyword());
       }
     }
   }
@@ -36,7 +36,7 @@ std::shared_ptr<Score> TopicMassPhi::CalculateScore(const artm::core::PhiMatrix&
 
   for (int token_index = 0; token_index < token_size; token_index++) {
     const auto& token = p_wt.token(token_index);
-    if ((!use_all_classes && !core::is_member(token.class_id, config_.class_id()))) {
+    if ((!use_all_classes && !core::is_member(token.class_id(), config_.class_id()))) {
       continue;
     }
 
@@ -33,6 +33,9 @@ class ifstream_or_cin {
 
   std::istream& get_stream() { return file_.is_open() ? file_ : std::cin; }
 
+  // Returns the content of the memory-mapped file, or nullptr when reading from std::cin.
+  const char* data() { return file_.is_open() ? file_->data() : nullptr; }
+
   size_t size() {
     if (!file_.is_open()) {
       return 0;
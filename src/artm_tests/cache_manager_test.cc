@@ -1,5 +1,6 @@
 // Copyright 2017, Additive Regularization of Topic Models.
 
+#include <algorithm>
 #include <memory>
 
 #include "gtest/gtest.h"
@@ -13,7 +14,7 @@
 #include "artm_tests/test_mother.h"
 #include "artm_tests/api.h"
 
-void RunTest(bool disk_cache, std::string ptd_name) {
+void RunTest(bool disk_cache, std::string ptd_name, bool use_fp16 = false, bool sparse_cache = false) {
   const int nTokens = 10;
   const int batches_size = 3;
   const int nTopics = 8;
@@ -32,6 +33,10 @@ void RunTest(bool disk_cache, std::string ptd_name) {
   if (disk_cache) {
     master_config.set_disk_cache_path(target_path);
   }
+  master_config.set_disk_cache_fp16(use_fp16);
+  if (sparse_cache) {
+    master_config.set_cache_theta_eps(0.01f);
+  }
   ::artm::MasterModel master_component(master_config);
   ::artm::test::Api api(master_component);
   EXPECT_TRUE(master_component.info().config().cache_theta());
@@ -49,19 +54,73 @@ void RunTest(bool disk_cache, std::string ptd_name) {
   ::artm::ThetaMatrix theta1 = master_component.GetThetaMatrix();
   EXPECT_EQ(theta1.num_topics(), nTopics);
   EXPECT_GE(theta1.item_id_size(), 1);
+
+  // fp16 values are compared with a looser tolerance.
+  const float tolerance = use_fp16 ? 1e-3f : 1e-6f;
+
+  // Paged retrieval must return the same items as the full retrieval
+  const int page_size = 2;
+  for (int item_offset = 0; item_offset < theta1.item_id_size(); item_offset += page_size) {
+    ::artm::GetThetaMatrixArgs get_theta_args;
+    get_theta_args.set_item_offset(item_offset);
+    get_theta_args.set_item_limit(page_size);
+    ::artm::ThetaMatrix page = master_component.GetThetaMatrix(get_theta_args);
+    ASSERT_EQ(page.item_id_size(), std::min(page_size, theta1.item_id_size() - item_offset));
+    for (int i = 0; i < page.item_id_size(); ++i) {
+      EXPECT_EQ(page.item_title(i), theta1.item_title(item_offset + i));
+      for (int topic_index = 0; topic_index < nTopics; ++topic_index) {
+        EXPECT_NEAR(page.item_weights(i).value(topic_index),
+                    theta1.item_weights(item_offset + i).value(topic_index), tolerance);
+      }
+    }
+  }
+  // Dense copy into external buffer (with a subset of topics) must match the message
+  {
+    ::artm::GetThetaMatrixArgs get_theta_args;
+    get_theta_args.add_topic_name(theta1.topic_name(nTopics - 1));
+    get_theta_args.add_topic_name(theta1.topic_name(0));
+    get_theta_args.set_item_offset(1);
+    ::artm::Matrix matrix;
+    ::artm::ThetaMatrix info = master_component.GetThetaMatrix(get_theta_args, &matrix);
+    ASSERT_EQ(info.item_id_size(), theta1.item_id_size() - 1);
+    ASSERT_EQ(matrix.no_rows(), info.item_id_size());
+    ASSERT_EQ(matrix.no_columns(), 2);
+    ASSERT_EQ(info.num_topics(), 2);
+    ASSERT_EQ(info.topic_name(0), theta1.topic_name(nTopics - 1));
+    ASSERT_EQ(info.topic_name(1), theta1.topic_name(0));
+    ASSERT_EQ(info.item_title_size(), theta1.item_title_size() - 1);
+    for (int i = 0; i < info.item_id_size(); ++i) {
+      EXPECT_EQ(info.item_id(i), theta1.item_id(i + 1));
+      if (info.item_title_size() > 0) {
+        EXPECT_EQ(info.item_title(i), theta1.item_title(i + 1));
+      }
+      EXPECT_NEAR(matrix(i, 0), theta1.item_weights(i + 1).value(nTopics - 1), tolerance);
+      EXPECT_NEAR(matrix(i, 1), theta1.item_weights(i + 1).value(0), tolerance);
+    }
+  }
+
   auto config = master_component.config();
   config.set_num_document_passes(0);
   master_component.Reconfigure(config);
   master_component.FitOfflineModel(fit_offline_args);
 
   ::artm::ThetaMatrix theta2 = master_component.GetThetaMatrix();
-  bool ok;
-  ::artm::test::Helpers::CompareThetaMatrices(theta1, theta2, &ok);
-  EXPECT_TRUE(ok);
-
-  if (!ok) {
-    ::artm::test::Helpers::DescribeThetaMatrix(theta1);
-    ::artm::test::Helpers::DescribeThetaMatrix(theta2);
+  if (use_fp16) {
+    ASSERT_EQ(theta1.item_id_size(), theta2.item_id_size());
+    for (int i = 0; i < theta1.item_id_size(); ++i) {
+      for (int topic_index = 0; topic_index < nTopics; ++topic_index) {
+        EXPECT_NEAR(theta1.item_weights(i).value(topic_index), theta2.item_weights(i).value(topic_index), tolerance);
+      }
+    }
+  } else {
+    bool ok;
+    ::artm::test::Helpers::CompareThetaMatrices(theta1, theta2, &ok);
+    EXPECT_TRUE(ok);
+
+    if (!ok) {
+      ::artm::test::Helpers::DescribeThetaMatrix(theta1);
+      ::artm::test::Helpers::DescribeThetaMatrix(theta2);
+    }
   }
 
   try { boost::filesystem::remove_all(target_path); }
@@ -80,6 +139,20 @@ TEST(CacheManager, DiskCache) {
   RunTest(true, /*ptd_name=*/ "");
 }
 
+// To run this particular test:
+// artm_tests.exe --gtest_filter=CacheManager.DiskCacheFp16
+TEST(CacheManager, DiskCacheFp16) {
+  RunTest(true, /*ptd_name=*/ "", /*use_fp16=*/ true);
+}
+
+// To run this particular test:
+// artm_tests.exe --gtest_filter=CacheManager.SparseCache
+TEST(CacheManager, SparseCache) {
+  RunTest(false, /*ptd_name=*/ "", /*use_fp16=*/ false, /*sparse_cache=*/ true);
+  RunTest(false, /*ptd_name=*/ "", /*use_fp16=*/ true, /*sparse_cache=*/ true);
+  RunTest(true, /*ptd_name=*/ "", /*use_fp16=*/ true, /*sparse_cache=*/ true);
+}
+
 // To run this particular test:
 // artm_tests.exe --gtest_filter=CacheManager.PtdName
 TEST(CacheManager, PtdName) {
@@ -1,5 +1,16 @@
 // Copyright 2017, Additive Regularization of Topic Models.
 
+#include <algorithm>
+#include <cmath>
+#include <fstream>  // NOLINT
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
 #include "boost/filesystem.hpp"
 
 #include "gtest/gtest.h"
@@ -143,6 +154,85 @@ TEST(CollectionParser, MatrixMarket) {
   catch (...) { }
 }
 
+// To run this particular test:
+// artm_tests.exe --gtest_filter=CollectionParser.MalformedLineMultipleThreads
+TEST(CollectionParser, MalformedLineMultipleThreads) {
+  std::string target_folder = artm::test::Helpers::getUniqueString();
+  fs::create_directory(target_folder);
+  std::string vocab_file = (fs::path(target_folder) / "vocab.txt").string();
+  std::string docword_file = (fs::path(target_folder) / "docword.txt").string();
+  {
+    std::ofstream fout(vocab_file);
+    fout << "a\nb\nc\nd\n";
+  }
+  {
+    std::ofstream fout(docword_file);
+    fout << "3\n4\n9\n";
+    for (int line = 0; line < 40; ++line) {
+      fout << (line / 10 + 1) << " " << (line % 4 + 1) << " " << ((line == 30) ? "x" : "1") << "\n";
+    }
+  }
+
+  ::artm::CollectionParserConfig config;
+  config.set_format(::artm::CollectionParserConfig_CollectionFormat_BagOfWordsUci);
+  config.set_target_folder(target_folder);
+  config.set_vocab_file_path(vocab_file);
+  config.set_docword_file_path(docword_file);
+  config.set_num_threads(4);
+
+  // Line numbers are reported as if the file was read sequentially
+  try {
+    ::artm::ParseCollection(config);
+    FAIL() << "Malformed line was not reported";
+  } catch (const artm::InvalidOperationException& e) {
+    ASSERT_NE(std::string(e.what()).find("Error at line 34,"), std::string::npos) << e.what();
+  }
+
+  try { fs::remove_all(target_folder); }
+  catch (...) { }
+}
+
+// To run this particular test:
+// artm_tests.exe --gtest_filter=CollectionParser.MatrixMarketMultipleThreads
+TEST(CollectionParser, MatrixMarketMultipleThreads) {
+  std::string target_folder1 = artm::test::Helpers::getUniqueString();
+  std::string target_folder4 = artm::test::Helpers::getUniqueString();
+
+  ::artm::CollectionParserConfig config;
+  config.set_format(::artm::CollectionParserConfig_CollectionFormat_MatrixMarket);
+  config.set_num_items_per_batch(2);
+  config.set_name_type(::artm::CollectionParserConfig_BatchNameType_Code);
+  config.set_vocab_file_path((::artm::test::Helpers::getTestDataDir() / "deerwestere.txt").string());
+  config.set_docword_file_path((::artm::test::Helpers::getTestDataDir() / "deerwestere.mm").string());
+
+  // Batches must not depend on the number of threads
+  std::vector<::artm::CollectionParserInfo> infos;
+  for (int num_threads : { 1, 4 }) {
+    config.set_num_threads(num_threads);
+    config.set_target_folder(num_threads == 1 ? target_folder1 : target_folder4);
+    infos.push_back(::artm::ParseCollection(config));
+  }
+
+  ASSERT_EQ(infos[0].num_batches(), 5);
+  ASSERT_EQ(infos[0].num_batches(), infos[1].num_batches());
+  ASSERT_EQ(infos[0].num_items(), infos[1].num_items());
+  ASSERT_EQ(infos[0].num_tokens(), infos[1].num_tokens());
+
+  const char* batch_names[] = { "aaaaaa", "aaaaab", "aaaaac", "aaaaad", "aaaaae" };
+  for (const char* batch_name : batch_names) {
+    ::artm::Batch batch1, batch4;
+    ::artm::core::Helpers::LoadMessage(std::string(batch_name) + ".batch",
+                                       target_folder1, &batch1);
+    ::artm::core::Helpers::LoadMessage(std::string(batch_name) + ".batch",
+                                       target_folder4, &batch4);
+    batch4.set_id(batch1.id());
+    ASSERT_EQ(batch1.SerializeAsString(), batch4.SerializeAsString());
+  }
+
+  try { fs::remove_all(target_folder1); fs::remove_all(target_folder4); }
+  catch (...) { }
+}
+
 TEST(CollectionParser, Multiclass) {
   std::string target_folder = artm::test::Helpers::getUniqueString();
 
@@ -258,6 +348,131 @@ TEST(CollectionParser, VowpalWabbit) {
   catch (...) {}
 }
 
+// To run this particular test:
+// artm_tests.exe --gtest_filter=CollectionParser.VowpalWabbitMultipleThreads
+TEST(CollectionParser, VowpalWabbitMultipleThreads) {
+  std::string target_folder = artm::test::Helpers::getUniqueString();
+  fs::create_directory(target_folder);
+
+  // The last line intentionally has no trailing newline
+  const int num_lines = 10;
+  std::string docword_file = (fs::path(target_folder) / "vw.txt").string();
+  {
+    std::ofstream fout(docword_file);
+    for (int line_no = 0; line_no < num_lines; ++line_no) {
+      fout << "doc" << line_no << " token" << line_no << ":" << (line_no + 1) << " common";
+      if (line_no + 1 < num_lines) {
+        fout << "\n";
+      }
+    }
+  }
+
+  ::artm::CollectionParserConfig config;
+  config.set_format(::artm::CollectionParserConfig_CollectionFormat_VowpalWabbit);
+  config.set_target_folder((fs::path(target_folder) / "batches").string());
+  config.set_docword_file_path(docword_file);
+  config.set_num_items_per_batch(3);
+  config.set_num_threads(4);
+  config.set_name_type(::artm::CollectionParserConfig_BatchNameType_Code);
+
+  ::artm::CollectionParserInfo info = ::artm::ParseCollection(config);
+  ASSERT_EQ(info.num_items(), num_lines);
+  ASSERT_EQ(info.num_batches(), 4);
+  ASSERT_EQ(info.dictionary_size(), num_lines + 1);
+
+  // Batches are named in the order of the docword file, and hold consecutive lines
+  const char* batch_names[] = { "aaaaaa", "aaaaab", "aaaaac", "aaaaad" };
+  for (int batch_index = 0; batch_index < 4; ++batch_index) {
+    ::artm::Batch batch;
+    ::artm::core::Helpers::LoadMessage(std::string(batch_names[batch_index]) + ".batch",
+                                       config.target_folder(), &batch);
+    ASSERT_EQ(batch.item_size(), (batch_index < 3) ? 3 : 1);
+    for (int item_index = 0; item_index < batch.item_size(); ++item_index) {
+      const int line_no = batch_index * 3 + item_index;
+      const ::artm::Item& item = batch.item(item_index);
+      ASSERT_EQ(item.id(), line_no);
+      ASSERT_EQ(item.title(), "doc" + std::to_string(line_no));
+      ASSERT_EQ(item.token_id_size(), 2);
+      ASSERT_EQ(batch.token(item.token_id(0)), "token" + std::to_string(line_no));
+      ASSERT_EQ(item.token_weight(0), line_no + 1);
+    }
+  }
+
+  // Reading the same file from std::cin also keeps the last line
+  std::ifstream fin(docword_file);
+  std::streambuf* cin_buf = std::cin.rdbuf(fin.rdbuf());
+  config.set_docword_file_path("-");
+  config.set_target_folder((fs::path(target_folder) / "batches_cin").string());
+  try {
+    info = ::artm::ParseCollection(config);
+  } catch (...) {
+    std::cin.rdbuf(cin_buf);
+    std::cin.clear();
+    throw;
+  }
+  std::cin.rdbuf(cin_buf);
+  std::cin.clear();
+  ASSERT_EQ(info.num_items(), num_lines);
+  ASSERT_EQ(info.num_batches(), 4);
+
+  try { fs::remove_all(target_folder); }
+  catch (...) {}
+}
+
+// To run this particular test:
+// artm_tests.exe --gtest_filter=CollectionParser.BatchManifest
+TEST(CollectionParser, BatchManifest) {
+  std::string target_folder = artm::test::Helpers::getUniqueString();
+
+  ::artm::CollectionParserConfig config;
+  config.set_format(::artm::CollectionParserConfig_CollectionFormat_VowpalWabbit);
+  config.set_target_folder(target_folder);
+  config.set_docword_file_path((::artm::test::Helpers::getTestDataDir() / "vw_data.txt").string());
+  config.set_num_items_per_batch(1);
+
+  ::artm::ParseCollection(config);
+
+  ::artm::BatchManifest manifest;
+  ASSERT_TRUE(::artm::core::Helpers::LoadBatchManifest(target_folder, &manifest));
+  ASSERT_EQ(manifest.entry_size(), 2);
+  for (const auto& entry : manifest.entry()) {
+    fs::path batch_path = fs::path(target_folder) / entry.filename();
+    ASSERT_EQ(static_cast<uintmax_t>(entry.byte_size()), fs::file_size(batch_path));
+
+    ::artm::Batch batch;
+    ::artm::core::Helpers::LoadMessage(batch_path.string(), &batch);
+    ASSERT_EQ(entry.item_count(), batch.item_size());
+    ASSERT_EQ(entry.token_count(), batch.item(0).token_id_size());
+  }
+
+  ::artm::Batch extra_batch;
+  extra_batch.set_id("11da7f62-57c0-4f96-9a4e-ea1b8d4d2b26");
+  extra_batch.add_item()->set_id(0);
+  ::artm::core::Helpers::SaveBatch(extra_batch, target_folder, "extra");
+
+  // By default batches are listed in directory order, same as without a manifest
+  std::vector<fs::path> directory_order;
+  for (fs::directory_iterator it(target_folder), endit; it != endit; ++it) {
+    if (it->path().extension() == ".batch") {
+      directory_order.push_back(it->path());
+    }
+  }
+  ASSERT_EQ(::artm::core::Helpers::ListAllBatches(target_folder), directory_order);
+
+  // For offline fitting batches from the manifest go first (largest first), then batches not listed in it
+  auto batches = ::artm::core::Helpers::ListAllBatches(target_folder, /* largest_first =*/ true);
+  ASSERT_EQ(batches.size(), 3u);
+  ASSERT_GE(fs::file_size(batches[0]), fs::file_size(batches[1]));
+  ASSERT_EQ(batches[2].filename().string(), "extra.batch");
+
+  // Batches removed from the folder are not listed even though they remain in the manifest
+  fs::remove(batches[0]);
+  ASSERT_EQ(::artm::core::Helpers::ListAllBatches(target_folder).size(), 2u);
+
+  try { fs::remove_all(target_folder); }
+  catch (...) {}
+}
+
 // To run this particular test:
 // artm_tests.exe --gtest_filter=CollectionParser.TransactionVowpalWabbit
 TEST(CollectionParser, TransactionVowpalWabbit) {
@@ -352,4 +567,369 @@ TEST(CollectionParser, TransactionVowpalWabbit) {
   try { fs::remove_all(target_folder); }
   catch (...) {}
 }
+
+// To run this particular test:
+// artm_tests.exe --gtest_filter=CollectionParser.CooccurrencesFromBatches
+TEST(CollectionParser, CooccurrencesFromBatches) {
+  std::string target_folder = artm::test::Helpers::getUniqueString();
+  fs::create_directory(target_folder);
+  const fs::path root(target_folder);
+
+  const int num_lines = 40;
+  {
+    std::ofstream vocab((root / "vocab.txt").string());
+    for (int i = 0; i < 8; ++i) {
+      vocab << "token" << i << "\n";
+    }
+    vocab << "alex author\nnoname author\n";
+
+    std::ofstream fout((root / "vw.txt").string());
+    for (int line_no = 0; line_no < num_lines; ++line_no) {
+      fout << "doc" << line_no;
+      for (int i = 0; i < 6; ++i) {
+        fout << " token" << (line_no * i + i) % 10 << ((i == 2) ? ":3" : "");
+      }
+      fout << " |author alex noname |@default_class token" << line_no % 3 << " token7\n";
+    }
+  }
+
+  ::artm::CollectionParserConfig config;
+  config.set_format(::artm::CollectionParserConfig_CollectionFormat_VowpalWabbit);
+  config.set_target_folder((root / "batches").string());
+  config.set_docword_file_path((root / "vw.txt").string());
+  config.set_vocab_file_path((root / "vocab.txt").string());
+  config.set_num_items_per_batch(7);
+  config.set_num_threads(2);
+  config.set_gather_cooc(true);
+  config.set_gather_cooc_tf(true);
+  config.set_gather_cooc_df(true);
+  config.set_cooc_window_width(3);
+  config.set_cooc_tf_file_path((root / "cooc_tf_vw").string());
+  config.set_cooc_df_file_path((root / "cooc_df_vw").string());
+  config.set_ppmi_tf_file_path((root / "ppmi_tf_vw").string());
+  ::artm::ParseCollection(config);
+
+  // The same co-occurrences are gathered from the batches, without parsing the text
+  config.set_format(::artm::CollectionParserConfig_CollectionFormat_Batches);
+  config.set_docword_file_path((root / "batches").string());
+  config.clear_target_folder();
+  config.set_cooc_tf_file_path((root / "cooc_tf").string());
+  config.set_cooc_df_file_path((root / "cooc_df").string());
+  config.set_ppmi_tf_file_path((root / "ppmi_tf").string());
+  ::artm::CollectionParserInfo info = ::artm::ParseCollection(config);
+  ASSERT_EQ(info.num_items(), num_lines);
+  ASSERT_EQ(info.num_batches(), 6);
+
+  for (const char* name : { "cooc_tf", "cooc_df", "ppmi_tf" }) {
+    std::ifstream from_vw((root / (std::string(name) + "_vw")).string());
+    std::ifstream from_batches((root / name).string());
+    std::string expected((std::istreambuf_iterator<char>(from_vw)), std::istreambuf_iterator<char>());
+    std::string actual((std::istreambuf_iterator<char>(from_batches)), std::istreambuf_iterator<char>());
+    ASSERT_FALSE(expected.empty());
+    ASSERT_EQ(expected, actual);
+  }
+
+  // Only co-occurrences can be gathered from batches
+  config.set_gather_cooc(false);
+  ASSERT_THROW(::artm::ParseCollection(config), ::artm::InvalidOperationException);
+
+  try { fs::remove_all(target_folder); }
+  catch (...) {}
+}
+
+// Co-occurrences of a collection of tokens "token<id>" of the default modality, counted right by the definition:
+// every token co-occurs with window_width tokens to its right. In symmetric mode only the pair <u v> with u <= v
+// is stored, in non-symmetric mode both pairs <u v> and <v u> are stored.
+class CoocReference {
+ public:
+  CoocReference(const std::vector<std::vector<int>>& docs, int vocab_size, int window_width, bool symmetric)
+      : num_of_pairs_token_occurred_in_(vocab_size, 0), num_of_documents_token_occurred_in_(vocab_size, 0),
+        total_num_of_pairs_(0), total_num_of_documents_(docs.size()) {
+    for (const std::vector<int>& doc : docs) {
+      for (int token_id : std::set<int>(doc.begin(), doc.end())) {
+        ++num_of_documents_token_occurred_in_[token_id];
+      }
+
+      std::set<std::pair<int, int>> pairs_in_doc;
+      for (int i = 0; i < static_cast<int>(doc.size()); ++i) {
+        for (int j = i + 1; j <= i + window_width && j < static_cast<int>(doc.size()); ++j) {
+          total_num_of_pairs_ += 2;
+          if (symmetric) {
+            AddPair(std::min(doc[i], doc[j]), std::max(doc[i], doc[j]), (doc[i] == doc[j]) ? 2 : 1,
+                    symmetric, &pairs_in_doc);
+          } else {
+            AddPair(doc[i], doc[j], 1, symmetric, &pairs_in_doc);
+            AddPair(doc[j], doc[i], 1, symmetric, &pairs_in_doc);
+          }
+        }
+      }
+    }
+  }
+
+  // Text file of co-occurrences in the format of the collection parser
+  std::string CoocText(bool tf, int64_t cooc_min) const {
+    const std::map<std::pair<int, int>, int64_t>& cooc = tf ? cooc_tf_ : cooc_df_;
+    std::map<int, std::string> lines;
+    for (const auto& pair : cooc) {
+      if (pair.second >= cooc_min && pair.first.first != pair.first.second) {
+        std::string& line = lines[pair.first.first];
+        if (line.empty()) {
+          line = "token" + std::to_string(pair.first.first) + " ";
+        }
+        line += "token" + std::to_string(pair.first.second) + ":" + std::to_string(pair.second) + " ";
+      }
+    }
+
+    std::string text;
+    for (const auto& line : lines) {
+      text += line.second + "\n";
+    }
+    return text;
+  }
+
+  // Text file of ppmi calculated from the text file of co-occurrences, the way it was done before
+  // ppmi was calculated during the merge of co-occurrence batches (CalculateAndWritePpmi)
+  std::string PpmiText(bool tf, int64_t cooc_min) const {
+    const long double n = tf ? total_num_of_pairs_ : total_num_of_documents_;
+    const std::vector<int64_t>& token_freq = tf ? num_of_pairs_token_occurred_in_
+                                                : num_of_documents_token_occurred_in_;
+    std::stringstream output_buf;
+    std::stringstream cooc_text(CoocText(tf, cooc_min));
+    std::string line;
+    while (std::getline(cooc_text, line)) {
+      std::stringstream line_stream(line);
+      std::string first_token_str;
+      line_stream >> first_token_str;
+      bool new_first_token = true;
+      std::string elem;
+      while (line_stream >> elem) {
+        const size_t colon = elem.find(':');
+        const std::string second_token_str = elem.substr(0, colon);
+        const long double n_u = token_freq[std::stoi(first_token_str.substr(5))];
+        const long double n_v = token_freq[std::stoi(second_token_str.substr(5))];
+        const long double n_uv = static_cast<long double>(std::stoull(elem.substr(colon + 1)));
+        double value_inside_logarithm = (n / n_u) / (n_v / n_uv);
+        if (value_inside_logarithm > 1.0) {
+          if (new_first_token) {
+            output_buf << first_token_str;
+            new_first_token = false;
+          }
+          output_buf << ' ' << second_token_str << ':' << log(value_inside_logarithm);
+        }
+      }
+      if (!new_first_token) {
+        output_buf << '\n';
+      }
+    }
+    return output_buf.str();
+  }
+
+ private:
+  void AddPair(int first_token_id, int second_token_id, int64_t cooc_tf, bool symmetric,
+               std::set<std::pair<int, int>>* pairs_in_doc) {
+    const std::pair<int, int> pair(first_token_id, second_token_id);
+    cooc_tf_[pair] += cooc_tf;
+    if (pairs_in_doc->insert(pair).second) {
+      ++cooc_df_[pair];
+    }
+    // Pairs <u u> have double weight, so in symmetric case they are counted once
+    num_of_pairs_token_occurred_in_[first_token_id] += cooc_tf;
+    if (symmetric && first_token_id != second_token_id) {
+      num_of_pairs_token_occurred_in_[second_token_id] += cooc_tf;
+    }
+  }
+
+  std::map<std::pair<int, int>, int64_t> cooc_tf_;
+  std::map<std::pair<int, int>, int64_t> cooc_df_;
+  std::vector<int64_t> num_of_pairs_token_occurred_in_;
+  std::vector<int64_t> num_of_documents_token_occurred_in_;
+  int64_t total_num_of_pairs_;
+  int64_t total_num_of_documents_;
+};
+
+// Writes vocab.txt and vw.txt with num_docs documents into the folder, returns token ids of the documents
+// Token ids and co-occurrence values don't fit in one byte, and small ids are more frequent
+static std::vector<std::vector<int>> GenerateCoocCollection(const fs::path& root, int num_docs, int doc_length,
+                                                            int vocab_size) {
+  std::ofstream vocab((root / "vocab.txt").string());
+  for (int token_id = 0; token_id < vocab_size; ++token_id) {
+    vocab << "token" << token_id << "\n";
+  }
+
+  std::vector<std::vector<int>> docs(num_docs);
+  std::ofstream fout((root / "vw.txt").string());
+  unsigned seed = 0;
+  for (int doc_id = 0; doc_id < num_docs; ++doc_id) {
+    fout << "doc" << doc_id;
+    for (int i = 0; i < doc_length; ++i) {
+      seed = seed * 1103515245 + 12345;
+      const int first = (seed >> 8) % vocab_size;
+      seed = seed * 1103515245 + 12345;
+      const int second = (seed >> 8) % vocab_size;
+      docs[doc_id].push_back(std::min(first, second));
+      fout << " token" << docs[doc_id].back();
+    }
+    fout << "\n";
+  }
+  return docs;
+}
+
+static std::string ReadFile(const fs::path& path) {
+  std::ifstream fin(path.string());
+  return std::string((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+}
+
+static ::artm::CollectionParserConfig GetCoocParserConfig(const fs::path& root, bool symmetric) {
+  ::artm::CollectionParserConfig config;
+  config.set_format(::artm::CollectionParserConfig_CollectionFormat_VowpalWabbit);
+  config.set_target_folder((root / "batches").string());
+  config.set_docword_file_path((root / "vw.txt").string());
+  config.set_vocab_file_path((root / "vocab.txt").string());
+  config.set_num_items_per_batch(50);
+  config.set_num_threads(2);
+  config.set_gather_cooc(true);
+  config.set_gather_cooc_tf(true);
+  config.set_gather_cooc_df(true);
+  config.set_cooc_window_width(5);
+  config.set_store_symmetric_cooc_values(symmetric);
+  config.set_cooc_tf_file_path((root / "cooc_tf").string());
+  config.set_cooc_df_file_path((root / "cooc_df").string());
+  return config;
+}
+
+// To run this particular test:
+// artm_tests.exe --gtest_filter=CollectionParser.CooccurrencesMergedByRanges
+TEST(CollectionParser, CooccurrencesMergedByRanges) {
+  std::string target_folder = artm::test::Helpers::getUniqueString();
+  fs::create_directory(target_folder);
+  const fs::path root(target_folder);
+
+  const int vocab_size = 300;
+  const int window_width = 5;
+  std::vector<std::vector<int>> docs = GenerateCoocCollection(root, 300, 100, vocab_size);
+
+  for (bool symmetric : { false, true }) {
+    // The smallest memory budget makes every thread dump its buffer of pairs several times per batch,
+    // so every pair is sorted, reduced, encoded in co-occurrence batches, read back and merged
+    ::artm::CollectionParserConfig config = GetCoocParserConfig(root, symmetric);
+    config.set_cooc_memory_budget_mb(1);
+    ::artm::ParseCollection(config);
+
+    CoocReference reference(docs, vocab_size, window_width, symmetric);
+    std::string expected_tf = reference.CoocText(/* tf = */ true, config.cooc_min_tf());
+    std::string expected_df = reference.CoocText(/* tf = */ false, config.cooc_min_df());
+    ASSERT_FALSE(expected_tf.empty());
+    ASSERT_EQ(ReadFile(root / "cooc_tf"), expected_tf);
+    ASSERT_EQ(ReadFile(root / "cooc_df"), expected_df);
+
+    // Rare pairs are dropped
+    config.set_cooc_min_tf(20);
+    config.set_cooc_min_df(10);
+    ::artm::ParseCollection(config);
+    expected_tf = reference.CoocText(/* tf = */ true, config.cooc_min_tf());
+    expected_df = reference.CoocText(/* tf = */ false, config.cooc_min_df());
+    ASSERT_NE(expected_tf, reference.CoocText(/* tf = */ true, 1));
+    ASSERT_EQ(ReadFile(root / "cooc_tf"), expected_tf);
+    ASSERT_EQ(ReadFile(root / "cooc_df"), expected_df);
+  }
+
+  try { fs::remove_all(target_folder); }
+  catch (...) {}
+}
+
+// To run this particular test:
+// artm_tests.exe --gtest_filter=CollectionParser.CooccurrencesMultipleThreads
+TEST(CollectionParser, CooccurrencesMultipleThreads) {
+  std::string target_folder = artm::test::Helpers::getUniqueString();
+  fs::create_directory(target_folder);
+  const fs::path root(target_folder);
+
+  std::vector<std::vector<int>> docs = GenerateCoocCollection(root, 200, 50, 1000);
+  CoocReference reference(docs, 1000, /* window_width = */ 5, /* symmetric = */ false);
+  const std::string expected_tf = reference.CoocText(/* tf = */ true, 1);
+  const std::string expected_df = reference.CoocText(/* tf = */ false, 1);
+
+  // Ranges of first tokens are merged by several workers, and they are written in the right order
+  for (int num_threads : { 1, 3, 8 }) {
+    ::artm::CollectionParserConfig config = GetCoocParserConfig(root, /* symmetric = */ false);
+    config.set_num_threads(num_threads);
+    ::artm::ParseCollection(config);
+    ASSERT_EQ(ReadFile(root / "cooc_tf"), expected_tf);
+    ASSERT_EQ(ReadFile(root / "cooc_df"), expected_df);
+  }
+
+  try { fs::remove_all(target_folder); }
+  catch (...) {}
+}
+
+// To run this particular test:
+// artm_tests.exe --gtest_filter=CollectionParser.PpmiDuringMerge
+TEST(CollectionParser, PpmiDuringMerge) {
+  std::string target_folder = artm::test::Helpers::getUniqueString();
+  fs::create_directory(target_folder);
+  const fs::path root(target_folder);
+
+  const int vocab_size = 300;
+  std::vector<std::vector<int>> docs = GenerateCoocCollection(root, 200, 50, vocab_size);
+
+  for (bool symmetric : { false, true }) {
+    ::artm::CollectionParserConfig config = GetCoocParserConfig(root, symmetric);
+    config.set_ppmi_tf_file_path((root / "ppmi_tf").string());
+    config.set_ppmi_df_file_path((root / "ppmi_df").string());
+    config.set_cooc_min_tf(5);
+    config.set_cooc_min_df(3);
+    ::artm::ParseCollection(config);
+
+    // ppmi is the same as if it was calculated from the co-occurrence files after the merge
+    CoocReference reference(docs, vocab_size, config.cooc_window_width(), symmetric);
+    const std::string expected_tf = reference.PpmiText(/* tf = */ true, config.cooc_min_tf());
+    const std::string expected_df = reference.PpmiText(/* tf = */ false, config.cooc_min_df());
+    ASSERT_FALSE(expected_tf.empty());
+    ASSERT_FALSE(expected_df.empty());
+    ASSERT_EQ(ReadFile(root / "ppmi_tf"), expected_tf);
+    ASSERT_EQ(ReadFile(root / "ppmi_df"), expected_df);
+  }
+
+  try { fs::remove_all(target_folder); }
+  catch (...) {}
+}
+
+// To run this particular test:
+// artm_tests.exe --gtest_filter=CollectionParser.CooccurrencesWithSketch
+TEST(CollectionParser, CooccurrencesWithSketch) {
+  std::string target_folder = artm::test::Helpers::getUniqueString();
+  fs::create_directory(target_folder);
+  const fs::path root(target_folder);
+
+  GenerateCoocCollection(root, 200, 50, 300);
+
+  for (bool symmetric : { false, true }) {
+    auto parse = [&root, symmetric](float cooc_sketch_error) {
+      ::artm::CollectionParserConfig config = GetCoocParserConfig(root, symmetric);
+      config.set_ppmi_tf_file_path((root / "ppmi_tf").string());
+      config.set_ppmi_df_file_path((root / "ppmi_df").string());
+      config.set_cooc_min_tf(5);
+      config.set_cooc_min_df(3);
+      config.set_cooc_sketch_error(cooc_sketch_error);
+      ::artm::ParseCollection(config);
+
+      std::vector<std::string> output;
+      for (const char* name : { "cooc_tf", "cooc_df", "ppmi_tf", "ppmi_df" }) {
+        output.push_back(ReadFile(root / name));
+      }
+      return output;
+    };
+
+    // Pairs which are dropped by the sketch can't pass cooc_min_tf / cooc_min_df, so the output is the same
+    std::vector<std::string> exact = parse(0.0f);
+    std::vector<std::string> approximate = parse(1e-5f);
+    for (size_t i = 0; i < exact.size(); ++i) {
+      ASSERT_FALSE(exact[i].empty());
+      ASSERT_EQ(approximate[i], exact[i]);
+    }
+  }
+
+  try { fs::remove_all(target_folder); }
+  catch (...) {}
+}
 // vim: set ts=2 sw=2 sts=2:
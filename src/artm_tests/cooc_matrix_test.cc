@@ -0,0 +1,116 @@
+// Copyright 2017, Additive Regularization of Topic Models.
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "boost/filesystem.hpp"
+
+#include "gtest/gtest.h"
+
+#include "artm/core/cooc_file.h"
+#include "artm/core/cooc_matrix.h"
+#include "artm/core/exceptions.h"
+
+#include "artm_tests/test_mother.h"
+
+using ::artm::core::CoocFile;
+using ::artm::core::CoocFileWriter;
+using ::artm::core::CoocMatrix;
+using ::artm::core::Token;
+
+// To run this particular test:
+// artm_tests.exe --gtest_filter=CoocMatrix.Basic
+TEST(CoocMatrix, Basic) {
+  CoocMatrix cooc_matrix;
+  EXPECT_TRUE(cooc_matrix.row(0).empty());
+
+  cooc_matrix.Add(3, 7, 1.0f);
+  cooc_matrix.Add(0, 5, 2.0f);
+  cooc_matrix.Add(3, 2, 3.0f);
+  cooc_matrix.Add(3, 7, 4.0f);  // duplicate, the first value is kept
+
+  // pending values are not visible before Freeze()
+  EXPECT_TRUE(cooc_matrix.empty());
+  cooc_matrix.Freeze();
+
+  EXPECT_EQ(cooc_matrix.size(), 3);
+  EXPECT_EQ(cooc_matrix.num_nonempty_rows(), 2);
+  EXPECT_TRUE(cooc_matrix.row(1).empty());
+  EXPECT_TRUE(cooc_matrix.row(4).empty());
+  EXPECT_TRUE(cooc_matrix.row(-1).empty());
+
+  CoocMatrix::Row row = cooc_matrix.row(3);
+  ASSERT_EQ(row.size(), 2);
+  EXPECT_EQ(row.col(0), 2);
+  EXPECT_EQ(row.value(0), 3.0f);
+  EXPECT_EQ(row.col(1), 7);
+  EXPECT_EQ(row.value(1), 1.0f);
+  ASSERT_NE(row.find(7), nullptr);
+  EXPECT_EQ(*row.find(7), 1.0f);
+  EXPECT_EQ(row.find(5), nullptr);
+
+  // values added after Freeze() are merged with the frozen ones
+  cooc_matrix.Add(5, 0, 5.0f);
+  cooc_matrix.Add(0, 5, 6.0f);
+  cooc_matrix.Freeze();
+  EXPECT_EQ(cooc_matrix.size(), 4);
+  EXPECT_EQ(cooc_matrix.num_nonempty_rows(), 3);
+  EXPECT_EQ(*cooc_matrix.row(0).find(5), 2.0f);
+  EXPECT_EQ(*cooc_matrix.row(5).find(0), 5.0f);
+
+  cooc_matrix.clear();
+  EXPECT_TRUE(cooc_matrix.empty());
+  EXPECT_TRUE(cooc_matrix.row(3).empty());
+}
+
+// To run this particular test:
+// artm_tests.exe --gtest_filter=CoocMatrix.CoocFile
+TEST(CoocMatrix, CoocFile) {
+  std::string file_name = ::artm::test::Helpers::getUniqueString() + ".cooc";
+  std::vector<Token> tokens = { Token(::artm::core::DefaultClass, "first"), Token("@labels", "second"),
+                                Token(::artm::core::DefaultClass, "third") };
+
+  {
+    CoocFileWriter writer(file_name, tokens);
+    writer.AddValue(0, 1, 1.5f);
+    writer.AddValue(0, 2, 2.5f);
+    writer.AddValue(2, 0, 3.5f);
+    ASSERT_THROW(writer.AddValue(1, 0, 1.0f), ::artm::core::InvalidOperation);
+    ASSERT_THROW(writer.AddValue(2, 3, 1.0f), ::artm::core::InvalidOperation);
+    writer.Close();
+  }
+
+  ASSERT_TRUE(CoocFile::IsCoocFile(file_name));
+  std::shared_ptr<CoocFile> cooc_file = CoocFile::Open(file_name);
+  ASSERT_EQ(cooc_file->num_tokens(), 3);
+  EXPECT_EQ(cooc_file->num_values(), 3);
+  EXPECT_TRUE(cooc_file->tokens()[1] == tokens[1]);
+
+  CoocMatrix cooc_matrix;
+  cooc_matrix.Attach(cooc_file, cooc_file->num_tokens(), cooc_file->row_ptr(), cooc_file->col(), cooc_file->value());
+  cooc_file.reset();  // the matrix keeps the file mapped
+
+  EXPECT_TRUE(cooc_matrix.is_attached());
+  EXPECT_EQ(cooc_matrix.size(), 3);
+  EXPECT_EQ(cooc_matrix.num_nonempty_rows(), 2);
+  EXPECT_EQ(cooc_matrix.row(0).size(), 2);
+  EXPECT_EQ(*cooc_matrix.row(0).find(2), 2.5f);
+  EXPECT_TRUE(cooc_matrix.row(1).empty());
+  EXPECT_EQ(*cooc_matrix.row(2).find(0), 3.5f);
+
+  // adding values to an attached matrix copies it
+  cooc_matrix.Add(1, 1, 4.5f);
+  cooc_matrix.Freeze();
+  EXPECT_FALSE(cooc_matrix.is_attached());
+  EXPECT_EQ(cooc_matrix.size(), 4);
+  EXPECT_EQ(*cooc_matrix.row(0).find(1), 1.5f);
+  EXPECT_EQ(*cooc_matrix.row(1).find(1), 4.5f);
+
+  // a truncated file is rejected
+  boost::filesystem::resize_file(file_name, boost::filesystem::file_size(file_name) - 4);
+  ASSERT_THROW(CoocFile::Open(file_name), ::artm::core::CorruptedMessageException);
+
+  boost::filesystem::remove(file_name);
+  ASSERT_FALSE(CoocFile::IsCoocFile(file_name));
+}
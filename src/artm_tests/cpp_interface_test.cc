@@ -1,5 +1,7 @@
 // Copyright 2017, Additive Regularization of Topic Models.
 
+#include <fstream>  // NOLINT
+
 #include "boost/thread.hpp"
 #include "gtest/gtest.h"
 
@@ -786,6 +788,129 @@ TEST(CppInterface, Dictionaries) {
   catch (...) { }
 }
 
+// artm_tests.exe --gtest_filter=CppInterface.GatherDictionaryMultipleThreads
+TEST(CppInterface, GatherDictionaryMultipleThreads) {
+  int nBatches = 70;
+  std::string target_folder = artm::test::Helpers::getUniqueString();
+  std::string spill_folder = artm::test::Helpers::getUniqueString();
+  ::artm::test::TestMother::GenerateBatches(nBatches, 50, target_folder);
+  artm::MasterModelConfig master_config;
+  artm::MasterModel master(master_config);
+
+  auto gather = [&master, &target_folder, &spill_folder](int num_threads, int max_tokens_in_memory) {
+    artm::GatherDictionaryArgs gather_args;
+    gather_args.set_data_path(target_folder);
+    gather_args.set_dictionary_target_name("gathered_dictionary");
+    gather_args.set_num_threads(num_threads);
+    gather_args.set_max_tokens_in_memory(max_tokens_in_memory);
+    gather_args.set_spill_folder(spill_folder);
+    master.GatherDictionary(gather_args);
+
+    ::artm::GetDictionaryArgs get_dict;
+    get_dict.set_dictionary_name("gathered_dictionary");
+    return master.GetDictionary(get_dict);
+  };
+
+  auto expected = gather(1, 0);
+  ASSERT_EQ(expected.token_size(), 50);
+  ASSERT_EQ(expected.num_items_in_collection(), nBatches);
+
+  auto dictionary = gather(3, 0);
+  ASSERT_EQ(dictionary.token_size(), expected.token_size());
+  for (int i = 0; i < expected.token_size(); ++i) {
+    EXPECT_EQ(dictionary.token(i), expected.token(i));
+    EXPECT_FLOAT_EQ(dictionary.token_tf(i), expected.token_tf(i));
+    EXPECT_FLOAT_EQ(dictionary.token_df(i), expected.token_df(i));
+    EXPECT_FLOAT_EQ(dictionary.token_value(i), expected.token_value(i));
+  }
+
+  // Spilling does not change the order of tokens. Each thread spills after every batch,
+  // so there are more spilled files than can be merged at once.
+  dictionary = gather(2, 10);
+  ASSERT_EQ(dictionary.token_size(), expected.token_size());
+  EXPECT_EQ(dictionary.num_items_in_collection(), expected.num_items_in_collection());
+  for (int i = 0; i < expected.token_size(); ++i) {
+    EXPECT_EQ(dictionary.token(i), expected.token(i));
+    EXPECT_FLOAT_EQ(dictionary.token_tf(i), expected.token_tf(i));
+    EXPECT_FLOAT_EQ(dictionary.token_df(i), expected.token_df(i));
+    EXPECT_FLOAT_EQ(dictionary.token_value(i), expected.token_value(i));
+  }
+
+  // Spilled files are removed
+  EXPECT_TRUE(boost::filesystem::is_empty(spill_folder));
+
+  try { boost::filesystem::remove_all(target_folder); }
+  catch (...) { }
+
+  try { boost::filesystem::remove_all(spill_folder); }
+  catch (...) { }
+}
+
+// artm_tests.exe --gtest_filter=CppInterface.ExportImportDictionaryMultipleThreads
+TEST(CppInterface, ExportImportDictionaryMultipleThreads) {
+  std::string target_folder = artm::test::Helpers::getUniqueString();
+  ::artm::test::TestMother::GenerateBatches(5, 50, target_folder);
+  artm::MasterModelConfig master_config;
+  artm::MasterModel master(master_config);
+
+  artm::GatherDictionaryArgs gather_args;
+  gather_args.set_data_path(target_folder);
+  gather_args.set_dictionary_target_name("gathered_dictionary");
+  master.GatherDictionary(gather_args);
+
+  // Format version 0 is written for older releases, version 1 is the default
+  for (int format_version : { 0, 1 }) {
+    artm::ExportDictionaryArgs export_args;
+    export_args.set_file_name(artm::test::Helpers::getUniqueString() + ".dict");
+    export_args.set_dictionary_name("gathered_dictionary");
+    export_args.set_num_threads(4);
+    if (format_version == 0) {
+      export_args.set_format_version(format_version);
+    }
+    master.ExportDictionary(export_args);
+
+    {
+      std::ifstream fin(export_args.file_name(), std::ifstream::binary);
+      ASSERT_EQ(fin.get(), format_version);
+    }
+
+    artm::ImportDictionaryArgs import_args;
+    import_args.set_file_name(export_args.file_name());
+    import_args.set_dictionary_name("imported_dictionary");
+    import_args.set_num_threads(4);
+    master.ImportDictionary(import_args);
+
+    ::artm::GetDictionaryArgs get_dict;
+    get_dict.set_dictionary_name("gathered_dictionary");
+    auto expected = master.GetDictionary(get_dict);
+    get_dict.set_dictionary_name("imported_dictionary");
+    auto dictionary = master.GetDictionary(get_dict);
+
+    ASSERT_EQ(dictionary.token_size(), expected.token_size());
+    EXPECT_EQ(dictionary.num_items_in_collection(), expected.num_items_in_collection());
+    for (int i = 0; i < expected.token_size(); ++i) {
+      EXPECT_EQ(dictionary.token(i), expected.token(i));
+      EXPECT_EQ(dictionary.class_id(i), expected.class_id(i));
+      EXPECT_EQ(dictionary.token_tf(i), expected.token_tf(i));
+      EXPECT_EQ(dictionary.token_df(i), expected.token_df(i));
+      EXPECT_EQ(dictionary.token_value(i), expected.token_value(i));
+    }
+
+    // Truncated file is rejected
+    if (format_version == 1) {
+      boost::filesystem::resize_file(import_args.file_name(),
+                                     boost::filesystem::file_size(import_args.file_name()) - 1);
+      EXPECT_THROW(master.ImportDictionary(import_args), artm::CorruptedMessageException);
+    }
+
+    try { boost::filesystem::remove(import_args.file_name()); }
+    catch (...) { }
+  }
+
+  try { boost::filesystem::remove_all(target_folder); }
+  catch (...) { }
+}
+
 // artm_tests.exe --gtest_filter=ProtobufMessages.Json
 TEST(ProtobufMessages, Json) {
   ::artm::MasterModelConfig config, config2;
@@ -8,6 +8,7 @@
 
 #include "artm/cpp_interface.h"
 #include "artm/core/common.h"
+#include "artm/core/token.h"
 
 #include "artm_tests/test_mother.h"
 #include "artm_tests/api.h"
@@ -452,3 +453,148 @@ TEST(MasterModel, TestReshapeTokensSmoothSparsePhi) {
   reg_config.add_class_id("@default_class");
   testReorderTokens(::artm::RegularizerType_SmoothSparsePhi, reg_config, 0.1);
 }
+
+// Trains two models on the same collection: one from batches saved on disk, and one
+// from batches streamed by the collection parser. Returns p_wt matrices of both models.
+static void fitFromDiskAndStream(bool online, ::artm::TopicModel* disk_model, ::artm::TopicModel* stream_model) {
+  std::string target_folder = artm::test::Helpers::getUniqueString();
+
+  ::artm::CollectionParserConfig parser_config;
+  parser_config.set_format(::artm::CollectionParserConfig_CollectionFormat_MatrixMarket);
+  parser_config.set_num_items_per_batch(2);
+  parser_config.set_num_threads(1);
+  parser_config.set_name_type(::artm::CollectionParserConfig_BatchNameType_Code);
+  parser_config.set_vocab_file_path((::artm::test::Helpers::getTestDataDir() / "deerwestere.txt").string());
+  parser_config.set_docword_file_path((::artm::test::Helpers::getTestDataDir() / "deerwestere.mm").string());
+  parser_config.set_target_folder(target_folder);
+  ::artm::ParseCollection(parser_config);
+
+  std::vector<std::string> batch_filename;
+  for (const char* batch_name : { "aaaaaa", "aaaaab", "aaaaac", "aaaaad", "aaaaae" }) {
+    batch_filename.push_back((boost::filesystem::path(target_folder) / batch_name).string() + ".batch");
+  }
+
+  for (int is_stream = 0; is_stream <= 1; is_stream++) {
+    ::artm::MasterModelConfig config;
+    config.set_num_processors(2);
+    config.add_topic_name("topic1"); config.add_topic_name("topic2"); config.add_topic_name("topic3");
+    ::artm::MasterModel master_model(config);
+
+    ::artm::GatherDictionaryArgs gather_args;
+    gather_args.set_dictionary_target_name("dictionary");
+    gather_args.set_data_path(target_folder);
+    master_model.GatherDictionary(gather_args);
+
+    ::artm::InitializeModelArgs initialize_model_args;
+    initialize_model_args.set_dictionary_name("dictionary");
+    initialize_model_args.set_seed(123);
+    master_model.InitializeModel(initialize_model_args);
+
+    ::artm::CollectionParserConfig stream_config(parser_config);
+    stream_config.clear_target_folder();
+
+    if (online) {
+      ::artm::FitOnlineMasterModelArgs fit_online_args;
+      if (is_stream) {
+        // The stream has 5 batches; update_after is extended with the same interval
+        fit_online_args.mutable_collection_parser_config()->CopyFrom(stream_config);
+        fit_online_args.add_update_after(2);
+        fit_online_args.add_apply_weight(0.5f);
+      } else {
+        for (const auto& name : batch_filename) {
+          fit_online_args.add_batch_filename(name);
+        }
+        for (int update_after : { 2, 4, 5 }) {
+          fit_online_args.add_update_after(update_after);
+          fit_online_args.add_apply_weight(0.5f);
+        }
+      }
+      master_model.FitOnlineModel(fit_online_args);
+      ASSERT_EQ(master_model.info().batch_size(), 0);  // streamed batches are not kept by default
+    } else {
+      ::artm::FitOfflineMasterModelArgs fit_offline_args;
+      fit_offline_args.set_num_collection_passes(3);
+      if (is_stream) {
+        fit_offline_args.mutable_collection_parser_config()->CopyFrom(stream_config);
+      } else {
+        fit_offline_args.set_batch_folder(target_folder);
+      }
+      master_model.FitOfflineModel(fit_offline_args);
+      ASSERT_EQ(master_model.info().batch_size(), is_stream ? 5 : 0);
+    }
+
+    ::artm::GetTopicModelArgs get_model_args;
+    get_model_args.set_matrix_layout(::artm::MatrixLayout_Dense);
+    (is_stream ? stream_model : disk_model)->CopyFrom(master_model.GetTopicModel(get_model_args));
+  }
+
+  try { boost::filesystem::remove_all(target_folder); }
+  catch (...) { }
+}
+
+static void compareModels(const ::artm::TopicModel& model1, const ::artm::TopicModel& model2) {
+  ASSERT_EQ(model1.token_size(), model2.token_size());
+  for (int token_index = 0; token_index < model1.token_size(); ++token_index) {
+    ASSERT_EQ(model1.token(token_index), model2.token(token_index));
+    for (int topic_index = 0; topic_index < model1.num_topics(); ++topic_index) {
+      ASSERT_NEAR(model1.token_weights(token_index).value(topic_index),
+                  model2.token_weights(token_index).value(topic_index), 1e-5);
+    }
+  }
+}
+
+// To run this particular test:
+// artm_tests.exe --gtest_filter=MasterModel.StreamingFitOffline
+TEST(MasterModel, StreamingFitOffline) {
+  ::artm::TopicModel disk_model, stream_model;
+  fitFromDiskAndStream(/*online =*/ false, &disk_model, &stream_model);
+  compareModels(disk_model, stream_model);
+}
+
+// To run this particular test:
+// artm_tests.exe --gtest_filter=MasterModel.StreamingFitOnline
+TEST(MasterModel, StreamingFitOnline) {
+  ::artm::TopicModel disk_model, stream_model;
+  fitFromDiskAndStream(/*online =*/ true, &disk_model, &stream_model);
+  compareModels(disk_model, stream_model);
+}
+
+// To run this particular test:
+// artm_tests.exe --gtest_filter=MasterModel.TransformDoesNotGrowVocabulary
+TEST(MasterModel, TransformDoesNotGrowVocabulary) {
+  ::artm::MasterModelConfig config;
+  config.set_num_processors(2);
+  config.add_topic_name("topic1"); config.add_topic_name("topic2");
+  ::artm::ScoreConfig* score_config = config.add_score_config();
+  score_config->set_type(::artm::ScoreType_Perplexity);
+  score_config->set_name("Perplexity");
+  score_config->set_config(::artm::PerplexityScoreConfig().SerializeAsString());
+  ::artm::MasterModel master_model(config);
+
+  ::artm::DictionaryData dictionary_data;
+  auto batches = ::artm::test::TestMother::GenerateBatches(/*batches_size =*/ 2, /*nTokens =*/ 10, &dictionary_data);
+  dictionary_data.set_name("dictionary");
+  master_model.CreateDictionary(dictionary_data);
+
+  ::artm::InitializeModelArgs initialize_model_args;
+  initialize_model_args.set_dictionary_name("dictionary");
+  master_model.InitializeModel(initialize_model_args);
+
+  // A new document has a token that was never seen by the process
+  const std::string new_keyword = "transform_does_not_grow_vocabulary_token";
+  ::artm::Batch batch(*batches[0]);
+  batch.add_token(new_keyword);
+  ::artm::Item* item = batch.mutable_item(0);
+  item->add_token_id(batch.token_size() - 1);
+  item->add_token_weight(1.0f);
+  item->add_transaction_start_index(item->token_id_size());  // the new token is a transaction of its own
+
+  const int vocabulary_size = ::artm::core::Token::vocabulary().size();
+  ::artm::TransformMasterModelArgs transform_args;
+  transform_args.add_batch()->CopyFrom(batch);
+  ::artm::ThetaMatrix theta = master_model.Transform(transform_args);
+  ASSERT_EQ(theta.item_id_size(), 1);
+
+  EXPECT_EQ(::artm::core::Token::vocabulary().size(), vocabulary_size);
+  EXPECT_FALSE(::artm::core::Token::Find(::artm::core::DefaultClass, new_keyword).known());
+}
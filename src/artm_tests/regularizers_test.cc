@@ -1,6 +1,9 @@
 // Copyright 2017, Additive Regularization of Topic Models.
 
+#include <cmath>
 #include <memory>
+#include <sstream>
+#include <string>
 #include <vector>
 
 #include "gtest/gtest.h"
@@ -378,3 +381,256 @@ TEST(Regularizers, RelativeRegularization) {
     ASSERT_NEAR(sparsity_scores.back().value(), true_score[i], 1e-3);
   }
 }
+
+// artm_tests.exe --gtest_filter=Regularizers.PhiTokenRanges
+TEST(Regularizers, PhiTokenRanges) {
+  // The model is large enough to be regularized by several ranges of tokens in parallel
+  int nTopics = 8;
+  int nTokens = 5000;
+
+  ::artm::MasterModelConfig master_config = ::artm::test::TestMother::GenerateMasterModelConfig(nTopics);
+  master_config.set_num_processors(4);
+
+  ::artm::RegularizerConfig* regularizer_config = master_config.add_regularizer_config();
+  regularizer_config->set_name("DecorrelatorPhi");
+  regularizer_config->set_type(::artm::RegularizerType_DecorrelatorPhi);
+  regularizer_config->set_tau(0.0f);  // regularizers are applied below with RegularizeModel
+  regularizer_config->set_config(::artm::DecorrelatorPhiConfig().SerializeAsString());
+
+  regularizer_config = master_config.add_regularizer_config();
+  regularizer_config->set_name("SmoothPhi");
+  regularizer_config->set_type(::artm::RegularizerType_SmoothSparsePhi);
+  regularizer_config->set_tau(0.0f);
+  regularizer_config->set_config(::artm::SmoothSparsePhiConfig().SerializeAsString());
+
+  regularizer_config = master_config.add_regularizer_config();
+  regularizer_config->set_name("RelativeSmoothPhi");
+  regularizer_config->set_type(::artm::RegularizerType_SmoothSparsePhi);
+  regularizer_config->set_tau(0.0f);
+  regularizer_config->set_config(::artm::SmoothSparsePhiConfig().SerializeAsString());
+
+  artm::MasterModel master(master_config);
+  ::artm::test::Api api(master);
+
+  auto offline_args = api.Initialize(::artm::test::TestMother::GenerateBatches(2, nTokens));
+  master.FitOfflineModel(offline_args);
+
+  const float decorrelator_tau = -2.0f;
+  const float smooth_tau = 0.5f;
+  const float relative_tau = 0.1f;
+  const float relative_gamma = 0.3f;
+  ::artm::RegularizeModelArgs regularize_model_args;
+  regularize_model_args.set_rwt_target_name("rwt");
+  regularize_model_args.set_pwt_source_name(master.config().pwt_name());
+  regularize_model_args.set_nwt_source_name(master.config().nwt_name());
+  ::artm::RegularizerSettings* regularizer_settings = regularize_model_args.add_regularizer_settings();
+  regularizer_settings->set_name("DecorrelatorPhi");
+  regularizer_settings->set_tau(decorrelator_tau);
+  regularizer_settings = regularize_model_args.add_regularizer_settings();
+  regularizer_settings->set_name("SmoothPhi");
+  regularizer_settings->set_tau(smooth_tau);
+  regularizer_settings = regularize_model_args.add_regularizer_settings();
+  regularizer_settings->set_name("RelativeSmoothPhi");
+  regularizer_settings->set_tau(relative_tau);
+  regularizer_settings->set_gamma(relative_gamma);
+  api.RegularizeModel(regularize_model_args);
+
+  ::artm::GetTopicModelArgs get_model_args;
+  get_model_args.set_model_name(master.config().pwt_name());
+  ::artm::TopicModel pwt = master.GetTopicModel(get_model_args);
+  get_model_args.set_model_name(master.config().nwt_name());
+  ::artm::TopicModel nwt = master.GetTopicModel(get_model_args);
+  get_model_args.set_model_name("rwt");
+  ::artm::TopicModel rwt = master.GetTopicModel(get_model_args);
+
+  ASSERT_EQ(rwt.token_size(), nTokens);
+  ASSERT_EQ(pwt.token_size(), nTokens);
+
+  // SmoothSparsePhi adds 1 to each element, so the sum of its absolute values is nTokens for each topic
+  std::vector<double> n_t(nTopics, 0.0);
+  double n = 0.0;
+  for (int token_index = 0; token_index < nTokens; ++token_index) {
+    for (int topic_index = 0; topic_index < nTopics; ++topic_index) {
+      n_t[topic_index] += nwt.token_weights(token_index).value(topic_index);
+      n += nwt.token_weights(token_index).value(topic_index);
+    }
+  }
+  std::vector<float> relative_values;
+  for (int topic_index = 0; topic_index < nTopics; ++topic_index) {
+    const double coefficient = relative_gamma * n_t[topic_index] / nTokens +
+                               (1 - relative_gamma) * n / (nTokens * nTopics);
+    relative_values.push_back(static_cast<float>(coefficient * relative_tau));
+  }
+  for (int token_index = 0; token_index < nTokens; ++token_index) {
+    ASSERT_EQ(rwt.token(token_index), pwt.token(token_index));
+    float weights_sum = 0.0f;
+    for (int topic_index = 0; topic_index < nTopics; ++topic_index) {
+      weights_sum += pwt.token_weights(token_index).value(topic_index);
+    }
+
+    for (int topic_index = 0; topic_index < nTopics; ++topic_index) {
+      const float weight = pwt.token_weights(token_index).value(topic_index);
+      const float expected = decorrelator_tau * (-weight * (weights_sum - weight)) + smooth_tau +
+                             relative_values[topic_index];
+      ASSERT_NEAR(rwt.token_weights(token_index).value(topic_index), expected, 1e-4);
+    }
+  }
+}
+
+// artm_tests.exe --gtest_filter=Regularizers.DecorrelatorPhiTopics
+TEST(Regularizers, DecorrelatorPhiTopics) {
+  int nTopics = 4;
+  int nTokens = 30;
+
+  ::artm::MasterModelConfig master_config = ::artm::test::TestMother::GenerateMasterModelConfig(nTopics);
+
+  // Topic1 and Topic3 are not regularized, unknown topic is ignored
+  ::artm::DecorrelatorPhiConfig topics_config;
+  topics_config.add_topic_name("Topic2");
+  topics_config.add_topic_name("Topic0");
+  topics_config.add_topic_name("UnknownTopic");
+
+  ::artm::RegularizerConfig* regularizer_config = master_config.add_regularizer_config();
+  regularizer_config->set_name("DecorrelatorTopics");
+  regularizer_config->set_type(::artm::RegularizerType_DecorrelatorPhi);
+  regularizer_config->set_tau(0.0f);
+  regularizer_config->set_config(topics_config.SerializeAsString());
+
+  // Topic0 is decorrelated from Topic1 and Topic3, Topic2 is decorrelated from Topic0
+  ::artm::DecorrelatorPhiConfig pairs_config;
+  const char* first_topics[] = { "Topic0", "Topic0", "Topic2", "UnknownTopic", "Topic2" };
+  const char* second_topics[] = { "Topic1", "Topic3", "Topic0", "Topic1", "UnknownTopic" };
+  const float pair_values[] = { 2.0f, 0.5f, 1.0f, 3.0f, 4.0f };
+  for (int i = 0; i < 5; ++i) {
+    pairs_config.add_first_topic_name(first_topics[i]);
+    pairs_config.add_second_topic_name(second_topics[i]);
+    pairs_config.add_value(pair_values[i]);
+  }
+
+  regularizer_config = master_config.add_regularizer_config();
+  regularizer_config->set_name("DecorrelatorPairs");
+  regularizer_config->set_type(::artm::RegularizerType_DecorrelatorPhi);
+  regularizer_config->set_tau(0.0f);
+  regularizer_config->set_config(pairs_config.SerializeAsString());
+
+  artm::MasterModel master(master_config);
+  ::artm::test::Api api(master);
+
+  auto offline_args = api.Initialize(::artm::test::TestMother::GenerateBatches(2, nTokens));
+  master.FitOfflineModel(offline_args);
+
+  ::artm::GetTopicModelArgs get_model_args;
+  get_model_args.set_model_name(master.config().pwt_name());
+  ::artm::TopicModel pwt = master.GetTopicModel(get_model_args);
+
+  for (const std::string regularizer_name : { "DecorrelatorTopics", "DecorrelatorPairs" }) {
+    ::artm::RegularizeModelArgs regularize_model_args;
+    regularize_model_args.set_rwt_target_name("rwt");
+    regularize_model_args.set_pwt_source_name(master.config().pwt_name());
+    regularize_model_args.set_nwt_source_name(master.config().nwt_name());
+    ::artm::RegularizerSettings* regularizer_settings = regularize_model_args.add_regularizer_settings();
+    regularizer_settings->set_name(regularizer_name);
+    regularizer_settings->set_tau(1.0f);
+    api.RegularizeModel(regularize_model_args);
+
+    get_model_args.set_model_name("rwt");
+    ::artm::TopicModel rwt = master.GetTopicModel(get_model_args);
+    ASSERT_EQ(rwt.token_size(), nTokens);
+
+    for (int token_index = 0; token_index < nTokens; ++token_index) {
+      const auto& p = pwt.token_weights(token_index);
+      std::vector<float> expected(nTopics, 0.0f);
+      if (regularizer_name == "DecorrelatorTopics") {
+        const float sum = p.value(0) + p.value(2);
+        expected[0] = -p.value(0) * (sum - p.value(0));
+        expected[2] = -p.value(2) * (sum - p.value(2));
+      } else {
+        const float sum_0 = 2.0f * p.value(1) + 0.5f * p.value(3);
+        const float sum_2 = 1.0f * p.value(0);
+        expected[0] = -p.value(0) * (sum_0 - p.value(0));
+        expected[2] = -p.value(2) * (sum_2 - p.value(2));
+      }
+
+      for (int topic_index = 0; topic_index < nTopics; ++topic_index) {
+        ASSERT_NEAR(rwt.token_weights(token_index).value(topic_index), expected[topic_index], 1e-6);
+      }
+    }
+  }
+}
+
+// artm_tests.exe --gtest_filter=Regularizers.SmoothSparsePhiDictionary
+TEST(Regularizers, SmoothSparsePhiDictionary) {
+  int nTopics = 6;
+  int nTokens = 3000;
+
+  ::artm::MasterModelConfig master_config = ::artm::test::TestMother::GenerateMasterModelConfig(nTopics);
+  master_config.set_num_processors(2);
+
+  // Only tokens with even indices are present in the dictionary
+  ::artm::DictionaryData dictionary_data;
+  dictionary_data.set_name("smooth_dictionary");
+  for (int token_index = 0; token_index < nTokens; token_index += 2) {
+    std::stringstream str;
+    str << "token" << token_index;
+    dictionary_data.add_token(str.str());
+    dictionary_data.add_token_value(static_cast<float>(token_index + 1));
+  }
+
+  ::artm::SmoothSparsePhiConfig dictionary_config;
+  dictionary_config.set_dictionary_name(dictionary_data.name());
+  ::artm::RegularizerConfig* regularizer_config = master_config.add_regularizer_config();
+  regularizer_config->set_name("SmoothDictionary");
+  regularizer_config->set_type(::artm::RegularizerType_SmoothSparsePhi);
+  regularizer_config->set_tau(0.0f);
+  regularizer_config->set_config(dictionary_config.SerializeAsString());
+
+  ::artm::SmoothSparsePhiConfig log_config;
+  log_config.mutable_transform_config()->set_type(::artm::TransformConfig_TransformType_Logarithm);
+  regularizer_config = master_config.add_regularizer_config();
+  regularizer_config->set_name("SmoothLog");
+  regularizer_config->set_type(::artm::RegularizerType_SmoothSparsePhi);
+  regularizer_config->set_tau(0.0f);
+  regularizer_config->set_config(log_config.SerializeAsString());
+
+  artm::MasterModel master(master_config);
+  ::artm::test::Api api(master);
+  master.CreateDictionary(dictionary_data);
+
+  auto offline_args = api.Initialize(::artm::test::TestMother::GenerateBatches(2, nTokens));
+
+  const float dictionary_tau = 0.5f;
+  const float log_tau = 0.2f;
+  // The second pass reuses the mapping of the dictionary to the tokens of the new phi matrix
+  for (int pass = 0; pass < 2; ++pass) {
+    master.FitOfflineModel(offline_args);
+
+    ::artm::RegularizeModelArgs regularize_model_args;
+    regularize_model_args.set_rwt_target_name("rwt");
+    regularize_model_args.set_pwt_source_name(master.config().pwt_name());
+    regularize_model_args.set_nwt_source_name(master.config().nwt_name());
+    ::artm::RegularizerSettings* regularizer_settings = regularize_model_args.add_regularizer_settings();
+    regularizer_settings->set_name("SmoothDictionary");
+    regularizer_settings->set_tau(dictionary_tau);
+    regularizer_settings = regularize_model_args.add_regularizer_settings();
+    regularizer_settings->set_name("SmoothLog");
+    regularizer_settings->set_tau(log_tau);
+    api.RegularizeModel(regularize_model_args);
+
+    ::artm::GetTopicModelArgs get_model_args;
+    get_model_args.set_model_name(master.config().pwt_name());
+    ::artm::TopicModel pwt = master.GetTopicModel(get_model_args);
+    get_model_args.set_model_name("rwt");
+    ::artm::TopicModel rwt = master.GetTopicModel(get_model_args);
+    ASSERT_EQ(rwt.token_size(), nTokens);
+
+    for (int token_index = 0; token_index < nTokens; ++token_index) {
+      ASSERT_EQ(rwt.token(token_index), pwt.token(token_index));
+      const float dictionary_value = (token_index % 2 == 0) ? dictionary_tau * (token_index + 1) : 0.0f;
+      for (int topic_index = 0; topic_index < nTopics; ++topic_index) {
+        const float weight = pwt.token_weights(token_index).value(topic_index);
+        const float log_value = weight > 0.0f ? log_tau * std::log(weight) : 0.0f;
+        ASSERT_NEAR(rwt.token_weights(token_index).value(topic_index), dictionary_value + log_value, 1e-3);
+      }
+    }
+  }
+}
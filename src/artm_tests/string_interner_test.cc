@@ -0,0 +1,91 @@
+// Copyright 2017, Additive Regularization of Topic Models.
+
+#include <future>  // NOLINT
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "artm/core/exceptions.h"
+#include "artm/core/string_interner.h"
+#include "artm/core/token.h"
+
+using ::artm::core::StringInterner;
+using ::artm::core::Token;
+using ::artm::core::TokenBuilder;
+
+// To run this particular test:
+// artm_tests.exe --gtest_filter=StringInterner.MultipleThreads
+TEST(StringInterner, MultipleThreads) {
+  const int num_threads = 4;
+  const int num_strings = 1000;
+  StringInterner interner;
+
+  // All threads intern the same strings in different order
+  auto func = [&interner, num_strings](int thread_index) {
+    std::vector<int> ids(num_strings);
+    for (int i = 0; i < num_strings; ++i) {
+      int str_index = (i * 7 + thread_index * 13) % num_strings;
+      ids[str_index] = interner.Intern("token" + std::to_string(str_index));
+    }
+    return ids;
+  };
+
+  std::vector<std::future<std::vector<int>>> tasks;
+  for (int i = 0; i < num_threads; i++) {
+    tasks.push_back(std::async(std::launch::async, func, i));
+  }
+
+  std::vector<int> ids = tasks[0].get();
+  for (int i = 1; i < num_threads; i++) {
+    ASSERT_EQ(tasks[i].get(), ids);
+  }
+
+  ASSERT_EQ(interner.size(), num_strings);
+  for (int i = 0; i < num_strings; ++i) {
+    const std::string str = "token" + std::to_string(i);
+    EXPECT_EQ(interner.str(ids[i]), str);
+    EXPECT_EQ(interner.Find(str), ids[i]);
+  }
+  EXPECT_EQ(interner.Find("token"), -1);
+}
+
+// artm_tests.exe --gtest_filter=StringInterner.MaxSize
+TEST(StringInterner, MaxSize) {
+  StringInterner interner(2);
+  const int first_id = interner.Intern("first");
+  const int second_id = interner.Intern("second");
+  ASSERT_THROW(interner.Intern("third"), ::artm::core::InvalidOperation);
+
+  // Strings that are already interned can still be found, and the ids are not reused
+  EXPECT_EQ(interner.Intern("first"), first_id);
+  EXPECT_EQ(interner.Intern("second"), second_id);
+  EXPECT_EQ(interner.size(), 2);
+  EXPECT_EQ(interner.Find("third"), -1);
+}
+
+// artm_tests.exe --gtest_filter=Token.FindDoesNotIntern
+TEST(Token, FindDoesNotIntern) {
+  StringInterner& vocabulary = Token::vocabulary();
+  const Token token("@find_test_class", "find_test_token");
+  const int size = vocabulary.size();
+
+  EXPECT_EQ(Token::Find("@find_test_class", "find_test_token"), token);
+  EXPECT_TRUE(Token::Find("@find_test_class", "find_test_token").known());
+  EXPECT_FALSE(Token::Find("@find_test_class", "find_test_missing_token").known());
+  EXPECT_FALSE(Token::Find("@find_test_missing_class", "find_test_token").known());
+  EXPECT_NE(Token::Find("@find_test_class", "find_test_missing_token"), token);
+
+  TokenBuilder token_builder;
+  EXPECT_EQ(token_builder.Find("@find_test_class", "find_test_token"), token);
+  EXPECT_FALSE(token_builder.Find("@find_test_class", "find_test_missing_token").known());
+  EXPECT_FALSE(token_builder.Find("@find_test_missing_class", "find_test_token").known());
+  EXPECT_EQ(vocabulary.size(), size);
+
+  // The builder interns a class id that it previously failed to find
+  const Token new_token = token_builder.Intern("@find_test_missing_class", "find_test_token");
+  EXPECT_EQ(new_token, Token("@find_test_missing_class", "find_test_token"));
+  EXPECT_EQ(new_token.class_id(), "@find_test_missing_class");
+  EXPECT_EQ(token_builder.Intern("@find_test_class", "find_test_token"), token);
+  EXPECT_EQ(vocabulary.size(), size + 1);
+}
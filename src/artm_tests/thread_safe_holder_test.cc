@@ -3,6 +3,8 @@
 #include "artm/core/thread_safe_holder.h"
 
 #include <future>  // NOLINT
+#include <string>
+#include <vector>
 
 #include "boost/thread/mutex.hpp"
 #include "boost/thread/future.hpp"
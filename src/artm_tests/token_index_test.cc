@@ -0,0 +1,141 @@
+// Copyright 2017, Additive Regularization of Topic Models.
+
+#include <chrono>  // NOLINT
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "artm/core/token.h"
+#include "artm/core/token_index.h"
+
+using ::artm::core::Token;
+using ::artm::core::TokenHasher;
+using ::artm::core::TokenIndex;
+
+namespace {
+
+// Tokens that are absent from the vocabulary, so that lookups of missing tokens don't intern them.
+// The vocabulary never assigns negative ids, and such tokens have distinct hashes (unlike unknown tokens).
+std::vector<Token> GenerateMissingTokens(int num_tokens) {
+  std::vector<Token> tokens;
+  tokens.reserve(num_tokens);
+  const int class_id_id = Token::vocabulary().Intern(::artm::core::DefaultClass);
+  for (int i = 0; i < num_tokens; ++i) {
+    tokens.push_back(Token(class_id_id, -(i + 2)));
+  }
+  return tokens;
+}
+
+std::vector<Token> GenerateTokens(int num_tokens, const std::string& prefix) {
+  std::vector<Token> tokens;
+  tokens.reserve(num_tokens);
+  for (int i = 0; i < num_tokens; ++i) {
+    tokens.push_back(Token((i % 3 == 0) ? "@labels" : ::artm::core::DefaultClass, prefix + std::to_string(i)));
+  }
+  return tokens;
+}
+
+double ElapsedMs(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Compares TokenIndex with std::unordered_map on num_tokens tokens:
+// builds both indices, then looks up every token (and the same number of missing tokens) num_passes times.
+void RunBenchmark(int num_tokens, int num_passes) {
+  std::vector<Token> tokens = GenerateTokens(num_tokens, "bench_token_");
+  std::vector<Token> missing_tokens = GenerateMissingTokens(num_tokens);
+
+  auto start = std::chrono::steady_clock::now();
+  TokenIndex token_index;
+  for (int i = 0; i < num_tokens; ++i) {
+    token_index.insert(tokens[i], i);
+  }
+  double flat_build_ms = ElapsedMs(start);
+
+  start = std::chrono::steady_clock::now();
+  std::unordered_map<Token, int, TokenHasher> token_map;
+  for (int i = 0; i < num_tokens; ++i) {
+    token_map.emplace(tokens[i], i);
+  }
+  double map_build_ms = ElapsedMs(start);
+
+  int64_t flat_sum = 0;
+  start = std::chrono::steady_clock::now();
+  for (int pass = 0; pass < num_passes; ++pass) {
+    for (int i = 0; i < num_tokens; ++i) {
+      flat_sum += token_index.find(tokens[i]) + token_index.find(missing_tokens[i]);
+    }
+  }
+  double flat_find_ms = ElapsedMs(start);
+
+  int64_t map_sum = 0;
+  start = std::chrono::steady_clock::now();
+  for (int pass = 0; pass < num_passes; ++pass) {
+    for (int i = 0; i < num_tokens; ++i) {
+      auto iter = token_map.find(tokens[i]);
+      map_sum += (iter != token_map.end()) ? iter->second : -1;
+      iter = token_map.find(missing_tokens[i]);
+      map_sum += (iter != token_map.end()) ? iter->second : -1;
+    }
+  }
+  double map_find_ms = ElapsedMs(start);
+
+  ASSERT_EQ(flat_sum, map_sum);
+  std::cout << num_tokens << " tokens, " << num_passes << " passes:" << std::endl
+            << "  TokenIndex:         build " << flat_build_ms << " ms, find " << flat_find_ms << " ms, "
+            << token_index.ByteSize() / (1024 * 1024) << " MB" << std::endl
+            << "  std::unordered_map: build " << map_build_ms << " ms, find " << map_find_ms << " ms" << std::endl;
+}
+
+}  // namespace
+
+// To run this particular test:
+// artm_tests.exe --gtest_filter=TokenIndex.Basic
+TEST(TokenIndex, Basic) {
+  const int num_tokens = 10000;
+  std::vector<Token> tokens = GenerateTokens(num_tokens, "token_");
+
+  TokenIndex token_index;
+  EXPECT_TRUE(token_index.empty());
+  EXPECT_FALSE(token_index.has_token(tokens[0]));
+
+  for (int i = 0; i < num_tokens; ++i) {
+    EXPECT_TRUE(token_index.insert(tokens[i], i));
+  }
+  EXPECT_FALSE(token_index.insert(tokens[5], 7));
+  ASSERT_EQ(token_index.size(), num_tokens);
+
+  for (int i = 0; i < num_tokens; ++i) {
+    EXPECT_EQ(token_index.find(tokens[i]), i);
+  }
+  EXPECT_FALSE(token_index.has_token(Token::Find("@labels", "token_1")));
+  EXPECT_FALSE(token_index.has_token(Token::Find(::artm::core::DefaultClass, "missing_token")));
+  for (const Token& token : GenerateMissingTokens(100)) {
+    EXPECT_FALSE(token_index.has_token(token));
+  }
+
+  TokenIndex other;
+  other.reserve(10);
+  other.insert(tokens[0], 42);
+  other.swap(&token_index);
+  EXPECT_EQ(token_index.size(), 1);
+  EXPECT_EQ(token_index.find(tokens[0]), 42);
+  EXPECT_EQ(other.find(tokens[num_tokens - 1]), num_tokens - 1);
+
+  other.clear();
+  EXPECT_TRUE(other.empty());
+  EXPECT_FALSE(other.has_token(tokens[0]));
+}
+
+// Microbenchmarks are disabled by default. To run them:
+// artm_tests.exe --gtest_filter=TokenIndex.* --gtest_also_run_disabled_tests
+TEST(TokenIndex, DISABLED_Benchmark1M) {
+  RunBenchmark(1000000, 10);
+}
+
+TEST(TokenIndex, DISABLED_Benchmark10M) {
+  RunBenchmark(10000000, 2);
+}
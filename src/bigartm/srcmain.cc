@@ -262,6 +262,7 @@ struct artm_options {
   std::string use_batches;
   int batch_size;
   bool b_guid_batch_name;
+  bool stream_batches;
 
   // Dictionary
   std::string use_dictionary;
@@ -271,6 +272,8 @@ struct artm_options {
   int cooc_window;
   int cooc_min_df;
   int cooc_min_tf;
+  int cooc_memory_budget;
+  float cooc_sketch_error;
   bool store_symmetric_cooc_values;
 
   // Model
@@ -309,6 +312,7 @@ struct artm_options {
   std::string write_cooc_df;
   std::string write_ppmi_tf;
   std::string write_ppmi_df;
+  bool write_cooc_binary;
   std::string write_class_predictions;
   std::string write_scores;
   std::string write_vw_corpus;
@@ -429,6 +433,29 @@ bool verifyOptions(const artm_options& options) {
     return false;
   }
 
+  if (options.stream_batches) {
+    if (options.read_vw_corpus.empty() && options.read_uci_docword.empty()) {
+      std::cerr << "Option --stream-batches require --read-vw-corpus or --read-uci-docword";
+      return false;
+    }
+
+    if (!options.save_batches.empty() || !options.write_vw_corpus.empty()) {
+      std::cerr << "Option --stream-batches can not be used together with --save-batches or --write-vw-corpus";
+      return false;
+    }
+
+    if ((options.num_collection_passes <= 0) && (options.time_limit <= 0)) {
+      std::cerr << "Option --stream-batches require --num-collection-passes or --time-limit";
+      return false;
+    }
+
+    // Without batches on disk the dictionary can not be gathered
+    if (options.use_dictionary.empty() && options.isDictionaryRequired()) {
+      std::cerr << "Option --stream-batches require --use-dictionary";
+      return false;
+    }
+  }
+
   bool ok = true;
   ok &= verifyWritableFile(options.save_model, options.force);
   ok &= verifyWritableFile(options.save_dictionary, options.force);
@@ -1075,6 +1102,107 @@ class BatchVectorizer {
  public:
   BatchVectorizer(const artm_options& options) : batch_folder_(), options_(options), cleanup_folder_() { }
 
+  ::artm::CollectionParserConfig parserConfig() const {
+    const bool parse_vw_format = !options_.read_vw_corpus.empty();
+    const bool parse_uci_format = !options_.read_uci_docword.empty();
+    const bool use_batches = !options_.use_batches.empty();
+
+    ::artm::CollectionParserConfig collection_parser_config;
+    if (parse_uci_format) {
+      collection_parser_config.set_format(CollectionParserConfig_CollectionFormat_BagOfWordsUci);
+      collection_parser_config.set_docword_file_path(options_.read_uci_docword);
+    } else if (parse_vw_format) {
+      collection_parser_config.set_format(CollectionParserConfig_CollectionFormat_VowpalWabbit);
+      collection_parser_config.set_docword_file_path(options_.read_vw_corpus);
+    } else if (use_batches) {  // only co-occurrences can be gathered from batches
+      collection_parser_config.set_format(CollectionParserConfig_CollectionFormat_Batches);
+      collection_parser_config.set_docword_file_path(options_.use_batches);
+    } else {
+      throw std::runtime_error("Internal error in bigartm.exe - unable to determine CollectionParserConfig_CollectionFormat");
+    }
+
+    if (!options_.read_uci_vocab.empty()) {
+      collection_parser_config.set_vocab_file_path(options_.read_uci_vocab);
+    }
+
+    collection_parser_config.set_num_threads(options_.threads);
+
+    collection_parser_config.set_num_items_per_batch(options_.batch_size);
+    collection_parser_config.set_name_type(options_.b_guid_batch_name ? CollectionParserConfig_BatchNameType_Guid : CollectionParserConfig_BatchNameType_Code);
+
+    // Settings for co-occurrence gathering
+    if (!options_.write_cooc_tf.empty()) {
+      collection_parser_config.set_cooc_tf_file_path(options_.write_cooc_tf);
+    }
+    if (!options_.write_cooc_df.empty()) {
+      collection_parser_config.set_cooc_df_file_path(options_.write_cooc_df);
+    }
+    if (!options_.write_ppmi_tf.empty()) {
+      collection_parser_config.set_ppmi_tf_file_path(options_.write_ppmi_tf);
+    }
+    if (!options_.write_ppmi_df.empty()) {
+      collection_parser_config.set_ppmi_df_file_path(options_.write_ppmi_df);
+    }
+
+    collection_parser_config.set_gather_cooc_tf(collection_parser_config.has_cooc_tf_file_path() ||
+                                                collection_parser_config.has_ppmi_tf_file_path());
+    collection_parser_config.set_gather_cooc_df(collection_parser_config.has_cooc_df_file_path() ||
+                                                collection_parser_config.has_ppmi_df_file_path());
+
+    collection_parser_config.set_gather_cooc(collection_parser_config.gather_cooc_tf() ||
+                                             collection_parser_config.gather_cooc_df());
+    collection_parser_config.set_cooc_window_width(options_.cooc_window);
+    collection_parser_config.set_cooc_min_tf(options_.cooc_min_tf);
+    collection_parser_config.set_cooc_min_df(options_.cooc_min_df);
+    collection_parser_config.set_cooc_memory_budget_mb(options_.cooc_memory_budget);
+    collection_parser_config.set_cooc_sketch_error(options_.cooc_sketch_error);
+    collection_parser_config.set_store_symmetric_cooc_values(options_.store_symmetric_cooc_values);
+    collection_parser_config.set_binary_cooc_files(options_.write_cooc_binary);
+
+    // If user specifies specific modalities "use_modality", pass it to collection parser to limit set of modalities available in batches
+    std::vector<std::pair<std::string, float>> class_ids = parseKeyValuePairs<float>(options_.use_modality);
+    for (auto& class_id : class_ids) {
+      if (!class_id.first.empty()) {
+        collection_parser_config.add_class_id(class_id.first);
+      }
+    }
+
+    return collection_parser_config;
+  }
+
+  // With --stream-batches the number of batches is not known until the collection is parsed.
+  // Online algorithm uses this estimate (based on the number of documents) to plan its updates.
+  // The number of VW documents is extrapolated from the lines at the beginning of the file; the online algorithm
+  // handles the stream that ends earlier or later than expected, so the estimate needs not be exact.
+  int estimateNumBatches() const {
+    int64_t num_documents = 0;
+    if (!options_.read_uci_docword.empty()) {
+      std::ifstream docword(options_.read_uci_docword);
+      docword >> num_documents;  // the first line of UCI header
+    } else if (fs::is_regular_file(options_.read_vw_corpus)) {
+      const int64_t file_size = static_cast<int64_t>(fs::file_size(options_.read_vw_corpus));
+      std::ifstream corpus(options_.read_vw_corpus, std::ios::binary);
+      std::vector<char> buffer(1024 * 1024);
+      corpus.read(buffer.data(), buffer.size());
+      const int64_t count = corpus.gcount();
+      const int64_t num_lines = std::count(buffer.begin(), buffer.begin() + count, '\n');
+      if (count == file_size) {
+        num_documents = num_lines + ((count > 0 && buffer[count - 1] != '\n') ? 1 : 0);
+      } else if (num_lines > 0) {
+        int64_t lines_size = count;  // the size of whole lines at the beginning of the file
+        while (buffer[lines_size - 1] != '\n') {
+          lines_size--;
+        }
+        num_documents = static_cast<int64_t>(static_cast<double>(file_size) * num_lines / lines_size);
+      } else {
+        num_documents = 1;  // the first document is longer than the buffer
+      }
+    }
+
+    const int64_t batch_size = std::max(options_.batch_size, 1);
+    return static_cast<int>(std::max<int64_t>((num_documents + batch_size - 1) / batch_size, 1));
+  }
+
   void Vectorize() {
     const bool parse_vw_format = !options_.read_vw_corpus.empty();
     const bool parse_uci_format = !options_.read_uci_docword.empty();
@@ -1088,7 +1216,10 @@ class BatchVectorizer {
       throw std::invalid_argument("--read-uci-vocab option must be specified together with --read-uci-docword\n");
     }
 
-    if (parse_vw_format || parse_uci_format) {
+    if (options_.stream_batches) {
+      std::cerr << "Batches will be parsed during the first pass through the collection\n";
+    }
+    else if (parse_vw_format || parse_uci_format) {
       if (options_.save_batches.empty()) {
         batch_folder_ = boost::lexical_cast<std::string>(boost::uuids::random_generator()());
         cleanup_folder_ = batch_folder_;
@@ -1110,60 +1241,8 @@ class BatchVectorizer {
       ::artm::CollectionParserInfo parser_info;
       {
         ProgressScope scope("Parsing text collection");
-        ::artm::CollectionParserConfig collection_parser_config;
-        if (parse_uci_format) {
-          collection_parser_config.set_format(CollectionParserConfig_CollectionFormat_BagOfWordsUci);
-        } else if (parse_vw_format) {
-          collection_parser_config.set_format(CollectionParserConfig_CollectionFormat_VowpalWabbit);
-        } else {
-          throw std::runtime_error("Internal error in bigartm.exe - unable to determine CollectionParserConfig_CollectionFormat");
-        }
-
-        collection_parser_config.set_docword_file_path(parse_vw_format ? options_.read_vw_corpus : options_.read_uci_docword);
-        if (!options_.read_uci_vocab.empty()) {
-          collection_parser_config.set_vocab_file_path(options_.read_uci_vocab);
-        }
-
-        collection_parser_config.set_num_threads(options_.threads);
-
+        ::artm::CollectionParserConfig collection_parser_config = parserConfig();
         collection_parser_config.set_target_folder(batch_folder_);
-        collection_parser_config.set_num_items_per_batch(options_.batch_size);
-        collection_parser_config.set_name_type(options_.b_guid_batch_name ? CollectionParserConfig_BatchNameType_Guid : CollectionParserConfig_BatchNameType_Code);
-
-        // Settings for co-occurrence gathering
-        if (!options_.write_cooc_tf.empty()) {
-          collection_parser_config.set_cooc_tf_file_path(options_.write_cooc_tf);
-        }
-        if (!options_.write_cooc_df.empty()) {
-          collection_parser_config.set_cooc_df_file_path(options_.write_cooc_df);
-        }
-        if (!options_.write_ppmi_tf.empty()) {
-          collection_parser_config.set_ppmi_tf_file_path(options_.write_ppmi_tf);
-        }
-        if (!options_.write_ppmi_df.empty()) {
-          collection_parser_config.set_ppmi_df_file_path(options_.write_ppmi_df);
-        }
-
-        collection_parser_config.set_gather_cooc_tf(collection_parser_config.has_cooc_tf_file_path() ||
-                                                    collection_parser_config.has_ppmi_tf_file_path());
-        collection_parser_config.set_gather_cooc_df(collection_parser_config.has_cooc_df_file_path() ||
-                                                    collection_parser_config.has_ppmi_df_file_path());
-
-        collection_parser_config.set_gather_cooc(collection_parser_config.gather_cooc_tf() ||
-                                                 collection_parser_config.gather_cooc_df());
-        collection_parser_config.set_cooc_window_width(options_.cooc_window);
-        collection_parser_config.set_cooc_min_tf(options_.cooc_min_tf);
-        collection_parser_config.set_cooc_min_df(options_.cooc_min_df);
-        collection_parser_config.set_store_symmetric_cooc_values(options_.store_symmetric_cooc_values);
-
-        // If user specifies specific modalities "use_modality", pass it to collection parser to limit set of modalities available in batches
-        std::vector<std::pair<std::string, float>> class_ids = parseKeyValuePairs<float>(options_.use_modality);
-        for (auto& class_id : class_ids) {
-          if (!class_id.first.empty()) {
-            collection_parser_config.add_class_id(class_id.first);
-          }
-        }
-
         parser_info = ::artm::ParseCollection(collection_parser_config);
       }
 
@@ -1183,6 +1262,12 @@ class BatchVectorizer {
       }
 
       std::cerr << "Using " << batch_files_count << " batches from '" << batch_folder_ << "'\n";
+
+      ::artm::CollectionParserConfig collection_parser_config = parserConfig();
+      if (collection_parser_config.gather_cooc()) {
+        ProgressScope scope("Gathering co-occurrences from batches");
+        ::artm::ParseCollection(collection_parser_config);
+      }
     }
   }
 
@@ -1604,17 +1689,28 @@ int execute(const artm_options& options, int argc, char* argv[]) {
       std::cerr << "================= Processing started.\n";
     }
 
+    // With --stream-batches the first pass parses the collection, and keeps the batches in memory for further use
+    const bool is_streaming = options.stream_batches && (iter == 0);
+    const bool keep_batches = (options.num_collection_passes != 1) ||
+                              !options.write_predictions.empty() || !options.write_class_predictions.empty();
+
     if (options.update_every > 0) {  // online algorithm
       FitOnlineMasterModelArgs fit_online_args;
       fit_online_args.set_asynchronous(options.asynchronous);
 
+      const int num_batches = is_streaming ? batch_vectorizer.estimateNumBatches() : (int) batch_file_names.size();
       int update_after = 0;
       do {
         update_count++;
         update_after += options.update_every;
-        fit_online_args.add_update_after(std::min<int>(update_after, batch_file_names.size()));
+        fit_online_args.add_update_after(std::min<int>(update_after, num_batches));
         fit_online_args.add_apply_weight(pow(options.tau0 + update_count, -options.kappa));
-      } while (update_after < (int) batch_file_names.size());
+      } while (update_after < num_batches);
+
+      if (is_streaming) {
+        fit_online_args.mutable_collection_parser_config()->CopyFrom(batch_vectorizer.parserConfig());
+        fit_online_args.set_keep_batches(keep_batches);
+      }
 
       for (const auto& batch_file_name : batch_file_names) {
         fit_online_args.add_batch_filename(batch_file_name.string());
@@ -1632,6 +1728,10 @@ int execute(const artm_options& options, int argc, char* argv[]) {
       }
     } else {
       FitOfflineMasterModelArgs fit_offline_args;
+      if (is_streaming) {
+        fit_offline_args.mutable_collection_parser_config()->CopyFrom(batch_vectorizer.parserConfig());
+      }
+
       for (const auto& batch_file_name : batch_file_names) {
         fit_offline_args.add_batch_filename(batch_file_name.string());
       }
@@ -1648,6 +1748,13 @@ int execute(const artm_options& options, int argc, char* argv[]) {
       }
     }
 
+    if (is_streaming) {
+      MasterComponentInfo master_info = master_component->info();
+      for (const auto& batch : master_info.batch()) {
+        batch_file_names.push_back(batch.name());
+      }
+    }
+
     score_helper.showScores(iter + 1, timer.elapsed_ms());
   }  // iter
 
@@ -1776,6 +1883,7 @@ int main(int argc, char * argv[]) {
       ("read-cooc", po::value(&options.read_cooc), "read co-occurrences format")
       ("batch-size", po::value(&options.batch_size)->default_value(500), "number of items per batch")
       ("use-batches", po::value(&options.use_batches), "folder with batches to use")
+      ("stream-batches", po::bool_switch(&options.stream_batches)->default_value(false), "parse the collection during the first pass, without saving batches to disk")
     ;
 
     po::options_description dictionary_options("Dictionary");
@@ -1783,6 +1891,8 @@ int main(int argc, char * argv[]) {
       ("cooc-min-tf", po::value(&options.cooc_min_tf)->default_value(0), "minimal value of cooccurrences of a pair of tokens that are saved in dictionary of cooccurrences")
       ("cooc-min-df", po::value(&options.cooc_min_df)->default_value(0), "minimal value of documents in which a specific pair of tokens occurred together closely")
       ("cooc-window", po::value(&options.cooc_window)->default_value(5), "number of tokens around specific token, which are used in calculation of cooccurrences")
+      ("cooc-memory-budget", po::value(&options.cooc_memory_budget)->default_value(1024), "memory (in MB) for pairs of tokens gathered by all threads before they are dumped on disk")
+      ("cooc-sketch-error", po::value(&options.cooc_sketch_error)->default_value(0), "if positive, pairs of tokens are firstly counted approximately (with count-min sketch, the error is relative to the total number of pairs), and only pairs that may pass cooc-min-tf / cooc-min-df are counted exactly")
       ("dictionary-min-df", po::value(&options.dictionary_min_df)->default_value(""), "filter out tokens present in less than N documents / less than P% of documents")
       ("dictionary-max-df", po::value(&options.dictionary_max_df)->default_value(""), "filter out tokens present in less than N documents / less than P% of documents")
       ("store-symmetric-cooc", po::bool_switch(&options.store_symmetric_cooc_values)->default_value(false), "to not write repeating pairs in co-occurrence dictionary, like if the pair (token_a, token_b) is written, to not write the pair (token_b, token_a)")
@@ -1820,6 +1930,7 @@ int main(int argc, char * argv[]) {
       ("write-cooc-df", po::value(&options.write_cooc_df)->default_value(""), "save dictionary of co-occurrences with number of documents in which every specific pair occured together")
       ("write-ppmi-tf", po::value(&options.write_ppmi_tf)->default_value(""), "save values of positive pmi of pairs of tokens from cooc_tf dictionary")
       ("write-ppmi-df", po::value(&options.write_ppmi_df)->default_value(""), "save values of positive pmi of pairs of tokens from cooc_df dictionary")
+      ("write-cooc-binary", po::bool_switch(&options.write_cooc_binary)->default_value(false), "save co-occurrences and ppmi values in binary format, which --read-cooc loads without parsing")
       ("save-model", po::value(&options.save_model)->default_value(""), "save the model to binary file after processing")
       ("save-batches", po::value(&options.save_batches)->default_value(""), "batch folder")
       ("save-dictionary", po::value(&options.save_dictionary)->default_value(""), "filename of dictionary file")